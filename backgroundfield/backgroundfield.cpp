@@ -23,7 +23,10 @@
 #include "../common.h"
 #include "../definitions.h"
 #include "../parameters.h"
+#include "../readparameters.h"
 #include "cmath"
+#include "map"
+#include "string"
 #include "backgroundfield.h"
 #include "fieldfunction.hpp"
 #include "integratefunction.hpp"
@@ -143,3 +146,30 @@ void setBackgroundFieldToZero(
    }
    
 }
+
+/*! Key identifying the parameters the background field is computed from: the project
+ * and its section of the configuration, and the system boundary sections, which decide
+ * the cell types some projects use. The grid is checked separately on restart. Restart
+ * files store the key with the background field, a restart with the same key can read
+ * the field instead of recomputing it. Changes of the code are not covered.
+ */
+uint64_t getBackgroundFieldKey() {
+   const char* boundarySections[] = {"boundaries","ionosphere","outflow","maxwellian","antisymmetric","projectboundary"};
+   std::map<std::string,std::string> values;
+   values["project"] = Parameters::projectName;
+   Readparameters::getSection(Parameters::projectName,values);
+   for (unsigned int i=0; i<sizeof(boundarySections)/sizeof(boundarySections[0]); i++) {
+      Readparameters::getSection(boundarySections[i],values);
+   }
+
+   //64-bit FNV-1a hash of the name=value lines
+   uint64_t key = 14695981039346656037ull;
+   for (std::map<std::string,std::string>::const_iterator it=values.begin(); it!=values.end(); ++it) {
+      const std::string line = it->first + "=" + it->second + "\n";
+      for (size_t c=0; c<line.size(); c++) {
+         key ^= static_cast<unsigned char>(line[c]);
+         key *= 1099511628211ull;
+      }
+   }
+   return key;
+}
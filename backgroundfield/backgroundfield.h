@@ -39,5 +39,7 @@ void setBackgroundFieldToZero(
    Real* volumeDerivatives
 );
 
+uint64_t getBackgroundFieldKey();
+
 #endif
 
@@ -25,6 +25,7 @@ Background magnetic field class of Vlasiator.
 
 #include <stdlib.h>
 #include <math.h>
+#include <algorithm>
 #include "dipole.hpp"
 #include "../common.h"
 
@@ -88,3 +89,169 @@ double Dipole::call( double x, double y, double z) const
 
 
 
+/* Closed-form integrals of the dipole field B = (3 r (q.r) - q r^2)/r^5, which has the
+   scalar potential Phi = q.r/r^3 and the vector potential A = q x r/r^3.
+
+   The integrals along a line are written in terms of the distance t along the line and
+   the squared distance c2 of the line from the dipole, R^2 = c2 + t^2. Cells are small
+   compared to their distance from the dipole, so the textbook primitives would subtract
+   nearly equal numbers; the differences below are rearranged to avoid that whenever both
+   ends are on the same side of the point closest to the dipole. Otherwise the line passes
+   the dipole at a distance of the order of its length and the primitives are fine.*/
+
+//int_a^b dt/R^3
+static double intR3(const double a,const double b,const double c2) {
+   const double Ra = sqrt(c2+a*a);
+   const double Rb = sqrt(c2+b*b);
+   if(a*b > 0)
+      return (b*b-a*a)/((b*Ra+a*Rb)*Ra*Rb);
+   return (b/Rb-a/Ra)/c2;
+}
+
+//int_a^b t dt/R^3
+static double intR3t(const double a,const double b,const double c2) {
+   const double Ra = sqrt(c2+a*a);
+   const double Rb = sqrt(c2+b*b);
+   return (b*b-a*a)/((Ra+Rb)*Ra*Rb);
+}
+
+//int_a^b dt/R^5
+static double intR5(const double a,const double b,const double c2) {
+   const double Ra = sqrt(c2+a*a);
+   const double Rb = sqrt(c2+b*b);
+   if(a*b > 0) {
+      // = [h - h^3/3]/c2^2 with h = t/R, where h_b-h_a and 3-(h_a^2+h_a h_b+h_b^2) are both proportional to c2
+      const double dh = (b*b-a*a)/((b*Ra+a*Rb)*Ra*Rb);
+      return dh/3*(1/(Ra*Ra) + 1/(Rb*Rb) + (a*a+b*b+c2)/((Ra*Rb+a*b)*Ra*Rb));
+   }
+   return (b*(2*b*b+3*c2)/(Rb*Rb*Rb) - a*(2*a*a+3*c2)/(Ra*Ra*Ra))/(3*c2*c2);
+}
+
+//int_a^b t dt/R^5
+static double intR5t(const double a,const double b,const double c2) {
+   const double Ra = sqrt(c2+a*a);
+   const double Rb = sqrt(c2+b*b);
+   const double dR = (b*b-a*a)/(Ra+Rb);
+   return dR*(Ra*Ra+Ra*Rb+Rb*Rb)/(3*Ra*Ra*Ra*Rb*Rb*Rb);
+}
+
+/* ln((v2+R2)/(v1+R1)) with R^2 = w2 + v^2, v1 < v2. For v < 0 the identity
+   v+R = w2/(R-v) is used, which also cancels w2 if both ends are negative.*/
+static double logRatio(const double v1,const double v2,const double w2) {
+   const double R1 = sqrt(w2+v1*v1);
+   const double R2 = sqrt(w2+v2*v2);
+   const double dR = (v2*v2-v1*v1)/(R1+R2);
+   if(v1 >= 0)
+      return log1p((v2-v1+dR)/(v1+R1));
+   if(v2 <= 0)
+      return log1p((v2-v1-dR)/(R2-v2));
+   return log((v2+R2)*(R1-v1)/w2);
+}
+
+//the tangential coordinates u,v of a face so that (u,v,face) is right-handed
+static void faceAxes(const coordinate face,int& u,int& v) {
+   u = (face+1)%3;
+   v = (face+2)%3;
+}
+
+static double potential(const double q[3],const double r[3]) {
+   const double r2 = r[0]*r[0]+r[1]*r[1]+r[2]*r[2];
+   return (q[0]*r[0]+q[1]*r[1]+q[2]*r[2])/(r2*sqrt(r2));
+}
+
+bool Dipole::hasClosedForm(const double lo[3],const double hi[3]) const {
+   //outside of minimumR the closed forms are the same field as call()
+   const double minimumR=1e-3*physicalconstants::R_E;
+   if(this->initialized==false)
+      return false;
+   double d2 = 0.0;
+   for(int i=0;i<3;i++) {
+      const double d = std::max(std::max(lo[i]-center[i],center[i]-hi[i]),0.0);
+      d2 += d*d;
+   }
+   return d2 >= minimumR*minimumR;
+}
+
+bool Dipole::lineIntegralPotential(coordinate line,const double r1[3],double L,double& result) const {
+   double r[3];
+   for(int i=0;i<3;i++) r[i] = r1[i]-center[i];
+   const int k = (line+1)%3;
+   const int l = (line+2)%3;
+   const double a = r[line];
+   const double b = r[line]+L;
+   const double c2 = r[k]*r[k]+r[l]*r[l];
+   result = (q[k]*r[k]+q[l]*r[l])*intR3(a,b,c2) + q[line]*intR3t(a,b,c2);
+   return true;
+}
+
+bool Dipole::lineIntegralB(coordinate component,coordinate line,const double r1[3],double L,double& result) const {
+   double r[3];
+   for(int i=0;i<3;i++) r[i] = r1[i]-center[i];
+   if(component == line) {
+      //B is the gradient of -Phi
+      double r2[3] = {r[0],r[1],r[2]};
+      r2[line] += L;
+      result = potential(q,r)-potential(q,r2);
+      return true;
+   }
+   const int k = (line+1)%3;
+   const int l = (line+2)%3;
+   const double a = r[line];
+   const double b = r[line]+L;
+   const double c2 = r[k]*r[k]+r[l]*r[l];
+   const double s = q[k]*r[k]+q[l]*r[l];
+   result = 3*r[component]*(s*intR5(a,b,c2) + q[line]*intR5t(a,b,c2)) - q[component]*intR3(a,b,c2);
+   return true;
+}
+
+bool Dipole::surfaceIntegralPotential(coordinate face,const double r1[3],double L1,double L2,double& result) const {
+   double r[3];
+   for(int i=0;i<3;i++) r[i] = r1[i]-center[i];
+   const int t1 = (face==X) ? Y : X;
+   const int t2 = (face==Z) ? Y : Z;
+   const double u[2] = {r[t1],r[t1]+L1};
+   const double v[2] = {r[t2],r[t2]+L2};
+   const double h = r[face];
+
+   //Phi = (q_face h + q_t1 u + q_t2 v)/R^3
+   double normal = 0.0;
+   if(h != 0.0) {
+      for(int i=0;i<2;i++) for(int j=0;j<2;j++) {
+         const double R = sqrt(h*h+u[i]*u[i]+v[j]*v[j]);
+         normal += ((i+j)%2 == 0 ? 1 : -1)*atan(u[i]*v[j]/(h*R));
+      }
+   }
+   //int u/R^3 du = -1/R, int -1/R dv = -ln(v+R)
+   const double tangential1 = logRatio(v[0],v[1],h*h+u[0]*u[0]) - logRatio(v[0],v[1],h*h+u[1]*u[1]);
+   const double tangential2 = logRatio(u[0],u[1],h*h+v[0]*v[0]) - logRatio(u[0],u[1],h*h+v[1]*v[1]);
+   result = q[face]*normal + q[t1]*tangential1 + q[t2]*tangential2;
+   return true;
+}
+
+bool Dipole::surfaceFlux(coordinate face,const double r1[3],double L1,double L2,double& result) const {
+   //Stokes: the flux of B = curl A is the circulation of A around the face
+   double r[3];
+   for(int i=0;i<3;i++) r[i] = r1[i]-center[i];
+   double length[3] = {0.0,0.0,0.0};
+   length[(face==X) ? Y : X] = L1;
+   length[(face==Z) ? Y : Z] = L2;
+   int u,v;
+   faceAxes(face,u,v);
+
+   //integral of A_e along an edge in direction e starting from p; the numerator of A_e is constant along it
+   double circulation = 0.0;
+   for(int side=0;side<4;side++) {
+      const int e = (side%2 == 0) ? u : v;
+      const int o = (side%2 == 0) ? v : u;
+      double p[3] = {r[0],r[1],r[2]};
+      //sides: (u1,v1)->(u2,v1), (u2,v1)->(u2,v2), backwards along (u1,v2)->(u2,v2) and (u1,v1)->(u1,v2)
+      if(side == 1 || side == 2) p[o] += length[o];
+      const double sign = (side < 2) ? 1.0 : -1.0;
+      const int k = (e+1)%3;
+      const int l = (e+2)%3;
+      const double cross = q[k]*p[l]-q[l]*p[k];
+      circulation += sign*cross*intR3(p[e],p[e]+length[e],p[k]*p[k]+p[l]*p[l]);
+   }
+   result = circulation;
+   return true;
+}
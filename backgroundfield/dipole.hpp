@@ -41,6 +41,11 @@ public:
    }
    void initialize(const double moment,const double center_x, const double center_y, const double center_z, const double tilt_angle);
    virtual double call(double x, double y, double z) const;  
+   virtual bool hasClosedForm(const double lo[3],const double hi[3]) const;
+   virtual bool lineIntegralB(coordinate component,coordinate line,const double r1[3],double L,double& result) const;
+   virtual bool lineIntegralPotential(coordinate line,const double r1[3],double L,double& result) const;
+   virtual bool surfaceIntegralPotential(coordinate face,const double r1[3],double L1,double L2,double& result) const;
+   virtual bool surfaceFlux(coordinate face,const double r1[3],double L1,double L2,double& result) const;
    virtual ~Dipole() {}
 };
 
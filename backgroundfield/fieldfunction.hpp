@@ -29,6 +29,9 @@ Background magnetic field class of Vlasiator.
 #include <iostream>
 #include <cstdlib>
 
+/* The component and derivative selection is state of the object, so a FieldFunction
+   must not be shared between threads that integrate different components at the same
+   time. Projects create one per call of setCellBackgroundField.*/
 class FieldFunction: public T3DFunction {
 private:
 protected:
@@ -52,6 +55,26 @@ public:
          std::exit(1);
       } 
    }
+   inline coordinate getComponent() const { return _fComponent; }
+   inline coordinate getDerivComponent() const { return _dComponent; }
+   inline unsigned int getDerivative() const { return _derivative; }
+
+   /* Closed-form integrals of the field. The FieldFunction overloads of lineAverage,
+      surfaceAverage and volumeAverage combine these instead of doing the quadrature
+      when hasClosedForm() is true for the integration domain; each one can still return
+      false to fall back to the quadrature. The potential is the scalar potential of the
+      field, B = -grad(Phi). Faces are given as in surfaceAverage: r1 is the lower left
+      corner and L1, L2 are the side lengths along the lower and higher tangential
+      coordinate. Functions without closed forms keep the defaults. */
+   virtual bool hasClosedForm(const double /*lo*/[3],const double /*hi*/[3]) const { return false; }
+   /* Integral of the component of B along the line from r1 to r1+L in direction line.*/
+   virtual bool lineIntegralB(coordinate,coordinate,const double /*r1*/[3],double /*L*/,double& /*result*/) const { return false; }
+   /* Integral of Phi along the line from r1 to r1+L in direction line.*/
+   virtual bool lineIntegralPotential(coordinate,const double /*r1*/[3],double /*L*/,double& /*result*/) const { return false; }
+   /* Integral of Phi over a face with normal face.*/
+   virtual bool surfaceIntegralPotential(coordinate,const double /*r1*/[3],double /*L1*/,double /*L2*/,double& /*result*/) const { return false; }
+   /* Flux of B through a face with normal face.*/
+   virtual bool surfaceFlux(coordinate,const double /*r1*/[3],double /*L1*/,double /*L2*/,double& /*result*/) const { return false; }
 };
 #endif
 
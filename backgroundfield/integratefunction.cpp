@@ -26,6 +26,7 @@ Background magnetic field class of Vlasiator.
 #include <string.h>
 #include <stdlib.h>
 #include <math.h>
+#include <cmath>
 #include <iostream>
 
 #include "../common.h"
@@ -41,40 +42,38 @@ double lineAverage(
    const double r1[3],
    double L
 ) {
+   // The quadrature routines keep all their state on the stack, so concurrent calls
+   // from different threads are safe as long as f1 is not modified meanwhile.
    double value;
-   //subroutines not threadsafe 
-#pragma omp critical
+   const double norm = 1/L;
+   const double acc = accuracy*L;
+   const double a = r1[line];
+   const double b = r1[line] + L;
+   
+   switch (line) {
+      case X:
       {
-         const double norm = 1/L;
-         const double acc = accuracy*L;
-         const double a = r1[line];
-         const double b = r1[line] + L;
-         
-         switch (line) {
-            case X:
-            {
-               T3D_fix23 f(f1,r1[1],r1[2]); 
-               value= Romberg(f,a,b,acc)*norm;
-            }
-            break;
-            case Y:
-            {
-               T3D_fix13 f(f1,r1[0],r1[2]); 
-               value= Romberg(f,a,b,acc)*norm;
-            }
-            break;
-            case Z: 
-            {
-               T3D_fix12 f(f1,r1[0],r1[1]); 
-               value= Romberg(f,a,b,acc)*norm;
-            }
-            break;
-            default:
-               cerr << "*** lineAverage  is bad\n";
-               value = 0.0;
-            break;
-         }
+         T3D_fix23 f(f1,r1[1],r1[2]); 
+         value= Romberg(f,a,b,acc)*norm;
       }
+      break;
+      case Y:
+      {
+         T3D_fix13 f(f1,r1[0],r1[2]); 
+         value= Romberg(f,a,b,acc)*norm;
+      }
+      break;
+      case Z: 
+      {
+         T3D_fix12 f(f1,r1[0],r1[1]); 
+         value= Romberg(f,a,b,acc)*norm;
+      }
+      break;
+      default:
+         cerr << "*** lineAverage  is bad\n";
+         value = 0.0;
+      break;
+   }
    return value;
 }
 
@@ -87,34 +86,31 @@ double surfaceAverage(
    double L2
 ) {
    double value;
-#pragma omp critical
-   {
-      const double acc = accuracy*L1*L2;
-      const double norm = 1/(L1*L2);
-      switch (face) {
-         case X:
-         {
-            T3D_fix1 f(f1,r1[0]);
-            value = Romberg(f, r1[1],r1[1]+L1, r1[2],r1[2]+L2, acc)*norm;
-         }
-         break;
-         case Y:
-         {
-            T3D_fix2 f(f1,r1[1]);
-            value = Romberg(f, r1[0],r1[0]+L1, r1[2],r1[2]+L2, acc)*norm; 
-         }
-         break;
-         case Z:
-         {
-            T3D_fix3 f(f1,r1[2]);
-            value = Romberg(f, r1[0],r1[0]+L1, r1[1],r1[1]+L2, acc)*norm;
-         }
-         break;
-         default:
-            cerr << "*** SurfaceAverage  is bad\n";
-            exit(1);
-         break;
+   const double acc = accuracy*L1*L2;
+   const double norm = 1/(L1*L2);
+   switch (face) {
+      case X:
+      {
+         T3D_fix1 f(f1,r1[0]);
+         value = Romberg(f, r1[1],r1[1]+L1, r1[2],r1[2]+L2, acc)*norm;
       }
+      break;
+      case Y:
+      {
+         T3D_fix2 f(f1,r1[1]);
+         value = Romberg(f, r1[0],r1[0]+L1, r1[2],r1[2]+L2, acc)*norm; 
+      }
+      break;
+      case Z:
+      {
+         T3D_fix3 f(f1,r1[2]);
+         value = Romberg(f, r1[0],r1[0]+L1, r1[1],r1[1]+L2, acc)*norm;
+      }
+      break;
+      default:
+         cerr << "*** SurfaceAverage  is bad\n";
+         exit(1);
+      break;
    }
    return value;
 }
@@ -126,13 +122,133 @@ double volumeAverage(
    const double r1[3],
    const double r2[3]
 ) {
-   double value;
-#pragma omp critical
-   {
-      const double acc = accuracy*(r2[0]-r1[0])*(r2[1]-r1[1])*(r2[2]-r1[2]);
-      const double norm = 1.0/((r2[0]-r1[0])*(r2[1]-r1[1])*(r2[2]-r1[2]));
-      value= Romberg(f1, r1[0],r2[0], r1[1],r2[1], r1[2],r2[2], acc)*norm;
+   const double acc = accuracy*(r2[0]-r1[0])*(r2[1]-r1[1])*(r2[2]-r1[2]);
+   const double norm = 1.0/((r2[0]-r1[0])*(r2[1]-r1[1])*(r2[2]-r1[2]));
+   return Romberg(f1, r1[0],r2[0], r1[1],r2[1], r1[2],r2[2], acc)*norm;
+}
+
+
+
+//the tangential coordinates of a face in the order of the side lengths of surfaceAverage
+static void faceSides(coordinate face,coordinate& t1,coordinate& t2) {
+   t1 = (face==X) ? Y : X;
+   t2 = (face==Z) ? Y : Z;
+}
+
+/* Integral of the component of the field over a face. A tangential component is the
+   derivative of -Phi along one side, so it integrates to the difference of the line
+   integrals of Phi along the other side.*/
+static bool faceIntegral(
+   const FieldFunction& f1,
+   coordinate component,
+   coordinate face,
+   const double r1[3],
+   double L1,
+   double L2,
+   double& result
+) {
+   if(component == face)
+      return f1.surfaceFlux(face,r1,L1,L2,result);
+   coordinate t1,t2;
+   faceSides(face,t1,t2);
+   const coordinate along = (component==t1) ? t2 : t1;
+   const double Lc = (component==t1) ? L1 : L2;
+   const double La = (component==t1) ? L2 : L1;
+   double r2[3] = {r1[0],r1[1],r1[2]};
+   r2[component] += Lc;
+   double lower,upper;
+   if(!f1.lineIntegralPotential(along,r1,La,lower) || !f1.lineIntegralPotential(along,r2,La,upper))
+      return false;
+   result = lower-upper;
+   return true;
+}
+
+double lineAverage(
+   const FieldFunction& f1,
+   coordinate line,
+   double accuracy,
+   const double r1[3],
+   double L
+) {
+   double lo[3] = {r1[0],r1[1],r1[2]};
+   double hi[3] = {r1[0],r1[1],r1[2]};
+   if(L > 0) hi[line] += L;
+   else lo[line] += L;
+
+   double integral;
+   if(f1.getDerivative() == 0 && f1.hasClosedForm(lo,hi) &&
+      f1.lineIntegralB(f1.getComponent(),line,r1,L,integral) && std::isfinite(integral)) {
+      return integral/L;
    }
-   return value;
+   return lineAverage(static_cast<const T3DFunction&>(f1),line,accuracy,r1,L);
+}
+
+double surfaceAverage(
+   const FieldFunction& f1,
+   coordinate face, double accuracy,
+   const double r1[3],
+   double L1,
+   double L2
+) {
+   coordinate t1,t2;
+   faceSides(face,t1,t2);
+   double hi[3] = {r1[0],r1[1],r1[2]};
+   hi[t1] += L1;
+   hi[t2] += L2;
+
+   if(f1.hasClosedForm(r1,hi)) {
+      const coordinate component = f1.getComponent();
+      const coordinate d = f1.getDerivComponent();
+      bool ok = false;
+      double integral;
+      if(f1.getDerivative() == 0) {
+         ok = faceIntegral(f1,component,face,r1,L1,L2,integral);
+      } else if(d != face) {
+         //the tangential derivative integrates to the difference of the line integrals along the other side
+         const coordinate along = (d==t1) ? t2 : t1;
+         const double Ld = (d==t1) ? L1 : L2;
+         const double La = (d==t1) ? L2 : L1;
+         double r2[3] = {r1[0],r1[1],r1[2]};
+         r2[d] += Ld;
+         double lower,upper;
+         ok = f1.lineIntegralB(component,along,r1,La,lower) && f1.lineIntegralB(component,along,r2,La,upper);
+         integral = upper-lower;
+      }
+      if(ok && std::isfinite(integral))
+         return integral/(L1*L2);
+   }
+   return surfaceAverage(static_cast<const T3DFunction&>(f1),face,accuracy,r1,L1,L2);
 }
 
+double volumeAverage(
+   const FieldFunction& f1,
+   double accuracy,
+   const double r1[3],
+   const double r2[3]
+) {
+   if(f1.hasClosedForm(r1,r2)) {
+      const double L[3] = {r2[0]-r1[0],r2[1]-r1[1],r2[2]-r1[2]};
+      const coordinate component = f1.getComponent();
+      //B_component = -dPhi/dcomponent and dB/dd integrate to differences over the faces normal to them
+      const coordinate normal = (f1.getDerivative() == 0) ? component : f1.getDerivComponent();
+      coordinate t1,t2;
+      faceSides(normal,t1,t2);
+      double rUpper[3] = {r1[0],r1[1],r1[2]};
+      rUpper[normal] = r2[normal];
+      double lower,upper;
+      bool ok;
+      double integral;
+      if(f1.getDerivative() == 0) {
+         ok = f1.surfaceIntegralPotential(normal,r1,L[t1],L[t2],lower) &&
+              f1.surfaceIntegralPotential(normal,rUpper,L[t1],L[t2],upper);
+         integral = lower-upper;
+      } else {
+         ok = faceIntegral(f1,component,normal,r1,L[t1],L[t2],lower) &&
+              faceIntegral(f1,component,normal,rUpper,L[t1],L[t2],upper);
+         integral = upper-lower;
+      }
+      if(ok && std::isfinite(integral))
+         return integral/(L[0]*L[1]*L[2]);
+   }
+   return volumeAverage(static_cast<const T3DFunction&>(f1),accuracy,r1,r2);
+}
@@ -29,6 +29,7 @@ Background magnetic field class of Vlasiator.
 
 #include "quadr.hpp"
 #include "functions.hpp"
+#include "fieldfunction.hpp"
 /*!
   Average of f1 along a coordinate-aligned line starting from r1,
   having length L (can be negative) and proceeding to line'th coordinate
@@ -65,5 +66,33 @@ double volumeAverage(
    const double r1[3],
    const double r2[3]
 );
+
+/*!
+  The same averages of the selected component (or derivative) of a field function.
+  They are computed from the closed-form integrals of the function when it provides
+  them for the domain, and with the quadrature above otherwise.
+*/
+double lineAverage(
+   const FieldFunction& f1,
+   coordinate line,
+   double accuracy,
+   const double r1[3],
+   double L
+);
+
+double surfaceAverage(
+   const FieldFunction& f1,
+   coordinate face, double accuracy,
+   const double r1[3],
+   double L1,
+   double L2
+);
+
+double volumeAverage(
+   const FieldFunction& f1,
+   double accuracy,
+   const double r1[3],
+   const double r2[3]
+);
 #endif
 
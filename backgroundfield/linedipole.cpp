@@ -25,6 +25,7 @@ Background magnetic field class of Vlasiator.
 
 #include <stdlib.h>
 #include <math.h>
+#include <algorithm>
 #include "linedipole.hpp"
 #include "../common.h"
 
@@ -101,3 +102,121 @@ double LineDipole::call( double x, double y, double z) const
 
 
 
+/* Closed-form integrals of the line dipole field. With D = -q[2] and rho^2 = x^2+z^2 the
+   field has the scalar potential Phi = D z/rho^2 and the vector potential A = D x/rho^2 e_y,
+   and nothing depends on y. The differences are written so that nearly equal terms are
+   not subtracted.*/
+
+bool LineDipole::hasClosedForm(const double lo[3],const double hi[3]) const {
+   //outside of minimumR the closed forms are the same field as call()
+   const double minimumR=1e-3*physicalconstants::R_E;
+   if(this->initialized==false)
+      return false;
+   double d2 = 0.0;
+   for(int i=0;i<3;i+=2) {
+      const double d = std::max(std::max(lo[i]-center[i],center[i]-hi[i]),0.0);
+      d2 += d*d;
+   }
+   return d2 >= minimumR*minimumR;
+}
+
+bool LineDipole::lineIntegralPotential(coordinate line,const double r1[3],double L,double& result) const {
+   const double D = -q[2];
+   const double x = r1[0]-center[0];
+   const double z = r1[2]-center[2];
+   switch(line) {
+      case X:
+         //D z int dx/(x^2+z^2) = D [atan(x/z)]
+         result = (z == 0.0) ? 0.0 : D*atan2(L*z,z*z+x*(x+L));
+         break;
+      case Y:
+         result = D*z/(x*x+z*z)*L;
+         break;
+      case Z:
+         //D int z dz/(x^2+z^2) = D/2 [ln(x^2+z^2)]
+         result = 0.5*D*log1p(L*(2*z+L)/(x*x+z*z));
+         break;
+   }
+   return true;
+}
+
+bool LineDipole::lineIntegralB(coordinate component,coordinate line,const double r1[3],double L,double& result) const {
+   const double D = -q[2];
+   const double x = r1[0]-center[0];
+   const double z = r1[2]-center[2];
+   const double rho2 = x*x+z*z;
+   if(component == Y) {
+      result = 0.0;
+      return true;
+   }
+   if(line == Y) {
+      result = ((component == X) ? 2*x*z : z*z-x*x)*D/(rho2*rho2)*L;
+      return true;
+   }
+   //a,b are the ends along the line, p the other coordinate
+   const double a = (line == X) ? x : z;
+   const double b = a+L;
+   const double p = (line == X) ? z : x;
+   const double norm = D/((p*p+a*a)*(p*p+b*b));
+   if(component == line) {
+      //-[Phi]
+      result = (line == X) ? norm*p*L*(a+b) : -norm*L*(p*p-a*b);
+   } else {
+      //B_x = -dA_y/dz, B_z = dA_y/dx
+      result = (line == Z) ? norm*p*L*(a+b) : norm*L*(p*p-a*b);
+   }
+   return true;
+}
+
+bool LineDipole::surfaceIntegralPotential(coordinate face,const double r1[3],double L1,double L2,double& result) const {
+   switch(face) {
+      case X:
+         //sides y,z
+         if(!lineIntegralPotential(Z,r1,L2,result))
+            return false;
+         result *= L1;
+         break;
+      case Y: {
+         //sides x,z, corner sum of the primitive x/2 ln(x^2+z^2) - x + z atan(x/z)
+         const double D = -q[2];
+         const double x[2] = {r1[0]-center[0],r1[0]-center[0]+L1};
+         const double z[2] = {r1[2]-center[2],r1[2]-center[2]+L2};
+         double sum = 0.0;
+         for(int i=0;i<2;i++) for(int j=0;j<2;j++) {
+            const double rho2 = x[i]*x[i]+z[j]*z[j];
+            double P = -x[i];
+            if(x[i] != 0.0) P += 0.5*x[i]*log(rho2);
+            if(z[j] != 0.0) P += z[j]*atan(x[i]/z[j]);
+            sum += ((i+j)%2 == 0 ? 1 : -1)*P;
+         }
+         result = D*sum;
+         break;
+      }
+      case Z:
+         //sides x,y
+         if(!lineIntegralPotential(X,r1,L1,result))
+            return false;
+         result *= L2;
+         break;
+   }
+   return true;
+}
+
+bool LineDipole::surfaceFlux(coordinate face,const double r1[3],double L1,double L2,double& result) const {
+   switch(face) {
+      case X:
+         if(!lineIntegralB(X,Z,r1,L2,result))
+            return false;
+         result *= L1;
+         break;
+      case Y:
+         result = 0.0;
+         break;
+      case Z:
+         if(!lineIntegralB(Z,X,r1,L1,result))
+            return false;
+         result *= L2;
+         break;
+   }
+   return true;
+}
@@ -37,6 +37,10 @@ using namespace std;
 
 /*
   The iterations are stopped when the results changes by less than absacc.
+  The routines are reentrant: the trapezoidal refinements, extrapolation tables and
+  the nested 1D integrands of the 2D and 3D rules live on the stack of each call,
+  so they may be called concurrently from several threads. The integrand is only
+  called through its const call() and must not be modified during the integration.
 */
 
 
@@ -0,0 +1,197 @@
+/*
+Test of the closed-form background field averages of Vlasiator.
+
+Computes the face and volume averages, and their derivatives, of the dipole and line
+dipole fields for cells of a Magnetosphere-sized grid both with the closed forms
+(FieldFunction overloads of the averaging functions) and with the quadrature
+(T3DFunction overloads), reports the largest relative difference of each kind and the
+time spent by both. Exits with failure if a difference exceeds the tolerance. The default
+tolerance is set by the accuracy of the quadrature reference for the derivatives, the
+closed forms themselves agree with brute force sums to about ten digits.
+
+Usage: test_averages [cells per dimension] [sample stride] [tolerance]
+*/
+
+#include "chrono"
+#include "cmath"
+#include "cstdlib"
+#include "iostream"
+#include "string"
+
+#include "../dipole.hpp"
+#include "../linedipole.hpp"
+#include "../integratefunction.hpp"
+
+using namespace std;
+
+// Kinds of averages, in the order setBackgroundField computes them
+enum Kind {FACE, FACE_DERIVATIVE, VOLUME, VOLUME_DERIVATIVE, N_KINDS};
+const char* kindNames[N_KINDS] = {"face average", "face derivative", "volume average", "volume derivative"};
+
+/*
+Computes all the averages setBackgroundField computes for one cell, values[kind][i]
+with i = component for the averages and 2*component+j for the derivatives.
+*/
+template<typename Function> void cellAverages(
+   FieldFunction& field,
+   const double accuracy,
+   const double start[3],
+   const double dx[3],
+   double values[N_KINDS][6]
+) {
+   const double end[3] = {start[0] + dx[0], start[1] + dx[1], start[2] + dx[2]};
+   const unsigned int faceCoord1[3] = {1, 0, 0};
+   const unsigned int faceCoord2[3] = {2, 2, 1};
+   const Function& f = field;
+
+   for (unsigned int c = 0; c < 3; c++) {
+      const coordinate face = (coordinate)c;
+      const double L1 = dx[faceCoord1[c]];
+      const double L2 = dx[faceCoord2[c]];
+      field.setComponent(face);
+      field.setDerivative(0);
+      values[FACE][c] = surfaceAverage(f, face, accuracy, start, L1, L2);
+      values[VOLUME][c] = volumeAverage(f, accuracy, start, end);
+      field.setDerivative(1);
+      field.setDerivComponent((coordinate)faceCoord1[c]);
+      values[FACE_DERIVATIVE][2*c] = L1 * surfaceAverage(f, face, accuracy, start, L1, L2);
+      values[VOLUME_DERIVATIVE][2*c] = L1 * volumeAverage(f, accuracy, start, end);
+      field.setDerivComponent((coordinate)faceCoord2[c]);
+      values[FACE_DERIVATIVE][2*c+1] = L2 * surfaceAverage(f, face, accuracy, start, L1, L2);
+      values[VOLUME_DERIVATIVE][2*c+1] = L2 * volumeAverage(f, accuracy, start, end);
+   }
+}
+
+/*
+Reference values for cellAverages from the quadrature. The accuracy setBackgroundField
+asks for is relative to the cell size only, which leaves the quadrature of the derivatives
+a few digits short, so the averages of the derivatives are computed as differences of the
+averages of the field on the opposite sides of the face or the cell instead.
+*/
+void referenceAverages(
+   FieldFunction& field,
+   const double start[3],
+   const double dx[3],
+   double values[N_KINDS][6]
+) {
+   const double accuracy = 1e-17;
+   const T3DFunction& f = field;
+   cellAverages<T3DFunction>(field, accuracy, start, dx, values);
+   field.setDerivative(0);
+
+   const unsigned int faceCoord[3][2] = {{1, 2}, {0, 2}, {0, 1}};
+   for (unsigned int c = 0; c < 3; c++) {
+      field.setComponent((coordinate)c);
+      for (int j = 0; j < 2; j++) {
+         const unsigned int d = faceCoord[c][j];
+         const unsigned int along = faceCoord[c][1-j];
+         double upper[3] = {start[0], start[1], start[2]};
+         upper[d] += dx[d];
+         values[FACE_DERIVATIVE][2*c+j] =
+            lineAverage(f, (coordinate)along, accuracy, upper, dx[along]) -
+            lineAverage(f, (coordinate)along, accuracy, start, dx[along]);
+         values[VOLUME_DERIVATIVE][2*c+j] =
+            surfaceAverage(f, (coordinate)d, accuracy, upper, dx[faceCoord[d][0]], dx[faceCoord[d][1]]) -
+            surfaceAverage(f, (coordinate)d, accuracy, start, dx[faceCoord[d][0]], dx[faceCoord[d][1]]);
+      }
+   }
+}
+
+/*
+Compares the closed forms against the quadrature for every stride'th cell of a cubic
+grid of n^3 cells, returns false if the largest relative difference is above tolerance.
+The difference is relative to the largest magnitude of the same kind in the cell. Cells
+within two cell sizes from the dipole are left out: the closed forms do not cover the ones
+touching it, and next to it the quadrature is not accurate enough to be a reference. The
+timing uses the accuracy of setBackgroundField.
+*/
+bool compare(
+   const string& name,
+   FieldFunction& field,
+   const int n,
+   const int stride,
+   const double tolerance
+) {
+   const double gridMin = -2.0e8, gridMax = 2.0e8;
+   const double dx[3] = {(gridMax - gridMin) / n, (gridMax - gridMin) / n, (gridMax - gridMin) / n};
+   double maxDifference[N_KINDS] = {0, 0, 0, 0};
+   double closedFormTime = 0, quadratureTime = 0;
+   int sampled = 0;
+
+   for (long cell = 0; cell < (long)n*n*n; cell += stride) {
+      const double start[3] = {
+         gridMin + (cell % n) * dx[0],
+         gridMin + ((cell / n) % n) * dx[1],
+         gridMin + (cell / ((long)n*n)) * dx[2]
+      };
+      const double lo[3] = {start[0] - 2*dx[0], start[1] - 2*dx[1], start[2] - 2*dx[2]};
+      const double hi[3] = {start[0] + 3*dx[0], start[1] + 3*dx[1], start[2] + 3*dx[2]};
+      if (!field.hasClosedForm(lo, hi)) continue;
+      double closedForm[N_KINDS][6], quadrature[N_KINDS][6], reference[N_KINDS][6];
+
+      chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+      cellAverages<FieldFunction>(field, 1e-17, start, dx, closedForm);
+      chrono::steady_clock::time_point t1 = chrono::steady_clock::now();
+      cellAverages<T3DFunction>(field, 1e-17, start, dx, quadrature);
+      chrono::steady_clock::time_point t2 = chrono::steady_clock::now();
+      closedFormTime += chrono::duration<double>(t1 - t0).count();
+      quadratureTime += chrono::duration<double>(t2 - t1).count();
+      referenceAverages(field, start, dx, reference);
+      sampled++;
+
+      for (int kind = 0; kind < N_KINDS; kind++) {
+         const int count = (kind == FACE || kind == VOLUME) ? 3 : 6;
+         double scale = 0;
+         for (int i = 0; i < count; i++) scale = max(scale, fabs(reference[kind][i]));
+         if (scale == 0) continue;
+         for (int i = 0; i < count; i++) {
+            maxDifference[kind] = max(maxDifference[kind], fabs(closedForm[kind][i] - reference[kind][i]) / scale);
+         }
+      }
+   }
+
+   bool success = true;
+   cout << name << ", " << sampled << " of " << n*n*n << " cells:" << endl;
+   for (int kind = 0; kind < N_KINDS; kind++) {
+      cout << "   " << kindNames[kind] << ": max relative difference " << maxDifference[kind] << endl;
+      if (!(maxDifference[kind] <= tolerance)) success = false;
+   }
+   const double fullGrid = (double)n*n*n / sampled;
+   cout << "   closed form " << closedFormTime / sampled * 1e6 << " us/cell, "
+        << "quadrature " << quadratureTime / sampled * 1e6 << " us/cell, "
+        << "estimated full grid " << closedFormTime * fullGrid << " s vs " << quadratureTime * fullGrid << " s" << endl;
+   return success;
+}
+
+
+int main(int argc, char* argv[])
+{
+   const int n = (argc > 1) ? atoi(argv[1]) : 50;
+   const int stride = (argc > 2) ? atoi(argv[2]) : 97;
+   const double tolerance = (argc > 3) ? atof(argv[3]) : 1e-5;
+
+   bool success = true;
+
+   Dipole dipole;
+   dipole.initialize(8e15, 0.0, 0.0, 0.0, 0.0);
+   success = compare("dipole", dipole, n, stride, tolerance) && success;
+
+   Dipole tilted;
+   tilted.initialize(8e15, 1.0e6, -2.0e6, 0.5e6, 0.3);
+   success = compare("tilted and shifted dipole", tilted, n, stride, tolerance) && success;
+
+   LineDipole lineDipole;
+   lineDipole.initialize(126.2e6, 0.0, 0.0, 0.0);
+   success = compare("line dipole", lineDipole, n, stride, tolerance) && success;
+
+   LineDipole shiftedLineDipole;
+   shiftedLineDipole.initialize(126.2e6, 3.0e6, 0.0, -1.0e6);
+   success = compare("shifted line dipole", shiftedLineDipole, n, stride, tolerance) && success;
+
+   if (!success) {
+      cout << "FAILED" << endl;
+      return EXIT_FAILURE;
+   }
+   cout << "PASSED" << endl;
+   return EXIT_SUCCESS;
+}
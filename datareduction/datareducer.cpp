@@ -26,12 +26,16 @@
 #include "datareducer.h"
 #include "../common.h"
 #include "dro_populations.h"
+#include "phiprof.hpp"
 using namespace std;
 
 void initializeDataReducers(DataReducer * outputReducer, DataReducer * diagnosticReducer)
 {
    typedef Parameters P;
 
+   // Backstream moments and energy densities share one pass over velocity space per output step
+   DRO::FusedVelocityMoments* fusedMoments = P::fusedVelocityMoments ? outputReducer->getFusedVelocityMoments() : NULL;
+
    vector<string>::const_iterator it;
    for (it = P::outputVariableList.begin();
         it != P::outputVariableList.end();
@@ -83,19 +87,19 @@ void initializeDataReducers(DataReducer * outputReducer, DataReducer * diagnosti
       }
       if(*it == "populations_moments_Backstream") { // Per-population moments of the backstreaming part
          for(unsigned int i =0; i < getObjectWrapper().particleSpecies.size(); i++) {
-            outputReducer->addOperator(new DRO::VariableRhoBackstream(i));
-            outputReducer->addOperator(new DRO::VariableVBackstream(i));
-            outputReducer->addOperator(new DRO::VariablePTensorBackstreamDiagonal(i));
-            outputReducer->addOperator(new DRO::VariablePTensorBackstreamOffDiagonal(i));
+            outputReducer->addOperator(new DRO::VariableRhoBackstream(i,fusedMoments));
+            outputReducer->addOperator(new DRO::VariableVBackstream(i,fusedMoments));
+            outputReducer->addOperator(new DRO::VariablePTensorBackstreamDiagonal(i,fusedMoments));
+            outputReducer->addOperator(new DRO::VariablePTensorBackstreamOffDiagonal(i,fusedMoments));
          }
          continue;
       }
       if(*it == "populations_moments_NonBackstream") { // Per-population moments of the non-backstreaming (thermal?) part.
          for(unsigned int i =0; i < getObjectWrapper().particleSpecies.size(); i++) {
-            outputReducer->addOperator(new DRO::VariableRhoNonBackstream(i));
-            outputReducer->addOperator(new DRO::VariableVNonBackstream(i));
-            outputReducer->addOperator(new DRO::VariablePTensorNonBackstreamDiagonal(i));
-            outputReducer->addOperator(new DRO::VariablePTensorNonBackstreamOffDiagonal(i));
+            outputReducer->addOperator(new DRO::VariableRhoNonBackstream(i,fusedMoments));
+            outputReducer->addOperator(new DRO::VariableVNonBackstream(i,fusedMoments));
+            outputReducer->addOperator(new DRO::VariablePTensorNonBackstreamDiagonal(i,fusedMoments));
+            outputReducer->addOperator(new DRO::VariablePTensorNonBackstreamOffDiagonal(i,fusedMoments));
          }
          continue;
       }
@@ -151,7 +155,7 @@ void initializeDataReducers(DataReducer * outputReducer, DataReducer * diagnosti
       if(*it == "populations_EnergyDensity") {
          // Per-population energy density in three energy ranges
          for(unsigned int i =0; i < getObjectWrapper().particleSpecies.size(); i++) {
-            outputReducer->addOperator(new DRO::VariableEnergyDensity(i));
+            outputReducer->addOperator(new DRO::VariableEnergyDensity(i,fusedMoments));
          }
          continue;
       }
@@ -605,3 +609,29 @@ bool DataReducer::writeParameters(const unsigned int& operatorID, vlsv::Writer&
    }
    return parameterOperator->writeParameters(vlsvWriter);
 }
+
+/** Get the fused velocity space reductions of this DataReducer. Operators given this
+ * pointer at construction request the reductions they need from it.
+ * @return Pointer to the fused reductions.*/
+DRO::FusedVelocityMoments* DataReducer::getFusedVelocityMoments() {
+   return &fusedVelocityMoments;
+}
+
+/** Compute everything the operators can share before they are applied to the given cells.
+ * Currently this is the single pass over velocity space of DRO::FusedVelocityMoments.
+ * @param mpiGrid Parallel grid library.
+ * @param cells Vector containing the local spatial cell IDs.
+ * @return If true, the shared reductions were computed successfully.*/
+bool DataReducer::prepareReductions(const dccrg::Dccrg<spatial_cell::SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                                    const std::vector<CellID>& cells) {
+   if (fusedVelocityMoments.isRequested() == false) return true;
+   phiprof::start("fused velocity moments");
+   const bool success = fusedVelocityMoments.evaluate(mpiGrid,cells);
+   phiprof::stop("fused velocity moments",cells.size(),"Spatial cells");
+   return success;
+}
+
+/** Release the shared reductions computed by prepareReductions.*/
+void DataReducer::finishReductions() {
+   fusedVelocityMoments.clear();
+}
@@ -54,6 +54,10 @@ class DataReducer {
                   const std::vector<CellID>& cells,const std::string& meshName,
                   vlsv::Writer& vlsvWriter);
    bool writeParameters(const unsigned int& operatorID, vlsv::Writer& vlsvWriter);
+   DRO::FusedVelocityMoments* getFusedVelocityMoments();
+   bool prepareReductions(const dccrg::Dccrg<spatial_cell::SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                          const std::vector<CellID>& cells);
+   void finishReductions();
 
  private:
    /** Private copy-constructor to prevent copying the class.
@@ -62,6 +66,8 @@ class DataReducer {
    
    std::vector<DRO::DataReductionOperator*> operators;
    /**< A container for all DRO::DataReductionOperators stored in DataReducer.*/
+   DRO::FusedVelocityMoments fusedVelocityMoments;
+   /**< Single-pass velocity space reductions shared by the operators that requested them.*/
 };
 
 void initializeDataReducers(DataReducer * outputReducer, DataReducer * diagnosticReducer);
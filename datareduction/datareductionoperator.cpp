@@ -70,6 +70,16 @@ namespace DRO {
       return false;
    }
 
+   /** Check the cell before reduceData or reduceDiagnostic is called for it.
+    * The default accepts every cell, operators that read everything they need in
+    * reduceData do not have to override this.
+    * @param cell the SpatialCell to be reduced next
+    * @return If false, the cell should not be reduced.
+    */
+   bool DataReductionOperator::setSpatialCell(const SpatialCell* cell) {
+      return true;
+   }
+
 
    DataReductionOperatorCellParams::DataReductionOperatorCellParams(const std::string& name,const unsigned int parameterIndex,const unsigned int _vectorSize):
    DataReductionOperator() {
@@ -88,8 +98,12 @@ namespace DRO {
    
    std::string DataReductionOperatorCellParams::getName() const {return variableName;}
    
+   const Real* DataReductionOperatorCellParams::getCellData(const SpatialCell* cell) const {
+      return &(cell->parameters[_parameterIndex]);
+   }
+
    bool DataReductionOperatorCellParams::reduceData(const SpatialCell* cell,char* buffer) {
-      const char* ptr = reinterpret_cast<const char*>(data);
+      const char* ptr = reinterpret_cast<const char*>(getCellData(cell));
       for (uint i = 0; i < vectorSize*sizeof(Real); ++i){
          buffer[i] = ptr[i];
       }
@@ -98,17 +112,20 @@ namespace DRO {
    
    bool DataReductionOperatorCellParams::reduceDiagnostic(const SpatialCell* cell,Real* buffer){
       //If vectorSize is >1 it still works, we just give the first value and no other ones..
-      *buffer=data[0];
+      *buffer=getCellData(cell)[0];
       return true;
    }
+   /** Check the values the operator writes out, so that the derivative operators check
+    * their own arrays instead of cell parameters.
+    */
    bool DataReductionOperatorCellParams::setSpatialCell(const SpatialCell* cell) {
+      const Real* data = getCellData(cell);
       for (uint i=0; i<vectorSize; i++) {
-         if(std::isinf(cell->parameters[_parameterIndex+i]) || std::isnan(cell->parameters[_parameterIndex+i])) {
+         if(std::isinf(data[i]) || std::isnan(data[i])) {
             string message = "The DataReductionOperator " + this->getName() + " returned a nan or an inf in its " + std::to_string(i) + "-component.";
             bailout(true, message, __FILE__, __LINE__);
          }
       }
-      data  = &(cell->parameters[_parameterIndex]);
       return true;
    }
 
@@ -121,9 +138,8 @@ namespace DRO {
 
    }
    //a version with derivatives, this is the only function that is different
-   bool DataReductionOperatorDerivatives::setSpatialCell(const SpatialCell* cell) {
-      data  = &(cell->derivatives[_parameterIndex]);
-      return true;
+   const Real* DataReductionOperatorDerivatives::getCellData(const SpatialCell* cell) const {
+      return &(cell->derivatives[_parameterIndex]);
    }
 
 
@@ -132,9 +148,8 @@ namespace DRO {
       
    }
    //a version with derivatives, this is the only function that is different
-   bool DataReductionOperatorBVOLDerivatives::setSpatialCell(const SpatialCell* cell) {
-      data  = &(cell->derivativesBVOL[_parameterIndex]);
-      return true;
+   const Real* DataReductionOperatorBVOLDerivatives::getCellData(const SpatialCell* cell) const {
+      return &(cell->derivativesBVOL[_parameterIndex]);
    }
    
    
@@ -153,12 +168,7 @@ namespace DRO {
    std::string VariableBVol::getName() const {return "B_vol";}
    
    bool VariableBVol::reduceData(const SpatialCell* cell,char* buffer) {
-      const char* ptr = reinterpret_cast<const char*>(B);
-      for (uint i = 0; i < 3*sizeof(Real); ++i) buffer[i] = ptr[i];
-      return true;
-   }
-   
-   bool VariableBVol::setSpatialCell(const SpatialCell* cell) {
+      Real B[3];
       B[0] = cell->parameters[CellParams::PERBXVOL] +  cell->parameters[CellParams::BGBXVOL];
       B[1] = cell->parameters[CellParams::PERBYVOL] +  cell->parameters[CellParams::BGBYVOL];
       B[2] = cell->parameters[CellParams::PERBZVOL] +  cell->parameters[CellParams::BGBZVOL];
@@ -169,12 +179,11 @@ namespace DRO {
          string message = "The DataReductionOperator " + this->getName() + " returned a nan or an inf.";
          bailout(true, message, __FILE__, __LINE__);
       }
+      const char* ptr = reinterpret_cast<const char*>(B);
+      for (uint i = 0; i < 3*sizeof(Real); ++i) buffer[i] = ptr[i];
       return true;
    }
-
-
-
-
+   
    //------------------ total B --------------------------------------- 
    VariableB::VariableB(): DataReductionOperator() { }
    VariableB::~VariableB() { }
@@ -189,12 +198,7 @@ namespace DRO {
    std::string VariableB::getName() const {return "B";}
    
    bool VariableB::reduceData(const SpatialCell* cell,char* buffer) {
-      const char* ptr = reinterpret_cast<const char*>(B);
-      for (uint i = 0; i < 3*sizeof(Real); ++i) buffer[i] = ptr[i];
-      return true;
-   }
-   
-   bool VariableB::setSpatialCell(const SpatialCell* cell) {
+      Real B[3];
       B[0] = cell->parameters[CellParams::PERBX] +  cell->parameters[CellParams::BGBX];
       B[1] = cell->parameters[CellParams::PERBY] +  cell->parameters[CellParams::BGBY];
       B[2] = cell->parameters[CellParams::PERBZ] +  cell->parameters[CellParams::BGBZ];
@@ -205,12 +209,15 @@ namespace DRO {
          string message = "The DataReductionOperator " + this->getName() + " returned a nan or an inf.";
          bailout(true, message, __FILE__, __LINE__);
       }
+      const char* ptr = reinterpret_cast<const char*>(B);
+      for (uint i = 0; i < 3*sizeof(Real); ++i) buffer[i] = ptr[i];
       return true;
    }
    
-   
    //MPI rank
-   MPIrank::MPIrank(): DataReductionOperator() { }
+   MPIrank::MPIrank(): DataReductionOperator() {
+      MPI_Comm_rank(MPI_COMM_WORLD,&mpiRank);
+   }
    MPIrank::~MPIrank() { }
    
    bool MPIrank::getDataVectorInfo(std::string& dataType,unsigned int& dataSize,unsigned int& vectorSize) const {
@@ -228,14 +235,6 @@ namespace DRO {
       return true;
    }
    
-   bool MPIrank::setSpatialCell(const SpatialCell* cell) {
-      int intRank;
-      MPI_Comm_rank(MPI_COMM_WORLD,&intRank);
-      rank = 1.0*intRank;
-      mpiRank = intRank;
-      return true;
-   }
-   
    //FsGrid cartcomm mpi rank
    FsGridRank::FsGridRank(): DataReductionOperator() { }
    FsGridRank::~FsGridRank() { }
@@ -250,16 +249,12 @@ namespace DRO {
    std::string FsGridRank::getName() const {return "FSgrid_rank";}
    
    bool FsGridRank::reduceData(const SpatialCell* cell,char* buffer) {
+      const int fsgridRank = cell->get_cell_parameters()[CellParams::FSGRID_RANK];
       const char* ptr = reinterpret_cast<const char*>(&fsgridRank);
       for (uint i=0; i<sizeof(int); ++i) buffer[i] = ptr[i];
       return true;
    }
    
-   bool FsGridRank::setSpatialCell(const SpatialCell* cell) {
-      fsgridRank = cell->get_cell_parameters()[CellParams::FSGRID_RANK];
-      return true;
-   }
-
    //FsGrids idea of what the boundaryType ist
    FsGridBoundaryType::FsGridBoundaryType(): DataReductionOperator() { }
    FsGridBoundaryType::~FsGridBoundaryType() { }
@@ -274,16 +269,12 @@ namespace DRO {
    std::string FsGridBoundaryType::getName() const {return "FSgrid_boundaryType";}
    
    bool FsGridBoundaryType::reduceData(const SpatialCell* cell,char* buffer) {
+      const int fsgridBoundaryType = cell->get_cell_parameters()[CellParams::FSGRID_BOUNDARYTYPE];
       const char* ptr = reinterpret_cast<const char*>(&fsgridBoundaryType);
       for (uint i=0; i<sizeof(int); ++i) buffer[i] = ptr[i];
       return true;
    }
    
-   bool FsGridBoundaryType::setSpatialCell(const SpatialCell* cell) {
-      fsgridBoundaryType = cell->get_cell_parameters()[CellParams::FSGRID_BOUNDARYTYPE];
-      return true;
-   }
-
    // BoundaryType
    BoundaryType::BoundaryType(): DataReductionOperator() { }
    BoundaryType::~BoundaryType() { }
@@ -298,17 +289,12 @@ namespace DRO {
    std::string BoundaryType::getName() const {return "Boundary_type";}
    
    bool BoundaryType::reduceData(const SpatialCell* cell,char* buffer) {
+      const int boundaryType = (int)cell->sysBoundaryFlag;
       const char* ptr = reinterpret_cast<const char*>(&boundaryType);
       for (uint i = 0; i < sizeof(int); ++i) buffer[i] = ptr[i];
       return true;
    }
    
-   bool BoundaryType::setSpatialCell(const SpatialCell* cell) {
-      boundaryType = (int)cell->sysBoundaryFlag;
-      return true;
-   }
-
-
       // BoundaryLayer
    BoundaryLayer::BoundaryLayer(): DataReductionOperator() { }
    BoundaryLayer::~BoundaryLayer() { }
@@ -323,16 +309,12 @@ namespace DRO {
    std::string BoundaryLayer::getName() const {return "Boundary_layer";}
    
    bool BoundaryLayer::reduceData(const SpatialCell* cell,char* buffer) {
+      const int boundaryLayer = (int)cell->sysBoundaryLayer;
       const char* ptr = reinterpret_cast<const char*>(&boundaryLayer);
       for (uint i = 0; i < sizeof(int); ++i) buffer[i] = ptr[i];
       return true;
    }
    
-   bool BoundaryLayer::setSpatialCell(const SpatialCell* cell) {
-      boundaryLayer = (int)cell->sysBoundaryLayer;
-      return true;
-   }
-   
    // Blocks
    Blocks::Blocks(cuint _popID): DataReductionOperator(),popID(_popID) {
       popName=getObjectWrapper().particleSpecies[popID].name;
@@ -349,18 +331,14 @@ namespace DRO {
    std::string Blocks::getName() const {return popName + "/Blocks";}
    
    bool Blocks::reduceData(const SpatialCell* cell,char* buffer) {
+      const uint nBlocks = cell->get_number_of_velocity_blocks(popID);
       const char* ptr = reinterpret_cast<const char*>(&nBlocks);
       for (uint i = 0; i < sizeof(int); ++i) buffer[i] = ptr[i];
       return true;
    }
    
    bool Blocks::reduceDiagnostic(const SpatialCell* cell,Real* buffer) {
-      *buffer = 1.0 * nBlocks;
-      return true;
-   }
-  
-   bool Blocks::setSpatialCell(const SpatialCell* cell) {
-      nBlocks = cell->get_number_of_velocity_blocks(popID);
+      *buffer = 1.0 * cell->get_number_of_velocity_blocks(popID);
       return true;
    }
    
@@ -378,16 +356,12 @@ namespace DRO {
    }
    
    bool VariablePressureSolver::reduceData(const SpatialCell* cell,char* buffer) {
+      const Real Pressure = 1.0/3.0 * (cell->parameters[CellParams::P_11] + cell->parameters[CellParams::P_22] + cell->parameters[CellParams::P_33]);
       const char* ptr = reinterpret_cast<const char*>(&Pressure);
       for (uint i = 0; i < sizeof(Real); ++i) buffer[i] = ptr[i];
       return true;
    }
    
-   bool VariablePressureSolver::setSpatialCell(const SpatialCell* cell) {
-      Pressure = 1.0/3.0 * (cell->parameters[CellParams::P_11] + cell->parameters[CellParams::P_22] + cell->parameters[CellParams::P_33]);
-      return true;
-   }
-   
    // YK Adding pressure calculations to Vlasiator.
    // p_ij = m/3 * integral((v - <V>)_i(v - <V>)_j * f(r,v) dV)
    
@@ -410,6 +384,10 @@ namespace DRO {
    
    bool VariablePTensorDiagonal::reduceData(const SpatialCell* cell,char* buffer) {
       const Real HALF = 0.5;
+      const Real averageVX = cell-> parameters[CellParams::VX];
+      const Real averageVY = cell-> parameters[CellParams::VY];
+      const Real averageVZ = cell-> parameters[CellParams::VZ];
+      Real PTensor[3] = {0.0, 0.0, 0.0};
       # pragma omp parallel
       {
          Real thread_nvxvx_sum = 0.0;
@@ -460,13 +438,6 @@ namespace DRO {
       return true;
    }
    
-   bool VariablePTensorDiagonal::setSpatialCell(const SpatialCell* cell) {
-      averageVX = cell-> parameters[CellParams::VX];
-      averageVY = cell-> parameters[CellParams::VY];
-      averageVZ = cell-> parameters[CellParams::VZ];
-      for(int i = 0; i < 3; i++) PTensor[i] = 0.0;
-      return true;
-   }
    
    VariablePTensorOffDiagonal::VariablePTensorOffDiagonal(cuint _popID): DataReductionOperator(),popID(_popID) {
       popName = getObjectWrapper().particleSpecies[popID].name;
@@ -484,6 +455,10 @@ namespace DRO {
    
    bool VariablePTensorOffDiagonal::reduceData(const SpatialCell* cell,char* buffer) {
       const Real HALF = 0.5;
+      const Real averageVX = cell-> parameters[CellParams::VX];
+      const Real averageVY = cell-> parameters[CellParams::VY];
+      const Real averageVZ = cell-> parameters[CellParams::VZ];
+      Real PTensor[3] = {0.0, 0.0, 0.0};
       # pragma omp parallel
       {
          Real thread_nvxvy_sum = 0.0;
@@ -534,13 +509,6 @@ namespace DRO {
       return true;
    }
    
-   bool VariablePTensorOffDiagonal::setSpatialCell(const SpatialCell* cell) {
-      averageVX = cell-> parameters[CellParams::VX];
-      averageVY = cell-> parameters[CellParams::VY];
-      averageVZ = cell-> parameters[CellParams::VZ];
-      for(int i = 0; i < 3; i++) PTensor[i] = 0.0;
-      return true;
-   }
    
    // Integrated divergence of magnetic field
    // Integral of div B over the simulation volume =
@@ -589,7 +557,6 @@ namespace DRO {
       return true;
    }
    
-   bool DiagnosticFluxB::setSpatialCell(const SpatialCell* cell) {return true;}
    
    
    
@@ -640,7 +607,6 @@ namespace DRO {
       return true;
    }
    
-   bool DiagnosticFluxE::setSpatialCell(const SpatialCell* cell) {return true;}
    
    // YK maximum value of the distribution function
    MaxDistributionFunction::MaxDistributionFunction(cuint _popID): DataReductionOperator(),popID(_popID) {
@@ -658,7 +624,7 @@ namespace DRO {
    }   
    
    bool MaxDistributionFunction::reduceDiagnostic(const SpatialCell* cell,Real* buffer) {
-      maxF = std::numeric_limits<Real>::min();
+      Real maxF = std::numeric_limits<Real>::min();
       
       #pragma omp parallel 
       {
@@ -691,9 +657,6 @@ namespace DRO {
       return true;
    }
    
-   bool MaxDistributionFunction::setSpatialCell(const SpatialCell* cell) {
-      return true;
-   }
    
    
    // YK minimum value of the distribution function
@@ -712,7 +675,7 @@ namespace DRO {
    }   
    
    bool MinDistributionFunction::reduceDiagnostic(const SpatialCell* cell,Real* buffer) {
-      minF =  std::numeric_limits<Real>::max();
+      Real minF =  std::numeric_limits<Real>::max();
 
       #pragma omp parallel 
       {
@@ -745,362 +708,26 @@ namespace DRO {
       return true;
    }
    
-   bool MinDistributionFunction::setSpatialCell(const SpatialCell* cell) {
-      return true;
-   }
-
-  /*******
-	  Helper functions for finding the velocity cell indices or IDs within a single velocity block
-	  either belonging to the backstreaming or the non-backstreaming population. 
-	  There is some code duplication here, but as these helper functions are called within threads for
-	  block separately, it's preferable to have them fast even at the cost of code repetition.
-  ********/
-
-   //Helper function for getting the velocity cell ids that are a part of the backstream population:
-   static void getBackstreamVelocityCells(
-      const Real* block_parameters,
-      vector<uint64_t> & vCellIds,
-      cuint popID
-   ) {
-      creal HALF = 0.5;
-      const std::array<Real, 3> backstreamV = getObjectWrapper().particleSpecies[popID].backstreamV;
-      creal backstreamRadius = getObjectWrapper().particleSpecies[popID].backstreamRadius;
-      // Go through every velocity cell (i, j, k are indices)
-      for (uint k = 0; k < WID; ++k) for (uint j = 0; j < WID; ++j) for (uint i = 0; i < WID; ++i) {
-         // Get the vx, vy, vz coordinates of the velocity cell
-         const Real VX = block_parameters[BlockParams::VXCRD] + (i + HALF) * block_parameters[BlockParams::DVX];
-         const Real VY = block_parameters[BlockParams::VYCRD] + (j + HALF) * block_parameters[BlockParams::DVY];
-         const Real VZ = block_parameters[BlockParams::VZCRD] + (k + HALF) * block_parameters[BlockParams::DVZ];
-         // Compare the distance of the velocity cell from the center of the maxwellian distribution to the radius of the maxwellian distribution
-         if( ( (backstreamV[0] - VX) * (backstreamV[0] - VX)
-             + (backstreamV[1] - VY) * (backstreamV[1] - VY)
-             + (backstreamV[2] - VZ) * (backstreamV[2] - VZ) )
-             >
-             backstreamRadius*backstreamRadius ) {
-             //The velocity cell is a part of the backstream population:
-             vCellIds.push_back(cellIndex(i,j,k));
-          }
-      }
-   }
-   //Helper function for getting the velocity cell ids that are a part of the backstream population:
-   static void getNonBackstreamVelocityCells(
-      const Real* block_parameters,
-      vector<uint64_t> & vCellIds,
-      cuint popID
-   ) {
-      creal HALF = 0.5;
-      const std::array<Real, 3> backstreamV = getObjectWrapper().particleSpecies[popID].backstreamV;
-      creal backstreamRadius = getObjectWrapper().particleSpecies[popID].backstreamRadius;
-      for (uint k = 0; k < WID; ++k) for (uint j = 0; j < WID; ++j) for (uint i = 0; i < WID; ++i) {
-         const Real VX = block_parameters[BlockParams::VXCRD] + (i + HALF) * block_parameters[BlockParams::DVX];
-         const Real VY = block_parameters[BlockParams::VYCRD] + (j + HALF) * block_parameters[BlockParams::DVY];
-         const Real VZ = block_parameters[BlockParams::VZCRD] + (k + HALF) * block_parameters[BlockParams::DVZ];
-         if( ( (backstreamV[0] - VX) * (backstreamV[0] - VX)
-             + (backstreamV[1] - VY) * (backstreamV[1] - VY)
-             + (backstreamV[2] - VZ) * (backstreamV[2] - VZ) )
-             <=
-             backstreamRadius*backstreamRadius ) {
-             //The velocity cell is not a part of the backstream population:
-             vCellIds.push_back(cellIndex(i,j,k));
-          }
-      }
-   }
-   //Helper function for getting the velocity cell indices that are a part of the backstream population:
-   static void getBackstreamVelocityCellIndices(
-      const Real* block_parameters,
-      vector<array<uint, 3>> & vCellIndices,
-      cuint popID
-   ) {
-      creal HALF = 0.5;
-      const std::array<Real, 3> backstreamV = getObjectWrapper().particleSpecies[popID].backstreamV;
-      creal backstreamRadius = getObjectWrapper().particleSpecies[popID].backstreamRadius;
-      // Go through a block's every velocity cell
-      for (uint k = 0; k < WID; ++k) for (uint j = 0; j < WID; ++j) for (uint i = 0; i < WID; ++i) {
-         // Get the coordinates of the velocity cell (e.g. VX = block_vx_min_coordinates + (velocity_cell_indice_x+0.5)*length_of_velocity_cell_in_x_direction
-         const Real VX = block_parameters[BlockParams::VXCRD] + (i + HALF) * block_parameters[BlockParams::DVX];
-         const Real VY = block_parameters[BlockParams::VYCRD] + (j + HALF) * block_parameters[BlockParams::DVY];
-         const Real VZ = block_parameters[BlockParams::VZCRD] + (k + HALF) * block_parameters[BlockParams::DVZ];
-         // Calculate the distance of the velocity cell from the center of the maxwellian distribution and compare it to the approximate radius of the maxwellian distribution
-         if( ( (backstreamV[0] - VX) * (backstreamV[0] - VX)
-             + (backstreamV[1] - VY) * (backstreamV[1] - VY)
-             + (backstreamV[2] - VZ) * (backstreamV[2] - VZ) )
-             >
-             backstreamRadius*backstreamRadius ) {
-             //The velocity cell is a part of the backstream population because it is not within the radius:
-             const array<uint, 3> indices{{i, j, k}};
-             vCellIndices.push_back( indices );
-          }
-      }
-   }
-   //Helper function for getting the velocity cell indices that are not a part of the backstream population:
-   static void getNonBackstreamVelocityCellIndices(
-      const Real* block_parameters,
-      vector<array<uint, 3>> & vCellIndices,
-      cuint popID
-   ) {
-      creal HALF = 0.5;
-      const std::array<Real, 3> backstreamV = getObjectWrapper().particleSpecies[popID].backstreamV;
-      creal backstreamRadius = getObjectWrapper().particleSpecies[popID].backstreamRadius;
-      // Go through a block's every velocity cell
-      for (uint k = 0; k < WID; ++k) for (uint j = 0; j < WID; ++j) for (uint i = 0; i < WID; ++i) {
-         // Get the coordinates of the velocity cell (e.g. VX = block_vx_min_coordinates + (velocity_cell_indice_x+0.5)*length_of_velocity_cell_in_x_direction
-         const Real VX = block_parameters[BlockParams::VXCRD] + (i + HALF) * block_parameters[BlockParams::DVX];
-         const Real VY = block_parameters[BlockParams::VYCRD] + (j + HALF) * block_parameters[BlockParams::DVY];
-         const Real VZ = block_parameters[BlockParams::VZCRD] + (k + HALF) * block_parameters[BlockParams::DVZ];
-         // Calculate the distance of the velocity cell from the center of the maxwellian distribution and compare it to the approximate radius of the maxwellian distribution
-         if( ( (backstreamV[0] - VX) * (backstreamV[0] - VX)
-             + (backstreamV[1] - VY) * (backstreamV[1] - VY)
-             + (backstreamV[2] - VZ) * (backstreamV[2] - VZ) )
-             <=
-             backstreamRadius*backstreamRadius ) {
-             //The velocity cell is not a part of the backstream population because it is within the radius:
-             const array<uint, 3> indices{{i, j, k}};
-             vCellIndices.push_back( indices );
-          }
-      }
-   }
-
-  /********
-	   Next level of helper functions - these include threading and calculate zeroth or first velocity moments or the
-	   diagonal / off-diagonal pressure tensor components for
-	   backstreaming or non-backstreaming populations  ********/
-
-   //Calculates rho backstream or rho non backstream
-   static void rhoBackstreamCalculation( const SpatialCell * cell, const bool calculateBackstream, cuint popID, Real & rho ) {
-      const Real HALF = 0.5;
-      # pragma omp parallel
-      {
-         Real thread_n_sum = 0.0;
-         
-         const Real* parameters = cell->get_block_parameters(popID);
-         const Realf* block_data = cell->get_data(popID);
-         
-         # pragma omp for
-         for (vmesh::LocalID n=0; n<cell->get_number_of_velocity_blocks(popID); ++n) {
-            const Real DV3
-            = parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVX]
-            * parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVY]
-            * parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVZ];
-            vector< uint64_t > vCells; //Velocity cell ids
-            vCells.clear();
-            if ( calculateBackstream == true ) {
-               getBackstreamVelocityCells(&parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS], vCells, popID);
-            } else {
-               getNonBackstreamVelocityCells(&parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS], vCells, popID);
-            }
-            for( vector< uint64_t >::const_iterator it = vCells.begin(); it != vCells.end(); ++it ) {
-               //velocity cell id = *it
-               thread_n_sum += block_data[n * SIZE_VELBLOCK + (*it)] * DV3;
-            }
-         }
-         // Accumulate contributions coming from this velocity block
-         // If multithreading / OpenMP is used, 
-         // these updates need to be atomic:
-         // todo: use omp reduction
-         # pragma omp critical
-         {
-            rho += thread_n_sum;
-         }
-      }
-      return;
-   }
-
-   static void VBackstreamCalculation( const SpatialCell * cell, const bool calculateBackstream, cuint popID, Real * V ) {
-      const Real HALF = 0.5;
-      // Make sure the V is initialized
-      V[0] = 0;
-      V[1] = 0;
-      V[2] = 0;
-      Real n = 0;
-      # pragma omp parallel
-      {
-         Real thread_nvx_sum = 0.0;
-         Real thread_nvy_sum = 0.0;
-         Real thread_nvz_sum = 0.0;
-         Real thread_n_sum = 0.0;
-
-         const Real* parameters = cell->get_block_parameters(popID);
-         const Realf* block_data = cell->get_data(popID);
-         
-         # pragma omp for
-         for (vmesh::LocalID n=0; n<cell->get_number_of_velocity_blocks(popID); ++n) {
-            // Get the volume of a velocity cell
-            const Real DV3
-            = parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVX]
-            * parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVY]
-            * parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVZ];
-            // Get the velocity cell indices of the cells that are a part of the backstream population
-            vector< array<uint, 3> > vCellIndices;
-            vCellIndices.clear();
-            // Save indices to the std::vector
-            if( calculateBackstream == true ) {
-               getBackstreamVelocityCellIndices(&parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS], vCellIndices, popID);
-            } else {
-               getNonBackstreamVelocityCellIndices(&parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS], vCellIndices, popID);
-            }
-            // We have now fethced all of the needed velocity cell indices, so now go through them:
-            for( vector< array<uint, 3> >::const_iterator it = vCellIndices.begin(); it != vCellIndices.end(); ++it ) {
-               // Get the indices of the current iterated velocity cell
-               const array<uint, 3> indices = *it;
-               const uint i = indices[0];
-               const uint j = indices[1];
-               const uint k = indices[2];
-               // Get the coordinates of the velocity cell (e.g. VX = block_vx_min_coordinates + (velocity_cell_indice_x+0.5)*length_of_velocity_cell_in_x_direction)
-               const Real VX = parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::VXCRD] + (i + HALF) * parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVX];
-               const Real VY = parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::VYCRD] + (j + HALF) * parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVY];
-               const Real VZ = parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::VZCRD] + (k + HALF) * parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVZ];
-               // Add the value of the coordinates and multiply by the AVGS value of the velocity cell and the volume of the velocity cell
-               thread_nvx_sum += block_data[n * SIZE_VELBLOCK + cellIndex(i,j,k)]*VX*DV3;
-               thread_nvy_sum += block_data[n * SIZE_VELBLOCK + cellIndex(i,j,k)]*VY*DV3;
-               thread_nvz_sum += block_data[n * SIZE_VELBLOCK + cellIndex(i,j,k)]*VZ*DV3;
-               thread_n_sum += block_data[n * SIZE_VELBLOCK + cellIndex(i,j,k)]*DV3;
-            }
-         } // for-loop over velocity blocks
-
-         // Accumulate contributions coming from this velocity block.
-         // If multithreading / OpenMP is used, 
-         // these updates need to be atomic:
-         # pragma omp critical
-         {
-            V[0] += thread_nvx_sum;
-            V[1] += thread_nvy_sum;
-            V[2] += thread_nvz_sum;
-            n += thread_n_sum;
-         }
-      }
-
-      // Finally, divide n*V by V.
-      V[0]/=n;
-      V[1]/=n;
-      V[2]/=n;
-      return;
-   }
-
-   static void PTensorDiagonalBackstreamCalculations( const SpatialCell * cell,
-                                                      const bool calculateBackstream,
-                                                      const Real averageVX,
-                                                      const Real averageVY,
-                                                      const Real averageVZ,
-                                                      cuint popID,
-                                                      Real * PTensor ) {
-      const Real HALF = 0.5;
-      # pragma omp parallel
-      {
-         Real thread_nvxvx_sum = 0.0;
-         Real thread_nvyvy_sum = 0.0;
-         Real thread_nvzvz_sum = 0.0;
-         
-         const Real* parameters = cell->get_block_parameters(popID);
-         const Realf* block_data = cell->get_data(popID);
-      
-         # pragma omp for
-         for (vmesh::LocalID n=0; n<cell->get_number_of_velocity_blocks(popID); ++n) {
-            const Real DV3
-            = parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVX]
-            * parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVY]
-            * parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVZ];
-            vector< array<uint, 3> > vCellIndices;
-            vCellIndices.clear();
-            if( calculateBackstream == true ) {
-               getBackstreamVelocityCellIndices(&parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS], vCellIndices, popID);
-            } else {
-               getNonBackstreamVelocityCellIndices(&parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS], vCellIndices, popID);
-            }
-            for( vector< array<uint, 3> >::const_iterator it = vCellIndices.begin(); it != vCellIndices.end(); ++it ) {
-               //Go through every velocity cell:
-               const array<uint, 3> indices = *it;
-               const uint i = indices[0];
-               const uint j = indices[1];
-               const uint k = indices[2];
-               const Real VX = parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::VXCRD] + (i + HALF) * parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVX];
-               const Real VY = parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::VYCRD] + (j + HALF) * parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVY];
-               const Real VZ = parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::VZCRD] + (k + HALF) * parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVZ];
-               thread_nvxvx_sum += block_data[n * SIZE_VELBLOCK + cellIndex(i,j,k)] * (VX - averageVX) * (VX - averageVX) * DV3;
-               thread_nvyvy_sum += block_data[n * SIZE_VELBLOCK + cellIndex(i,j,k)] * (VY - averageVY) * (VY - averageVY) * DV3;
-               thread_nvzvz_sum += block_data[n * SIZE_VELBLOCK + cellIndex(i,j,k)] * (VZ - averageVZ) * (VZ - averageVZ) * DV3;
-            }
-         }
-         thread_nvxvx_sum *= getObjectWrapper().particleSpecies[popID].mass;
-         thread_nvyvy_sum *= getObjectWrapper().particleSpecies[popID].mass;
-         thread_nvzvz_sum *= getObjectWrapper().particleSpecies[popID].mass;
-
-         // Accumulate contributions coming from this velocity block to the 
-         // spatial cell velocity moments. If multithreading / OpenMP is used, 
-         // these updates need to be atomic:
-         # pragma omp critical
-         {
-            PTensor[0] += thread_nvxvx_sum;
-            PTensor[1] += thread_nvyvy_sum;
-            PTensor[2] += thread_nvzvz_sum;
-         }
-      }
-      return;
-   }
 
-   static void PTensorOffDiagonalBackstreamCalculations( const SpatialCell * cell,
-                                                         const bool calculateBackstream,
-                                                         const Real averageVX,
-                                                         const Real averageVY,
-                                                         const Real averageVZ,
-                                                         cuint popID,
-                                                         Real * PTensor ) {
-      const Real HALF = 0.5;
-      # pragma omp parallel
-      {
-         Real thread_nvxvy_sum = 0.0;
-         Real thread_nvzvx_sum = 0.0;
-         Real thread_nvyvz_sum = 0.0;
-         
-         const Real* parameters = cell->get_block_parameters(popID);
-         const Realf* block_data = cell->get_data(popID);
-      
-         # pragma omp for
-         for (vmesh::LocalID n=0; n<cell->get_number_of_velocity_blocks(popID); ++n) {
-            const Real DV3
-            = parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVX]
-            * parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVY]
-            * parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVZ];
-            vector< array<uint, 3> > vCellIndices;
-            if( calculateBackstream == true ) {
-               getBackstreamVelocityCellIndices(&parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS], vCellIndices, popID);
-            } else {
-               getNonBackstreamVelocityCellIndices(&parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS], vCellIndices, popID);
-            }
-            for( vector< array<uint, 3> >::const_iterator it = vCellIndices.begin(); it != vCellIndices.end(); ++it ) {
-               //Go through every velocity cell:
-               const array<uint, 3> indices = *it;
-               const uint i = indices[0];
-               const uint j = indices[1];
-               const uint k = indices[2];
-               const Real VX = parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::VXCRD] + (i + HALF) * parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVX];
-               const Real VY = parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::VYCRD] + (j + HALF) * parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVY];
-               const Real VZ = parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::VZCRD] + (k + HALF) * parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVZ];
-               thread_nvxvy_sum += block_data[n * SIZE_VELBLOCK + cellIndex(i,j,k)] * (VX - averageVX) * (VY - averageVY) * DV3;
-               thread_nvzvx_sum += block_data[n * SIZE_VELBLOCK + cellIndex(i,j,k)] * (VZ - averageVZ) * (VX - averageVX) * DV3;
-               thread_nvyvz_sum += block_data[n * SIZE_VELBLOCK + cellIndex(i,j,k)] * (VY - averageVY) * (VZ - averageVZ) * DV3;
-            }
-         }
-         thread_nvxvy_sum *= getObjectWrapper().particleSpecies[popID].mass;
-         thread_nvzvx_sum *= getObjectWrapper().particleSpecies[popID].mass;
-         thread_nvyvz_sum *= getObjectWrapper().particleSpecies[popID].mass;
-         
-         // Accumulate contributions coming from this velocity block to the 
-         // spatial cell velocity moments. If multithreading / OpenMP is used, 
-         // these updates need to be atomic:
-         # pragma omp critical
-         {
-            PTensor[0] += thread_nvyvz_sum;
-            PTensor[1] += thread_nvzvx_sum;
-            PTensor[2] += thread_nvxvy_sum;
-         }
-      }
+   /** Copy values computed by the fused velocity space reductions into an output buffer.
+    * @return False if the fused values are not available for this cell, in which case the
+    * operator has to compute the values itself.
+    */
+   static bool copyFusedMoments(const FusedVelocityMoments* moments,
+                                const SpatialCell* cell,
+                                cuint popID,
+                                const VelocityMoments::Group group,
+                                const int firstValue,
+                                const int nValues,
+                                char* buffer) {
+      if (moments == NULL) return false;
+      const Real* values = moments->get(cell,popID,group);
+      if (values == NULL) return false;
+      const char* ptr = reinterpret_cast<const char*>(values + firstValue);
+      for (uint i = 0; i < nValues*sizeof(Real); ++i) buffer[i] = ptr[i];
+      return true;
    }
 
-  /********* 
-	     End velocity moment / backstream/non-backstreamn helper functions
-  *********/
-
-
    VariableMeshData::VariableMeshData(): DataReductionOperatorHandlesWriting() { }
    VariableMeshData::~VariableMeshData() { }
    
@@ -1110,7 +737,6 @@ namespace DRO {
       return true;
    }
    
-   bool VariableMeshData::setSpatialCell(const SpatialCell* cell) {return true;}
    
    bool VariableMeshData::writeData(const dccrg::Dccrg<spatial_cell::SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
                                     const std::vector<CellID>& cells,const std::string& meshName,
@@ -1143,9 +769,10 @@ namespace DRO {
    }
    
    // Rho backstream:
-   VariableRhoBackstream::VariableRhoBackstream(cuint _popID): DataReductionOperator(),popID(_popID) {
+   VariableRhoBackstream::VariableRhoBackstream(cuint _popID,FusedVelocityMoments* _moments): DataReductionOperator(),popID(_popID),moments(_moments) {
       popName = getObjectWrapper().particleSpecies[popID].name;
       doSkip = (getObjectWrapper().particleSpecies[popID].backstreamRadius == 0.0) ? true : false;
+      if (moments != NULL && doSkip == false) _moments->request(popID,VelocityMoments::BACKSTREAM);
    }
    VariableRhoBackstream::~VariableRhoBackstream() { }
    
@@ -1160,23 +787,22 @@ namespace DRO {
    
    // Adding rho backstream calculations to Vlasiator.
    bool VariableRhoBackstream::reduceData(const SpatialCell* cell,char* buffer) {
+      if (copyFusedMoments(moments,cell,popID,VelocityMoments::BACKSTREAM,VelocityMoments::RHO,1,buffer) == true) return true;
       const bool calculateBackstream = true;
-      rhoBackstreamCalculation( cell, calculateBackstream, popID, RhoBackstream );
+      Real RhoBackstream = 0.0;
+      rhoBackstreamCalculation( cell, calculateBackstream, getObjectWrapper().particleSpecies[popID], popID, RhoBackstream );
       const char* ptr = reinterpret_cast<const char*>(&RhoBackstream);
       for (uint i = 0; i < sizeof(Real); ++i) buffer[i] = ptr[i];
       return true;
    }
    
-   bool VariableRhoBackstream::setSpatialCell(const SpatialCell* cell) {
-      RhoBackstream = 0.0;
-      return true;
-   }
 
 
    // Rho non backstream:
-   VariableRhoNonBackstream::VariableRhoNonBackstream(cuint _popID): DataReductionOperator(),popID(_popID) {
+   VariableRhoNonBackstream::VariableRhoNonBackstream(cuint _popID,FusedVelocityMoments* _moments): DataReductionOperator(),popID(_popID),moments(_moments) {
       popName = getObjectWrapper().particleSpecies[popID].name;
       doSkip = (getObjectWrapper().particleSpecies[popID].backstreamRadius == 0.0) ? true : false;
+      if (moments != NULL && doSkip == false) _moments->request(popID,VelocityMoments::NONBACKSTREAM);
    }
    VariableRhoNonBackstream::~VariableRhoNonBackstream() { }
    
@@ -1191,22 +817,21 @@ namespace DRO {
    
    // Rho non backstream calculation.
    bool VariableRhoNonBackstream::reduceData(const SpatialCell* cell,char* buffer) {
+      if (copyFusedMoments(moments,cell,popID,VelocityMoments::NONBACKSTREAM,VelocityMoments::RHO,1,buffer) == true) return true;
       const bool calculateBackstream = false; //We don't want backstream
-      rhoBackstreamCalculation( cell, calculateBackstream, popID, Rho );
+      Real Rho = 0.0;
+      rhoBackstreamCalculation( cell, calculateBackstream, getObjectWrapper().particleSpecies[popID], popID, Rho );
       const char* ptr = reinterpret_cast<const char*>(&Rho);
       for (uint i = 0; i < sizeof(Real); ++i) buffer[i] = ptr[i];
       return true;
    }
    
-   bool VariableRhoNonBackstream::setSpatialCell(const SpatialCell* cell) {
-      Rho = 0.0;
-      return true;
-   }
 
    // v backstream:
-   VariableVBackstream::VariableVBackstream(cuint _popID): DataReductionOperator(),popID(_popID) {
+   VariableVBackstream::VariableVBackstream(cuint _popID,FusedVelocityMoments* _moments): DataReductionOperator(),popID(_popID),moments(_moments) {
       popName = getObjectWrapper().particleSpecies[popID].name;
       doSkip = (getObjectWrapper().particleSpecies[popID].backstreamRadius == 0.0) ? true : false;
+      if (moments != NULL && doSkip == false) _moments->request(popID,VelocityMoments::BACKSTREAM);
    }
    VariableVBackstream::~VariableVBackstream() { }
    
@@ -1221,27 +846,23 @@ namespace DRO {
 
    // Adding v backstream calculations to Vlasiator.
    bool VariableVBackstream::reduceData(const SpatialCell* cell,char* buffer) {
+      if (copyFusedMoments(moments,cell,popID,VelocityMoments::BACKSTREAM,VelocityMoments::VX,3,buffer) == true) return true;
       const bool calculateBackstream = true;
       //Calculate v backstream
-      VBackstreamCalculation( cell, calculateBackstream, popID, VBackstream );
+      Real VBackstream[3];
+      VBackstreamCalculation( cell, calculateBackstream, getObjectWrapper().particleSpecies[popID], popID, VBackstream );
       const uint VBackstreamSize = 3;
       const char* ptr = reinterpret_cast<const char*>(&VBackstream);
       for (uint i = 0; i < VBackstreamSize*sizeof(Real); ++i) buffer[i] = ptr[i];
       return true;
    }
    
-   bool VariableVBackstream::setSpatialCell(const SpatialCell* cell) {
-      // Initialize values
-      for( uint i = 0; i < 3; ++i ) {
-         VBackstream[i] = 0.0;
-      }
-      return true;
-   }
 
    //v non backstream:
-   VariableVNonBackstream::VariableVNonBackstream(cuint _popID): DataReductionOperator(),popID(_popID) {
+   VariableVNonBackstream::VariableVNonBackstream(cuint _popID,FusedVelocityMoments* _moments): DataReductionOperator(),popID(_popID),moments(_moments) {
       popName = getObjectWrapper().particleSpecies[popID].name;
       doSkip = (getObjectWrapper().particleSpecies[popID].backstreamRadius == 0.0) ? true : false;
+      if (moments != NULL && doSkip == false) _moments->request(popID,VelocityMoments::NONBACKSTREAM);
    }
    VariableVNonBackstream::~VariableVNonBackstream() { }
    
@@ -1256,22 +877,17 @@ namespace DRO {
 
    // Adding v non backstream calculations to Vlasiator.
    bool VariableVNonBackstream::reduceData(const SpatialCell* cell,char* buffer) {
+      if (copyFusedMoments(moments,cell,popID,VelocityMoments::NONBACKSTREAM,VelocityMoments::VX,3,buffer) == true) return true;
       const bool calculateBackstream = false;
       //Calculate v backstream
-      VBackstreamCalculation( cell, calculateBackstream, popID, V );
+      Real V[3];
+      VBackstreamCalculation( cell, calculateBackstream, getObjectWrapper().particleSpecies[popID], popID, V );
       const uint vectorSize = 3;
       const char* ptr = reinterpret_cast<const char*>(&V);
       for (uint i = 0; i < vectorSize*sizeof(Real); ++i) buffer[i] = ptr[i];
       return true;
    }
    
-   bool VariableVNonBackstream::setSpatialCell(const SpatialCell* cell) {
-      // Initialize values
-      for( uint i = 0; i < 3; ++i ) {
-         V[i] = 0.0;
-      }
-      return true;
-   }
 
    // Adding pressure calculations for backstream population to Vlasiator.
    // p_ij = m/3 * integral((v - <V>)_i(v - <V>)_j * f(r,v) dV)
@@ -1279,9 +895,10 @@ namespace DRO {
    // Pressure tensor 6 components (11, 22, 33, 23, 13, 12) added by YK
    // Split into VariablePTensorBackstreamDiagonal (11, 22, 33)
    // and VariablePTensorOffDiagonal (23, 13, 12)
-   VariablePTensorBackstreamDiagonal::VariablePTensorBackstreamDiagonal(cuint _popID): DataReductionOperator(),popID(_popID) {
+   VariablePTensorBackstreamDiagonal::VariablePTensorBackstreamDiagonal(cuint _popID,FusedVelocityMoments* _moments): DataReductionOperator(),popID(_popID),moments(_moments) {
       popName = getObjectWrapper().particleSpecies[popID].name;
       doSkip = (getObjectWrapper().particleSpecies[popID].backstreamRadius == 0.0) ? true : false;
+      if (moments != NULL && doSkip == false) _moments->request(popID,VelocityMoments::BACKSTREAM);
    }
    VariablePTensorBackstreamDiagonal::~VariablePTensorBackstreamDiagonal() { }
    
@@ -1295,9 +912,17 @@ namespace DRO {
    }
    
    bool VariablePTensorBackstreamDiagonal::reduceData(const SpatialCell* cell,char* buffer) {
+      if (copyFusedMoments(moments,cell,popID,VelocityMoments::BACKSTREAM,VelocityMoments::P_11,3,buffer) == true) return true;
       const bool calculateBackstream = true;
+      //Get v of the backstream and use it as the average velocity:
+      Real V[3] = {0};
+      VBackstreamCalculation( cell, calculateBackstream, getObjectWrapper().particleSpecies[popID], popID, V );
+      const Real averageVX = V[0];
+      const Real averageVY = V[1];
+      const Real averageVZ = V[2];
+      Real PTensor[3] = {0.0, 0.0, 0.0};
       //Calculate PTensor and save it in PTensorArray:
-      PTensorDiagonalBackstreamCalculations( cell, calculateBackstream, averageVX, averageVY, averageVZ, popID, PTensor );
+      PTensorDiagonalBackstreamCalculations( cell, calculateBackstream, averageVX, averageVY, averageVZ, getObjectWrapper().particleSpecies[popID], popID, PTensor );
       const uint vectorSize = 3;
       //Save the data into buffer:
       const char* ptr = reinterpret_cast<const char*>(&PTensor);
@@ -1305,19 +930,6 @@ namespace DRO {
       return true;
    }
    
-   bool VariablePTensorBackstreamDiagonal::setSpatialCell(const SpatialCell* cell) {
-      //Get v of the backstream:
-      Real V[3] = {0};
-      const bool calculateBackstream = true; //We are calculating backstream
-      VBackstreamCalculation( cell, calculateBackstream, popID, V );
-      //Set the average velocities:
-      averageVX = V[0];
-      averageVY = V[1];
-      averageVZ = V[2];
-      const uint vectorSize = 3;
-      for(uint i = 0; i < vectorSize; i++) PTensor[i] = 0.0;
-      return true;
-   }
 
    // Adding pressure calculations for backstream population to Vlasiator.
    // p_ij = m/3 * integral((v - <V>)_i(v - <V>)_j * f(r,v) dV)
@@ -1325,9 +937,10 @@ namespace DRO {
    // Pressure tensor 6 components (11, 22, 33, 23, 13, 12) added by YK
    // Split into VariablePTensorNonBackstreamDiagonal (11, 22, 33)
    // and VariablePTensorOffDiagonal (23, 13, 12)
-   VariablePTensorNonBackstreamDiagonal::VariablePTensorNonBackstreamDiagonal(cuint _popID): DataReductionOperator(),popID(_popID) {
+   VariablePTensorNonBackstreamDiagonal::VariablePTensorNonBackstreamDiagonal(cuint _popID,FusedVelocityMoments* _moments): DataReductionOperator(),popID(_popID),moments(_moments) {
       popName = getObjectWrapper().particleSpecies[popID].name;
       doSkip = (getObjectWrapper().particleSpecies[popID].backstreamRadius == 0.0) ? true : false;
+      if (moments != NULL && doSkip == false) _moments->request(popID,VelocityMoments::NONBACKSTREAM);
    }
    VariablePTensorNonBackstreamDiagonal::~VariablePTensorNonBackstreamDiagonal() { }
    
@@ -1341,9 +954,17 @@ namespace DRO {
    }
    
    bool VariablePTensorNonBackstreamDiagonal::reduceData(const SpatialCell* cell,char* buffer) {
+      if (copyFusedMoments(moments,cell,popID,VelocityMoments::NONBACKSTREAM,VelocityMoments::P_11,3,buffer) == true) return true;
       const bool calculateBackstream = false;
+      //Get v of the non-backstream and use it as the average velocity:
+      Real V[3] = {0};
+      VBackstreamCalculation( cell, calculateBackstream, getObjectWrapper().particleSpecies[popID], popID, V );
+      const Real averageVX = V[0];
+      const Real averageVY = V[1];
+      const Real averageVZ = V[2];
+      Real PTensor[3] = {0.0, 0.0, 0.0};
       //Calculate PTensor and save it in PTensorArray:
-      PTensorDiagonalBackstreamCalculations( cell, calculateBackstream, averageVX, averageVY, averageVZ, popID, PTensor );
+      PTensorDiagonalBackstreamCalculations( cell, calculateBackstream, averageVX, averageVY, averageVZ, getObjectWrapper().particleSpecies[popID], popID, PTensor );
       const uint vectorSize = 3;
       //Save the data into buffer:
       const char* ptr = reinterpret_cast<const char*>(&PTensor);
@@ -1351,23 +972,11 @@ namespace DRO {
       return true;
    }
    
-   bool VariablePTensorNonBackstreamDiagonal::setSpatialCell(const SpatialCell* cell) {
-      //Get v of the backstream:
-      Real V[3] = {0};
-      const bool calculateBackstream = false; //We are not calculating backstream
-      VBackstreamCalculation( cell, calculateBackstream, popID, V );
-      //Set the average velocities:
-      averageVX = V[0];
-      averageVY = V[1];
-      averageVZ = V[2];
-      const uint vectorSize = 3;
-      for(uint i = 0; i < vectorSize; i++) PTensor[i] = 0.0;
-      return true;
-   }
 
-   VariablePTensorBackstreamOffDiagonal::VariablePTensorBackstreamOffDiagonal(cuint _popID): DataReductionOperator(),popID(_popID) {
+   VariablePTensorBackstreamOffDiagonal::VariablePTensorBackstreamOffDiagonal(cuint _popID,FusedVelocityMoments* _moments): DataReductionOperator(),popID(_popID),moments(_moments) {
       popName = getObjectWrapper().particleSpecies[popID].name;
       doSkip = (getObjectWrapper().particleSpecies[popID].backstreamRadius == 0.0) ? true : false;
+      if (moments != NULL && doSkip == false) _moments->request(popID,VelocityMoments::BACKSTREAM);
    }
    VariablePTensorBackstreamOffDiagonal::~VariablePTensorBackstreamOffDiagonal() { }
    
@@ -1381,10 +990,18 @@ namespace DRO {
    }
    
    bool VariablePTensorBackstreamOffDiagonal::reduceData(const SpatialCell* cell,char* buffer) {
+      if (copyFusedMoments(moments,cell,popID,VelocityMoments::BACKSTREAM,VelocityMoments::P_23,3,buffer) == true) return true;
       //Calculate PTensor for PTensorArray:
       const bool calculateBackstream = true;
+      //Get v of the backstream and use it as the average velocity:
+      Real V[3] = {0};
+      VBackstreamCalculation( cell, calculateBackstream, getObjectWrapper().particleSpecies[popID], popID, V );
+      const Real averageVX = V[0];
+      const Real averageVY = V[1];
+      const Real averageVZ = V[2];
+      Real PTensor[3] = {0.0, 0.0, 0.0};
       //Calculate and save:
-      PTensorOffDiagonalBackstreamCalculations( cell, calculateBackstream, averageVX, averageVY, averageVZ, popID, PTensor );
+      PTensorOffDiagonalBackstreamCalculations( cell, calculateBackstream, averageVX, averageVY, averageVZ, getObjectWrapper().particleSpecies[popID], popID, PTensor );
       const uint vectorSize = 3;
       //Input data into buffer
       const char* ptr = reinterpret_cast<const char*>(&PTensor);
@@ -1392,22 +1009,11 @@ namespace DRO {
       return true;
    }
    
-   bool VariablePTensorBackstreamOffDiagonal::setSpatialCell(const SpatialCell* cell) {
-      //Get v of the backstream:
-      Real V[3] = {0};
-      const bool calculateBackstream = true; //We are calculating backstream
-      VBackstreamCalculation( cell, calculateBackstream, popID, V );
-      //Set the average velocities:
-      averageVX = V[0];
-      averageVY = V[1];
-      averageVZ = V[2];
-      for(int i = 0; i < 3; i++) PTensor[i] = 0.0;
-      return true;
-   }
 
-   VariablePTensorNonBackstreamOffDiagonal::VariablePTensorNonBackstreamOffDiagonal(cuint _popID): DataReductionOperator(),popID(_popID) {
+   VariablePTensorNonBackstreamOffDiagonal::VariablePTensorNonBackstreamOffDiagonal(cuint _popID,FusedVelocityMoments* _moments): DataReductionOperator(),popID(_popID),moments(_moments) {
       popName = getObjectWrapper().particleSpecies[popID].name;
       doSkip = (getObjectWrapper().particleSpecies[popID].backstreamRadius == 0.0) ? true : false;
+      if (moments != NULL && doSkip == false) _moments->request(popID,VelocityMoments::NONBACKSTREAM);
    }
    VariablePTensorNonBackstreamOffDiagonal::~VariablePTensorNonBackstreamOffDiagonal() { }
    
@@ -1421,10 +1027,18 @@ namespace DRO {
    }
    
    bool VariablePTensorNonBackstreamOffDiagonal::reduceData(const SpatialCell* cell,char* buffer) {
+      if (copyFusedMoments(moments,cell,popID,VelocityMoments::NONBACKSTREAM,VelocityMoments::P_23,3,buffer) == true) return true;
       //Calculate PTensor for PTensorArray:
       const bool calculateBackstream = false;
+      //Get v of the non-backstream and use it as the average velocity:
+      Real V[3] = {0};
+      VBackstreamCalculation( cell, calculateBackstream, getObjectWrapper().particleSpecies[popID], popID, V );
+      const Real averageVX = V[0];
+      const Real averageVY = V[1];
+      const Real averageVZ = V[2];
+      Real PTensor[3] = {0.0, 0.0, 0.0};
       //Calculate and save:
-      PTensorOffDiagonalBackstreamCalculations( cell, calculateBackstream, averageVX, averageVY, averageVZ, popID, PTensor );
+      PTensorOffDiagonalBackstreamCalculations( cell, calculateBackstream, averageVX, averageVY, averageVZ, getObjectWrapper().particleSpecies[popID], popID, PTensor );
       const uint vectorSize = 3;
       //Input data into buffer
       const char* ptr = reinterpret_cast<const char*>(&PTensor);
@@ -1432,18 +1046,6 @@ namespace DRO {
       return true;
    }
    
-   bool VariablePTensorNonBackstreamOffDiagonal::setSpatialCell(const SpatialCell* cell) {
-      //Get v of the backstream:
-      Real V[3] = {0};
-      const bool calculateBackstream = false; //We are not calculating backstream
-      VBackstreamCalculation( cell, calculateBackstream, popID, V );
-      //Set the average velocities:
-      averageVX = V[0];
-      averageVY = V[1];
-      averageVZ = V[2];
-      for(int i = 0; i < 3; i++) PTensor[i] = 0.0;
-      return true;
-   }
 
 
    VariableEffectiveSparsityThreshold::VariableEffectiveSparsityThreshold(cuint _popID): DataReductionOperator(),popID(_popID) { 
@@ -1473,9 +1075,6 @@ namespace DRO {
       return true;
    }
 
-   bool VariableEffectiveSparsityThreshold::setSpatialCell(const spatial_cell::SpatialCell* cell) {
-      return true;
-   }
 
    /*! \brief Precipitation directional differential number flux
     * Evaluation of the precipitating differential flux (per population).
@@ -1509,7 +1108,7 @@ namespace DRO {
 
    bool VariablePrecipitationDiffFlux::reduceData(const SpatialCell* cell,char* buffer) {
 
-      dataDiffFlux.assign(nChannels,0.0);
+      std::vector<Real> dataDiffFlux(nChannels,0.0);
 
       std::vector<Real> sumWeights(nChannels,0.0);
 
@@ -1600,9 +1199,6 @@ namespace DRO {
       return true;
    }
 
-   bool VariablePrecipitationDiffFlux::setSpatialCell(const SpatialCell* cell) {
-      return true;
-   }
 
    bool VariablePrecipitationDiffFlux::writeParameters(vlsv::Writer& vlsvWriter) {
       for (int i=0; i<nChannels; i++) {
@@ -1627,12 +1223,13 @@ namespace DRO {
     *    - EnergyDensityELimit2 (as scalar multiplier of EnergyDensityESW).
     */
 
-   VariableEnergyDensity::VariableEnergyDensity(cuint _popID): DataReductionOperatorHasParameters(),popID(_popID) {
+   VariableEnergyDensity::VariableEnergyDensity(cuint _popID,FusedVelocityMoments* _moments): DataReductionOperatorHasParameters(),popID(_popID),moments(_moments) {
       popName = getObjectWrapper().particleSpecies[popID].name;
       // Store internally in SI units
       solarwindenergy = getObjectWrapper().particleSpecies[popID].SolarWindEnergy;
       E1limit = solarwindenergy * getObjectWrapper().particleSpecies[popID].EnergyDensityLimit1;
       E2limit = solarwindenergy * getObjectWrapper().particleSpecies[popID].EnergyDensityLimit2;
+      if (moments != NULL) _moments->request(popID,VelocityMoments::ENERGYDENSITY);
    }
    VariableEnergyDensity::~VariableEnergyDensity() { }
    
@@ -1646,65 +1243,14 @@ namespace DRO {
    }
    
    bool VariableEnergyDensity::reduceData(const SpatialCell* cell,char* buffer) {
-      const Real HALF = 0.5;
-      for(int i = 0; i < 3; i++) {
-	 EDensity[i] = 0.0;
-      }
-      # pragma omp parallel
-      {
-         Real thread_E0_sum = 0.0;
-         Real thread_E1_sum = 0.0;
-         Real thread_E2_sum = 0.0;
-         
-         const Real* parameters  = cell->get_block_parameters(popID);
-         const Realf* block_data = cell->get_data(popID);
-        
-         # pragma omp for
-         for (vmesh::LocalID n=0; n<cell->get_number_of_velocity_blocks(popID); n++) {
-	    const Real DV3 
-	       = parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVX]
-	       * parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVY] 
-	       * parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVZ];
-	    for (uint k = 0; k < WID; ++k) for (uint j = 0; j < WID; ++j) for (uint i = 0; i < WID; ++i) {
-	       const Real VX 
-		  =          parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::VXCRD] 
-		  + (i + HALF)*parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVX];
-	       const Real VY 
-		  =          parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::VYCRD] 
-		  + (j + HALF)*parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVY];
-	       const Real VZ 
-		  =          parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::VZCRD] 
-		  + (k + HALF)*parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVZ];
-	       
-	       const Real ENERGY = (VX*VX + VY*VY + VZ*VZ) * HALF * getObjectWrapper().particleSpecies[popID].mass;
-	       thread_E0_sum += block_data[n * SIZE_VELBLOCK+cellIndex(i,j,k)] * ENERGY * DV3;
-	       if (ENERGY > E1limit) thread_E1_sum += block_data[n * SIZE_VELBLOCK+cellIndex(i,j,k)] * ENERGY * DV3;
-	       if (ENERGY > E2limit) thread_E2_sum += block_data[n * SIZE_VELBLOCK+cellIndex(i,j,k)] * ENERGY * DV3;
-	    }
-         }
-         // Accumulate contributions coming from this velocity block to the 
-         // spatial cell velocity moments. If multithreading / OpenMP is used, 
-         // these updates need to be atomic:
-         # pragma omp critical
-         {
-            EDensity[0] += thread_E0_sum;
-            EDensity[1] += thread_E1_sum;
-            EDensity[2] += thread_E2_sum;
-         }
-
-      }
-      // Output energy density in units eV/cm^3 instead of Joules per m^3
-      EDensity[0] *= (1.0e-6)/physicalconstants::CHARGE;
-      EDensity[1] *= (1.0e-6)/physicalconstants::CHARGE;
-      EDensity[2] *= (1.0e-6)/physicalconstants::CHARGE;
+      if (copyFusedMoments(moments,cell,popID,VelocityMoments::ENERGYDENSITY,0,3,buffer) == true) return true;
+      Real EDensity[3] = {0.0, 0.0, 0.0};
+      energyDensityCalculation( cell, E1limit, E2limit, getObjectWrapper().particleSpecies[popID], popID, EDensity );
       const char* ptr = reinterpret_cast<const char*>(&EDensity);
       for (uint i = 0; i < 3*sizeof(Real); ++i) buffer[i] = ptr[i];
       return true;
    }
    
-   bool VariableEnergyDensity::setSpatialCell(const SpatialCell* cell) {
-      return true;
-   }
 
    bool VariableEnergyDensity::writeParameters(vlsv::Writer& vlsvWriter) {
       // Output solar wind energy in eV
@@ -32,6 +32,7 @@
 #include "../definitions.h"
 #include "../spatial_cell.hpp"
 #include "../parameters.h"
+#include "dro_velocitymoments.h"
 using namespace spatial_cell;
 
 namespace DRO {
@@ -47,7 +48,11 @@ namespace DRO {
     * If needed, a user can write his or her own DRO::DataReductionOperators, which 
     * are loaded when the simulation initializes.
     *
-    * Datareduction oeprators are not thread-safe, some of the more intensive ones are threaded within. 
+    * Datareduction operators are reentrant: all per-cell state lives on the stack of reduceData 
+    * and reduceDiagnostic, so one operator may reduce different cells from several threads at 
+    * once. setSpatialCell may only validate the cell, it must not store anything in the operator. 
+    * Some of the more intensive ones are also threaded within, these inner regions run serially 
+    * when the caller is already parallelised over cells.
     */
 
    class DataReductionOperator {
@@ -59,7 +64,7 @@ namespace DRO {
       virtual std::string getName() const = 0;
       virtual bool reduceData(const SpatialCell* cell,char* buffer);
       virtual bool reduceDiagnostic(const SpatialCell* cell,Real * result);
-      virtual bool setSpatialCell(const SpatialCell* cell) = 0;
+      virtual bool setSpatialCell(const SpatialCell* cell);
       
    protected:
    
@@ -94,19 +99,21 @@ namespace DRO {
       uint _parameterIndex;
       uint vectorSize;
       std::string variableName;
-      const Real *data;
+      virtual const Real* getCellData(const SpatialCell* cell) const;
    };
 
    class DataReductionOperatorDerivatives: public DataReductionOperatorCellParams {
    public:
       DataReductionOperatorDerivatives(const std::string& name,const unsigned int parameterIndex,const unsigned int vectorSize);
-      virtual bool setSpatialCell(const SpatialCell* cell);
+   protected:
+      virtual const Real* getCellData(const SpatialCell* cell) const;
    };
    
    class DataReductionOperatorBVOLDerivatives: public DataReductionOperatorCellParams {
    public:
       DataReductionOperatorBVOLDerivatives(const std::string& name,const unsigned int parameterIndex,const unsigned int vectorSize);
-      virtual bool setSpatialCell(const SpatialCell* cell);
+   protected:
+      virtual const Real* getCellData(const SpatialCell* cell) const;
    };
    
    class MPIrank: public DataReductionOperator {
@@ -117,10 +124,8 @@ namespace DRO {
       virtual bool getDataVectorInfo(std::string& dataType,unsigned int& dataSize,unsigned int& vectorSize) const;
       virtual std::string getName() const;
       virtual bool reduceData(const SpatialCell* cell,char* buffer);
-      virtual bool setSpatialCell(const SpatialCell* cell);
       
    protected:
-      Real rank;
       int mpiRank;
    };
 
@@ -132,11 +137,6 @@ namespace DRO {
       virtual bool getDataVectorInfo(std::string& dataType,unsigned int& dataSize,unsigned int& vectorSize) const;
       virtual std::string getName() const;
       virtual bool reduceData(const SpatialCell* cell,char* buffer);
-      virtual bool setSpatialCell(const SpatialCell* cell);
-      
-   protected:
-      Real rank;
-      int fsgridRank;
    };
 
    class FsGridBoundaryType: public DataReductionOperator {
@@ -147,11 +147,6 @@ namespace DRO {
       virtual bool getDataVectorInfo(std::string& dataType,unsigned int& dataSize,unsigned int& vectorSize) const;
       virtual std::string getName() const;
       virtual bool reduceData(const SpatialCell* cell,char* buffer);
-      virtual bool setSpatialCell(const SpatialCell* cell);
-      
-   protected:
-      Real rank;
-      int fsgridBoundaryType;
    };
    
    class BoundaryType: public DataReductionOperator {
@@ -162,10 +157,6 @@ namespace DRO {
       virtual bool getDataVectorInfo(std::string& dataType,unsigned int& dataSize,unsigned int& vectorSize) const;
       virtual std::string getName() const;
       virtual bool reduceData(const SpatialCell* cell,char* buffer);
-      virtual bool setSpatialCell(const SpatialCell* cell);
-      
-   protected:
-      int boundaryType;
    };
 
    class BoundaryLayer: public DataReductionOperator {
@@ -176,10 +167,6 @@ namespace DRO {
       virtual bool getDataVectorInfo(std::string& dataType,unsigned int& dataSize,unsigned int& vectorSize) const;
       virtual std::string getName() const;
       virtual bool reduceData(const SpatialCell* cell,char* buffer);
-      virtual bool setSpatialCell(const SpatialCell* cell);
-      
-   protected:
-      int boundaryLayer;
    };
 
    class Blocks: public DataReductionOperator {
@@ -191,10 +178,8 @@ namespace DRO {
       virtual std::string getName() const;
       virtual bool reduceData(const SpatialCell* cell,char* buffer);
       virtual bool reduceDiagnostic(const SpatialCell* cell,Real* buffer);
-      virtual bool setSpatialCell(const SpatialCell* cell);
       
    protected:
-      uint nBlocks;
       uint popID;
       std::string popName;
    };
@@ -207,10 +192,6 @@ namespace DRO {
       virtual bool getDataVectorInfo(std::string& dataType,unsigned int& dataSize,unsigned int& vectorSize) const;
       virtual std::string getName() const;
       virtual bool reduceData(const SpatialCell* cell,char* buffer);
-      virtual bool setSpatialCell(const SpatialCell* cell);
-      
-   protected:
-      Real B[3];
    };
 
       
@@ -222,10 +203,6 @@ namespace DRO {
       virtual bool getDataVectorInfo(std::string& dataType,unsigned int& dataSize,unsigned int& vectorSize) const;
       virtual std::string getName() const;
       virtual bool reduceData(const SpatialCell* cell,char* buffer);
-      virtual bool setSpatialCell(const SpatialCell* cell);
-      
-   protected:
-      Real B[3];
    };
 
    
@@ -237,10 +214,6 @@ namespace DRO {
       virtual bool getDataVectorInfo(std::string& dataType,unsigned int& dataSize,unsigned int& vectorSize) const;
       virtual std::string getName() const;
       virtual bool reduceData(const SpatialCell* cell,char* buffer);
-      virtual bool setSpatialCell(const SpatialCell* cell);
-      
-   protected:
-      Real Pressure;
    };
    
    class VariablePTensorDiagonal: public DataReductionOperator {
@@ -251,11 +224,8 @@ namespace DRO {
       virtual bool getDataVectorInfo(std::string& dataType,unsigned int& dataSize,unsigned int& vectorSize) const;
       virtual std::string getName() const;
       virtual bool reduceData(const SpatialCell* cell,char* buffer);
-      virtual bool setSpatialCell(const SpatialCell* cell);
       
    protected:
-      Real averageVX, averageVY, averageVZ;
-      Real PTensor[3];
       uint popID;
       std::string popName;
    };
@@ -268,11 +238,8 @@ namespace DRO {
       virtual bool getDataVectorInfo(std::string& dataType,unsigned int& dataSize,unsigned int& vectorSize) const;
       virtual std::string getName() const;
       virtual bool reduceData(const SpatialCell* cell,char* buffer);
-      virtual bool setSpatialCell(const SpatialCell* cell);
       
    protected:
-      Real averageVX, averageVY, averageVZ;
-      Real PTensor[3];
       uint popID;
       std::string popName;
    };
@@ -285,7 +252,6 @@ namespace DRO {
       virtual bool getDataVectorInfo(std::string& dataType,unsigned int& dataSize,unsigned int& vectorSize) const;
       virtual std::string getName() const;
       virtual bool reduceDiagnostic(const SpatialCell* cell,Real* result);
-      virtual bool setSpatialCell(const SpatialCell* cell);
       
    protected:
       
@@ -299,7 +265,6 @@ namespace DRO {
       virtual bool getDataVectorInfo(std::string& dataType,unsigned int& dataSize,unsigned int& vectorSize) const;
       virtual std::string getName() const;
       virtual bool reduceDiagnostic(const SpatialCell* cell,Real* result);
-      virtual bool setSpatialCell(const SpatialCell* cell);
       
    protected:
       
@@ -314,10 +279,8 @@ namespace DRO {
       virtual std::string getName() const;
       virtual bool reduceData(const SpatialCell* cell,char* buffer);
       virtual bool reduceDiagnostic(const SpatialCell* cell,Real *buffer);
-      virtual bool setSpatialCell(const SpatialCell* cell);
       
    protected:
-      Real maxF;
       uint popID;
       std::string popName;
    };
@@ -331,10 +294,8 @@ namespace DRO {
       virtual std::string getName() const;
       virtual bool reduceData(const SpatialCell* cell,char* buffer);
       virtual bool reduceDiagnostic(const SpatialCell* cell,Real *buffer);
-      virtual bool setSpatialCell(const SpatialCell* cell);
       
    protected:
-      Real minF;
       uint popID;
       std::string popName;
    };
@@ -348,7 +309,6 @@ namespace DRO {
       
       virtual bool getDataVectorInfo(std::string& dataType,unsigned int& dataSize,unsigned int& vectorSize) const;
       virtual std::string getName() const;
-      virtual bool setSpatialCell(const SpatialCell* cell);
       virtual bool writeData(const dccrg::Dccrg<spatial_cell::SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
                              const std::vector<CellID>& cells,const std::string& meshName,
                              vlsv::Writer& vlsvWriter);
@@ -359,141 +319,129 @@ namespace DRO {
    
    class VariableRhoBackstream: public DataReductionOperator {
    public:
-      VariableRhoBackstream(cuint popID);
+      VariableRhoBackstream(cuint popID,FusedVelocityMoments* moments = NULL);
       virtual ~VariableRhoBackstream();
      
       virtual bool getDataVectorInfo(std::string& dataType,unsigned int& dataSize,unsigned int& vectorSize) const;
       virtual std::string getName() const;
       virtual bool reduceData(const SpatialCell* cell,char* buffer);
-      virtual bool setSpatialCell(const SpatialCell* cell);
      
    protected:
-      Real RhoBackstream;
       uint popID;
       std::string popName;
+      const FusedVelocityMoments* moments; /**< Fused single-pass reductions, NULL if not used.*/
       bool doSkip;
    };
 
    class VariableRhoNonBackstream: public DataReductionOperator {
    public:
-      VariableRhoNonBackstream(cuint popID);
+      VariableRhoNonBackstream(cuint popID,FusedVelocityMoments* moments = NULL);
       virtual ~VariableRhoNonBackstream();
      
       virtual bool getDataVectorInfo(std::string& dataType,unsigned int& dataSize,unsigned int& vectorSize) const;
       virtual std::string getName() const;
       virtual bool reduceData(const SpatialCell* cell,char* buffer);
-      virtual bool setSpatialCell(const SpatialCell* cell);
      
    protected:
-      Real Rho;
       uint popID;
       std::string popName;
+      const FusedVelocityMoments* moments; /**< Fused single-pass reductions, NULL if not used.*/
       bool doSkip;
    };
 
    class VariableVBackstream: public DataReductionOperator {
    public:
-      VariableVBackstream(cuint popID);
+      VariableVBackstream(cuint popID,FusedVelocityMoments* moments = NULL);
       virtual ~VariableVBackstream();
      
       virtual bool getDataVectorInfo(std::string& dataType,unsigned int& dataSize,unsigned int& vectorSize) const;
       virtual std::string getName() const;
       virtual bool reduceData(const SpatialCell* cell,char* buffer);
-      virtual bool setSpatialCell(const SpatialCell* cell);
      
    protected:
-      Real VBackstream[3];
       uint popID;
       std::string popName;
+      const FusedVelocityMoments* moments; /**< Fused single-pass reductions, NULL if not used.*/
       bool doSkip;
    };
 
    class VariableVNonBackstream: public DataReductionOperator {
    public:
-      VariableVNonBackstream(cuint popID);
+      VariableVNonBackstream(cuint popID,FusedVelocityMoments* moments = NULL);
       virtual ~VariableVNonBackstream();
 
       virtual bool getDataVectorInfo(std::string& dataType,unsigned int& dataSize,unsigned int& vectorSize) const;
       virtual std::string getName() const;
       virtual bool reduceData(const SpatialCell* cell,char* buffer);
-      virtual bool setSpatialCell(const SpatialCell* cell);
 
    protected:
-      Real V[3];
       uint popID;
       std::string popName;
+      const FusedVelocityMoments* moments; /**< Fused single-pass reductions, NULL if not used.*/
       bool doSkip;
    };
 
    class VariablePTensorBackstreamDiagonal: public DataReductionOperator {
    public:
-      VariablePTensorBackstreamDiagonal(cuint popID);
+      VariablePTensorBackstreamDiagonal(cuint popID,FusedVelocityMoments* moments = NULL);
       virtual ~VariablePTensorBackstreamDiagonal();
       
       virtual bool getDataVectorInfo(std::string& dataType,unsigned int& dataSize,unsigned int& vectorSize) const;
       virtual std::string getName() const;
       virtual bool reduceData(const SpatialCell* cell,char* buffer);
-      virtual bool setSpatialCell(const SpatialCell* cell);
       
    protected:
-      Real averageVX, averageVY, averageVZ;
-      Real PTensor[3];
       uint popID;
       std::string popName;
+      const FusedVelocityMoments* moments; /**< Fused single-pass reductions, NULL if not used.*/
       bool doSkip;
    };
 
    class VariablePTensorNonBackstreamDiagonal: public DataReductionOperator {
    public:
-      VariablePTensorNonBackstreamDiagonal(cuint popID);
+      VariablePTensorNonBackstreamDiagonal(cuint popID,FusedVelocityMoments* moments = NULL);
       virtual ~VariablePTensorNonBackstreamDiagonal();
 
       virtual bool getDataVectorInfo(std::string& dataType,unsigned int& dataSize,unsigned int& vectorSize) const;
       virtual std::string getName() const;
       virtual bool reduceData(const SpatialCell* cell,char* buffer);
-      virtual bool setSpatialCell(const SpatialCell* cell);
 
    protected:
-      Real averageVX, averageVY, averageVZ;
-      Real PTensor[3];
       uint popID;
       std::string popName;
+      const FusedVelocityMoments* moments; /**< Fused single-pass reductions, NULL if not used.*/
       bool doSkip;
    };
 
    class VariablePTensorBackstreamOffDiagonal: public DataReductionOperator {
    public:
-      VariablePTensorBackstreamOffDiagonal(cuint popID);
+      VariablePTensorBackstreamOffDiagonal(cuint popID,FusedVelocityMoments* moments = NULL);
       virtual ~VariablePTensorBackstreamOffDiagonal();
 
       virtual bool getDataVectorInfo(std::string& dataType,unsigned int& dataSize,unsigned int& vectorSize) const;
       virtual std::string getName() const;
       virtual bool reduceData(const SpatialCell* cell,char* buffer);
-      virtual bool setSpatialCell(const SpatialCell* cell);
 
    protected:
-      Real averageVX, averageVY, averageVZ;
-      Real PTensor[3];
       uint popID;
       std::string popName;
+      const FusedVelocityMoments* moments; /**< Fused single-pass reductions, NULL if not used.*/
       bool doSkip;
    };
 
    class VariablePTensorNonBackstreamOffDiagonal: public DataReductionOperator {
    public:
-      VariablePTensorNonBackstreamOffDiagonal(cuint popID);
+      VariablePTensorNonBackstreamOffDiagonal(cuint popID,FusedVelocityMoments* moments = NULL);
       virtual ~VariablePTensorNonBackstreamOffDiagonal();
 
       virtual bool getDataVectorInfo(std::string& dataType,unsigned int& dataSize,unsigned int& vectorSize) const;
       virtual std::string getName() const;
       virtual bool reduceData(const SpatialCell* cell,char* buffer);
-      virtual bool setSpatialCell(const SpatialCell* cell);
 
    protected:
-      Real averageVX, averageVY, averageVZ;
-      Real PTensor[3];
       uint popID;
       std::string popName;
+      const FusedVelocityMoments* moments; /**< Fused single-pass reductions, NULL if not used.*/
       bool doSkip;
    };
    
@@ -506,7 +454,6 @@ namespace DRO {
       virtual std::string getName() const;
       virtual bool reduceData(const SpatialCell* cell,char* buffer);
       virtual bool reduceDiagnostic(const spatial_cell::SpatialCell* cell,Real* result);
-      virtual bool setSpatialCell(const SpatialCell* cell);
       
    protected:
       uint popID;
@@ -516,19 +463,18 @@ namespace DRO {
 
    class VariableEnergyDensity: public DataReductionOperatorHasParameters {
    public:
-      VariableEnergyDensity(cuint popID);
+      VariableEnergyDensity(cuint popID,FusedVelocityMoments* moments = NULL);
       virtual ~VariableEnergyDensity();
 
       virtual bool getDataVectorInfo(std::string& dataType,unsigned int& dataSize,unsigned int& vectorSize) const;
       virtual std::string getName() const;
       virtual bool reduceData(const SpatialCell* cell,char* buffer);
-      virtual bool setSpatialCell(const SpatialCell* cell);
       virtual bool writeParameters(vlsv::Writer& vlsvWriter);
 
    protected:
       uint popID;
       std::string popName;
-      Real EDensity[3];
+      const FusedVelocityMoments* moments; /**< Fused single-pass reductions, NULL if not used.*/
       Real solarwindenergy;
       Real E1limit;
       Real E2limit;
@@ -543,7 +489,6 @@ namespace DRO {
       virtual bool getDataVectorInfo(std::string& dataType,unsigned int& dataSize,unsigned int& vectorSize) const;
       virtual std::string getName() const;
       virtual bool reduceData(const SpatialCell* cell,char* buffer);
-      virtual bool setSpatialCell(const SpatialCell* cell);
       virtual bool writeParameters(vlsv::Writer& vlsvWriter);
 
    protected:
@@ -552,7 +497,7 @@ namespace DRO {
       int nChannels;
       Real emin, emax;
       Real lossConeAngle;
-      std::vector<Real> channels, dataDiffFlux;
+      std::vector<Real> channels;
    };
    
 } // namespace DRO
@@ -0,0 +1,123 @@
+/*
+ * This file is part of Vlasiator.
+ * Copyright 2010-2016 Finnish Meteorological Institute
+ *
+ * For details of usage, see the COPYING file and read the "Rules of the Road"
+ * at http://www.physics.helsinki.fi/vlasiator/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "dro_velocitymoments.h"
+#include "../object_wrapper.h"
+
+using namespace std;
+using namespace spatial_cell;
+
+namespace DRO {
+
+   FusedVelocityMoments::FusedVelocityMoments(): recordSize(0) { }
+
+   /** Request a group of reductions for a population. Called by the operators that
+    * consume the group when they are constructed.
+    * @param popID Population ID.
+    * @param group Requested group of reductions.
+    */
+   void FusedVelocityMoments::request(const uint popID,const VelocityMoments::Group group) {
+      if (requested.size() <= popID) {
+         requested.resize(popID+1,vector<bool>(VelocityMoments::N_GROUPS,false));
+      }
+      requested[popID][group] = true;
+
+      // Update the per-cell record layout, each population with requests gets all groups
+      popOffset.assign(requested.size(),0);
+      recordSize = 0;
+      for (uint p=0; p<requested.size(); ++p) {
+         popOffset[p] = recordSize;
+         for (uint g=0; g<VelocityMoments::N_GROUPS; ++g) {
+            if (requested[p][g] == true) {
+               recordSize += VelocityMoments::N_GROUPS*VelocityMoments::N_VALUES;
+               break;
+            }
+         }
+      }
+   }
+
+   /** @return True if any reductions have been requested.*/
+   bool FusedVelocityMoments::isRequested() const {
+      return recordSize > 0;
+   }
+
+   /** Compute all requested reductions of the given cells, one pass over the velocity
+    * blocks of each cell and population.
+    * @param mpiGrid Parallel grid library.
+    * @param cells Local cells to evaluate.
+    * @return If true, the reductions were computed successfully.
+    */
+   bool FusedVelocityMoments::evaluate(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                                       const std::vector<CellID>& cells) {
+      clear();
+      if (isRequested() == false) return true;
+
+      values.resize(cells.size()*recordSize);
+      cellRecord.reserve(cells.size());
+      for (size_t c=0; c<cells.size(); ++c) {
+         cellRecord[mpiGrid[cells[c]]] = c;
+      }
+
+      #pragma omp parallel for schedule(dynamic,1)
+      for (size_t c=0; c<cells.size(); ++c) {
+         reduceCell(mpiGrid[cells[c]],&(values[c*recordSize]));
+      }
+      return true;
+   }
+
+   /** Get the evaluated values of a group.
+    * @param cell Spatial cell.
+    * @param popID Population ID.
+    * @param group Requested group.
+    * @return Pointer to VelocityMoments::N_VALUES values, or NULL if the cell has not been evaluated.
+    */
+   const Real* FusedVelocityMoments::get(const SpatialCell* cell,const uint popID,const VelocityMoments::Group group) const {
+      if (popID >= requested.size() || requested[popID][group] == false) return NULL;
+      unordered_map<const SpatialCell*,size_t>::const_iterator it = cellRecord.find(cell);
+      if (it == cellRecord.end()) return NULL;
+      return &(values[it->second*recordSize + popOffset[popID] + group*VelocityMoments::N_VALUES]);
+   }
+
+   /** Drop the evaluated values, operators fall back to their own calculation.*/
+   void FusedVelocityMoments::clear() {
+      cellRecord.clear();
+      values.clear();
+   }
+
+   /** Compute the requested reductions of all populations of one cell.
+    * @param cell Spatial cell.
+    * @param result Record of recordSize values to fill.
+    */
+   void FusedVelocityMoments::reduceCell(const SpatialCell* cell,Real* result) const {
+      using namespace VelocityMoments;
+
+      for (uint popID=0; popID<requested.size(); ++popID) {
+         if (requested[popID][BACKSTREAM] == false && requested[popID][NONBACKSTREAM] == false
+             && requested[popID][ENERGYDENSITY] == false) continue;
+
+         // Moments are accumulated relative to the bulk velocity of the population
+         fusedVelocityMoments(cell,getObjectWrapper().particleSpecies[popID],popID,requested[popID],
+                              cell->get_population(popID).V,result + popOffset[popID]);
+      }
+   }
+
+} // namespace DRO
@@ -0,0 +1,74 @@
+/*
+ * This file is part of Vlasiator.
+ * Copyright 2010-2016 Finnish Meteorological Institute
+ *
+ * For details of usage, see the COPYING file and read the "Rules of the Road"
+ * at http://www.physics.helsinki.fi/vlasiator/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef DRO_VELOCITYMOMENTS_H
+#define DRO_VELOCITYMOMENTS_H
+
+#include <vector>
+#include <unordered_map>
+
+#include <dccrg.hpp>
+#include <dccrg_cartesian_geometry.hpp>
+
+#include "../definitions.h"
+#include "../spatial_cell.hpp"
+#include "velocity_moment_kernels.h"
+
+namespace DRO {
+
+   /** DRO::FusedVelocityMoments computes all requested velocity space reductions of all
+    * populations in a single pass over the velocity blocks of each cell. Operators that
+    * need one of the groups request it at construction time (so the set of groups follows
+    * the output variable list), evaluate() fills the results for the local cells before
+    * the variables are written, and the operators then copy out their slice with get().
+    * Outside of an evaluate()/clear() pair get() returns NULL and the operators fall back
+    * to their own calculation.
+    *
+    * The backstream moments are accumulated relative to the bulk velocity of the population
+    * rather than the mean of each part, see fusedVelocityMoments() for the precision this costs.
+    * An empty part gives P = 0, where the two-pass calculation gives NaN if the part contains
+    * velocity cells with f == 0. datareduction/tests compares the two.
+    */
+   class FusedVelocityMoments {
+   public:
+      FusedVelocityMoments();
+
+      void request(const uint popID,const VelocityMoments::Group group);
+      bool isRequested() const;
+      bool evaluate(const dccrg::Dccrg<spatial_cell::SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                    const std::vector<CellID>& cells);
+      const Real* get(const spatial_cell::SpatialCell* cell,const uint popID,const VelocityMoments::Group group) const;
+      void clear();
+
+   private:
+      void reduceCell(const spatial_cell::SpatialCell* cell,Real* result) const;
+
+      std::vector<std::vector<bool> > requested;                 /**< Requested groups per population.*/
+      std::vector<uint> popOffset;                                /**< Offset of each population's values in the per-cell record.*/
+      uint recordSize;                                            /**< Number of Reals stored per cell.*/
+      std::unordered_map<const spatial_cell::SpatialCell*,size_t> cellRecord; /**< Position of each evaluated cell in values.*/
+      std::vector<Real> values;
+   };
+
+} // namespace DRO
+
+#endif
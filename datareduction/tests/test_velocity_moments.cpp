@@ -0,0 +1,238 @@
+/*
+Test of the fused single pass velocity moments against the two-pass calculations of the backstream operators.
+
+Fills a few spatial cells with known distributions, a Maxwellian core inside the backstream sphere and a
+hot beam outside it, on a velocity mesh around the sphere: both parts present on a dense and a sparse mesh,
+only the core (empty backstream part), only the beam (empty non-backstream part) and no velocity blocks at
+all. For each cell computes the fused moments with fusedVelocityMoments around the bulk velocity of the cell
+and around zero, and compares them to rhoBackstreamCalculation, VBackstreamCalculation,
+PTensorDiagonalBackstreamCalculations, PTensorOffDiagonalBackstreamCalculations and energyDensityCalculation.
+Rho and energy density are compared relative to their value, V relative to |V| plus the thermal speed of the
+part and the pressure tensor relative to its trace. For an empty part both give V = NaN, the fused pressure
+has to be 0 and the two-pass pressure NaN if the part has velocity cells in the mesh, 0 otherwise. Exits with
+failure if a relative difference exceeds the tolerance.
+
+Usage: test_velocity_moments [blocks per dimension] [tolerance]
+*/
+
+#include "cmath"
+#include "cstdlib"
+#include "iostream"
+#include "string"
+#include "vector"
+
+#include "../velocity_moment_kernels.h"
+
+using namespace std;
+using namespace DRO;
+
+// Distribution of one spatial cell with the velocity block interface of SpatialCell used by the kernels
+struct TestCell {
+   vector<Real> parameters;
+   vector<Realf> data;
+
+   vmesh::LocalID get_number_of_velocity_blocks(const uint) const {return data.size() / WID3;}
+   const Real* get_block_parameters(const uint) const {return parameters.data();}
+   const Realf* get_data(const uint) const {return data.data();}
+};
+
+struct Maxwellian {
+   Real n;
+   Real V[3];
+   Real T;
+};
+
+// Phase space density of a sum of Maxwellians at velocity v
+Real phaseSpaceDensity(const vector<Maxwellian>& components, const Real mass, const Real v[3]) {
+   Real f = 0.0;
+   for (size_t c = 0; c < components.size(); c++) {
+      const Real vth2 = physicalconstants::K_B*components[c].T / mass;
+      Real dv2 = 0.0;
+      for (int d = 0; d < 3; d++) dv2 += (v[d] - components[c].V[d])*(v[d] - components[c].V[d]);
+      f += components[c].n * pow(2.0*M_PI*vth2, -1.5) * exp(-0.5*dv2/vth2);
+   }
+   return f;
+}
+
+/* Sample the Maxwellians on a mesh of N^3 blocks spanning [-vMax, vMax]. Values of the velocity cells inside
+ * (keep == 1) or outside (keep == 0) the backstream sphere are zeroed if keep is set, the blocks stay in the
+ * mesh. With sparse, blocks with all values below the threshold are dropped as the sparse velocity mesh would.
+ */
+TestCell fillCell(
+   const vector<Maxwellian>& components,
+   const species::Species& species,
+   const int N,
+   const Real vMax,
+   const bool sparse,
+   const int keep
+) {
+   const Real dv = 2.0*vMax / (N*WID);
+   const Real threshold = 1.0e-15;
+   TestCell cell;
+   for (int bk = 0; bk < N; bk++) for (int bj = 0; bj < N; bj++) for (int bi = 0; bi < N; bi++) {
+      const int blockIndices[3] = {bi, bj, bk};
+      Real parameters[BlockParams::N_VELOCITY_BLOCK_PARAMS];
+      for (int d = 0; d < 3; d++) {
+         parameters[BlockParams::VXCRD+d] = -vMax + blockIndices[d]*WID*dv;
+         parameters[BlockParams::DVX+d] = dv;
+      }
+      Realf values[WID3];
+      bool hasContent = false;
+      for (uint k = 0; k < WID; k++) for (uint j = 0; j < WID; j++) for (uint i = 0; i < WID; i++) {
+         const uint cellIndices[3] = {i, j, k};
+         Real v[3];
+         Real distance2 = 0.0;
+         for (int d = 0; d < 3; d++) {
+            v[d] = parameters[BlockParams::VXCRD+d] + (cellIndices[d] + 0.5)*dv;
+            distance2 += (v[d] - species.backstreamV[d])*(v[d] - species.backstreamV[d]);
+         }
+         const bool inside = (distance2 <= species.backstreamRadius*species.backstreamRadius);
+         Realf f = phaseSpaceDensity(components, species.mass, v);
+         if ((keep == 1 && !inside) || (keep == 0 && inside)) f = 0.0;
+         values[cellIndex(i,j,k)] = f;
+         hasContent = hasContent || (f >= threshold);
+      }
+      if (sparse && !hasContent) continue;
+      cell.parameters.insert(cell.parameters.end(), parameters, parameters + BlockParams::N_VELOCITY_BLOCK_PARAMS);
+      cell.data.insert(cell.data.end(), values, values + WID3);
+   }
+   return cell;
+}
+
+// Bulk velocity of the whole distribution, as the moments of the cell give it
+void bulkVelocity(const TestCell& cell, Real V[3]) {
+   Real n = 0.0;
+   for (int d = 0; d < 3; d++) V[d] = 0.0;
+   for (vmesh::LocalID b = 0; b < cell.get_number_of_velocity_blocks(0); b++) {
+      const Real* parameters = &cell.parameters[b*BlockParams::N_VELOCITY_BLOCK_PARAMS];
+      const Real DV3 = parameters[BlockParams::DVX]*parameters[BlockParams::DVY]*parameters[BlockParams::DVZ];
+      for (uint k = 0; k < WID; k++) for (uint j = 0; j < WID; j++) for (uint i = 0; i < WID; i++) {
+         const Real fDV3 = cell.data[b*WID3 + cellIndex(i,j,k)]*DV3;
+         n += fDV3;
+         V[0] += fDV3*(parameters[BlockParams::VXCRD] + (i + 0.5)*parameters[BlockParams::DVX]);
+         V[1] += fDV3*(parameters[BlockParams::VYCRD] + (j + 0.5)*parameters[BlockParams::DVY]);
+         V[2] += fDV3*(parameters[BlockParams::VZCRD] + (k + 0.5)*parameters[BlockParams::DVZ]);
+      }
+   }
+   for (int d = 0; d < 3; d++) V[d] = (n > 0.0) ? V[d]/n : 0.0;
+}
+
+// Relative difference of a to b, 0 if both are NaN
+double difference(const Real a, const Real b, const Real scale) {
+   if (std::isnan(a) && std::isnan(b)) return 0.0;
+   return fabs(a - b) / scale;
+}
+
+int main(int argc, char* argv[]) {
+   const int N = (argc > 1) ? atoi(argv[1]) : 12;
+   const double tolerance = (argc > 2) ? atof(argv[2]) : 1e-10;
+   const Real vMax = 1.6e6;
+
+   species::Species species;
+   species.name = "proton";
+   species.mass = physicalconstants::MASS_PROTON;
+   species.charge = physicalconstants::CHARGE;
+   species.backstreamV = {{-5.0e5, 0.0, 0.0}};
+   species.backstreamRadius = 4.0e5;
+   species.SolarWindSpeed = 5.0e5;
+   species.SolarWindEnergy = 0.5*species.mass*species.SolarWindSpeed*species.SolarWindSpeed;
+   species.EnergyDensityLimit1 = 5.0;
+   species.EnergyDensityLimit2 = 10.0;
+   creal E1limit = species.SolarWindEnergy*species.EnergyDensityLimit1;
+   creal E2limit = species.SolarWindEnergy*species.EnergyDensityLimit2;
+
+   // Solar wind core inside the sphere and a hot reflected beam outside it
+   const Maxwellian core = {1.0e6, {-5.0e5, 2.0e4, -1.0e4}, 5.0e5};
+   const Maxwellian beam = {1.0e5, {4.0e5, 3.0e5, -2.0e5}, 5.0e6};
+   vector<Maxwellian> both;
+   both.push_back(core);
+   both.push_back(beam);
+
+   const string names[] = {"core and beam", "core and beam, sparse", "core only", "beam only", "no blocks"};
+   vector<TestCell> cells;
+   cells.push_back(fillCell(both, species, N, vMax, false, -1));
+   cells.push_back(fillCell(both, species, N, vMax, true, -1));
+   cells.push_back(fillCell(vector<Maxwellian>(1, core), species, N, vMax, false, 1));
+   cells.push_back(fillCell(vector<Maxwellian>(1, beam), species, N, vMax, false, 0));
+   cells.push_back(TestCell());
+
+   const vector<bool> requested(VelocityMoments::N_GROUPS, true);
+   double maxDifference = 0.0;
+   int nCases = 0;
+   for (size_t c = 0; c < cells.size(); c++) {
+      Real references[2][3] = {{0.0, 0.0, 0.0}, {0.0, 0.0, 0.0}};
+      bulkVelocity(cells[c], references[0]);
+      for (int r = 0; r < 2; r++) {
+         Real fused[VelocityMoments::N_GROUPS*VelocityMoments::N_VALUES];
+         fusedVelocityMoments(&cells[c], species, 0, requested, references[r], fused);
+
+         for (int part = 0; part < 2; part++) {
+            const bool calculateBackstream = (part == 0);
+            const string name = names[c] + (calculateBackstream ? ", backstream" : ", non-backstream")
+                              + (r == 0 ? ", around bulk V" : ", around zero");
+            const Real* values = fused + (calculateBackstream ? VelocityMoments::BACKSTREAM : VelocityMoments::NONBACKSTREAM)*VelocityMoments::N_VALUES;
+
+            Real rho = 0.0;
+            Real V[3];
+            Real PDiagonal[3] = {0.0, 0.0, 0.0};
+            Real POffDiagonal[3] = {0.0, 0.0, 0.0};
+            rhoBackstreamCalculation(&cells[c], calculateBackstream, species, 0, rho);
+            VBackstreamCalculation(&cells[c], calculateBackstream, species, 0, V);
+            PTensorDiagonalBackstreamCalculations(&cells[c], calculateBackstream, V[0], V[1], V[2], species, 0, PDiagonal);
+            PTensorOffDiagonalBackstreamCalculations(&cells[c], calculateBackstream, V[0], V[1], V[2], species, 0, POffDiagonal);
+            const Real P[6] = {PDiagonal[0], PDiagonal[1], PDiagonal[2], POffDiagonal[0], POffDiagonal[1], POffDiagonal[2]};
+
+            if (rho == 0.0) {
+               // Empty part: V is NaN in both, the fused pressure is 0 where the two-pass one is NaN as soon as
+               // the part has velocity cells in the mesh
+               const bool hasVelocityCells = (cells[c].get_number_of_velocity_blocks(0) > 0);
+               bool ok = (values[VelocityMoments::RHO] == 0.0);
+               for (int d = 0; d < 3; d++) ok = ok && std::isnan(values[VelocityMoments::VX+d]) && std::isnan(V[d]);
+               for (int p = 0; p < 6; p++) {
+                  ok = ok && (values[VelocityMoments::P_11+p] == 0.0);
+                  ok = ok && (hasVelocityCells ? std::isnan(P[p]) : (P[p] == 0.0));
+               }
+               if (!ok) {
+                  cerr << name << ": empty part not handled as documented" << endl;
+                  return EXIT_FAILURE;
+               }
+               nCases++;
+               continue;
+            }
+
+            const Real PScale = (P[0] + P[1] + P[2]) / 3.0;
+            const Real VScale = sqrt(V[0]*V[0] + V[1]*V[1] + V[2]*V[2]) + sqrt(PScale / (species.mass*rho));
+            double partDifference = difference(values[VelocityMoments::RHO], rho, rho);
+            for (int d = 0; d < 3; d++) {
+               partDifference = max(partDifference, difference(values[VelocityMoments::VX+d], V[d], VScale));
+            }
+            for (int p = 0; p < 6; p++) {
+               partDifference = max(partDifference, difference(values[VelocityMoments::P_11+p], P[p], PScale));
+            }
+            maxDifference = max(maxDifference, partDifference);
+            nCases++;
+            if (!(partDifference <= tolerance)) {
+               cerr << name << ": relative difference " << partDifference << " exceeds tolerance " << tolerance << endl;
+               return EXIT_FAILURE;
+            }
+         }
+
+         Real energy[3] = {0.0, 0.0, 0.0};
+         energyDensityCalculation(&cells[c], E1limit, E2limit, species, 0, energy);
+         const Real* values = fused + VelocityMoments::ENERGYDENSITY*VelocityMoments::N_VALUES;
+         double energyDifference = 0.0;
+         for (int e = 0; e < 3; e++) {
+            energyDifference = max(energyDifference, (energy[e] == 0.0) ? fabs(values[e]) : difference(values[e], energy[e], energy[e]));
+         }
+         maxDifference = max(maxDifference, energyDifference);
+         nCases++;
+         if (!(energyDifference <= tolerance)) {
+            cerr << names[c] << ", energy density: relative difference " << energyDifference << " exceeds tolerance " << tolerance << endl;
+            return EXIT_FAILURE;
+         }
+      }
+   }
+
+   cout << nCases << " cases, largest relative difference " << maxDifference << " for tolerance " << tolerance << endl;
+   return EXIT_SUCCESS;
+}
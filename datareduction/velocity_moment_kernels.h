@@ -0,0 +1,598 @@
+/*
+ * This file is part of Vlasiator.
+ * Copyright 2010-2016 Finnish Meteorological Institute
+ *
+ * For details of usage, see the COPYING file and read the "Rules of the Road"
+ * at http://www.physics.helsinki.fi/vlasiator/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef VELOCITY_MOMENT_KERNELS_H
+#define VELOCITY_MOMENT_KERNELS_H
+
+#include <array>
+#include <vector>
+
+#include "../common.h"
+#include "../particle_species.h"
+
+/*! Kernels of the backstream/non-backstream and energy density reductions: the two-pass calculations
+ * of the individual operators and the single pass of FusedVelocityMoments. They only use the velocity
+ * block interface of SpatialCell (get_block_parameters, get_data, get_number_of_velocity_blocks) and
+ * the species parameters, so that both can be tested without a spatial cell, see datareduction/tests.
+ */
+namespace DRO {
+
+   /** Groups of velocity space reductions that FusedVelocityMoments can compute.*/
+   namespace VelocityMoments {
+      enum Group {
+         BACKSTREAM,     /*!< Rho, V and pressure tensor of the backstreaming part.*/
+         NONBACKSTREAM,  /*!< Rho, V and pressure tensor of the non-backstreaming part.*/
+         ENERGYDENSITY,  /*!< Energy density total and above the two energy limits.*/
+         N_GROUPS
+      };
+
+      /** Layout of the values of one group, energy density only uses the first three.*/
+      enum Value {
+         RHO,
+         VX,VY,VZ,
+         P_11,P_22,P_33,
+         P_23,P_13,P_12,
+         N_VALUES
+      };
+   }
+
+  /*******
+	  Helper functions for finding the velocity cell indices or IDs within a single velocity block
+	  either belonging to the backstreaming or the non-backstreaming population.
+	  There is some code duplication here, but as these helper functions are called within threads for
+	  block separately, it's preferable to have them fast even at the cost of code repetition.
+  ********/
+
+   //Helper function for getting the velocity cell ids that are a part of the backstream population:
+   inline void getBackstreamVelocityCells(
+      const Real* block_parameters,
+      std::vector<uint64_t> & vCellIds,
+      const species::Species& species
+   ) {
+      creal HALF = 0.5;
+      const std::array<Real, 3> backstreamV = species.backstreamV;
+      creal backstreamRadius = species.backstreamRadius;
+      // Go through every velocity cell (i, j, k are indices)
+      for (uint k = 0; k < WID; ++k) for (uint j = 0; j < WID; ++j) for (uint i = 0; i < WID; ++i) {
+         // Get the vx, vy, vz coordinates of the velocity cell
+         const Real VX = block_parameters[BlockParams::VXCRD] + (i + HALF) * block_parameters[BlockParams::DVX];
+         const Real VY = block_parameters[BlockParams::VYCRD] + (j + HALF) * block_parameters[BlockParams::DVY];
+         const Real VZ = block_parameters[BlockParams::VZCRD] + (k + HALF) * block_parameters[BlockParams::DVZ];
+         // Compare the distance of the velocity cell from the center of the maxwellian distribution to the radius of the maxwellian distribution
+         if( ( (backstreamV[0] - VX) * (backstreamV[0] - VX)
+             + (backstreamV[1] - VY) * (backstreamV[1] - VY)
+             + (backstreamV[2] - VZ) * (backstreamV[2] - VZ) )
+             >
+             backstreamRadius*backstreamRadius ) {
+             //The velocity cell is a part of the backstream population:
+             vCellIds.push_back(cellIndex(i,j,k));
+          }
+      }
+   }
+   //Helper function for getting the velocity cell ids that are a part of the backstream population:
+   inline void getNonBackstreamVelocityCells(
+      const Real* block_parameters,
+      std::vector<uint64_t> & vCellIds,
+      const species::Species& species
+   ) {
+      creal HALF = 0.5;
+      const std::array<Real, 3> backstreamV = species.backstreamV;
+      creal backstreamRadius = species.backstreamRadius;
+      for (uint k = 0; k < WID; ++k) for (uint j = 0; j < WID; ++j) for (uint i = 0; i < WID; ++i) {
+         const Real VX = block_parameters[BlockParams::VXCRD] + (i + HALF) * block_parameters[BlockParams::DVX];
+         const Real VY = block_parameters[BlockParams::VYCRD] + (j + HALF) * block_parameters[BlockParams::DVY];
+         const Real VZ = block_parameters[BlockParams::VZCRD] + (k + HALF) * block_parameters[BlockParams::DVZ];
+         if( ( (backstreamV[0] - VX) * (backstreamV[0] - VX)
+             + (backstreamV[1] - VY) * (backstreamV[1] - VY)
+             + (backstreamV[2] - VZ) * (backstreamV[2] - VZ) )
+             <=
+             backstreamRadius*backstreamRadius ) {
+             //The velocity cell is not a part of the backstream population:
+             vCellIds.push_back(cellIndex(i,j,k));
+          }
+      }
+   }
+   //Helper function for getting the velocity cell indices that are a part of the backstream population:
+   inline void getBackstreamVelocityCellIndices(
+      const Real* block_parameters,
+      std::vector<std::array<uint, 3>> & vCellIndices,
+      const species::Species& species
+   ) {
+      creal HALF = 0.5;
+      const std::array<Real, 3> backstreamV = species.backstreamV;
+      creal backstreamRadius = species.backstreamRadius;
+      // Go through a block's every velocity cell
+      for (uint k = 0; k < WID; ++k) for (uint j = 0; j < WID; ++j) for (uint i = 0; i < WID; ++i) {
+         // Get the coordinates of the velocity cell (e.g. VX = block_vx_min_coordinates + (velocity_cell_indice_x+0.5)*length_of_velocity_cell_in_x_direction
+         const Real VX = block_parameters[BlockParams::VXCRD] + (i + HALF) * block_parameters[BlockParams::DVX];
+         const Real VY = block_parameters[BlockParams::VYCRD] + (j + HALF) * block_parameters[BlockParams::DVY];
+         const Real VZ = block_parameters[BlockParams::VZCRD] + (k + HALF) * block_parameters[BlockParams::DVZ];
+         // Calculate the distance of the velocity cell from the center of the maxwellian distribution and compare it to the approximate radius of the maxwellian distribution
+         if( ( (backstreamV[0] - VX) * (backstreamV[0] - VX)
+             + (backstreamV[1] - VY) * (backstreamV[1] - VY)
+             + (backstreamV[2] - VZ) * (backstreamV[2] - VZ) )
+             >
+             backstreamRadius*backstreamRadius ) {
+             //The velocity cell is a part of the backstream population because it is not within the radius:
+             const std::array<uint, 3> indices{{i, j, k}};
+             vCellIndices.push_back( indices );
+          }
+      }
+   }
+   //Helper function for getting the velocity cell indices that are not a part of the backstream population:
+   inline void getNonBackstreamVelocityCellIndices(
+      const Real* block_parameters,
+      std::vector<std::array<uint, 3>> & vCellIndices,
+      const species::Species& species
+   ) {
+      creal HALF = 0.5;
+      const std::array<Real, 3> backstreamV = species.backstreamV;
+      creal backstreamRadius = species.backstreamRadius;
+      // Go through a block's every velocity cell
+      for (uint k = 0; k < WID; ++k) for (uint j = 0; j < WID; ++j) for (uint i = 0; i < WID; ++i) {
+         // Get the coordinates of the velocity cell (e.g. VX = block_vx_min_coordinates + (velocity_cell_indice_x+0.5)*length_of_velocity_cell_in_x_direction
+         const Real VX = block_parameters[BlockParams::VXCRD] + (i + HALF) * block_parameters[BlockParams::DVX];
+         const Real VY = block_parameters[BlockParams::VYCRD] + (j + HALF) * block_parameters[BlockParams::DVY];
+         const Real VZ = block_parameters[BlockParams::VZCRD] + (k + HALF) * block_parameters[BlockParams::DVZ];
+         // Calculate the distance of the velocity cell from the center of the maxwellian distribution and compare it to the approximate radius of the maxwellian distribution
+         if( ( (backstreamV[0] - VX) * (backstreamV[0] - VX)
+             + (backstreamV[1] - VY) * (backstreamV[1] - VY)
+             + (backstreamV[2] - VZ) * (backstreamV[2] - VZ) )
+             <=
+             backstreamRadius*backstreamRadius ) {
+             //The velocity cell is not a part of the backstream population because it is within the radius:
+             const std::array<uint, 3> indices{{i, j, k}};
+             vCellIndices.push_back( indices );
+          }
+      }
+   }
+
+  /********
+	   Next level of helper functions - these include threading and calculate zeroth or first velocity moments or the
+	   diagonal / off-diagonal pressure tensor components for
+	   backstreaming or non-backstreaming populations  ********/
+
+   //Calculates rho backstream or rho non backstream
+   template<typename CELL>
+   void rhoBackstreamCalculation( const CELL * cell, const bool calculateBackstream, const species::Species& species, cuint popID, Real & rho ) {
+      # pragma omp parallel
+      {
+         Real thread_n_sum = 0.0;
+
+         const Real* parameters = cell->get_block_parameters(popID);
+         const Realf* block_data = cell->get_data(popID);
+
+         # pragma omp for
+         for (vmesh::LocalID n=0; n<cell->get_number_of_velocity_blocks(popID); ++n) {
+            const Real DV3
+            = parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVX]
+            * parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVY]
+            * parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVZ];
+            std::vector< uint64_t > vCells; //Velocity cell ids
+            vCells.clear();
+            if ( calculateBackstream == true ) {
+               getBackstreamVelocityCells(&parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS], vCells, species);
+            } else {
+               getNonBackstreamVelocityCells(&parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS], vCells, species);
+            }
+            for( std::vector< uint64_t >::const_iterator it = vCells.begin(); it != vCells.end(); ++it ) {
+               //velocity cell id = *it
+               thread_n_sum += block_data[n * SIZE_VELBLOCK + (*it)] * DV3;
+            }
+         }
+         // Accumulate contributions coming from this velocity block
+         // If multithreading / OpenMP is used,
+         // these updates need to be atomic:
+         // todo: use omp reduction
+         # pragma omp critical
+         {
+            rho += thread_n_sum;
+         }
+      }
+      return;
+   }
+
+   //Calculates V backstream or V non backstream, NaN for an empty part
+   template<typename CELL>
+   void VBackstreamCalculation( const CELL * cell, const bool calculateBackstream, const species::Species& species, cuint popID, Real * V ) {
+      const Real HALF = 0.5;
+      // Make sure the V is initialized
+      V[0] = 0;
+      V[1] = 0;
+      V[2] = 0;
+      Real n = 0;
+      # pragma omp parallel
+      {
+         Real thread_nvx_sum = 0.0;
+         Real thread_nvy_sum = 0.0;
+         Real thread_nvz_sum = 0.0;
+         Real thread_n_sum = 0.0;
+
+         const Real* parameters = cell->get_block_parameters(popID);
+         const Realf* block_data = cell->get_data(popID);
+
+         # pragma omp for
+         for (vmesh::LocalID n=0; n<cell->get_number_of_velocity_blocks(popID); ++n) {
+            // Get the volume of a velocity cell
+            const Real DV3
+            = parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVX]
+            * parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVY]
+            * parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVZ];
+            // Get the velocity cell indices of the cells that are a part of the backstream population
+            std::vector< std::array<uint, 3> > vCellIndices;
+            vCellIndices.clear();
+            // Save indices to the std::vector
+            if( calculateBackstream == true ) {
+               getBackstreamVelocityCellIndices(&parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS], vCellIndices, species);
+            } else {
+               getNonBackstreamVelocityCellIndices(&parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS], vCellIndices, species);
+            }
+            // We have now fethced all of the needed velocity cell indices, so now go through them:
+            for( std::vector< std::array<uint, 3> >::const_iterator it = vCellIndices.begin(); it != vCellIndices.end(); ++it ) {
+               // Get the indices of the current iterated velocity cell
+               const std::array<uint, 3> indices = *it;
+               const uint i = indices[0];
+               const uint j = indices[1];
+               const uint k = indices[2];
+               // Get the coordinates of the velocity cell (e.g. VX = block_vx_min_coordinates + (velocity_cell_indice_x+0.5)*length_of_velocity_cell_in_x_direction)
+               const Real VX = parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::VXCRD] + (i + HALF) * parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVX];
+               const Real VY = parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::VYCRD] + (j + HALF) * parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVY];
+               const Real VZ = parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::VZCRD] + (k + HALF) * parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVZ];
+               // Add the value of the coordinates and multiply by the AVGS value of the velocity cell and the volume of the velocity cell
+               thread_nvx_sum += block_data[n * SIZE_VELBLOCK + cellIndex(i,j,k)]*VX*DV3;
+               thread_nvy_sum += block_data[n * SIZE_VELBLOCK + cellIndex(i,j,k)]*VY*DV3;
+               thread_nvz_sum += block_data[n * SIZE_VELBLOCK + cellIndex(i,j,k)]*VZ*DV3;
+               thread_n_sum += block_data[n * SIZE_VELBLOCK + cellIndex(i,j,k)]*DV3;
+            }
+         } // for-loop over velocity blocks
+
+         // Accumulate contributions coming from this velocity block.
+         // If multithreading / OpenMP is used,
+         // these updates need to be atomic:
+         # pragma omp critical
+         {
+            V[0] += thread_nvx_sum;
+            V[1] += thread_nvy_sum;
+            V[2] += thread_nvz_sum;
+            n += thread_n_sum;
+         }
+      }
+
+      // Finally, divide n*V by V.
+      V[0]/=n;
+      V[1]/=n;
+      V[2]/=n;
+      return;
+   }
+
+   //Calculates the diagonal of the pressure tensor of the backstream or non backstream part around the given average
+   //velocity. For an empty part the average is NaN, so the result is NaN if the part has any velocity cells in the mesh.
+   template<typename CELL>
+   void PTensorDiagonalBackstreamCalculations( const CELL * cell,
+                                               const bool calculateBackstream,
+                                               const Real averageVX,
+                                               const Real averageVY,
+                                               const Real averageVZ,
+                                               const species::Species& species,
+                                               cuint popID,
+                                               Real * PTensor ) {
+      const Real HALF = 0.5;
+      # pragma omp parallel
+      {
+         Real thread_nvxvx_sum = 0.0;
+         Real thread_nvyvy_sum = 0.0;
+         Real thread_nvzvz_sum = 0.0;
+
+         const Real* parameters = cell->get_block_parameters(popID);
+         const Realf* block_data = cell->get_data(popID);
+
+         # pragma omp for
+         for (vmesh::LocalID n=0; n<cell->get_number_of_velocity_blocks(popID); ++n) {
+            const Real DV3
+            = parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVX]
+            * parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVY]
+            * parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVZ];
+            std::vector< std::array<uint, 3> > vCellIndices;
+            vCellIndices.clear();
+            if( calculateBackstream == true ) {
+               getBackstreamVelocityCellIndices(&parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS], vCellIndices, species);
+            } else {
+               getNonBackstreamVelocityCellIndices(&parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS], vCellIndices, species);
+            }
+            for( std::vector< std::array<uint, 3> >::const_iterator it = vCellIndices.begin(); it != vCellIndices.end(); ++it ) {
+               //Go through every velocity cell:
+               const std::array<uint, 3> indices = *it;
+               const uint i = indices[0];
+               const uint j = indices[1];
+               const uint k = indices[2];
+               const Real VX = parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::VXCRD] + (i + HALF) * parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVX];
+               const Real VY = parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::VYCRD] + (j + HALF) * parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVY];
+               const Real VZ = parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::VZCRD] + (k + HALF) * parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVZ];
+               thread_nvxvx_sum += block_data[n * SIZE_VELBLOCK + cellIndex(i,j,k)] * (VX - averageVX) * (VX - averageVX) * DV3;
+               thread_nvyvy_sum += block_data[n * SIZE_VELBLOCK + cellIndex(i,j,k)] * (VY - averageVY) * (VY - averageVY) * DV3;
+               thread_nvzvz_sum += block_data[n * SIZE_VELBLOCK + cellIndex(i,j,k)] * (VZ - averageVZ) * (VZ - averageVZ) * DV3;
+            }
+         }
+         thread_nvxvx_sum *= species.mass;
+         thread_nvyvy_sum *= species.mass;
+         thread_nvzvz_sum *= species.mass;
+
+         // Accumulate contributions coming from this velocity block to the
+         // spatial cell velocity moments. If multithreading / OpenMP is used,
+         // these updates need to be atomic:
+         # pragma omp critical
+         {
+            PTensor[0] += thread_nvxvx_sum;
+            PTensor[1] += thread_nvyvy_sum;
+            PTensor[2] += thread_nvzvz_sum;
+         }
+      }
+      return;
+   }
+
+   //Calculates the off-diagonal of the pressure tensor (23, 13, 12) of the backstream or non backstream part around
+   //the given average velocity, NaN for an empty part as for the diagonal.
+   template<typename CELL>
+   void PTensorOffDiagonalBackstreamCalculations( const CELL * cell,
+                                                  const bool calculateBackstream,
+                                                  const Real averageVX,
+                                                  const Real averageVY,
+                                                  const Real averageVZ,
+                                                  const species::Species& species,
+                                                  cuint popID,
+                                                  Real * PTensor ) {
+      const Real HALF = 0.5;
+      # pragma omp parallel
+      {
+         Real thread_nvxvy_sum = 0.0;
+         Real thread_nvzvx_sum = 0.0;
+         Real thread_nvyvz_sum = 0.0;
+
+         const Real* parameters = cell->get_block_parameters(popID);
+         const Realf* block_data = cell->get_data(popID);
+
+         # pragma omp for
+         for (vmesh::LocalID n=0; n<cell->get_number_of_velocity_blocks(popID); ++n) {
+            const Real DV3
+            = parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVX]
+            * parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVY]
+            * parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVZ];
+            std::vector< std::array<uint, 3> > vCellIndices;
+            if( calculateBackstream == true ) {
+               getBackstreamVelocityCellIndices(&parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS], vCellIndices, species);
+            } else {
+               getNonBackstreamVelocityCellIndices(&parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS], vCellIndices, species);
+            }
+            for( std::vector< std::array<uint, 3> >::const_iterator it = vCellIndices.begin(); it != vCellIndices.end(); ++it ) {
+               //Go through every velocity cell:
+               const std::array<uint, 3> indices = *it;
+               const uint i = indices[0];
+               const uint j = indices[1];
+               const uint k = indices[2];
+               const Real VX = parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::VXCRD] + (i + HALF) * parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVX];
+               const Real VY = parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::VYCRD] + (j + HALF) * parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVY];
+               const Real VZ = parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::VZCRD] + (k + HALF) * parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVZ];
+               thread_nvxvy_sum += block_data[n * SIZE_VELBLOCK + cellIndex(i,j,k)] * (VX - averageVX) * (VY - averageVY) * DV3;
+               thread_nvzvx_sum += block_data[n * SIZE_VELBLOCK + cellIndex(i,j,k)] * (VZ - averageVZ) * (VX - averageVX) * DV3;
+               thread_nvyvz_sum += block_data[n * SIZE_VELBLOCK + cellIndex(i,j,k)] * (VY - averageVY) * (VZ - averageVZ) * DV3;
+            }
+         }
+         thread_nvxvy_sum *= species.mass;
+         thread_nvzvx_sum *= species.mass;
+         thread_nvyvz_sum *= species.mass;
+
+         // Accumulate contributions coming from this velocity block to the
+         // spatial cell velocity moments. If multithreading / OpenMP is used,
+         // these updates need to be atomic:
+         # pragma omp critical
+         {
+            PTensor[0] += thread_nvyvz_sum;
+            PTensor[1] += thread_nvzvx_sum;
+            PTensor[2] += thread_nvxvy_sum;
+         }
+      }
+   }
+
+   //Calculates the energy density, total and above E1limit and E2limit, in eV/cm^3
+   template<typename CELL>
+   void energyDensityCalculation( const CELL * cell,
+                                  creal E1limit,
+                                  creal E2limit,
+                                  const species::Species& species,
+                                  cuint popID,
+                                  Real * EDensity ) {
+      const Real HALF = 0.5;
+      # pragma omp parallel
+      {
+         Real thread_E0_sum = 0.0;
+         Real thread_E1_sum = 0.0;
+         Real thread_E2_sum = 0.0;
+
+         const Real* parameters  = cell->get_block_parameters(popID);
+         const Realf* block_data = cell->get_data(popID);
+
+         # pragma omp for
+         for (vmesh::LocalID n=0; n<cell->get_number_of_velocity_blocks(popID); n++) {
+	    const Real DV3
+	       = parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVX]
+	       * parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVY]
+	       * parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVZ];
+	    for (uint k = 0; k < WID; ++k) for (uint j = 0; j < WID; ++j) for (uint i = 0; i < WID; ++i) {
+	       const Real VX
+		  =          parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::VXCRD]
+		  + (i + HALF)*parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVX];
+	       const Real VY
+		  =          parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::VYCRD]
+		  + (j + HALF)*parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVY];
+	       const Real VZ
+		  =          parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::VZCRD]
+		  + (k + HALF)*parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS + BlockParams::DVZ];
+
+	       const Real ENERGY = (VX*VX + VY*VY + VZ*VZ) * HALF * species.mass;
+	       thread_E0_sum += block_data[n * SIZE_VELBLOCK+cellIndex(i,j,k)] * ENERGY * DV3;
+	       if (ENERGY > E1limit) thread_E1_sum += block_data[n * SIZE_VELBLOCK+cellIndex(i,j,k)] * ENERGY * DV3;
+	       if (ENERGY > E2limit) thread_E2_sum += block_data[n * SIZE_VELBLOCK+cellIndex(i,j,k)] * ENERGY * DV3;
+	    }
+         }
+         // Accumulate contributions coming from this velocity block to the
+         // spatial cell velocity moments. If multithreading / OpenMP is used,
+         // these updates need to be atomic:
+         # pragma omp critical
+         {
+            EDensity[0] += thread_E0_sum;
+            EDensity[1] += thread_E1_sum;
+            EDensity[2] += thread_E2_sum;
+         }
+
+      }
+      // Output energy density in units eV/cm^3 instead of Joules per m^3
+      EDensity[0] *= (1.0e-6)/physicalconstants::CHARGE;
+      EDensity[1] *= (1.0e-6)/physicalconstants::CHARGE;
+      EDensity[2] *= (1.0e-6)/physicalconstants::CHARGE;
+   }
+
+  /*********
+	     End velocity moment / backstream/non-backstreamn helper functions
+  *********/
+
+   /** Single pass over the velocity blocks of one population computing the requested groups of
+    * FusedVelocityMoments::reduceCell.
+    *
+    * The backstream and non-backstream moments are accumulated relative to the given reference
+    * velocity, in practice the bulk velocity of the whole population, not relative to the mean of
+    * each part: V = c + S/n and P_ij = m (Q_ij - S_i S_j / n) where S and Q are the first and second
+    * moments of v - c. In exact arithmetic this equals the two-pass calculation for any c. In floating
+    * point the correction S_i S_j / n cancels against Q_ij, losing about log10(|V - c|^2 / (P/(m n)))
+    * digits, i.e. the square of the ratio of the distance of the part mean from c to the thermal speed
+    * of the part. With Real as double and parts such as a foreshock beam this stays well below the
+    * precision of the float output and of the distribution itself.
+    *
+    * An empty part (rho == 0) gives V = NaN as in the two-pass calculation, but P = 0. The two-pass
+    * calculation gives P = NaN there as soon as any velocity cell of the mesh, even one with f == 0,
+    * falls inside the part, because the pressure is accumulated around the NaN mean velocity.
+    *
+    * @param cell Cell with the velocity block interface of SpatialCell.
+    * @param species Species of the population.
+    * @param popID Population ID.
+    * @param requested Requested groups, indexed by VelocityMoments::Group.
+    * @param reference Reference velocity c the moments are accumulated around.
+    * @param result N_GROUPS*N_VALUES values, only the requested groups are filled.
+    */
+   template<typename CELL>
+   void fusedVelocityMoments(const CELL* cell,
+                             const species::Species& species,
+                             const uint popID,
+                             const std::vector<bool>& requested,
+                             const Real* reference,
+                             Real* result) {
+      const Real HALF = 0.5;
+      using namespace VelocityMoments;
+
+      const bool doBackstream = requested[BACKSTREAM];
+      const bool doNonBackstream = requested[NONBACKSTREAM];
+      const bool doEnergy = requested[ENERGYDENSITY];
+
+      const std::array<Real, 3> backstreamV = species.backstreamV;
+      creal backstreamRadius2 = species.backstreamRadius*species.backstreamRadius;
+      creal mass = species.mass;
+      creal E1limit = species.SolarWindEnergy * species.EnergyDensityLimit1;
+      creal E2limit = species.SolarWindEnergy * species.EnergyDensityLimit2;
+
+      // Per part (0 = backstream, 1 = non-backstream): n, S_x,S_y,S_z, Q_xx,Q_yy,Q_zz,Q_yz,Q_zx,Q_xy
+      Real sums[2][10] = {{0}};
+      Real energy[3] = {0.0, 0.0, 0.0};
+
+      const Real* parameters = cell->get_block_parameters(popID);
+      const Realf* block_data = cell->get_data(popID);
+      for (vmesh::LocalID n=0; n<cell->get_number_of_velocity_blocks(popID); ++n) {
+         const Real* blockParams = &(parameters[n * BlockParams::N_VELOCITY_BLOCK_PARAMS]);
+         const Real DV3 = blockParams[BlockParams::DVX] * blockParams[BlockParams::DVY] * blockParams[BlockParams::DVZ];
+         for (uint k = 0; k < WID; ++k) for (uint j = 0; j < WID; ++j) for (uint i = 0; i < WID; ++i) {
+            const Real VX = blockParams[BlockParams::VXCRD] + (i + HALF) * blockParams[BlockParams::DVX];
+            const Real VY = blockParams[BlockParams::VYCRD] + (j + HALF) * blockParams[BlockParams::DVY];
+            const Real VZ = blockParams[BlockParams::VZCRD] + (k + HALF) * blockParams[BlockParams::DVZ];
+            const Real fDV3 = block_data[n * SIZE_VELBLOCK + cellIndex(i,j,k)] * DV3;
+
+            if (doEnergy == true) {
+               const Real ENERGY = (VX*VX + VY*VY + VZ*VZ) * HALF * mass;
+               energy[0] += fDV3 * ENERGY;
+               if (ENERGY > E1limit) energy[1] += fDV3 * ENERGY;
+               if (ENERGY > E2limit) energy[2] += fDV3 * ENERGY;
+            }
+
+            if (doBackstream == false && doNonBackstream == false) continue;
+            const Real distance2 = (backstreamV[0] - VX) * (backstreamV[0] - VX)
+                                 + (backstreamV[1] - VY) * (backstreamV[1] - VY)
+                                 + (backstreamV[2] - VZ) * (backstreamV[2] - VZ);
+            const int part = (distance2 > backstreamRadius2) ? 0 : 1;
+            if ((part == 0 && doBackstream == false) || (part == 1 && doNonBackstream == false)) continue;
+
+            const Real dVX = VX - reference[0];
+            const Real dVY = VY - reference[1];
+            const Real dVZ = VZ - reference[2];
+            Real* s = sums[part];
+            s[0] += fDV3;
+            s[1] += fDV3 * dVX;
+            s[2] += fDV3 * dVY;
+            s[3] += fDV3 * dVZ;
+            s[4] += fDV3 * dVX * dVX;
+            s[5] += fDV3 * dVY * dVY;
+            s[6] += fDV3 * dVZ * dVZ;
+            s[7] += fDV3 * dVY * dVZ;
+            s[8] += fDV3 * dVZ * dVX;
+            s[9] += fDV3 * dVX * dVY;
+         }
+      }
+
+      for (int part=0; part<2; ++part) {
+         const Group group = (part == 0) ? BACKSTREAM : NONBACKSTREAM;
+         if (requested[group] == false) continue;
+         const Real* s = sums[part];
+         Real* out = result + group*N_VALUES;
+         creal rho = s[0];
+         out[RHO] = rho;
+         // As in the two-pass calculation, V of an empty part is undefined (0/0)
+         out[VX] = reference[0] + s[1]/rho;
+         out[VY] = reference[1] + s[2]/rho;
+         out[VZ] = reference[2] + s[3]/rho;
+         if (rho != 0.0) {
+            out[P_11] = mass * (s[4] - s[1]*s[1]/rho);
+            out[P_22] = mass * (s[5] - s[2]*s[2]/rho);
+            out[P_33] = mass * (s[6] - s[3]*s[3]/rho);
+            out[P_23] = mass * (s[7] - s[2]*s[3]/rho);
+            out[P_13] = mass * (s[8] - s[3]*s[1]/rho);
+            out[P_12] = mass * (s[9] - s[1]*s[2]/rho);
+         } else {
+            // Empty part: no pressure, where the two-pass calculation may give NaN
+            for (int v=P_11; v<=P_12; ++v) out[v] = 0.0;
+         }
+      }
+      if (doEnergy == true) {
+         // Energy density in units eV/cm^3 instead of Joules per m^3
+         Real* out = result + ENERGYDENSITY*N_VALUES;
+         for (int e=0; e<3; ++e) out[e] = energy[e] * (1.0e-6)/physicalconstants::CHARGE;
+      }
+   }
+
+} // namespace DRO
+
+#endif
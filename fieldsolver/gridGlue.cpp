@@ -1,139 +1,365 @@
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+#include <unordered_set>
 #include <dccrg.hpp>
 #include <dccrg_cartesian_geometry.hpp>
 #include "../grid.h"
 #include "../spatial_cell.hpp"
 #include "../definitions.h"
 #include "../common.h"
+#include "../mpiconversion.h"
 #include "gridGlue.hpp"
 
-void feedMomentsIntoFsGrid(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
-                           const std::vector<CellID>& cells,
-                           FsGrid< std::array<Real, fsgrids::moments::N_MOMENTS>, 2>& momentsGrid, bool dt2 /*=false*/) {
-
-   momentsGrid.setupForTransferIn(cells.size());
-
-   // Setup transfer buffers
-   std::vector< std::array<Real, fsgrids::moments::N_MOMENTS> > transferBuffer(cells.size());
+FsGridCoupling::FsGridCoupling() : comm(MPI_COMM_NULL), rank(-1), nCoupledCells(0) {
+   for (int c=0; c<N_CHANNELS; ++c) {
+      channels[c].recordSize = 0;
+      channels[c].initialized = false;
+   }
+}
 
-   // Fill from cellParams
-   #pragma omp parallel for
-   for(int i=0; i< cells.size(); i++) {
-      auto cellParams = mpiGrid[cells[i]]->get_cell_parameters();
-      std::array<Real, fsgrids::moments::N_MOMENTS>* thisCellData = &transferBuffer[i];
-    
-      if(!dt2) {
-         thisCellData->at(fsgrids::moments::RHOM) = cellParams[CellParams::RHOM];
-         thisCellData->at(fsgrids::moments::RHOQ) = cellParams[CellParams::RHOQ];
-         thisCellData->at(fsgrids::moments::VX) = cellParams[CellParams::VX];
-         thisCellData->at(fsgrids::moments::VY) = cellParams[CellParams::VY];
-         thisCellData->at(fsgrids::moments::VZ) = cellParams[CellParams::VZ];
-         thisCellData->at(fsgrids::moments::P_11) = cellParams[CellParams::P_11];
-         thisCellData->at(fsgrids::moments::P_22) = cellParams[CellParams::P_22];
-         thisCellData->at(fsgrids::moments::P_33) = cellParams[CellParams::P_33];
+FsGridCoupling::~FsGridCoupling() { }
+
+void FsGridCoupling::setup(FsGrid< fsgrids::technical, 2>& technicalGrid, const std::vector<CellID>& cells) {
+   freeChannels();
+
+   comm = technicalGrid.getComm();
+   rank = technicalGrid.getRank();
+   int nTasks;
+   MPI_Comm_size(comm, &nTasks);
+   nCoupledCells = cells.size();
+
+   // Find the FsGrid task and local storage index of every local cell.
+   // FSGrid cellIds are 0-based, whereas DCCRG cellIds are 1-based, beware
+   std::vector<int> targetTask(cells.size());
+   std::vector<int64_t> targetID(cells.size());
+   std::vector<int> sendCounts(nTasks, 0);
+   localCopies.clear();
+   for (uint i=0; i<cells.size(); ++i) {
+      const auto taskAndID = technicalGrid.getTaskForGlobalID(cells[i] - 1);
+      targetTask[i] = taskAndID.first;
+      targetID[i] = taskAndID.second;
+      if (targetTask[i] == rank) {
+         localCopies.push_back(std::make_pair(i, targetID[i]));
       } else {
-         thisCellData->at(fsgrids::moments::RHOM) = cellParams[CellParams::RHOM_DT2];
-         thisCellData->at(fsgrids::moments::RHOQ) = cellParams[CellParams::RHOQ_DT2];
-         thisCellData->at(fsgrids::moments::VX) = cellParams[CellParams::VX_DT2];
-         thisCellData->at(fsgrids::moments::VY) = cellParams[CellParams::VY_DT2];
-         thisCellData->at(fsgrids::moments::VZ) = cellParams[CellParams::VZ_DT2];
-         thisCellData->at(fsgrids::moments::P_11) = cellParams[CellParams::P_11_DT2];
-         thisCellData->at(fsgrids::moments::P_22) = cellParams[CellParams::P_22_DT2];
-         thisCellData->at(fsgrids::moments::P_33) = cellParams[CellParams::P_33_DT2];
+         sendCounts[targetTask[i]]++;
       }
    }
 
-   for(int i=0; i< cells.size(); i++) {
-      momentsGrid.transferDataIn(cells[i] - 1, &transferBuffer[i]);
+   // Group remote cells by target task, keeping the local cell order within each task
+   std::vector<int> sendDispls(nTasks + 1, 0);
+   for (int t=0; t<nTasks; ++t) {
+      sendDispls[t+1] = sendDispls[t] + sendCounts[t];
+   }
+   dccrgCells.resize(sendDispls[nTasks]);
+   std::vector<int64_t> sendIDs(sendDispls[nTasks]);
+   std::vector<int> fill(sendDispls.begin(), sendDispls.end() - 1);
+   for (uint i=0; i<cells.size(); ++i) {
+      if (targetTask[i] == rank) continue;
+      const int position = fill[targetTask[i]]++;
+      dccrgCells[position] = i;
+      sendIDs[position] = targetID[i];
    }
 
-   // Finish the actual transfer
-   momentsGrid.finishTransfersIn();
+   dccrgPeers.clear();
+   dccrgOffsets.clear();
+   for (int t=0; t<nTasks; ++t) {
+      if (sendCounts[t] == 0) continue;
+      dccrgPeers.push_back(t);
+      dccrgOffsets.push_back(sendDispls[t]);
+   }
+   dccrgOffsets.push_back(dccrgCells.size());
+
+   // Tell each FsGrid task which of its cells it will receive from us, and in which order
+   std::vector<int> recvCounts(nTasks, 0);
+   MPI_Alltoall(sendCounts.data(), 1, MPI_INT, recvCounts.data(), 1, MPI_INT, comm);
+   std::vector<int> recvDispls(nTasks + 1, 0);
+   for (int t=0; t<nTasks; ++t) {
+      recvDispls[t+1] = recvDispls[t] + recvCounts[t];
+   }
+   fsLocalIDs.resize(recvDispls[nTasks]);
+   MPI_Alltoallv(sendIDs.data(), sendCounts.data(), sendDispls.data(), MPI_Type<int64_t>(),
+                 fsLocalIDs.data(), recvCounts.data(), recvDispls.data(), MPI_Type<int64_t>(), comm);
+
+   fsPeers.clear();
+   fsOffsets.clear();
+   for (int t=0; t<nTasks; ++t) {
+      if (recvCounts[t] == 0) continue;
+      fsPeers.push_back(t);
+      fsOffsets.push_back(recvDispls[t]);
+   }
+   fsOffsets.push_back(fsLocalIDs.size());
 }
 
+void FsGridCoupling::initializeChannel(Channel channel, const int recordSize, const bool inwards) {
+   ChannelData& data = channels[channel];
+   if (data.initialized) {
+      if (data.recordSize != recordSize) {
+         std::cerr << "ERROR, FsGridCoupling channel " << channel << " used with record size " << recordSize;
+         std::cerr << " but was initialized with " << data.recordSize << " at " << __FILE__ << ":" << __LINE__ << std::endl;
+         abort();
+      }
+      return;
+   }
 
-void feedBgFieldsIntoFsGrid(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
-    const std::vector<CellID>& cells, FsGrid< std::array<Real, fsgrids::bgbfield::N_BGB>, 2>& bgBGrid) {
+   // Buffers must not be reallocated after this, the persistent requests point into them
+   const int tag = 32000 + channel;
+   data.recordSize = recordSize;
+   data.dccrgBuffer.resize(dccrgCells.size() * recordSize);
+   data.fsBuffer.resize(fsLocalIDs.size() * recordSize);
+   data.dccrgRequests.resize(dccrgPeers.size());
+   data.fsRequests.resize(fsPeers.size());
+
+   for (uint p=0; p<dccrgPeers.size(); ++p) {
+      Real* buffer = &(data.dccrgBuffer[dccrgOffsets[p] * recordSize]);
+      const int count = (dccrgOffsets[p+1] - dccrgOffsets[p]) * recordSize;
+      if (inwards) {
+         MPI_Send_init(buffer, count, MPI_Type<Real>(), dccrgPeers[p], tag, comm, &(data.dccrgRequests[p]));
+      } else {
+         MPI_Recv_init(buffer, count, MPI_Type<Real>(), dccrgPeers[p], tag, comm, &(data.dccrgRequests[p]));
+      }
+   }
+   for (uint p=0; p<fsPeers.size(); ++p) {
+      Real* buffer = &(data.fsBuffer[fsOffsets[p] * recordSize]);
+      const int count = (fsOffsets[p+1] - fsOffsets[p]) * recordSize;
+      if (inwards) {
+         MPI_Recv_init(buffer, count, MPI_Type<Real>(), fsPeers[p], tag, comm, &(data.fsRequests[p]));
+      } else {
+         MPI_Send_init(buffer, count, MPI_Type<Real>(), fsPeers[p], tag, comm, &(data.fsRequests[p]));
+      }
+   }
+   data.initialized = true;
+}
+
+void FsGridCoupling::freeChannels() {
+   for (int c=0; c<N_CHANNELS; ++c) {
+      ChannelData& data = channels[c];
+      for (uint p=0; p<data.dccrgRequests.size(); ++p) {
+         MPI_Request_free(&(data.dccrgRequests[p]));
+      }
+      for (uint p=0; p<data.fsRequests.size(); ++p) {
+         MPI_Request_free(&(data.fsRequests[p]));
+      }
+      data.dccrgRequests.clear();
+      data.fsRequests.clear();
+      std::vector<Real>().swap(data.dccrgBuffer);
+      std::vector<Real>().swap(data.fsBuffer);
+      data.recordSize = 0;
+      data.initialized = false;
+   }
+}
 
-  bgBGrid.setupForTransferIn(cells.size());
+void FsGridCoupling::finalize() {
+   freeChannels();
+}
 
-   // Setup transfer buffers
-   std::vector< std::array<Real, fsgrids::bgbfield::N_BGB> > transferBuffer(cells.size());
+double FsGridCoupling::computeLocalFraction() const {
+   uint64_t localCounts[2] = {localCopies.size(), nCoupledCells};
+   uint64_t globalCounts[2] = {0, 0};
+   MPI_Allreduce(localCounts, globalCounts, 2, MPI_Type<uint64_t>(), MPI_SUM, comm);
+   if (globalCounts[1] == 0) return 1.0;
+   return (double)globalCounts[0] / globalCounts[1];
+}
 
-   // Fill from cellParams
-   #pragma omp parallel for
-   for(int i=0; i< cells.size(); i++) {
-      auto cellParams = mpiGrid[cells[i]]->get_cell_parameters();
-      auto derivatives = mpiGrid[cells[i]]->derivatives;
-      auto volumeDerivatives = mpiGrid[cells[i]]->derivativesBVOL;
-      std::array<Real, fsgrids::bgbfield::N_BGB>* thisCellData = &transferBuffer[i];
-
-      thisCellData->at(fsgrids::bgbfield::BGBX) = cellParams[CellParams::BGBX];
-      thisCellData->at(fsgrids::bgbfield::BGBY) = cellParams[CellParams::BGBY];
-      thisCellData->at(fsgrids::bgbfield::BGBZ) = cellParams[CellParams::BGBZ];
-      thisCellData->at(fsgrids::bgbfield::BGBXVOL) = cellParams[CellParams::BGBXVOL];
-      thisCellData->at(fsgrids::bgbfield::BGBYVOL) = cellParams[CellParams::BGBYVOL];
-      thisCellData->at(fsgrids::bgbfield::BGBZVOL) = cellParams[CellParams::BGBZVOL];
-
-      thisCellData->at(fsgrids::bgbfield::dBGBxdy) = derivatives[fieldsolver::dBGBxdy];
-      thisCellData->at(fsgrids::bgbfield::dBGBxdz) = derivatives[fieldsolver::dBGBxdz];
-      thisCellData->at(fsgrids::bgbfield::dBGBydx) = derivatives[fieldsolver::dBGBydx];
-      thisCellData->at(fsgrids::bgbfield::dBGBydz) = derivatives[fieldsolver::dBGBydz];
-      thisCellData->at(fsgrids::bgbfield::dBGBzdx) = derivatives[fieldsolver::dBGBzdx];
-      thisCellData->at(fsgrids::bgbfield::dBGBzdy) = derivatives[fieldsolver::dBGBzdy];
-
-      thisCellData->at(fsgrids::bgbfield::dBGBXVOLdy) = volumeDerivatives[bvolderivatives::dBGBXVOLdy];
-      thisCellData->at(fsgrids::bgbfield::dBGBXVOLdz) = volumeDerivatives[bvolderivatives::dBGBXVOLdz];
-      thisCellData->at(fsgrids::bgbfield::dBGBYVOLdx) = volumeDerivatives[bvolderivatives::dBGBYVOLdx];
-      thisCellData->at(fsgrids::bgbfield::dBGBYVOLdz) = volumeDerivatives[bvolderivatives::dBGBYVOLdz];
-      thisCellData->at(fsgrids::bgbfield::dBGBZVOLdx) = volumeDerivatives[bvolderivatives::dBGBZVOLdx];
-      thisCellData->at(fsgrids::bgbfield::dBGBZVOLdy) = volumeDerivatives[bvolderivatives::dBGBZVOLdy];
+void pinCellsToFsGrid(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                      const std::vector<CellID>& cells,
+                      FsGrid< fsgrids::technical, 2>& technicalGrid,
+                      std::unordered_set<CellID>& pinnedCells) {
+   pinnedCells.clear();
+
+   // FsGrid task numbers are ranks in its own cartesian communicator, translate them to
+   // the communicator of the DCCRG grid
+   MPI_Comm dccrgComm = mpiGrid.get_communicator();
+   int nRanks;
+   MPI_Comm_size(dccrgComm, &nRanks);
+   MPI_Group fsGroup, dccrgGroup;
+   MPI_Comm_group(technicalGrid.getComm(), &fsGroup);
+   MPI_Comm_group(dccrgComm, &dccrgGroup);
+   int nTasks;
+   MPI_Group_size(fsGroup, &nTasks);
+   std::vector<int> fsRanks(nTasks);
+   std::vector<int> dccrgRanks(nTasks);
+   for (int t=0; t<nTasks; ++t) {
+      fsRanks[t] = t;
+   }
+   MPI_Group_translate_ranks(fsGroup, nTasks, fsRanks.data(), dccrgGroup, dccrgRanks.data());
+   MPI_Group_free(&fsGroup);
+   MPI_Group_free(&dccrgGroup);
+
+   // Vlasov work in each FsGrid task box. FSGrid cellIds are 0-based, whereas DCCRG
+   // cellIds are 1-based, beware
+   std::vector<int> cellTask(cells.size());
+   std::vector<double> localBoxWeight(nTasks, 0.0);
+   std::vector<double> boxWeight(nTasks, 0.0);
+   for (uint i=0; i<cells.size(); ++i) {
+      cellTask[i] = technicalGrid.getTaskForGlobalID(cells[i] - 1).first;
+      localBoxWeight[cellTask[i]] += mpiGrid[cells[i]]->parameters[CellParams::LBWEIGHTCOUNTER];
+   }
+   MPI_Allreduce(localBoxWeight.data(), boxWeight.data(), nTasks, MPI_DOUBLE, MPI_SUM, dccrgComm);
+   MPI_Comm_free(&dccrgComm);
+
+   // Choose the boxes to pin, the same on every rank. Zoltan spreads the work of the other
+   // boxes evenly, so a rank owning a pinned box ends up with its weight plus an even share
+   // of the rest. Pin the largest set of the lightest boxes for which that stays within the
+   // load balance tolerance.
+   double tolerance = atof(Parameters::loadBalanceTolerance.c_str());
+   if (!(tolerance > 1.0)) tolerance = 1.0;
+   double totalWeight = 0.0;
+   std::vector<int> order(nTasks);
+   for (int t=0; t<nTasks; ++t) {
+      order[t] = t;
+      totalWeight += boxWeight[t];
+   }
+   std::sort(order.begin(), order.end(), [&boxWeight](int a, int b) {
+      return boxWeight[a] < boxWeight[b] || (boxWeight[a] == boxWeight[b] && a < b);
+   });
+   const double maxLoad = tolerance * totalWeight / nRanks;
+   double pinnedWeight = 0.0;
+   int nPinnedBoxes = 0;
+   for (int k=0; k<nTasks; ++k) {
+      pinnedWeight += boxWeight[order[k]];
+      if (boxWeight[order[k]] + (totalWeight - pinnedWeight) / nRanks <= maxLoad) {
+         nPinnedBoxes = k + 1;
+      }
+   }
+   std::vector<bool> pinBox(nTasks, false);
+   for (int k=0; k<nPinnedBoxes; ++k) {
+      pinBox[order[k]] = true;
    }
 
-   for(int i=0; i< cells.size(); i++) {
-      bgBGrid.transferDataIn(cells[i] - 1, &transferBuffer[i]);
+   for (uint i=0; i<cells.size(); ++i) {
+      if (pinBox[cellTask[i]]) {
+         mpiGrid.pin(cells[i], dccrgRanks[cellTask[i]]);
+         pinnedCells.insert(cells[i]);
+      }
    }
+}
 
-   // Finish the actual transfer
-   bgBGrid.finishTransfersIn();
+void feedMomentsIntoFsGrid(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                           const std::vector<CellID>& cells,
+                           FsGrid< std::array<Real, fsgrids::moments::N_MOMENTS>, 2>& momentsGrid,
+                           FsGrid< std::array<Real, fsgrids::moments::N_MOMENTS>, 2>& momentsDt2Grid,
+                           FsGridCoupling& coupling, bool dt2 /*=false*/) {
+
+   const int N = fsgrids::moments::N_MOMENTS;
+
+   // Pack from cellParams, base moments first and then either _DT2 or base moments again
+   auto pack = [&](const uint i, Real* thisCellData) {
+      const Real* cellParams = mpiGrid[cells[i]]->get_cell_parameters();
+
+      thisCellData[fsgrids::moments::RHOM] = cellParams[CellParams::RHOM];
+      thisCellData[fsgrids::moments::RHOQ] = cellParams[CellParams::RHOQ];
+      thisCellData[fsgrids::moments::VX] = cellParams[CellParams::VX];
+      thisCellData[fsgrids::moments::VY] = cellParams[CellParams::VY];
+      thisCellData[fsgrids::moments::VZ] = cellParams[CellParams::VZ];
+      thisCellData[fsgrids::moments::P_11] = cellParams[CellParams::P_11];
+      thisCellData[fsgrids::moments::P_22] = cellParams[CellParams::P_22];
+      thisCellData[fsgrids::moments::P_33] = cellParams[CellParams::P_33];
+
+      Real* dt2CellData = thisCellData + N;
+      if(!dt2) {
+         for (int m=0; m<N; ++m) {
+            dt2CellData[m] = thisCellData[m];
+         }
+      } else {
+         dt2CellData[fsgrids::moments::RHOM] = cellParams[CellParams::RHOM_DT2];
+         dt2CellData[fsgrids::moments::RHOQ] = cellParams[CellParams::RHOQ_DT2];
+         dt2CellData[fsgrids::moments::VX] = cellParams[CellParams::VX_DT2];
+         dt2CellData[fsgrids::moments::VY] = cellParams[CellParams::VY_DT2];
+         dt2CellData[fsgrids::moments::VZ] = cellParams[CellParams::VZ_DT2];
+         dt2CellData[fsgrids::moments::P_11] = cellParams[CellParams::P_11_DT2];
+         dt2CellData[fsgrids::moments::P_22] = cellParams[CellParams::P_22_DT2];
+         dt2CellData[fsgrids::moments::P_33] = cellParams[CellParams::P_33_DT2];
+      }
+   };
+
+   auto unpack = [&](const int64_t id, const Real* thisCellData) {
+      std::array<Real, fsgrids::moments::N_MOMENTS>* moments = momentsGrid.get(id);
+      std::array<Real, fsgrids::moments::N_MOMENTS>* momentsDt2 = momentsDt2Grid.get(id);
+      for (int m=0; m<N; ++m) {
+         (*moments)[m] = thisCellData[m];
+         (*momentsDt2)[m] = thisCellData[N + m];
+      }
+   };
 
+   coupling.transferIn(FsGridCoupling::MOMENTS, 2*N, pack, unpack);
 }
 
-void getVolumeFieldsFromFsGrid(FsGrid< std::array<Real, fsgrids::volfields::N_VOL>, 2>& volumeFieldsGrid,
-                           dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
-                           const std::vector<CellID>& cells) {
 
-   // Setup transfer buffers
-   std::vector< std::array<Real, fsgrids::volfields::N_VOL> > transferBuffer(cells.size());
+void feedBgFieldsIntoFsGrid(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+    const std::vector<CellID>& cells, FsGrid< std::array<Real, fsgrids::bgbfield::N_BGB>, 2>& bgBGrid,
+    FsGridCoupling& coupling) {
+
+   // Pack from cellParams and derivatives
+   auto pack = [&](const uint i, Real* thisCellData) {
+      const Real* cellParams = mpiGrid[cells[i]]->get_cell_parameters();
+      const Real* derivatives = mpiGrid[cells[i]]->derivatives.data();
+      const Real* volumeDerivatives = mpiGrid[cells[i]]->derivativesBVOL.data();
+
+      thisCellData[fsgrids::bgbfield::BGBX] = cellParams[CellParams::BGBX];
+      thisCellData[fsgrids::bgbfield::BGBY] = cellParams[CellParams::BGBY];
+      thisCellData[fsgrids::bgbfield::BGBZ] = cellParams[CellParams::BGBZ];
+      thisCellData[fsgrids::bgbfield::BGBXVOL] = cellParams[CellParams::BGBXVOL];
+      thisCellData[fsgrids::bgbfield::BGBYVOL] = cellParams[CellParams::BGBYVOL];
+      thisCellData[fsgrids::bgbfield::BGBZVOL] = cellParams[CellParams::BGBZVOL];
+
+      thisCellData[fsgrids::bgbfield::dBGBxdy] = derivatives[fieldsolver::dBGBxdy];
+      thisCellData[fsgrids::bgbfield::dBGBxdz] = derivatives[fieldsolver::dBGBxdz];
+      thisCellData[fsgrids::bgbfield::dBGBydx] = derivatives[fieldsolver::dBGBydx];
+      thisCellData[fsgrids::bgbfield::dBGBydz] = derivatives[fieldsolver::dBGBydz];
+      thisCellData[fsgrids::bgbfield::dBGBzdx] = derivatives[fieldsolver::dBGBzdx];
+      thisCellData[fsgrids::bgbfield::dBGBzdy] = derivatives[fieldsolver::dBGBzdy];
+
+      thisCellData[fsgrids::bgbfield::dBGBXVOLdy] = volumeDerivatives[bvolderivatives::dBGBXVOLdy];
+      thisCellData[fsgrids::bgbfield::dBGBXVOLdz] = volumeDerivatives[bvolderivatives::dBGBXVOLdz];
+      thisCellData[fsgrids::bgbfield::dBGBYVOLdx] = volumeDerivatives[bvolderivatives::dBGBYVOLdx];
+      thisCellData[fsgrids::bgbfield::dBGBYVOLdz] = volumeDerivatives[bvolderivatives::dBGBYVOLdz];
+      thisCellData[fsgrids::bgbfield::dBGBZVOLdx] = volumeDerivatives[bvolderivatives::dBGBZVOLdx];
+      thisCellData[fsgrids::bgbfield::dBGBZVOLdy] = volumeDerivatives[bvolderivatives::dBGBZVOLdy];
+   };
+
+   auto unpack = [&](const int64_t id, const Real* thisCellData) {
+      std::array<Real, fsgrids::bgbfield::N_BGB>* bgb = bgBGrid.get(id);
+      for (int m=0; m<fsgrids::bgbfield::N_BGB; ++m) {
+         (*bgb)[m] = thisCellData[m];
+      }
+   };
 
-   // Setup transfer pointers
-   volumeFieldsGrid.setupForTransferOut(cells.size());
-   for(int i=0; i< cells.size(); i++) {
-      std::array<Real, fsgrids::volfields::N_VOL>* thisCellData = &transferBuffer[i];
-      volumeFieldsGrid.transferDataOut(cells[i] - 1, thisCellData);
-   }
-   // Do the transfer
-   volumeFieldsGrid.finishTransfersOut();
+   coupling.transferIn(FsGridCoupling::BGFIELDS, fsgrids::bgbfield::N_BGB, pack, unpack);
+}
 
-   // Distribute data from the transfer buffer back into the appropriate mpiGrid places
-   #pragma omp parallel for
-   for(int i=0; i< cells.size(); i++) {
-      std::array<Real, fsgrids::volfields::N_VOL>* thisCellData = &transferBuffer[i];
-      auto cellParams = mpiGrid[cells[i]]->get_cell_parameters();
-
-      cellParams[CellParams::PERBXVOL]                          = thisCellData->at(fsgrids::volfields::PERBXVOL);
-      cellParams[CellParams::PERBYVOL]                          = thisCellData->at(fsgrids::volfields::PERBYVOL);
-      cellParams[CellParams::PERBZVOL]                          = thisCellData->at(fsgrids::volfields::PERBZVOL);
-      cellParams[CellParams::EXVOL]                             = thisCellData->at(fsgrids::volfields::EXVOL);
-      cellParams[CellParams::EYVOL]                             = thisCellData->at(fsgrids::volfields::EYVOL);
-      cellParams[CellParams::EZVOL]                             = thisCellData->at(fsgrids::volfields::EZVOL);
-      mpiGrid[cells[i]]->derivativesBVOL[bvolderivatives::dPERBXVOLdy] = thisCellData->at(fsgrids::volfields::dPERBXVOLdy);
-      mpiGrid[cells[i]]->derivativesBVOL[bvolderivatives::dPERBXVOLdz] = thisCellData->at(fsgrids::volfields::dPERBXVOLdz);
-      mpiGrid[cells[i]]->derivativesBVOL[bvolderivatives::dPERBYVOLdx] = thisCellData->at(fsgrids::volfields::dPERBYVOLdx);
-      mpiGrid[cells[i]]->derivativesBVOL[bvolderivatives::dPERBYVOLdz] = thisCellData->at(fsgrids::volfields::dPERBYVOLdz);
-      mpiGrid[cells[i]]->derivativesBVOL[bvolderivatives::dPERBZVOLdx] = thisCellData->at(fsgrids::volfields::dPERBZVOLdx);
-      mpiGrid[cells[i]]->derivativesBVOL[bvolderivatives::dPERBZVOLdy] = thisCellData->at(fsgrids::volfields::dPERBZVOLdy);
-   }
+void getVolumeFieldsFromFsGrid(FsGrid< std::array<Real, fsgrids::volfields::N_VOL>, 2>& volumeFieldsGrid,
+                           dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                           const std::vector<CellID>& cells,
+                           FsGridCoupling& coupling) {
 
+   auto pack = [&](const int64_t id, Real* thisCellData) {
+      const std::array<Real, fsgrids::volfields::N_VOL>* vol = volumeFieldsGrid.get(id);
+      for (int m=0; m<fsgrids::volfields::N_VOL; ++m) {
+         thisCellData[m] = (*vol)[m];
+      }
+   };
+
+   // Distribute data back into the appropriate mpiGrid places
+   auto unpack = [&](const uint i, const Real* thisCellData) {
+      Real* cellParams = mpiGrid[cells[i]]->get_cell_parameters();
+      Real* derivativesBVOL = mpiGrid[cells[i]]->derivativesBVOL.data();
+
+      cellParams[CellParams::PERBXVOL]                 = thisCellData[fsgrids::volfields::PERBXVOL];
+      cellParams[CellParams::PERBYVOL]                 = thisCellData[fsgrids::volfields::PERBYVOL];
+      cellParams[CellParams::PERBZVOL]                 = thisCellData[fsgrids::volfields::PERBZVOL];
+      cellParams[CellParams::EXVOL]                    = thisCellData[fsgrids::volfields::EXVOL];
+      cellParams[CellParams::EYVOL]                    = thisCellData[fsgrids::volfields::EYVOL];
+      cellParams[CellParams::EZVOL]                    = thisCellData[fsgrids::volfields::EZVOL];
+      derivativesBVOL[bvolderivatives::dPERBXVOLdy]    = thisCellData[fsgrids::volfields::dPERBXVOLdy];
+      derivativesBVOL[bvolderivatives::dPERBXVOLdz]    = thisCellData[fsgrids::volfields::dPERBXVOLdz];
+      derivativesBVOL[bvolderivatives::dPERBYVOLdx]    = thisCellData[fsgrids::volfields::dPERBYVOLdx];
+      derivativesBVOL[bvolderivatives::dPERBYVOLdz]    = thisCellData[fsgrids::volfields::dPERBYVOLdz];
+      derivativesBVOL[bvolderivatives::dPERBZVOLdx]    = thisCellData[fsgrids::volfields::dPERBZVOLdx];
+      derivativesBVOL[bvolderivatives::dPERBZVOLdy]    = thisCellData[fsgrids::volfields::dPERBZVOLdy];
+   };
+
+   coupling.transferOut(FsGridCoupling::VOLFIELDS, fsgrids::volfields::N_VOL, pack, unpack);
 }
 
 
@@ -141,99 +367,88 @@ void getDerivativesFromFsGrid(FsGrid< std::array<Real, fsgrids::dperb::N_DPERB>,
                           FsGrid< std::array<Real, fsgrids::dmoments::N_DMOMENTS>, 2>& dmomentsGrid,
                           FsGrid< std::array<Real, fsgrids::bgbfield::N_BGB>, 2>& bgbfieldGrid,
                           dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
-                          const std::vector<CellID>& cells) {
-
-   // Setup transfer buffers
-   std::vector< std::array<Real, fsgrids::dperb::N_DPERB> > dperbTransferBuffer(cells.size());
-   std::vector< std::array<Real, fsgrids::dmoments::N_DMOMENTS> > dmomentsTransferBuffer(cells.size());
-   std::vector< std::array<Real, fsgrids::bgbfield::N_BGB> > bgbfieldTransferBuffer(cells.size());
-
-   // Transfer dperbGrid data
-   dperbGrid.setupForTransferOut(cells.size());
-   for(int i=0; i< cells.size(); i++) {
-      std::array<Real, fsgrids::dperb::N_DPERB>* thisCellData = &dperbTransferBuffer[i];
-      dperbGrid.transferDataOut(cells[i] - 1, thisCellData);
-   }
-   // Do the transfer
-   dperbGrid.finishTransfersOut();
-
-   // Transfer dmomentsGrid data
-   dmomentsGrid.setupForTransferOut(cells.size());
-   for(int i=0; i< cells.size(); i++) {
-      std::array<Real, fsgrids::dmoments::N_DMOMENTS>* thisCellData = &dmomentsTransferBuffer[i];
-      dmomentsGrid.transferDataOut(cells[i] - 1, thisCellData);
-   }
-   // Do the transfer
-   dmomentsGrid.finishTransfersOut();
-
-   // Transfer bgbfieldGrid data
-   bgbfieldGrid.setupForTransferOut(cells.size());
-   for(int i=0; i< cells.size(); i++) {
-      std::array<Real, fsgrids::bgbfield::N_BGB>* thisCellData = &bgbfieldTransferBuffer[i];
-      bgbfieldGrid.transferDataOut(cells[i] - 1, thisCellData);
-   }
-   // Do the transfer
-   bgbfieldGrid.finishTransfersOut();
-
-   // Distribute data from the transfer buffers back into the appropriate mpiGrid places
-   #pragma omp parallel for
-   for(int i=0; i< cells.size(); i++) {
-      std::array<Real, fsgrids::dperb::N_DPERB>* dperb = &dperbTransferBuffer[i];
-      std::array<Real, fsgrids::dmoments::N_DMOMENTS>* dmoments = &dmomentsTransferBuffer[i];
-      std::array<Real, fsgrids::bgbfield::N_BGB>* bgbfield = &bgbfieldTransferBuffer[i];
-      auto cellParams = mpiGrid[cells[i]]->get_cell_parameters();
-
-      mpiGrid[cells[i]]->derivatives[fieldsolver::drhomdx] = dmoments->at(fsgrids::dmoments::drhomdx);
-      mpiGrid[cells[i]]->derivatives[fieldsolver::drhomdy] = dmoments->at(fsgrids::dmoments::drhomdy);
-      mpiGrid[cells[i]]->derivatives[fieldsolver::drhomdz] = dmoments->at(fsgrids::dmoments::drhomdz);
-      mpiGrid[cells[i]]->derivatives[fieldsolver::drhoqdx] = dmoments->at(fsgrids::dmoments::drhoqdx);
-      mpiGrid[cells[i]]->derivatives[fieldsolver::drhoqdy] = dmoments->at(fsgrids::dmoments::drhoqdy);
-      mpiGrid[cells[i]]->derivatives[fieldsolver::drhoqdz] = dmoments->at(fsgrids::dmoments::drhoqdz);
-      mpiGrid[cells[i]]->derivatives[fieldsolver::dp11dx] = dmoments->at(fsgrids::dmoments::dp11dx);
-      mpiGrid[cells[i]]->derivatives[fieldsolver::dp11dy] = dmoments->at(fsgrids::dmoments::dp11dy);
-      mpiGrid[cells[i]]->derivatives[fieldsolver::dp11dz] = dmoments->at(fsgrids::dmoments::dp11dz);
-      mpiGrid[cells[i]]->derivatives[fieldsolver::dp22dx] = dmoments->at(fsgrids::dmoments::dp22dx);
-      mpiGrid[cells[i]]->derivatives[fieldsolver::dp22dy] = dmoments->at(fsgrids::dmoments::dp22dy);
-      mpiGrid[cells[i]]->derivatives[fieldsolver::dp22dz] = dmoments->at(fsgrids::dmoments::dp22dz);
-      mpiGrid[cells[i]]->derivatives[fieldsolver::dp33dx] = dmoments->at(fsgrids::dmoments::dp33dx);
-      mpiGrid[cells[i]]->derivatives[fieldsolver::dp33dy] = dmoments->at(fsgrids::dmoments::dp33dy);
-      mpiGrid[cells[i]]->derivatives[fieldsolver::dp33dz] = dmoments->at(fsgrids::dmoments::dp33dz);
-
-      mpiGrid[cells[i]]->derivatives[fieldsolver::dVxdx] = dmoments->at(fsgrids::dmoments::dVxdx);
-      mpiGrid[cells[i]]->derivatives[fieldsolver::dVxdy] = dmoments->at(fsgrids::dmoments::dVxdy);
-      mpiGrid[cells[i]]->derivatives[fieldsolver::dVxdz] = dmoments->at(fsgrids::dmoments::dVxdz);
-      mpiGrid[cells[i]]->derivatives[fieldsolver::dVydx] = dmoments->at(fsgrids::dmoments::dVydx);
-      mpiGrid[cells[i]]->derivatives[fieldsolver::dVydy] = dmoments->at(fsgrids::dmoments::dVydy);
-      mpiGrid[cells[i]]->derivatives[fieldsolver::dVydz] = dmoments->at(fsgrids::dmoments::dVydz);
-      mpiGrid[cells[i]]->derivatives[fieldsolver::dVzdx] = dmoments->at(fsgrids::dmoments::dVzdx);
-      mpiGrid[cells[i]]->derivatives[fieldsolver::dVzdy] = dmoments->at(fsgrids::dmoments::dVzdy);
-      mpiGrid[cells[i]]->derivatives[fieldsolver::dVzdz] = dmoments->at(fsgrids::dmoments::dVzdz);
-
-      mpiGrid[cells[i]]->derivatives[fieldsolver::dPERBxdy] = dperb->at(fsgrids::dperb::dPERBxdy);
-      mpiGrid[cells[i]]->derivatives[fieldsolver::dPERBxdz] = dperb->at(fsgrids::dperb::dPERBxdz);
-      mpiGrid[cells[i]]->derivatives[fieldsolver::dPERBydx] = dperb->at(fsgrids::dperb::dPERBydx);
-      mpiGrid[cells[i]]->derivatives[fieldsolver::dPERBydz] = dperb->at(fsgrids::dperb::dPERBydz);
-      mpiGrid[cells[i]]->derivatives[fieldsolver::dPERBzdx] = dperb->at(fsgrids::dperb::dPERBzdx);
-      mpiGrid[cells[i]]->derivatives[fieldsolver::dPERBzdy] = dperb->at(fsgrids::dperb::dPERBzdy);
-
-      mpiGrid[cells[i]]->derivatives[fieldsolver::dPERBxdyy] = dperb->at(fsgrids::dperb::dPERBxdyy);
-      mpiGrid[cells[i]]->derivatives[fieldsolver::dPERBxdzz] = dperb->at(fsgrids::dperb::dPERBxdzz);
-      mpiGrid[cells[i]]->derivatives[fieldsolver::dPERBydxx] = dperb->at(fsgrids::dperb::dPERBydxx);
-      mpiGrid[cells[i]]->derivatives[fieldsolver::dPERBydzz] = dperb->at(fsgrids::dperb::dPERBydzz);
-      mpiGrid[cells[i]]->derivatives[fieldsolver::dPERBzdxx] = dperb->at(fsgrids::dperb::dPERBzdxx);
-      mpiGrid[cells[i]]->derivatives[fieldsolver::dPERBzdyy] = dperb->at(fsgrids::dperb::dPERBzdyy);
-      mpiGrid[cells[i]]->derivatives[fieldsolver::dPERBxdyz] = dperb->at(fsgrids::dperb::dPERBxdyz);
-      mpiGrid[cells[i]]->derivatives[fieldsolver::dPERBydxz] = dperb->at(fsgrids::dperb::dPERBydxz);
-      mpiGrid[cells[i]]->derivatives[fieldsolver::dPERBzdxy] = dperb->at(fsgrids::dperb::dPERBzdxy);
-
-      mpiGrid[cells[i]]->derivatives[fieldsolver::dBGBxdy] = bgbfield->at(fsgrids::bgbfield::dBGBxdy);
-      mpiGrid[cells[i]]->derivatives[fieldsolver::dBGBxdz] = bgbfield->at(fsgrids::bgbfield::dBGBxdz);
-      mpiGrid[cells[i]]->derivatives[fieldsolver::dBGBydx] = bgbfield->at(fsgrids::bgbfield::dBGBydx);
-      mpiGrid[cells[i]]->derivatives[fieldsolver::dBGBydz] = bgbfield->at(fsgrids::bgbfield::dBGBydz);
-      mpiGrid[cells[i]]->derivatives[fieldsolver::dBGBzdx] = bgbfield->at(fsgrids::bgbfield::dBGBzdx);
-      mpiGrid[cells[i]]->derivatives[fieldsolver::dBGBzdy] = bgbfield->at(fsgrids::bgbfield::dBGBzdy);
-   }
-
+                          const std::vector<CellID>& cells,
+                          FsGridCoupling& coupling) {
+
+   // Record layout: dperb, then dmoments, then bgbfield
+   const int dmomentsOffset = fsgrids::dperb::N_DPERB;
+   const int bgbfieldOffset = dmomentsOffset + fsgrids::dmoments::N_DMOMENTS;
+   const int recordSize = bgbfieldOffset + fsgrids::bgbfield::N_BGB;
+
+   auto pack = [&](const int64_t id, Real* thisCellData) {
+      const std::array<Real, fsgrids::dperb::N_DPERB>* dperb = dperbGrid.get(id);
+      const std::array<Real, fsgrids::dmoments::N_DMOMENTS>* dmoments = dmomentsGrid.get(id);
+      const std::array<Real, fsgrids::bgbfield::N_BGB>* bgbfield = bgbfieldGrid.get(id);
+      for (int m=0; m<fsgrids::dperb::N_DPERB; ++m) {
+         thisCellData[m] = (*dperb)[m];
+      }
+      for (int m=0; m<fsgrids::dmoments::N_DMOMENTS; ++m) {
+         thisCellData[dmomentsOffset + m] = (*dmoments)[m];
+      }
+      for (int m=0; m<fsgrids::bgbfield::N_BGB; ++m) {
+         thisCellData[bgbfieldOffset + m] = (*bgbfield)[m];
+      }
+   };
+
+   // Distribute data back into the appropriate mpiGrid places
+   auto unpack = [&](const uint i, const Real* thisCellData) {
+      const Real* dperb = thisCellData;
+      const Real* dmoments = thisCellData + dmomentsOffset;
+      const Real* bgbfield = thisCellData + bgbfieldOffset;
+      Real* derivatives = mpiGrid[cells[i]]->derivatives.data();
+
+      derivatives[fieldsolver::drhomdx] = dmoments[fsgrids::dmoments::drhomdx];
+      derivatives[fieldsolver::drhomdy] = dmoments[fsgrids::dmoments::drhomdy];
+      derivatives[fieldsolver::drhomdz] = dmoments[fsgrids::dmoments::drhomdz];
+      derivatives[fieldsolver::drhoqdx] = dmoments[fsgrids::dmoments::drhoqdx];
+      derivatives[fieldsolver::drhoqdy] = dmoments[fsgrids::dmoments::drhoqdy];
+      derivatives[fieldsolver::drhoqdz] = dmoments[fsgrids::dmoments::drhoqdz];
+      derivatives[fieldsolver::dp11dx] = dmoments[fsgrids::dmoments::dp11dx];
+      derivatives[fieldsolver::dp11dy] = dmoments[fsgrids::dmoments::dp11dy];
+      derivatives[fieldsolver::dp11dz] = dmoments[fsgrids::dmoments::dp11dz];
+      derivatives[fieldsolver::dp22dx] = dmoments[fsgrids::dmoments::dp22dx];
+      derivatives[fieldsolver::dp22dy] = dmoments[fsgrids::dmoments::dp22dy];
+      derivatives[fieldsolver::dp22dz] = dmoments[fsgrids::dmoments::dp22dz];
+      derivatives[fieldsolver::dp33dx] = dmoments[fsgrids::dmoments::dp33dx];
+      derivatives[fieldsolver::dp33dy] = dmoments[fsgrids::dmoments::dp33dy];
+      derivatives[fieldsolver::dp33dz] = dmoments[fsgrids::dmoments::dp33dz];
+
+      derivatives[fieldsolver::dVxdx] = dmoments[fsgrids::dmoments::dVxdx];
+      derivatives[fieldsolver::dVxdy] = dmoments[fsgrids::dmoments::dVxdy];
+      derivatives[fieldsolver::dVxdz] = dmoments[fsgrids::dmoments::dVxdz];
+      derivatives[fieldsolver::dVydx] = dmoments[fsgrids::dmoments::dVydx];
+      derivatives[fieldsolver::dVydy] = dmoments[fsgrids::dmoments::dVydy];
+      derivatives[fieldsolver::dVydz] = dmoments[fsgrids::dmoments::dVydz];
+      derivatives[fieldsolver::dVzdx] = dmoments[fsgrids::dmoments::dVzdx];
+      derivatives[fieldsolver::dVzdy] = dmoments[fsgrids::dmoments::dVzdy];
+      derivatives[fieldsolver::dVzdz] = dmoments[fsgrids::dmoments::dVzdz];
+
+      derivatives[fieldsolver::dPERBxdy] = dperb[fsgrids::dperb::dPERBxdy];
+      derivatives[fieldsolver::dPERBxdz] = dperb[fsgrids::dperb::dPERBxdz];
+      derivatives[fieldsolver::dPERBydx] = dperb[fsgrids::dperb::dPERBydx];
+      derivatives[fieldsolver::dPERBydz] = dperb[fsgrids::dperb::dPERBydz];
+      derivatives[fieldsolver::dPERBzdx] = dperb[fsgrids::dperb::dPERBzdx];
+      derivatives[fieldsolver::dPERBzdy] = dperb[fsgrids::dperb::dPERBzdy];
+
+      derivatives[fieldsolver::dPERBxdyy] = dperb[fsgrids::dperb::dPERBxdyy];
+      derivatives[fieldsolver::dPERBxdzz] = dperb[fsgrids::dperb::dPERBxdzz];
+      derivatives[fieldsolver::dPERBydxx] = dperb[fsgrids::dperb::dPERBydxx];
+      derivatives[fieldsolver::dPERBydzz] = dperb[fsgrids::dperb::dPERBydzz];
+      derivatives[fieldsolver::dPERBzdxx] = dperb[fsgrids::dperb::dPERBzdxx];
+      derivatives[fieldsolver::dPERBzdyy] = dperb[fsgrids::dperb::dPERBzdyy];
+      derivatives[fieldsolver::dPERBxdyz] = dperb[fsgrids::dperb::dPERBxdyz];
+      derivatives[fieldsolver::dPERBydxz] = dperb[fsgrids::dperb::dPERBydxz];
+      derivatives[fieldsolver::dPERBzdxy] = dperb[fsgrids::dperb::dPERBzdxy];
+
+      derivatives[fieldsolver::dBGBxdy] = bgbfield[fsgrids::bgbfield::dBGBxdy];
+      derivatives[fieldsolver::dBGBxdz] = bgbfield[fsgrids::bgbfield::dBGBxdz];
+      derivatives[fieldsolver::dBGBydx] = bgbfield[fsgrids::bgbfield::dBGBydx];
+      derivatives[fieldsolver::dBGBydz] = bgbfield[fsgrids::bgbfield::dBGBydz];
+      derivatives[fieldsolver::dBGBzdx] = bgbfield[fsgrids::bgbfield::dBGBzdx];
+      derivatives[fieldsolver::dBGBzdy] = bgbfield[fsgrids::bgbfield::dBGBzdy];
+   };
+
+   coupling.transferOut(FsGridCoupling::DERIVATIVES, recordSize, pack, unpack);
 }
     
 
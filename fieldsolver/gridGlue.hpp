@@ -2,40 +2,250 @@
 #include <fsgrid.hpp>
 #include <vector>
 #include <array>
+#include <utility>
+#include <unordered_set>
 
-/*! Take input moments from DCCRG grid and put them into the Fieldsolver grid
+/*! Persistent coupling between the DCCRG and FsGrid decompositions.
+ *
+ * All FsGrids share the same Cartesian decomposition, so one mapping serves
+ * them all. setup() determines, for each local DCCRG cell, which FsGrid task
+ * and local storage index it corresponds to, and tells every FsGrid task in
+ * which order it will receive cells from each DCCRG task. The mapping, the
+ * packing buffers and the persistent MPI requests are then reused for every
+ * transfer until the next call to setup(), i.e. until the next load balance.
+ *
+ * Cells whose DCCRG and FsGrid owners are the same task are copied directly
+ * without going through MPI.
+ */
+class FsGridCoupling {
+public:
+   /*! Independent transfer channels, each with its own buffers, requests and MPI tag.*/
+   enum Channel {
+      MOMENTS,        /*!< DCCRG -> FsGrid, moments and _DT2 moments in one record.*/
+      BGFIELDS,       /*!< DCCRG -> FsGrid, background field and its derivatives.*/
+      VOLFIELDS,      /*!< FsGrid -> DCCRG, volume averaged fields.*/
+      DERIVATIVES,    /*!< FsGrid -> DCCRG, dperb, dmoments and bgb derivatives in one record.*/
+      N_CHANNELS
+   };
+
+   FsGridCoupling();
+   ~FsGridCoupling();
+
+   /*! (Re)build the coupling for the current DCCRG partition. Collective over the FsGrid communicator.
+    * \param technicalGrid Any FsGrid, used only to query the decomposition
+    * \param cells List of local cells, the same list has to be passed to the transfer functions
+    */
+   void setup(FsGrid< fsgrids::technical, 2>& technicalGrid, const std::vector<CellID>& cells);
+
+   /*! Transfer records from DCCRG cells into FsGrid cells.
+    * \param channel Transfer channel to use
+    * \param recordSize Number of Reals per cell, has to be constant for each channel
+    * \param pack Functor (cellIndex, Real* record) filling the record of cells[cellIndex]
+    * \param unpack Functor (localID, const Real* record) storing the record into FsGrid storage
+    */
+   template<typename Pack, typename Unpack>
+   void transferIn(Channel channel, const int recordSize, Pack pack, Unpack unpack);
+
+   /*! Transfer records from FsGrid cells back into DCCRG cells.
+    * \param channel Transfer channel to use
+    * \param recordSize Number of Reals per cell, has to be constant for each channel
+    * \param pack Functor (localID, Real* record) filling the record from FsGrid storage
+    * \param unpack Functor (cellIndex, const Real* record) storing the record into cells[cellIndex]
+    */
+   template<typename Pack, typename Unpack>
+   void transferOut(Channel channel, const int recordSize, Pack pack, Unpack unpack);
+
+   /*! Free the persistent requests. Has to be called before the FsGrids are finalized.*/
+   void finalize();
+
+   /*! Global fraction of coupled cells whose DCCRG and FsGrid owners are the same task.
+    * Collective over the FsGrid communicator.
+    */
+   double computeLocalFraction() const;
+
+   /*! Number of local cells whose FsGrid counterpart lives on the same task.*/
+   size_t getNumberOfLocalCopies() const {return localCopies.size();}
+   /*! Number of local cells coupled by the last call to setup().*/
+   size_t getNumberOfCoupledCells() const {return nCoupledCells;}
+
+private:
+   FsGridCoupling(const FsGridCoupling&);
+   FsGridCoupling& operator=(const FsGridCoupling&);
+
+   /*! Buffers and persistent requests of one channel.*/
+   struct ChannelData {
+      int recordSize;
+      bool initialized;
+      std::vector<Real> dccrgBuffer;           /*!< Records of the DCCRG side, ordered as dccrgCells.*/
+      std::vector<Real> fsBuffer;              /*!< Records of the FsGrid side, ordered as fsLocalIDs.*/
+      std::vector<MPI_Request> dccrgRequests;  /*!< One request per DCCRG side peer.*/
+      std::vector<MPI_Request> fsRequests;     /*!< One request per FsGrid side peer.*/
+   };
+
+   void initializeChannel(Channel channel, const int recordSize, const bool inwards);
+   void freeChannels();
+
+   MPI_Comm comm;
+   int rank;
+   size_t nCoupledCells;
+
+   // DCCRG side: remote FsGrid tasks owning some of our cells.
+   std::vector<int> dccrgPeers;
+   std::vector<size_t> dccrgOffsets;           /*!< dccrgCells range of each peer, size dccrgPeers.size()+1.*/
+   std::vector<uint> dccrgCells;               /*!< Indices into the local cell list.*/
+
+   // FsGrid side: remote DCCRG tasks owning cells of our FsGrid domain.
+   std::vector<int> fsPeers;
+   std::vector<size_t> fsOffsets;              /*!< fsLocalIDs range of each peer, size fsPeers.size()+1.*/
+   std::vector<int64_t> fsLocalIDs;            /*!< FsGrid local storage indices.*/
+
+   // Cells owned by this task on both sides: (index into local cell list, FsGrid local ID).
+   std::vector< std::pair<uint, int64_t> > localCopies;
+
+   ChannelData channels[N_CHANNELS];
+};
+
+template<typename Pack, typename Unpack>
+void FsGridCoupling::transferIn(Channel channel, const int recordSize, Pack pack, Unpack unpack) {
+   initializeChannel(channel, recordSize, true);
+   ChannelData& data = channels[channel];
+
+   if (data.fsRequests.size() > 0) {
+      MPI_Startall(data.fsRequests.size(), data.fsRequests.data());
+   }
+
+   #pragma omp parallel
+   {
+      #pragma omp for nowait
+      for (size_t i=0; i<dccrgCells.size(); ++i) {
+         pack(dccrgCells[i], &(data.dccrgBuffer[i*recordSize]));
+      }
+
+      // Cells on the same task are copied straight into the FsGrid
+      std::vector<Real> record(recordSize);
+      #pragma omp for
+      for (size_t i=0; i<localCopies.size(); ++i) {
+         pack(localCopies[i].first, record.data());
+         unpack(localCopies[i].second, record.data());
+      }
+   }
+
+   if (data.dccrgRequests.size() > 0) {
+      MPI_Startall(data.dccrgRequests.size(), data.dccrgRequests.data());
+   }
+   if (data.fsRequests.size() > 0) {
+      MPI_Waitall(data.fsRequests.size(), data.fsRequests.data(), MPI_STATUSES_IGNORE);
+   }
+
+   #pragma omp parallel for
+   for (size_t i=0; i<fsLocalIDs.size(); ++i) {
+      unpack(fsLocalIDs[i], &(data.fsBuffer[i*recordSize]));
+   }
+
+   if (data.dccrgRequests.size() > 0) {
+      MPI_Waitall(data.dccrgRequests.size(), data.dccrgRequests.data(), MPI_STATUSES_IGNORE);
+   }
+}
+
+template<typename Pack, typename Unpack>
+void FsGridCoupling::transferOut(Channel channel, const int recordSize, Pack pack, Unpack unpack) {
+   initializeChannel(channel, recordSize, false);
+   ChannelData& data = channels[channel];
+
+   if (data.dccrgRequests.size() > 0) {
+      MPI_Startall(data.dccrgRequests.size(), data.dccrgRequests.data());
+   }
+
+   #pragma omp parallel
+   {
+      #pragma omp for nowait
+      for (size_t i=0; i<fsLocalIDs.size(); ++i) {
+         pack(fsLocalIDs[i], &(data.fsBuffer[i*recordSize]));
+      }
+
+      // Cells on the same task are copied straight from the FsGrid
+      std::vector<Real> record(recordSize);
+      #pragma omp for
+      for (size_t i=0; i<localCopies.size(); ++i) {
+         pack(localCopies[i].second, record.data());
+         unpack(localCopies[i].first, record.data());
+      }
+   }
+
+   if (data.fsRequests.size() > 0) {
+      MPI_Startall(data.fsRequests.size(), data.fsRequests.data());
+   }
+   if (data.dccrgRequests.size() > 0) {
+      MPI_Waitall(data.dccrgRequests.size(), data.dccrgRequests.data(), MPI_STATUSES_IGNORE);
+   }
+
+   #pragma omp parallel for
+   for (size_t i=0; i<dccrgCells.size(); ++i) {
+      unpack(dccrgCells[i], &(data.dccrgBuffer[i*recordSize]));
+   }
+
+   if (data.fsRequests.size() > 0) {
+      MPI_Waitall(data.fsRequests.size(), data.fsRequests.data(), MPI_STATUSES_IGNORE);
+   }
+}
+
+/*! Pin local DCCRG cells to the task owning the same cell in the FsGrid decomposition,
+ * where that does not cost load balance.
+ * \param mpiGrid The DCCRG grid, LBWEIGHTCOUNTER of the cells is the Vlasov work
+ * \param cells List of local cells
+ * \param technicalGrid Any FsGrid, used only to query the decomposition
+ * \param pinnedCells Returns the local cells that were pinned
+ *
+ * Whole FsGrid task boxes are pinned, the lightest first, as long as the owner of a pinned
+ * box is expected to stay within loadBalance.tolerance of the mean work once Zoltan has
+ * spread the remaining cells. Pass pinnedCells to balanceLoad, which leaves them out of
+ * the Zoltan partitioning. The coupling of the pinned boxes becomes rank-local. Used
+ * with loadBalance.fsgridColocation.
+ */
+void pinCellsToFsGrid(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                      const std::vector<CellID>& cells,
+                      FsGrid< fsgrids::technical, 2>& technicalGrid,
+                      std::unordered_set<CellID>& pinnedCells);
+
+/*! Take input moments from DCCRG grid and put them into the Fieldsolver grids
  * \param mpiGrid The DCCRG grid carrying rho, rhoV and P
  * \param cells List of local cells
- * \param momentsGrid Fieldsolver grid for these quantities
- * \param dt2 Whether to copy base moments, or _DT2 moments
+ * \param momentsGrid Fieldsolver grid for the base moments
+ * \param momentsDt2Grid Fieldsolver grid for the _DT2 moments
+ * \param coupling Persistent coupling set up for cells
+ * \param dt2 Whether to copy _DT2 moments or base moments into momentsDt2Grid
  *
- * This function assumes that proper grid coupling has been set up.
+ * Both moment sets travel in the same message.
  */
 void feedMomentsIntoFsGrid(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
                            const std::vector<CellID>& cells,
                            FsGrid< std::array<Real, fsgrids::moments::N_MOMENTS>, 2>& momentsGrid,
+                           FsGrid< std::array<Real, fsgrids::moments::N_MOMENTS>, 2>& momentsDt2Grid,
+                           FsGridCoupling& coupling,
                            bool dt2=false);
 
 /*! Copy field solver result (Volume-averaged fields) and store them back into DCCRG
  * \param mpiGrid The DCCRG grid carrying fields.
  * \param cells List of local cells
  * \param volumeFieldsGrid Fieldsolver grid for these quantities
- *
- * This function assumes that proper grid coupling has been set up.
+ * \param coupling Persistent coupling set up for cells
  */
 void getVolumeFieldsFromFsGrid(FsGrid< std::array<Real, fsgrids::volfields::N_VOL>, 2>& volumeFieldsGrid,
                            dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
-                           const std::vector<CellID>& cells);
+                           const std::vector<CellID>& cells,
+                           FsGridCoupling& coupling);
 
 /*! Copy field derivatives from the appropriate FsGrids and store them back into DCCRG
  *
+ * All three grids travel in the same message.
  * This should only be neccessary for debugging.
  */
 void getDerivativesFromFsGrid(FsGrid< std::array<Real, fsgrids::dperb::N_DPERB>, 2>& dperbGrid,
                           FsGrid< std::array<Real, fsgrids::dmoments::N_DMOMENTS>, 2>& dmomentsGrid,
                           FsGrid< std::array<Real, fsgrids::bgbfield::N_BGB>, 2>& bgbfieldGrid,
                           dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
-                          const std::vector<CellID>& cells);
+                          const std::vector<CellID>& cells,
+                          FsGridCoupling& coupling);
 
 /*! Transfer data into technical grid (boundary info etc.)
  * \param mpiGrid The DCCRG grid carrying rho, rhoV and P
@@ -65,12 +275,12 @@ void getFsGridMaxDt(FsGrid< fsgrids::technical, 2>& technicalGrid,
  * \param mpiGrid The DCCRG grid carrying fieldparam data
  * \param cells List of local cells
  * \param targetGrid Fieldsolver grid for these quantities
- *
- * This function assumes that proper grid coupling has been set up.
+ * \param coupling Persistent coupling set up for cells
  */
 void feedBgFieldsIntoFsGrid(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
     const std::vector<CellID>& cells,
-    FsGrid< std::array<Real, fsgrids::bgbfield::N_BGB>, 2>& BgBGrid);
+    FsGrid< std::array<Real, fsgrids::bgbfield::N_BGB>, 2>& BgBGrid,
+    FsGridCoupling& coupling);
 
 /*! Transfer field data from DCCRG cellparams into the appropriate FsGrid structure
  * \param mpiGrid The DCCRG grid carrying fieldparam data
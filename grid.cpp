@@ -26,6 +26,10 @@
 #include <iomanip> // for setprecision()
 #include <cmath>
 #include <vector>
+#include <map>
+#include <set>
+#include <algorithm>
+#include <cstring>
 #include <sstream>
 #include <ctime>
 #include <omp.h>
@@ -171,17 +175,22 @@ void initializeGrid(
    if (P::isRestart) {
       logFile << "Restart from "<< P::restartFileName << std::endl << writeVerbose;
       phiprof::start("Read restart");
-      if (readGrid(mpiGrid,P::restartFileName) == false) {
+      bool backgroundFieldRead = false;
+      if (readGrid(mpiGrid,P::restartFileName,backgroundFieldRead) == false) {
          logFile << "(MAIN) ERROR: restarting failed" << endl;
          exit(1);
       }
       phiprof::stop("Read restart");
-      const vector<CellID>& cells = getLocalCells();
-      //set background field, FIXME should be read in from restart
-      #pragma omp parallel for schedule(dynamic)
-      for (size_t i=0; i<cells.size(); ++i) {
-         SpatialCell* cell = mpiGrid[cells[i]];
-         project.setCellBackgroundField(cell);
+      //set background field, unless it was read from the restart
+      if (backgroundFieldRead == false) {
+         phiprof::start("setCellBackgroundField");
+         const vector<CellID>& cells = getLocalCells();
+         #pragma omp parallel for schedule(dynamic)
+         for (size_t i=0; i<cells.size(); ++i) {
+            SpatialCell* cell = mpiGrid[cells[i]];
+            project.setCellBackgroundField(cell);
+         }
+         phiprof::stop("setCellBackgroundField");
       }
    
       //initial state for sys-boundary cells, will skip those not set to be reapplied at restart
@@ -313,7 +322,8 @@ void initSpatialCellCoordinates(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geomet
 }
 
 
-void balanceLoad(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid, SysBoundary& sysBoundaries){
+void balanceLoad(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid, SysBoundary& sysBoundaries,
+                 const std::unordered_set<CellID>& pinnedCells){
    // Invalidate cached cell lists
    Parameters::meshRepartitioned = true;
 
@@ -333,14 +343,22 @@ void balanceLoad(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid, S
       //counter which is updated in acceleration, otherwise we just
       //use the number of blocks.
 //      if (P::propagateVlasovAcceleration) 
-      mpiGrid.set_cell_weight(cells[i], mpiGrid[cells[i]]->parameters[CellParams::LBWEIGHTCOUNTER]);
+      //Pinned cells do not move with the partition, leave their work out of it
+      if (pinnedCells.count(cells[i]) > 0) {
+         mpiGrid.set_cell_weight(cells[i], 0.0);
+      } else {
+         mpiGrid.set_cell_weight(cells[i], mpiGrid[cells[i]]->parameters[CellParams::LBWEIGHTCOUNTER]);
+      }
 //      else
 //         mpiGrid.set_cell_weight(cells[i], mpiGrid[cells[i]]->get_number_of_all_velocity_blocks());
       //reset counter
       //mpiGrid[cells[i]]->parameters[CellParams::LBWEIGHTCOUNTER] = 0.0;
    }
    phiprof::start("dccrg.initialize_balance_load");
-   mpiGrid.initialize_balance_load(true);
+   // Zoltan is only not needed if every cell has been pinned (see pinCellsToFsGrid)
+   int allPinned = (pinnedCells.size() == cells.size()) ? 1 : 0;
+   MPI_Allreduce(MPI_IN_PLACE, &allPinned, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+   mpiGrid.initialize_balance_load(allPinned == 0);
    phiprof::stop("dccrg.initialize_balance_load");
 
    const std::unordered_set<uint64_t>& incoming_cells = mpiGrid.get_cells_added_by_balance_load();
@@ -427,6 +445,9 @@ void balanceLoad(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid, S
    //finish up load balancing
    phiprof::start("dccrg.finish_balance_load");
    mpiGrid.finish_balance_load();
+   if (pinnedCells.size() > 0) {
+      mpiGrid.unpin_all_cells();
+   }
    phiprof::stop("dccrg.finish_balance_load");
 
    //Make sure transfers are enabled for all cells
@@ -463,6 +484,315 @@ void balanceLoad(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid, S
    phiprof::stop("Balancing load");
 }
 
+static const int BLOCK_WITH_CONTENT_LIST_TAG = 1033; /*!< MPI tag of the single-round content list exchange.*/
+static const int BLOCK_LIST_TAG = 1034;              /*!< MPI tag of the single-round block list exchange.*/
+static const int BLOCK_DATA_TAG = 1035;              /*!< MPI tag of the staged block data exchange.*/
+static const int NEIGHBOR_BLOCK_DATA_TAG = 1036;     /*!< MPI tag of the staged neighbor block data exchange.*/
+
+/*! Communication pattern of the exchanges with remote cells of one neighborhood done
+ * outside dccrg: which local cells are sent to which process and which remote cells
+ * are received from which process, both in cell ID order. Same rule as dccrg uses in
+ * update_copies_of_remote_neighbors: a local cell is sent to the owners of the remote
+ * cells that have it as a neighbor (get_neighbors_to), and a remote cell is received if
+ * it is a neighbor of a local cell (get_neighbors_of). The two sides are thus the same
+ * relation seen from either end, also for one-sided neighborhoods such as the SHIFT_*
+ * ones of translation. Rebuilt when the local cells change.
+ */
+struct RemoteCellExchangePattern {
+   bool initialized = false;
+   uint generation = 0;
+   std::vector<int> sendRanks;
+   std::vector<std::vector<CellID>> sendCells;   /*!< Local cells sent to each of sendRanks.*/
+   std::vector<int> receiveRanks;
+   std::vector<std::vector<CellID>> receiveCells;/*!< Remote cells received from each of receiveRanks.*/
+   std::vector<std::vector<char>> sendBuffers;   /*!< Persistent per-rank send buffers.*/
+   std::vector<std::vector<char>> receiveBuffers;/*!< Persistent per-rank receive buffers.*/
+};
+
+static RemoteCellExchangePattern& getRemoteCellExchangePattern(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                                                               const int neighborhood) {
+   static std::map<int,RemoteCellExchangePattern> patterns;
+   RemoteCellExchangePattern& pattern = patterns[neighborhood];
+   if (pattern.initialized && pattern.generation == P::localCellsGeneration) {
+      return pattern;
+   }
+
+   // Local cell is sent to the owners of remote cells that have it as neighbor
+   std::map<int,std::vector<CellID>> cellsPerRank;
+   const vector<CellID>& localCells = getLocalCells();
+   for (const CellID cellID : localCells) {
+      const auto* neighborsTo = mpiGrid.get_neighbors_to(cellID, neighborhood);
+      if (neighborsTo == NULL) continue;
+      vector<int> ranks;
+      for (const auto& nbrPair : *neighborsTo) {
+         if (nbrPair.first == 0 || mpiGrid.is_local(nbrPair.first)) continue;
+         ranks.push_back(mpiGrid.get_process(nbrPair.first));
+      }
+      std::sort(ranks.begin(), ranks.end());
+      ranks.erase(std::unique(ranks.begin(), ranks.end()), ranks.end());
+      for (const int rank : ranks) {
+         cellsPerRank[rank].push_back(cellID);
+      }
+   }
+   pattern.sendRanks.clear();
+   pattern.sendCells.clear();
+   for (auto& rankCells : cellsPerRank) {
+      std::sort(rankCells.second.begin(), rankCells.second.end());
+      pattern.sendRanks.push_back(rankCells.first);
+      pattern.sendCells.push_back(std::move(rankCells.second));
+   }
+
+   // Remote neighbors of local cells are received from their owners
+   cellsPerRank.clear();
+   for (const CellID cellID : localCells) {
+      const auto* neighborsOf = mpiGrid.get_neighbors_of(cellID, neighborhood);
+      if (neighborsOf == NULL) continue;
+      for (const auto& nbrPair : *neighborsOf) {
+         if (nbrPair.first == 0 || mpiGrid.is_local(nbrPair.first)) continue;
+         cellsPerRank[mpiGrid.get_process(nbrPair.first)].push_back(nbrPair.first);
+      }
+   }
+   pattern.receiveRanks.clear();
+   pattern.receiveCells.clear();
+   for (auto& rankCells : cellsPerRank) {
+      std::sort(rankCells.second.begin(), rankCells.second.end());
+      rankCells.second.erase(std::unique(rankCells.second.begin(), rankCells.second.end()), rankCells.second.end());
+      pattern.receiveRanks.push_back(rankCells.first);
+      pattern.receiveCells.push_back(std::move(rankCells.second));
+   }
+
+   pattern.sendBuffers.resize(pattern.sendRanks.size());
+   pattern.receiveBuffers.resize(pattern.receiveRanks.size());
+   pattern.generation = P::localCellsGeneration;
+   pattern.initialized = true;
+   return pattern;
+}
+
+/*! Sends a list of velocity block global IDs of each local cell to the processes
+ * that hold a copy of it in the given neighborhood, and stores the received lists
+ * into the remote cells. Lists of all cells going to one process are packed into a
+ * single message as (cell ID, list size, list) records; receivers size their buffers
+ * with MPI_Probe, so sizes and lists travel in one round instead of two. As in the
+ * dccrg transfers, cells with MPI transfers disabled are neither sent nor updated;
+ * every process pair of the pattern still exchanges a message, possibly empty.
+ * \param mpiGrid Spatial grid
+ * \param neighborhood Neighborhood whose remote cells are updated
+ * \param tag MPI tag of the exchange, distinct for each kind of list
+ * \param getList Returns the list of a local cell as a (pointer, size) pair
+ * \param setList Stores a list into a remote cell, called in parallel for different cells
+ */
+template<typename GetList,typename SetList>
+static void exchangeBlockLists(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                               const int neighborhood,
+                               const int tag,
+                               GetList getList,
+                               SetList setList) {
+   RemoteCellExchangePattern& pattern = getRemoteCellExchangePattern(mpiGrid, neighborhood);
+   const size_t headerSize = sizeof(CellID) + sizeof(vmesh::LocalID);
+
+   #pragma omp parallel for schedule(dynamic)
+   for (size_t r=0; r<pattern.sendRanks.size(); ++r) {
+      const vector<CellID>& cells = pattern.sendCells[r];
+      size_t bytes = 0;
+      for (const CellID cellID : cells) {
+         if (!mpiGrid[cellID]->get_mpi_transfer_enabled()) continue;
+         bytes += headerSize + getList(mpiGrid[cellID]).second * sizeof(vmesh::GlobalID);
+      }
+      std::vector<char>& buffer = pattern.sendBuffers[r];
+      buffer.resize(bytes);
+      char* ptr = buffer.data();
+      for (const CellID cellID : cells) {
+         if (!mpiGrid[cellID]->get_mpi_transfer_enabled()) continue;
+         const std::pair<const vmesh::GlobalID*,vmesh::LocalID> list = getList(mpiGrid[cellID]);
+         std::memcpy(ptr, &cellID, sizeof(CellID));
+         std::memcpy(ptr + sizeof(CellID), &list.second, sizeof(vmesh::LocalID));
+         ptr += headerSize;
+         if (list.second > 0) std::memcpy(ptr, list.first, list.second * sizeof(vmesh::GlobalID));
+         ptr += list.second * sizeof(vmesh::GlobalID);
+      }
+   }
+
+   std::vector<MPI_Request> sendRequests(pattern.sendRanks.size());
+   for (size_t r=0; r<pattern.sendRanks.size(); ++r) {
+      MPI_Isend(pattern.sendBuffers[r].data(), pattern.sendBuffers[r].size(), MPI_BYTE,
+                pattern.sendRanks[r], tag, MPI_COMM_WORLD, &sendRequests[r]);
+   }
+
+   // Probe a specific source so that a message of the next exchange with the same tag is never taken for this one
+   for (size_t r=0; r<pattern.receiveRanks.size(); ++r) {
+      MPI_Status status;
+      int bytes;
+      MPI_Probe(pattern.receiveRanks[r], tag, MPI_COMM_WORLD, &status);
+      MPI_Get_count(&status, MPI_BYTE, &bytes);
+      pattern.receiveBuffers[r].resize(bytes);
+      MPI_Recv(pattern.receiveBuffers[r].data(), bytes, MPI_BYTE,
+               pattern.receiveRanks[r], tag, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+   }
+
+   // Index records, then unpack them in parallel
+   std::vector<std::pair<CellID,const char*>> records;
+   for (size_t r=0; r<pattern.receiveBuffers.size(); ++r) {
+      const char* ptr = pattern.receiveBuffers[r].data();
+      const char* end = ptr + pattern.receiveBuffers[r].size();
+      while (ptr < end) {
+         CellID cellID;
+         vmesh::LocalID size;
+         std::memcpy(&cellID, ptr, sizeof(CellID));
+         std::memcpy(&size, ptr + sizeof(CellID), sizeof(vmesh::LocalID));
+         records.push_back(std::make_pair(cellID, ptr));
+         ptr += headerSize + size * sizeof(vmesh::GlobalID);
+      }
+   }
+
+   #pragma omp parallel for schedule(dynamic)
+   for (size_t i=0; i<records.size(); ++i) {
+      SpatialCell* cell = mpiGrid[records[i].first];
+      if (cell == NULL) {
+         cerr << __FILE__ << ":" << __LINE__
+              << " No data for spatial cell " << records[i].first
+              << endl;
+         abort();
+      }
+      if (!cell->get_mpi_transfer_enabled()) continue;
+      vmesh::LocalID size;
+      std::memcpy(&size, records[i].second + sizeof(CellID), sizeof(vmesh::LocalID));
+      // Record headers are a multiple of sizeof(vmesh::GlobalID) long, so the lists stay aligned
+      setList(cell, reinterpret_cast<const vmesh::GlobalID*>(records[i].second + headerSize), size);
+   }
+
+   MPI_Waitall(sendRequests.size(), sendRequests.data(), MPI_STATUSES_IGNORE);
+}
+
+/*! Sends velocity block data of each local cell to the processes that hold a copy of it
+ * in the given neighborhood and copies the received data into the remote cells. All cells
+ * going to one process are packed into one contiguous staging buffer, a (cell ID, block
+ * count) header for each cell first and then the data, so each pair of processes exchanges
+ * a single message. The receiver finds the cells by their IDs, so the contents of the
+ * message do not have to match its own cell list position by position. As in the dccrg
+ * transfers, cells with MPI transfers disabled are neither sent nor updated. Packing and
+ * unpacking are OpenMP-parallel over cells.
+ * \param mpiGrid Spatial grid
+ * \param neighborhood Neighborhood whose remote cells are updated
+ * \param tag MPI tag of the exchange
+ * \param getBlocks Returns the block data of a cell and the number of blocks in it. For a
+ * remote cell this is where the received data is stored and how many blocks are expected.
+ * \return Number of bytes of block data sent
+ */
+template<typename GetBlocks>
+static double exchangeBlockData(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                                const int neighborhood,
+                                const int tag,
+                                GetBlocks getBlocks) {
+   RemoteCellExchangePattern& pattern = getRemoteCellExchangePattern(mpiGrid, neighborhood);
+   const size_t blockBytes = WID3 * sizeof(Realf);
+   // Header sizes are a multiple of sizeof(Realf), so the block data stays aligned
+   const size_t headerSize = sizeof(CellID) + sizeof(uint64_t);
+   double bytesSent = 0.0;
+
+   // Buffer layout: cell count, headers of all sent cells in cell ID order, then their data in the same order
+   std::vector<std::vector<CellID>> sentCells(pattern.sendRanks.size());
+   std::vector<std::vector<size_t>> sendOffsets(pattern.sendRanks.size());
+   for (size_t r=0; r<pattern.sendRanks.size(); ++r) {
+      for (const CellID cellID : pattern.sendCells[r]) {
+         if (mpiGrid[cellID]->get_mpi_transfer_enabled()) sentCells[r].push_back(cellID);
+      }
+      const vector<CellID>& cells = sentCells[r];
+      size_t offset = sizeof(uint64_t) + cells.size() * headerSize;
+      sendOffsets[r].resize(cells.size());
+      for (size_t c=0; c<cells.size(); ++c) {
+         sendOffsets[r][c] = offset;
+         offset += getBlocks(mpiGrid[cells[c]]).second * blockBytes;
+      }
+      pattern.sendBuffers[r].resize(offset);
+      const uint64_t nCells = cells.size();
+      std::memcpy(pattern.sendBuffers[r].data(), &nCells, sizeof(uint64_t));
+      bytesSent += offset - sizeof(uint64_t) - cells.size() * headerSize;
+   }
+
+   #pragma omp parallel
+   for (size_t r=0; r<pattern.sendRanks.size(); ++r) {
+      const vector<CellID>& cells = sentCells[r];
+      char* buffer = pattern.sendBuffers[r].data();
+      #pragma omp for schedule(dynamic,16) nowait
+      for (size_t c=0; c<cells.size(); ++c) {
+         const std::pair<Realf*,vmesh::LocalID> blocks = getBlocks(mpiGrid[cells[c]]);
+         const uint64_t nBlocks = blocks.second;
+         char* header = buffer + sizeof(uint64_t) + c * headerSize;
+         std::memcpy(header, &cells[c], sizeof(CellID));
+         std::memcpy(header + sizeof(CellID), &nBlocks, sizeof(uint64_t));
+         if (nBlocks > 0) std::memcpy(buffer + sendOffsets[r][c], blocks.first, nBlocks * blockBytes);
+      }
+   }
+
+   std::vector<MPI_Request> sendRequests(pattern.sendRanks.size());
+   for (size_t r=0; r<pattern.sendRanks.size(); ++r) {
+      MPI_Isend(pattern.sendBuffers[r].data(), pattern.sendBuffers[r].size(), MPI_BYTE,
+                pattern.sendRanks[r], tag, MPI_COMM_WORLD, &sendRequests[r]);
+   }
+
+   // Index the received cells. Every message is checked against its size and every cell
+   // against the remote cells expected from that process before anything is copied.
+   std::vector<std::pair<CellID,std::pair<const char*,uint64_t>>> records;
+   for (size_t r=0; r<pattern.receiveRanks.size(); ++r) {
+      MPI_Status status;
+      int bytes;
+      MPI_Probe(pattern.receiveRanks[r], tag, MPI_COMM_WORLD, &status);
+      MPI_Get_count(&status, MPI_BYTE, &bytes);
+      pattern.receiveBuffers[r].resize(bytes);
+      MPI_Recv(pattern.receiveBuffers[r].data(), bytes, MPI_BYTE,
+               pattern.receiveRanks[r], tag, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+
+      const vector<CellID>& expected = pattern.receiveCells[r];
+      const char* buffer = pattern.receiveBuffers[r].data();
+      uint64_t nCells = 0;
+      if ((size_t)bytes >= sizeof(uint64_t)) std::memcpy(&nCells, buffer, sizeof(uint64_t));
+      size_t offset = sizeof(uint64_t) + nCells * headerSize;
+      bool valid = (size_t)bytes >= offset;
+      for (uint64_t c=0; valid && c<nCells; ++c) {
+         CellID cellID;
+         uint64_t nBlocks;
+         const char* header = buffer + sizeof(uint64_t) + c * headerSize;
+         std::memcpy(&cellID, header, sizeof(CellID));
+         std::memcpy(&nBlocks, header + sizeof(CellID), sizeof(uint64_t));
+         if (!std::binary_search(expected.begin(), expected.end(), cellID)) {
+            cerr << __FILE__ << ":" << __LINE__
+                 << " Received spatial cell " << cellID << " from process " << pattern.receiveRanks[r]
+                 << " which is not a remote neighbor of this process" << endl;
+            abort();
+         }
+         if (nBlocks > getBlocks(mpiGrid[cellID]).second) {
+            cerr << __FILE__ << ":" << __LINE__
+                 << " Received " << nBlocks << " blocks for spatial cell " << cellID
+                 << " which has room for " << getBlocks(mpiGrid[cellID]).second
+                 << endl;
+            abort();
+         }
+         records.push_back(std::make_pair(cellID, std::make_pair(buffer + offset, nBlocks)));
+         offset += nBlocks * blockBytes;
+         valid = (size_t)bytes >= offset;
+      }
+      if (!valid || offset != (size_t)bytes) {
+         cerr << __FILE__ << ":" << __LINE__
+              << " Malformed block data message of " << bytes << " bytes from process "
+              << pattern.receiveRanks[r] << endl;
+         abort();
+      }
+   }
+
+   #pragma omp parallel for schedule(dynamic,16)
+   for (size_t i=0; i<records.size(); ++i) {
+      SpatialCell* cell = mpiGrid[records[i].first];
+      if (!cell->get_mpi_transfer_enabled()) continue;
+      const std::pair<Realf*,vmesh::LocalID> blocks = getBlocks(cell);
+      const uint64_t nBlocks = records[i].second.second;
+      if (nBlocks > 0) std::memcpy(blocks.first, records[i].second.first, nBlocks * blockBytes);
+      if (nBlocks < blocks.second) std::memset(blocks.first + nBlocks * WID3, 0, (blocks.second - nBlocks) * blockBytes);
+   }
+
+   MPI_Waitall(sendRequests.size(), sendRequests.data(), MPI_STATUSES_IGNORE);
+   return bytesSent;
+}
+
 /*
   Adjust sparse velocity space to make it consistent in all 6 dimensions.
 
@@ -487,10 +817,22 @@ bool adjustVelocityBlocks(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& m
    
    phiprof::initializeTimer("Transfer with_content_list","MPI");
    phiprof::start("Transfer with_content_list");
-   SpatialCell::set_mpi_transfer_type(Transfer::VEL_BLOCK_WITH_CONTENT_STAGE1 );
-   mpiGrid.update_copies_of_remote_neighbors(NEAREST_NEIGHBORHOOD_ID);
-   SpatialCell::set_mpi_transfer_type(Transfer::VEL_BLOCK_WITH_CONTENT_STAGE2 );
-   mpiGrid.update_copies_of_remote_neighbors(NEAREST_NEIGHBORHOOD_ID);
+   if (P::fusedBlockListExchange) {
+      exchangeBlockLists(mpiGrid, NEAREST_NEIGHBORHOOD_ID, BLOCK_WITH_CONTENT_LIST_TAG,
+         [](SpatialCell* cell) {
+            return std::make_pair((const vmesh::GlobalID*)cell->velocity_block_with_content_list.data(),
+                                  (vmesh::LocalID)cell->velocity_block_with_content_list.size());
+         },
+         [](SpatialCell* cell, const vmesh::GlobalID* list, const vmesh::LocalID size) {
+            cell->velocity_block_with_content_list.assign(list, list + size);
+            cell->velocity_block_with_content_list_size = size;
+         });
+   } else {
+      SpatialCell::set_mpi_transfer_type(Transfer::VEL_BLOCK_WITH_CONTENT_STAGE1 );
+      mpiGrid.update_copies_of_remote_neighbors(NEAREST_NEIGHBORHOOD_ID);
+      SpatialCell::set_mpi_transfer_type(Transfer::VEL_BLOCK_WITH_CONTENT_STAGE2 );
+      mpiGrid.update_copies_of_remote_neighbors(NEAREST_NEIGHBORHOOD_ID);
+   }
    phiprof::stop("Transfer with_content_list");
    
    //Adjusts velocity blocks in local spatial cells, doesn't adjust velocity blocks in remote cells.
@@ -647,10 +989,24 @@ void updateRemoteVelocityBlockLists(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Ge
    // then list. For large we do it in two steps
    phiprof::initializeTimer("Velocity block list update","MPI");
    phiprof::start("Velocity block list update");
-   SpatialCell::set_mpi_transfer_type(Transfer::VEL_BLOCK_LIST_STAGE1);
-   mpiGrid.update_copies_of_remote_neighbors(DIST_FUNC_NEIGHBORHOOD_ID);
-   SpatialCell::set_mpi_transfer_type(Transfer::VEL_BLOCK_LIST_STAGE2);
-   mpiGrid.update_copies_of_remote_neighbors(DIST_FUNC_NEIGHBORHOOD_ID);
+   if (P::fusedBlockListExchange) {
+      exchangeBlockLists(mpiGrid, DIST_FUNC_NEIGHBORHOOD_ID, BLOCK_LIST_TAG,
+         [popID](SpatialCell* cell) {
+            vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh = cell->get_velocity_mesh(popID);
+            return std::make_pair((const vmesh::GlobalID*)vmesh.getGrid().data(), (vmesh::LocalID)vmesh.size());
+         },
+         [popID](SpatialCell* cell, const vmesh::GlobalID* list, const vmesh::LocalID size) {
+            vmesh::VelocityMesh<vmesh::GlobalID,vmesh::LocalID>& vmesh = cell->get_velocity_mesh(popID);
+            vmesh.setNewSize(size);
+            std::copy(list, list + size, vmesh.getGrid().begin());
+            cell->get_population(popID).N_blocks = size;
+         });
+   } else {
+      SpatialCell::set_mpi_transfer_type(Transfer::VEL_BLOCK_LIST_STAGE1);
+      mpiGrid.update_copies_of_remote_neighbors(DIST_FUNC_NEIGHBORHOOD_ID);
+      SpatialCell::set_mpi_transfer_type(Transfer::VEL_BLOCK_LIST_STAGE2);
+      mpiGrid.update_copies_of_remote_neighbors(DIST_FUNC_NEIGHBORHOOD_ID);
+   }
    phiprof::stop("Velocity block list update");
 
    // Prepare spatial cells for receiving velocity block data
@@ -672,6 +1028,36 @@ void updateRemoteVelocityBlockLists(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Ge
    phiprof::stop("Preparing receives", incoming_cells.size(), "SpatialCells");
 }
 
+/*
+Updates velocity block data of remote cells using packed staging buffers, one message
+per pair of processes. Block lists of the remote cells must be up to date.
+*/
+void updateRemoteVelocityBlockData(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                                   const int neighborhood,
+                                   const uint popID) {
+   phiprof::start("staged block data transfer");
+   const double bytesSent = exchangeBlockData(mpiGrid, neighborhood, BLOCK_DATA_TAG,
+      [popID](SpatialCell* cell) {
+         return std::make_pair(cell->get_data(popID), cell->get_number_of_velocity_blocks(popID));
+      });
+   phiprof::stop("staged block data transfer", bytesSent, "bytes");
+}
+
+/*
+Updates neighbor_block_data of remote cells using packed staging buffers, one message
+per pair of processes. neighbor_number_of_blocks of the remote cells must be set to the
+number of blocks expected.
+*/
+void updateRemoteNeighborBlockData(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                                   const int neighborhood) {
+   phiprof::start("staged neighbor block data transfer");
+   const double bytesSent = exchangeBlockData(mpiGrid, neighborhood, NEIGHBOR_BLOCK_DATA_TAG,
+      [](SpatialCell* cell) {
+         return std::make_pair(cell->neighbor_block_data, cell->neighbor_number_of_blocks);
+      });
+   phiprof::stop("staged neighbor block data transfer", bytesSent, "bytes");
+}
+
 /*
   Set stencils. These are the stencils (in 2D, real ones in 3D of
   course). x are stencil neighbor to cell local cell o:
@@ -28,6 +28,7 @@
 #include "sysboundary/sysboundary.h"
 #include "projects/project.h"
 #include <string>
+#include <unordered_set>
 
 /*!
   \brief Initialize parallel grid
@@ -44,8 +45,10 @@ void initializeGrid(
   \brief Balance load
 
     \param[in,out] mpiGrid The DCCRG grid with spatial cells
+    \param pinnedCells Local cells pinned to a process before the call, they get no weight in the partitioning
 */
-void balanceLoad(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid, SysBoundary& sysBoundaries);
+void balanceLoad(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid, SysBoundary& sysBoundaries,
+                 const std::unordered_set<CellID>& pinnedCells = std::unordered_set<CellID>());
 
 /*!
 
@@ -60,6 +63,38 @@ void updateRemoteVelocityBlockLists(
         const uint popID
 );
 
+/*!
+
+Updates velocity block data of remote cells in the given neighborhood. All
+cells exchanged between two processes are packed into one contiguous buffer
+and sent as a single message, instead of one datatype per cell through dccrg.
+Block lists of the remote cells must be up to date.
+
+\param mpiGrid   The DCCRG grid with spatial cells
+\param neighborhood Neighborhood whose remote cells are updated
+\param popID     Particle species
+*/
+void updateRemoteVelocityBlockData(
+   dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+   const int neighborhood,
+   const uint popID
+);
+
+/*!
+
+Same as updateRemoteVelocityBlockData, but for the neighbor_block_data
+pointers used to send translation contributions to remote cells.
+neighbor_number_of_blocks of the remote cells must be set to the number of
+blocks they are to receive.
+
+\param mpiGrid   The DCCRG grid with spatial cells
+\param neighborhood Neighborhood whose remote cells are updated
+*/
+void updateRemoteNeighborBlockData(
+   dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+   const int neighborhood
+);
+
 /*! Deallocates all blocks in remote cells in order to save
  *  memory. 
  * \param mpiGrid Spatial grid
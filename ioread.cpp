@@ -28,8 +28,12 @@
 #include <sstream>
 #include <ctime>
 #include <array>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <omp.h>
 
 #include "ioread.h"
 #include "phiprof.hpp"
@@ -38,6 +42,9 @@
 #include "vlsv_reader_parallel.h"
 #include "vlasovmover.h"
 #include "object_wrapper.h"
+#include "velocity_block_compression.h"
+#include "backgroundfield/backgroundfield.h"
+#include "fieldsolver/gridGlue.hpp"
 
 using namespace std;
 using namespace phiprof;
@@ -46,6 +53,152 @@ extern Logger logFile, diagnostic;
 
 typedef Parameters P;
 
+/*! Local cells separated by at most this many other cells in a restart file are read with
+ * the same read call, the cells in between are read and skipped.*/
+static const uint64_t RESTART_READ_GAP_CELLS = 8;
+
+/*! Cells of this process in a restart file, stored as runs of entries in the file's cell list
+ * so that each run can be read with one read call. A run may contain cells of other processes
+ * (see RESTART_READ_GAP_CELLS), which keeps the number of reads small when the local cells
+ * are scattered over the file, e.g. after the number of processes has changed. The reads are
+ * collective, so every process makes N_runs reads and reads nothing once its own runs are
+ * exhausted.*/
+struct FileCellRuns {
+   std::vector<uint64_t> begin;     /*!< Index of the first entry of each run in the file's cell list.*/
+   std::vector<uint64_t> size;      /*!< Number of entries in each run, skipped cells included.*/
+   std::vector<uint64_t> cells;     /*!< Indices of the local cells in the file's cell list, in increasing order.*/
+   std::vector<uint64_t> firstCell; /*!< Position in cells of the first local cell of each run, followed by the number of local cells.*/
+   uint64_t N_runs;                 /*!< Maximum number of runs over all processes.*/
+};
+
+/*! Offsets of the cells of this process in an array whose entries are stored cell after cell
+ * in a restart file, e.g. the velocity blocks in BLOCKIDS. Stored for every entry of every run
+ * of FileCellRuns and for the entry following each run.*/
+struct FileCellOffsets {
+   std::vector<uint64_t> offset;   /*!< Offsets of the entries of all runs.*/
+   std::vector<uint64_t> runFirst; /*!< Position in offset of the first entry of each run.*/
+
+   /*! Offset of the cell at the given index in the file's cell list, in the given run. The
+    * index may be the one just past the run.*/
+   uint64_t at(const FileCellRuns& runs,const size_t run,const uint64_t i) const {
+      return offset[runFirst[run] + i - runs.begin[run]];
+   }
+};
+
+/*! Per-cell arrays of a restart file that are needed for cells of other processes (block counts,
+ * load balance weights) are not read whole by each process. Each process reads an even slice
+ * of them, the entries of the other slices are fetched from their processes with fetchSliceEntries.
+ * \param N_entries Number of entries in the array
+ * \return First entry of the slice of each process, followed by N_entries
+ */
+static vector<uint64_t> getSliceBegins(const uint64_t N_entries) {
+   int processes;
+   MPI_Comm_size(MPI_COMM_WORLD,&processes);
+   vector<uint64_t> sliceBegin(processes+1);
+   for (int p=0; p<=processes; ++p) sliceBegin[p] = N_entries * p / processes;
+   return sliceBegin;
+}
+
+/*! Fetches entries of an array read in slices (see getSliceBegins) from the processes whose
+ * slices contain them. Must be called simultaneously by all processes.
+ * \param slice Entries of the slice of this process
+ * \param sliceBegin First entry of the slice of each process
+ * \param indices Indices of the needed entries, in increasing order
+ * \param values The needed entries in the order of indices
+ */
+template<typename T>
+static void fetchSliceEntries(const vector<T>& slice,const vector<uint64_t>& sliceBegin,
+                              const vector<uint64_t>& indices,vector<T>& values) {
+   int myRank;
+   MPI_Comm_rank(MPI_COMM_WORLD,&myRank);
+   const int processes = sliceBegin.size() - 1;
+
+   // Indices are in increasing order, so the requests to each process are consecutive
+   vector<int> sendCounts(processes,0);
+   vector<int> recvCounts(processes,0);
+   int p = 0;
+   for (size_t i=0; i<indices.size(); ++i) {
+      while (indices[i] >= sliceBegin[p+1]) ++p;
+      ++sendCounts[p];
+   }
+   MPI_Alltoall(sendCounts.data(),1,MPI_INT,recvCounts.data(),1,MPI_INT,MPI_COMM_WORLD);
+   vector<int> sendDispls(processes,0);
+   vector<int> recvDispls(processes,0);
+   for (p=1; p<processes; ++p) {
+      sendDispls[p] = sendDispls[p-1] + sendCounts[p-1];
+      recvDispls[p] = recvDispls[p-1] + recvCounts[p-1];
+   }
+   const int N_requests = recvDispls.back() + recvCounts.back();
+
+   vector<uint64_t> requests(N_requests+1);
+   MPI_Alltoallv(const_cast<uint64_t*>(indices.data()),sendCounts.data(),sendDispls.data(),MPI_Type<uint64_t>(),
+                 requests.data(),recvCounts.data(),recvDispls.data(),MPI_Type<uint64_t>(),MPI_COMM_WORLD);
+
+   vector<T> replies(N_requests+1);
+   for (int r=0; r<N_requests; ++r) replies[r] = slice[requests[r] - sliceBegin[myRank]];
+
+   // Replies go back as bytes
+   for (p=0; p<processes; ++p) {
+      sendCounts[p] *= sizeof(T);
+      sendDispls[p] *= sizeof(T);
+      recvCounts[p] *= sizeof(T);
+      recvDispls[p] *= sizeof(T);
+   }
+   values.resize(indices.size()+1);
+   MPI_Alltoallv(replies.data(),recvCounts.data(),recvDispls.data(),MPI_BYTE,
+                 values.data(),sendCounts.data(),sendDispls.data(),MPI_BYTE,MPI_COMM_WORLD);
+   values.resize(indices.size());
+}
+
+/*! Reads the offsets of the cells of this process in an array whose entries are stored cell
+ * after cell, from the array of the number of entries of each cell (e.g. BLOCKSPERCELL for
+ * BLOCKIDS). Each process reads a slice of the counts, the offsets are their prefix sums over
+ * all slices. Must be called simultaneously by all processes.
+ * \param file VLSV reader with input file open
+ * \param tagName Array of the entry counts
+ * \param attribs Attributes of the array
+ * \param N_cells Number of cells in the file
+ * \param runs Cells of this process
+ * \param offsets The offsets of the entries of the runs of this process
+ * \return If true, the counts were read successfully
+ */
+static bool readFileCellOffsets(vlsv::ParallelReader& file,const string& tagName,
+                                const list<pair<string,string> >& attribs,const uint64_t N_cells,
+                                const FileCellRuns& runs,FileCellOffsets& offsets) {
+   int myRank;
+   MPI_Comm_rank(MPI_COMM_WORLD,&myRank);
+
+   // Slices of N_cells+1 entries, the last one is the total number of entries
+   const vector<uint64_t> sliceBegin = getSliceBegins(N_cells+1);
+   const uint64_t countBegin = sliceBegin[myRank];
+   const uint64_t countEnd = min(sliceBegin[myRank+1],N_cells);
+   const uint64_t N_counts = (countEnd > countBegin) ? countEnd - countBegin : 0;
+   vector<uint64_t> counts(N_counts+1,0);
+   uint64_t* countPointer = counts.data();
+   bool success = file.read(tagName,attribs,countBegin,N_counts,countPointer,false);
+
+   uint64_t localSum = 0;
+   for (uint64_t i=0; i<N_counts; ++i) localSum += counts[i];
+   uint64_t sliceOffset = 0;
+   MPI_Exscan(&localSum,&sliceOffset,1,MPI_Type<uint64_t>(),MPI_SUM,MPI_COMM_WORLD);
+   if (myRank == 0) sliceOffset = 0;
+   vector<uint64_t> slice(sliceBegin[myRank+1] - sliceBegin[myRank]);
+   for (size_t i=0; i<slice.size(); ++i) {
+      slice[i] = sliceOffset;
+      if (i < N_counts) sliceOffset += counts[i];
+   }
+
+   // Offsets of all entries of the runs and of the entry after each run
+   vector<uint64_t> indices;
+   offsets.runFirst.resize(runs.begin.size());
+   for (size_t r=0; r<runs.begin.size(); ++r) {
+      offsets.runFirst[r] = indices.size();
+      for (uint64_t i=runs.begin[r]; i<=runs.begin[r]+runs.size[r]; ++i) indices.push_back(i);
+   }
+   fetchSliceEntries(slice,sliceBegin,indices,offsets.offset);
+   return success;
+}
+
 /*!
  * \brief Checks for command files written to the local directory.
  * If a file STOP was written and is readable, then a bailout with restart writing is initiated.
@@ -205,18 +358,19 @@ bool readCellIds(vlsv::ParallelReader & file,
    return success;
 }
 
-/* Read the total number of velocity blocks per spatial cell in the spatial mesh.
+/* Read the total number of velocity blocks per spatial cell in the spatial mesh, for a slice
+ * of the file's cell list (see getSliceBegins).
  * The returned value for each cell is a sum of the velocity blocks associated in each particle species. 
  * The value is used to calculate an initial load balance after restart.
  * @param file Some vlsv reader with a file open (can be old or new vlsv reader)
+ * @param sliceBegin Index of the first cell of the slice in the file's cell list
+ * @param sliceSize Number of cells in the slice
  * @param nBlocks Vector for holding information on cells and the number of blocks in them -- this function saves data here
- * @param masterRank The master rank of this process (Vlasiator uses masterRank = 0 and so it should be the default)
- * @param comm MPI comm
  * @return Returns true if the operation was successful
  @ @see exec_readGrid
 */
 bool readNBlocks(vlsv::ParallelReader& file,const std::string& meshName,
-                 std::vector<size_t>& nBlocks,int masterRank,MPI_Comm comm) {
+                 const uint64_t sliceBegin,const uint64_t sliceSize,std::vector<size_t>& nBlocks) {
    bool success = true;
 
    // Get info on array containing cell IDs:
@@ -224,19 +378,10 @@ bool readNBlocks(vlsv::ParallelReader& file,const std::string& meshName,
    uint64_t vectorSize;
    vlsv::datatype::type dataType;
    uint64_t byteSize;
-
-   // Read mesh bounding box to all processes, the info in bbox contains 
-   // the number of spatial cells in the mesh.
-   // (This is *not* the physical coordinate bounding box.)
-   uint64_t bbox[6];
-   uint64_t* bbox_ptr = bbox;
    list<pair<string,string> > attribs;
-   attribs.push_back(make_pair("mesh",meshName));
-   if (file.read("MESH_BBOX",attribs,0,6,bbox_ptr,false) == false) return false;
 
    // Resize the output vector and init to zero values
-   const uint64_t N_spatialCells = bbox[0]*bbox[1]*bbox[2];
-   nBlocks.resize(N_spatialCells);
+   nBlocks.resize(sliceSize);
    #pragma omp parallel for
    for (size_t i=0; i<nBlocks.size(); ++i) nBlocks[i] = 0;
 
@@ -246,40 +391,43 @@ bool readNBlocks(vlsv::ParallelReader& file,const std::string& meshName,
    set<string> speciesNames;
    if (file.getUniqueAttributeValues("BLOCKSPERCELL","name",speciesNames) == false) return false;
 
-   // Iterate over all particle species and read in BLOCKSPERCELL array 
-   // to all processes, and add the values to nBlocks
-   uint64_t* buffer = new uint64_t[N_spatialCells];
+   // Iterate over all particle species and read in the slice of the BLOCKSPERCELL
+   // array, and add the values to nBlocks
+   vector<uint64_t> buffer(sliceSize+1);
    for (set<string>::const_iterator s=speciesNames.begin(); s!=speciesNames.end(); ++s) {      
       attribs.clear();
       attribs.push_back(make_pair("mesh",meshName));
       attribs.push_back(make_pair("name",*s));
       if (file.getArrayInfo("BLOCKSPERCELL",attribs,arraySize,vectorSize,dataType,byteSize) == false) return false;
 
-      if (file.read("BLOCKSPERCELL",attribs,0,arraySize,buffer) == false) {
-         delete [] buffer; buffer = NULL;
+      uint64_t* bufferPointer = buffer.data();
+      if (file.read("BLOCKSPERCELL",attribs,sliceBegin,sliceSize,bufferPointer,false) == false) {
          return false;
       }
 
       #pragma omp parallel for
-      for (size_t i=0; i<N_spatialCells; ++i) {
+      for (size_t i=0; i<sliceSize; ++i) {
          nBlocks[i] += buffer[i];
       }
    }
-   delete [] buffer; buffer = NULL;
    return success;
 }
 
+/*! Number of velocity blocks read at a time when reading a restart. The next chunk is read
+ * while the blocks of the previous one are inserted into the spatial cells.*/
+static const uint64_t RESTART_READ_CHUNK_BLOCKS = 131072;
+
 /** Read velocity block mesh data and distribution function data belonging to this process 
  * for the given particle species. This function must be called simultaneously by all processes.
+ * The data is read in chunks into two alternating buffers, and the cells of a chunk are
+ * processed by all threads while the master thread reads the next chunk.
  * @param file VLSV reader with input file open.
  * @param spatMeshName Name of the spatial mesh.
  * @param fileCells List of all spatial cell IDs.
- * @param localCellStartOffset The offset from which to start reading cells.
- * @param localCells How many spatial cells after the offset to read.
- * @param blocksPerCell Number of velocity blocks for this particle species in each spatial cell belonging to this process.
- * @param localBlockStartOffset Offset into velocity block data arrays from which to start reading data.
- * @param localBlocks Number of velocity blocks for this species assigned to this process.
+ * @param runs Cells of this process in fileCells.
+ * @param blockOffsets Offset of the velocity blocks of this particle species of the cells of this process in the velocity block data arrays.
  * @param mpiGrid Parallel grid library.
+ * @param blockIDremapper Renumbering of velocity block IDs.
  * @param popID ID of the particle species who's data is to be read.
  * @return If true, velocity block data was read successfully.*/
 template <typename fileReal>
@@ -287,11 +435,8 @@ bool _readBlockData(
    vlsv::ParallelReader & file,
    const std::string& spatMeshName,
    const std::vector<uint64_t>& fileCells,
-   const uint64_t localCellStartOffset,
-   const uint64_t localCells,
-   const vmesh::LocalID* blocksPerCell,
-   const uint64_t localBlockStartOffset,
-   const uint64_t localBlocks,
+   const FileCellRuns& runs,
+   const FileCellOffsets& blockOffsets,
    dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
    std::function<vmesh::GlobalID(vmesh::GlobalID)> blockIDremapper,
    const uint popID
@@ -339,42 +484,251 @@ bool _readBlockData(
       return false;
    }
 
-   fileReal* avgBuffer = new fileReal[avgVectorSize * localBlocks]; //avgs data for all cells
-   vmesh::GlobalID * blockIdBuffer = new vmesh::GlobalID[blockIdVectorSize * localBlocks]; //blockids of all cells
+   const double t_start = MPI_Wtime();
+
+   // Split the runs into chunks of roughly RESTART_READ_CHUNK_BLOCKS velocity blocks.
+   // A chunk does not cross the end of a run, so that its blocks are consecutive in the file.
+   // The local cells of chunk c are runs.cells[chunkFirstCell[c]] ... runs.cells[chunkFirstCell[c+1]-1].
+   vector<uint64_t> chunkCellBegin;
+   vector<uint64_t> chunkCellEnd;
+   vector<size_t> chunkRun;
+   vector<size_t> chunkFirstCell;
+   for (size_t r=0; r<runs.begin.size(); ++r) {
+      uint64_t begin = runs.begin[r];
+      size_t first = runs.firstCell[r];
+      for (size_t c=runs.firstCell[r]; c<runs.firstCell[r+1]; ++c) {
+         const uint64_t i = runs.cells[c];
+         if (blockOffsets.at(runs,r,i+1) - blockOffsets.at(runs,r,begin) > RESTART_READ_CHUNK_BLOCKS && c > first) {
+            chunkCellBegin.push_back(begin);
+            chunkCellEnd.push_back(i);
+            chunkRun.push_back(r);
+            chunkFirstCell.push_back(first);
+            begin = i;
+            first = c;
+         }
+      }
+      chunkCellBegin.push_back(begin);
+      chunkCellEnd.push_back(runs.begin[r] + runs.size[r]);
+      chunkRun.push_back(r);
+      chunkFirstCell.push_back(first);
+   }
+   chunkFirstCell.push_back(runs.cells.size());
+   uint64_t maxChunkBlocks = 1;
+   uint64_t localBlocks = 0;
+   for (size_t c=0; c<chunkCellBegin.size(); ++c) {
+      const uint64_t chunkBlocks = blockOffsets.at(runs,chunkRun[c],chunkCellEnd[c]) - blockOffsets.at(runs,chunkRun[c],chunkCellBegin[c]);
+      maxChunkBlocks = max(maxChunkBlocks,chunkBlocks);
+      localBlocks += chunkBlocks;
+   }
+
+   // Reads are collective, every process does as many as the process with most chunks
+   uint64_t localChunks = chunkCellBegin.size();
+   uint64_t N_chunks;
+   MPI_Allreduce(&localChunks,&N_chunks,1,MPI_Type<uint64_t>(),MPI_MAX,MPI_COMM_WORLD);
+
+   // Two buffers, the next chunk is read into one while the cells of the other are processed
+   vector<fileReal> avgBuffer[2];
+   vector<vmesh::GlobalID> blockIdBuffer[2];
+   for (int b=0; b<2; ++b) {
+      avgBuffer[b].resize(avgVectorSize * maxChunkBlocks);
+      blockIdBuffer[b].resize(blockIdVectorSize * maxChunkBlocks);
+   }
+
+   // Read the given chunk into the given buffer, processes without such a chunk read nothing
+   auto readChunk = [&](const uint64_t chunk,const int b) -> bool {
+      uint64_t blockBegin = 0;
+      uint64_t N_blocks = 0;
+      if (chunk < localChunks) {
+         blockBegin = blockOffsets.at(runs,chunkRun[chunk],chunkCellBegin[chunk]);
+         N_blocks = blockOffsets.at(runs,chunkRun[chunk],chunkCellEnd[chunk]) - blockBegin;
+      }
+      bool readSuccess = true;
+      if (file.readArray("BLOCKIDS", blockIdAttribs, blockBegin, N_blocks, (char*)blockIdBuffer[b].data()) == false) {
+         cerr << "ERROR, failed to read BLOCKIDS in " << __FILE__ << ":" << __LINE__ << endl;
+         readSuccess = false;
+      }
+      if (file.readArray("BLOCKVARIABLE", avgAttribs, blockBegin, N_blocks, (char*)avgBuffer[b].data()) == false) {
+         cerr << "ERROR, failed to read BLOCKVARIABLE in " << __FILE__ << ":" << __LINE__ << endl;
+         readSuccess = false;
+      }
+      return readSuccess;
+   };
+
+   if (N_chunks > 0 && readChunk(0,0) == false) success = false;
+   for (uint64_t chunk=0; chunk<N_chunks; ++chunk) {
+      const int b = chunk % 2;
+      const size_t run = (chunk < localChunks) ? chunkRun[chunk] : 0;
+      const size_t cellBegin = (chunk < localChunks) ? chunkFirstCell[chunk] : 0;
+      const size_t cellEnd   = (chunk < localChunks) ? chunkFirstCell[chunk+1] : 0;
+      const uint64_t chunkBlockBegin = (chunk < localChunks) ? blockOffsets.at(runs,run,chunkCellBegin[chunk]) : 0;
+
+      #pragma omp parallel
+      {
+         // Thread 0 reads the next chunk (MPI is only called from the master thread)
+         // and joins the processing of this chunk once it is done
+         if (omp_get_thread_num() == 0 && chunk+1 < N_chunks) {
+            if (readChunk(chunk+1,1-b) == false) success = false;
+         }
+
+         vector<vmesh::GlobalID> blockIdsInCell; //blockIds in a particular cell, temporary usage
+         #pragma omp for schedule(dynamic,1)
+         for (size_t c=cellBegin; c<cellEnd; ++c) {
+            const uint64_t i = runs.cells[c];
+            const CellID cell = fileCells[i]; //spatial cell id
+            const vmesh::LocalID nBlocksInCell = blockOffsets.at(runs,run,i+1) - blockOffsets.at(runs,run,i);
+            const uint64_t blockBufferOffset = blockOffsets.at(runs,run,i) - chunkBlockBegin;
+            //copy blocks in this cell to vector blockIdsInCell, size of read in data has been checked earlier
+            blockIdsInCell.assign(blockIdBuffer[b].begin() + blockBufferOffset, blockIdBuffer[b].begin() + blockBufferOffset + nBlocksInCell);
+            for(auto& id : blockIdsInCell) {
+               id = blockIDremapper(id);
+            }
+            mpiGrid[cell]->add_velocity_blocks(blockIdsInCell,popID); //allocate space for all blocks and create them
+            //copy avgs data, here a conversion may happen between float and double
+            Realf *cellBlockData=mpiGrid[cell]->get_data(popID);
+            const fileReal* fileBlockData = &(avgBuffer[b][blockBufferOffset*WID3]);
+            for(uint64_t j = 0; j< WID3 * nBlocksInCell ; j++){
+               cellBlockData[j] = fileBlockData[j];
+            }
+         }
+      }
+   }
+
+   // Report the read bandwidth of the slowest process
+   double t_read = MPI_Wtime() - t_start;
+   double t_readMax;
+   uint64_t bytesRead = localBlocks * (avgVectorSize*sizeof(fileReal) + blockIdVectorSize*sizeof(vmesh::GlobalID));
+   uint64_t bytesReadSum;
+   MPI_Allreduce(&t_read,&t_readMax,1,MPI_DOUBLE,MPI_MAX,MPI_COMM_WORLD);
+   MPI_Allreduce(&bytesRead,&bytesReadSum,1,MPI_Type<uint64_t>(),MPI_SUM,MPI_COMM_WORLD);
+   logFile << "(RESTART) Read and inserted velocity blocks of " << popName << " in " << N_chunks << " chunks, ";
+   logFile << bytesReadSum/1.0e6 << " MB in " << t_readMax << " s (" << bytesReadSum/1.0e6/max(t_readMax,1.0e-9) << " MB/s)" << endl << write;
+
+   return success;
+}
+
+/** Decode one compressed cell into the velocity block data of a spatial cell.
+ * Chunks stored with a different value type than Realf are converted.
+ * @param chunk Start of the compressed chunk.
+ * @param nBytes Size of the chunk.
+ * @param N_values Number of values in the chunk.
+ * @param data Velocity block data of the cell.
+ * @return If true, the chunk was decoded successfully.*/
+static bool _decodeCompressedCell(const char* chunk,const uint64_t nBytes,const uint64_t N_values,Realf* data) {
+   const size_t valueSize = blockcompression::valueSize(chunk,nBytes);
+   if (valueSize == sizeof(Realf)) return blockcompression::decode(chunk,nBytes,N_values,data);
+
+   bool success = false;
+   if (valueSize == sizeof(float)) {
+      vector<float> buffer(N_values);
+      success = blockcompression::decode(chunk,nBytes,N_values,buffer.data());
+      for (uint64_t i=0; i<N_values; ++i) data[i] = buffer[i];
+   } else if (valueSize == sizeof(double)) {
+      vector<double> buffer(N_values);
+      success = blockcompression::decode(chunk,nBytes,N_values,buffer.data());
+      for (uint64_t i=0; i<N_values; ++i) data[i] = buffer[i];
+   }
+   return success;
+}
+
+/** Read compressed velocity block data (BLOCKVARIABLE_COMPRESSED) of a particle species,
+ * see velocity_block_compression.h for the format.
+ * @param file VLSV reader.
+ * @param spatMeshName Name of the spatial mesh.
+ * @param fileCells Vector containing spatial cell IDs.
+ * @param runs Cells of this process in fileCells.
+ * @param blockOffsets Offset of the velocity blocks of the cells of this process in BLOCKIDS.
+ * @param mpiGrid Parallel grid library.
+ * @param blockIDremapper Renumbering of velocity block IDs.
+ * @param popID ID of the particle species who's data is to be read.
+ * @return If true, velocity block data was read successfully.*/
+static bool _readCompressedBlockData(
+   vlsv::ParallelReader & file,
+   const std::string& spatMeshName,
+   const std::vector<uint64_t>& fileCells,
+   const FileCellRuns& runs,
+   const FileCellOffsets& blockOffsets,
+   dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+   std::function<vmesh::GlobalID(vmesh::GlobalID)> blockIDremapper,
+   const uint popID
+) {
+   bool success = true;
+   list<pair<string,string> > attribs;
+   attribs.push_back(make_pair("mesh",spatMeshName));
+   attribs.push_back(make_pair("name",getObjectWrapper().particleSpecies[popID].name));
 
-   //Read block ids and data
-   if (file.readArray("BLOCKIDS", blockIdAttribs, localBlockStartOffset, localBlocks, (char*)blockIdBuffer ) == false) {
-      cerr << "ERROR, failed to read BLOCKIDS in " << __FILE__ << ":" << __LINE__ << endl;
+   // Offsets of the cells in the compressed data, each process reads a slice of BLOCKVARIABLEBYTES
+   FileCellOffsets byteOffsets;
+   if (readFileCellOffsets(file,"BLOCKVARIABLEBYTES",attribs,fileCells.size(),runs,byteOffsets) == false) {
+      logFile << "(RESTART) ERROR: Failed to read BLOCKVARIABLEBYTES at " << __FILE__ << ":" << __LINE__ << endl << write;
       success = false;
    }
-   if (file.readArray("BLOCKVARIABLE", avgAttribs, localBlockStartOffset, localBlocks, (char*)avgBuffer) == false) {
-      cerr << "ERROR, failed to read BLOCKVARIABLE in " << __FILE__ << ":" << __LINE__ << endl;
+
+   // Position of each run's blocks and bytes in the local buffers
+   vector<uint64_t> runBlockPos(runs.begin.size()+1,0);
+   vector<uint64_t> runBytePos(runs.begin.size()+1,0);
+   for (size_t r=0; r<runs.begin.size(); ++r) {
+      const uint64_t runEnd = runs.begin[r] + runs.size[r];
+      runBlockPos[r+1] = runBlockPos[r] + blockOffsets.at(runs,r,runEnd) - blockOffsets.at(runs,r,runs.begin[r]);
+      runBytePos[r+1] = runBytePos[r] + byteOffsets.at(runs,r,runEnd) - byteOffsets.at(runs,r,runs.begin[r]);
+   }
+
+   // One collective read per run, processes with fewer runs read nothing in the remaining ones
+   vector<char> compressed(max(runBytePos.back(),(uint64_t)1));
+   vector<vmesh::GlobalID> blockIdBuffer(max(runBlockPos.back(),(uint64_t)1));
+   for (uint64_t r=0; r<runs.N_runs; ++r) {
+      uint64_t blockBegin = 0, N_blocks = 0, byteBegin = 0, N_bytes = 0;
+      char* blockIdPtr = (char*)blockIdBuffer.data();
+      char* bytePtr = compressed.data();
+      if (r < runs.begin.size()) {
+         const uint64_t runEnd = runs.begin[r] + runs.size[r];
+         blockBegin = blockOffsets.at(runs,r,runs.begin[r]);
+         N_blocks = blockOffsets.at(runs,r,runEnd) - blockBegin;
+         byteBegin = byteOffsets.at(runs,r,runs.begin[r]);
+         N_bytes = byteOffsets.at(runs,r,runEnd) - byteBegin;
+         blockIdPtr = (char*)&(blockIdBuffer[runBlockPos[r]]);
+         bytePtr = &(compressed[runBytePos[r]]);
+      }
+      if (file.readArray("BLOCKIDS",attribs,blockBegin,N_blocks,blockIdPtr) == false) {
+         cerr << "ERROR, failed to read BLOCKIDS in " << __FILE__ << ":" << __LINE__ << endl;
+         success = false;
+      }
+      if (file.readArray("BLOCKVARIABLE_COMPRESSED",attribs,byteBegin,N_bytes,bytePtr) == false) {
+         cerr << "ERROR, failed to read BLOCKVARIABLE_COMPRESSED in " << __FILE__ << ":" << __LINE__ << endl;
+         success = false;
+      }
+   }
+   if (success == false) return false;
+
+   // Create the blocks, then decode the cells in parallel
+   vector<uint64_t> localBytePos(runs.cells.size());
+   vector<uint64_t> localBytes(runs.cells.size());
+   vector<uint64_t> localBlocks(runs.cells.size());
+   vector<vmesh::GlobalID> blockIdsInCell;
+   for (size_t r=0; r<runs.begin.size(); ++r) {
+      for (size_t c=runs.firstCell[r]; c<runs.firstCell[r+1]; ++c) {
+         const uint64_t i = runs.cells[c];
+         const uint64_t blockPos = runBlockPos[r] + blockOffsets.at(runs,r,i) - blockOffsets.at(runs,r,runs.begin[r]);
+         localBlocks[c] = blockOffsets.at(runs,r,i+1) - blockOffsets.at(runs,r,i);
+         blockIdsInCell.assign(blockIdBuffer.begin() + blockPos, blockIdBuffer.begin() + blockPos + localBlocks[c]);
+         for (auto& id : blockIdsInCell) {
+            id = blockIDremapper(id);
+         }
+         mpiGrid[fileCells[i]]->add_velocity_blocks(blockIdsInCell,popID);
+         localBytePos[c] = runBytePos[r] + byteOffsets.at(runs,r,i) - byteOffsets.at(runs,r,runs.begin[r]);
+         localBytes[c] = byteOffsets.at(runs,r,i+1) - byteOffsets.at(runs,r,i);
+      }
+   }
+
+   int decodeFailures = 0;
+   #pragma omp parallel for schedule(dynamic,1) reduction(+:decodeFailures)
+   for (size_t c=0; c<runs.cells.size(); ++c) {
+      if (_decodeCompressedCell(&(compressed[localBytePos[c]]),localBytes[c],
+                                localBlocks[c]*WID3,mpiGrid[fileCells[runs.cells[c]]]->get_data(popID)) == false) ++decodeFailures;
+   }
+   if (decodeFailures > 0) {
+      cerr << "ERROR, failed to decode " << decodeFailures << " cells of BLOCKVARIABLE_COMPRESSED in " << __FILE__ << ":" << __LINE__ << endl;
       success = false;
    }
-   
-   uint64_t blockBufferOffset=0;
-   //Go through all spatial cells     
-   vector<vmesh::GlobalID> blockIdsInCell; //blockIds in a particular cell, temporary usage
-   for(uint64_t i=0; i<localCells; i++) {
-      CellID cell = fileCells[localCellStartOffset + i]; //spatial cell id 
-      vmesh::LocalID nBlocksInCell = blocksPerCell[i];
-      //copy blocks in this cell to vector blockIdsInCell, size of read in data has been checked earlier
-      blockIdsInCell.reserve(nBlocksInCell);
-      blockIdsInCell.assign(blockIdBuffer + blockBufferOffset, blockIdBuffer + blockBufferOffset + nBlocksInCell);
-      for(auto& id : blockIdsInCell) {
-         id = blockIDremapper(id);
-      }
-      mpiGrid[cell]->add_velocity_blocks(blockIdsInCell,popID); //allocate space for all blocks and create them
-      //copy avgs data, here a conversion may happen between float and double
-      Realf *cellBlockData=mpiGrid[cell]->get_data(popID);
-      for(uint64_t i = 0; i< WID3 * nBlocksInCell ; i++){
-         cellBlockData[i] =  avgBuffer[blockBufferOffset*WID3 + i];
-      }
-      blockBufferOffset += nBlocksInCell; //jump to location of next local cell
-   }
-
-   delete[] avgBuffer;
-   delete[] blockIdBuffer;
    return success;
 }
 
@@ -382,30 +736,24 @@ bool _readBlockData(
  * @param file VLSV reader.
  * @param meshName Name of the spatial mesh.
  * @param fileCells Vector containing spatial cell IDs.
- * @param localCellStartOffset Offset into fileCells, determines where the cells belonging 
- * to this process start.
- * @param localCells Number of spatial cells assigned to this process.
+ * @param runs Cells of this process in fileCells.
  * @param mpiGrid Parallel grid library.
  * @return If true, velocity block data was read successfully.*/
 bool readBlockData(
         vlsv::ParallelReader& file,
         const string& meshName,
         const vector<CellID>& fileCells,
-        const uint64_t localCellStartOffset,
-        const uint64_t localCells,
+        const FileCellRuns& runs,
         dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid
    ) {
    bool success = true;
 
    const uint64_t bytesReadStart = file.getBytesRead();
-   int N_processes;
-   MPI_Comm_size(MPI_COMM_WORLD,&N_processes);
 
    uint64_t arraySize;
    uint64_t vectorSize;
    vlsv::datatype::type dataType;
    uint64_t byteSize;
-   uint64_t* offsetArray = new uint64_t[N_processes];
 
    for (uint popID=0; popID<getObjectWrapper().particleSpecies.size(); ++popID) {
       const string& popName = getObjectWrapper().particleSpecies[popID].name;
@@ -534,31 +882,25 @@ bool readBlockData(
       }
 
       // In restart files each spatial cell has an entry in CELLSWITHBLOCKS. 
-      // Each process calculates how many velocity blocks it has for this species.
+      // The offset of each local cell's blocks in the block data arrays follows
+      // from the block counts, each process reads a slice of them.
       attribs.clear();
       attribs.push_back(make_pair("mesh",meshName));
       attribs.push_back(make_pair("name",popName));
-      vmesh::LocalID* blocksPerCell = NULL;
+      FileCellOffsets blockOffsets;
       
-      if (file.read("BLOCKSPERCELL",attribs,localCellStartOffset,localCells,blocksPerCell,true) == false) {
+      if (readFileCellOffsets(file,"BLOCKSPERCELL",attribs,fileCells.size(),runs,blockOffsets) == false) {
          logFile << "(RESTART) ERROR: Failed to read BLOCKSPERCELL at " << __FILE__ << ":" << __LINE__ << endl << write;
-         success = false;
+         return false;
       }
 
-      // Count how many velocity blocks this process gets
-      uint64_t blockSum = 0;
-      for (uint64_t i=0; i<localCells; ++i){
-         blockSum += blocksPerCell[i];
+      // Velocity distributions written with io.distribution_compression
+      if (file.getArrayInfo("BLOCKVARIABLE_COMPRESSED",attribs,arraySize,vectorSize,dataType,byteSize) == true) {
+         if (_readCompressedBlockData(file,meshName,fileCells,runs,blockOffsets,
+                                      mpiGrid,blockIDremapper,popID) == false) success = false;
+         continue;
       }
       
-      // Gather all block sums to master process who will them broadcast 
-      // the values to everyone
-      MPI_Allgather(&blockSum,1,MPI_Type<uint64_t>(),offsetArray,1,MPI_Type<uint64_t>(),MPI_COMM_WORLD);      
-      
-      // Calculate the offset from which this process starts reading block data
-      uint64_t myOffset = 0;
-      for (int64_t i=0; i<mpiGrid.get_rank(); ++i) myOffset += offsetArray[i];
-      
       if (file.getArrayInfo("BLOCKVARIABLE",attribs,arraySize,vectorSize,dataType,byteSize) == false) {
          logFile << "(RESTART)  ERROR: Failed to read BLOCKVARIABLE INFO" << endl << write;
          return false;
@@ -568,44 +910,42 @@ bool readBlockData(
       if (dataType == vlsv::datatype::type::FLOAT) {
          switch (byteSize) {
             case sizeof(double):
-               if (_readBlockData<double>(file,meshName,fileCells,localCellStartOffset,localCells,blocksPerCell,
-                                          myOffset,blockSum,mpiGrid,blockIDremapper,popID) == false) success = false;
+               if (_readBlockData<double>(file,meshName,fileCells,runs,blockOffsets,
+                                          mpiGrid,blockIDremapper,popID) == false) success = false;
                break;
             case sizeof(float):
-               if (_readBlockData<float>(file,meshName,fileCells,localCellStartOffset,localCells,blocksPerCell,
-                                         myOffset,blockSum,mpiGrid,blockIDremapper,popID) == false) success = false;
+               if (_readBlockData<float>(file,meshName,fileCells,runs,blockOffsets,
+                                         mpiGrid,blockIDremapper,popID) == false) success = false;
                break;
          }
       } else if (dataType == vlsv::datatype::type::UINT) {
          switch (byteSize) {
             case sizeof(uint32_t):
-               if (_readBlockData<uint32_t>(file,meshName,fileCells,localCellStartOffset,localCells,blocksPerCell,
-                                            myOffset,blockSum,mpiGrid,blockIDremapper,popID) == false) success = false;
+               if (_readBlockData<uint32_t>(file,meshName,fileCells,runs,blockOffsets,
+                                            mpiGrid,blockIDremapper,popID) == false) success = false;
                break;
             case sizeof(uint64_t):
-               if (_readBlockData<uint64_t>(file,meshName,fileCells,localCellStartOffset,localCells,blocksPerCell,
-                                            myOffset,blockSum,mpiGrid,blockIDremapper,popID) == false) success = false;
+               if (_readBlockData<uint64_t>(file,meshName,fileCells,runs,blockOffsets,
+                                            mpiGrid,blockIDremapper,popID) == false) success = false;
                break;
          }
       } else if (dataType == vlsv::datatype::type::INT) {
          switch (byteSize) {
             case sizeof(int32_t):
-               if (_readBlockData<int32_t>(file,meshName,fileCells,localCellStartOffset,localCells,blocksPerCell,
-                                           myOffset,blockSum,mpiGrid,blockIDremapper,popID) == false) success = false;
+               if (_readBlockData<int32_t>(file,meshName,fileCells,runs,blockOffsets,
+                                           mpiGrid,blockIDremapper,popID) == false) success = false;
                break;
             case sizeof(int64_t):
-               if (_readBlockData<int64_t>(file,meshName,fileCells,localCellStartOffset,localCells,blocksPerCell,
-                                           myOffset,blockSum,mpiGrid,blockIDremapper,popID) == false) success = false;
+               if (_readBlockData<int64_t>(file,meshName,fileCells,runs,blockOffsets,
+                                           mpiGrid,blockIDremapper,popID) == false) success = false;
                break;
          }
       } else {
          logFile << "(RESTART) ERROR: Failed to read data type at readCellParamsVariable" << endl << write;
          success = false;
       }
-      delete [] blocksPerCell; blocksPerCell = NULL;
    } // for-loop over particle species
 
-   delete [] offsetArray; offsetArray = NULL;
    
    const uint64_t bytesReadEnd = file.getBytesRead() - bytesReadStart;
    logFile << "Velocity meshes and data read, approximate data rate is ";
@@ -614,26 +954,41 @@ bool readBlockData(
    return success;
 }
 
+/*! Arrays of a spatial cell that cell variables can be read into.*/
+enum CellArray {
+   CELL_PARAMETERS,       /*!< SpatialCell::parameters, indexed by CellParams.*/
+   CELL_DERIVATIVES,      /*!< SpatialCell::derivatives, indexed by fieldsolver.*/
+   CELL_BVOL_DERIVATIVES  /*!< SpatialCell::derivativesBVOL, indexed by bvolderivatives.*/
+};
+
+static Real* getCellArray(SpatialCell* cell,const CellArray array) {
+   switch (array) {
+      case CELL_DERIVATIVES:      return cell->derivatives.data();
+      case CELL_BVOL_DERIVATIVES: return cell->derivativesBVOL.data();
+      default:                    return cell->parameters.data();
+   }
+}
+
 /*! Reads cell parameters from the file and saves them in the right place in mpiGrid
  \param file Some parallel vlsv reader with a file open
  \param fileCells List of all cell ids
- \param localCellStartOffset Offset in the fileCells list for this process ( calculated so that the amount of blocks is distributed somewhat evenly between processes)
- \param localCells The amount of cells to read in this process after localCellStartOffset
+ \param runs Cells of this process in the fileCells list
  \param cellParamsIndex The parameter of the cell index e.g. CellParams::RHOM
  \param expectedVectorSize The amount of elements in the parameter (parameter can be a scalar or a vector of size N)
  \param mpiGrid Vlasiator's grid (the parameters are saved here)
+ \param target The array of the cells cellParamsIndex refers to
  \return Returns true if the operation is successful
  */
 template <typename fileReal>
 static bool _readCellParamsVariable(
                                     vlsv::ParallelReader& file,
                                     const vector<uint64_t>& fileCells,
-                                    const uint64_t localCellStartOffset,
-                                    const uint64_t localCells,
+                                    const FileCellRuns& runs,
                                     const string& variableName,
                                     const size_t cellParamsIndex,
                                     const size_t expectedVectorSize,
-                                    dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid
+                                    dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                                    const CellArray target
                                    ) {
    uint64_t arraySize;
    uint64_t vectorSize;
@@ -656,17 +1011,27 @@ static bool _readCellParamsVariable(
       return false;
    }
    
-   buffer=new fileReal[vectorSize*localCells];
-   if(file.readArray("VARIABLE",attribs,localCellStartOffset,localCells,(char *)buffer) == false ) {
-      logFile << "(RESTART)  ERROR: Failed to read " << variableName << endl << write;
-      return false;
-   }
+   uint64_t maxRunSize = 1;
+   for (size_t r=0; r<runs.size.size(); ++r) maxRunSize = max(maxRunSize,runs.size[r]);
+   buffer=new fileReal[vectorSize*maxRunSize];
+
+   // One collective read per run, processes with fewer runs read nothing in the remaining ones
+   for (uint64_t r=0; r<runs.N_runs; ++r) {
+      const uint64_t runBegin = (r < runs.begin.size()) ? runs.begin[r] : 0;
+      const uint64_t runSize  = (r < runs.begin.size()) ? runs.size[r] : 0;
+      if(file.readArray("VARIABLE",attribs,runBegin,runSize,(char *)buffer) == false ) {
+         logFile << "(RESTART)  ERROR: Failed to read " << variableName << endl << write;
+         success = false;
+      }
    
-   for(uint i=0;i<localCells;i++){
-     uint cell=fileCells[localCellStartOffset+i];
-     for(uint j=0;j<vectorSize;j++){
-        mpiGrid[cell]->parameters[cellParamsIndex+j]=buffer[i*vectorSize+j];
-     }
+      if (r >= runs.begin.size()) continue;
+      for(uint64_t c=runs.firstCell[r];c<runs.firstCell[r+1];c++){
+        const uint64_t i = runs.cells[c] - runBegin;
+        Real* cellData = getCellArray(mpiGrid[fileCells[runs.cells[c]]],target);
+        for(uint j=0;j<vectorSize;j++){
+           cellData[cellParamsIndex+j]=buffer[i*vectorSize+j];
+        }
+      }
    }
    
    delete[] buffer;
@@ -676,22 +1041,22 @@ static bool _readCellParamsVariable(
 /*! Reads cell parameters from the file and saves them in the right place in mpiGrid
  \param file Some parallel vlsv reader with a file open
  \param fileCells List of all cell ids
- \param localCellStartOffset Offset in the fileCells list for this process ( calculated so that the amount of blocks is distributed somewhat evenly between processes)
- \param localCells The amount of cells to read in this process after localCellStartOffset
+ \param runs Cells of this process in the fileCells list
  \param cellParamsIndex The parameter of the cell index e.g. CellParams::RHOM
  \param expectedVectorSize The amount of elements in the parameter (parameter can be a scalar or a vector of size N)
  \param mpiGrid Vlasiator's grid (the parameters are saved here)
+ \param target The array of the cells cellParamsIndex refers to, by default the cell parameters
  \return Returns true if the operation is successful
  */
 bool readCellParamsVariable(
    vlsv::ParallelReader& file,
    const vector<CellID>& fileCells,
-   const uint64_t localCellStartOffset,
-   const uint64_t localCells,
+   const FileCellRuns& runs,
    const string& variableName,
    const size_t cellParamsIndex,
    const size_t expectedVectorSize,
-   dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid
+   dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+   const CellArray target=CELL_PARAMETERS
 ) {
    uint64_t arraySize;
    uint64_t vectorSize;
@@ -711,29 +1076,29 @@ bool readCellParamsVariable(
    if( dataType == vlsv::datatype::type::FLOAT ) {
       switch (byteSize) {
          case sizeof(double):
-            return _readCellParamsVariable<double>( file, fileCells, localCellStartOffset, localCells, variableName, cellParamsIndex, expectedVectorSize, mpiGrid );
+            return _readCellParamsVariable<double>( file, fileCells, runs, variableName, cellParamsIndex, expectedVectorSize, mpiGrid, target );
             break;
          case sizeof(float):
-            return _readCellParamsVariable<float>( file, fileCells, localCellStartOffset, localCells, variableName, cellParamsIndex, expectedVectorSize, mpiGrid );
+            return _readCellParamsVariable<float>( file, fileCells, runs, variableName, cellParamsIndex, expectedVectorSize, mpiGrid, target );
             break;
       }
    } else if( dataType == vlsv::datatype::type::UINT ) {
       switch (byteSize) {
 
          case sizeof(uint32_t):
-            return _readCellParamsVariable<uint32_t>( file, fileCells, localCellStartOffset, localCells, variableName, cellParamsIndex, expectedVectorSize, mpiGrid );
+            return _readCellParamsVariable<uint32_t>( file, fileCells, runs, variableName, cellParamsIndex, expectedVectorSize, mpiGrid, target );
             break;
          case sizeof(uint64_t):
-            return _readCellParamsVariable<uint64_t>( file, fileCells, localCellStartOffset, localCells, variableName, cellParamsIndex, expectedVectorSize, mpiGrid );
+            return _readCellParamsVariable<uint64_t>( file, fileCells, runs, variableName, cellParamsIndex, expectedVectorSize, mpiGrid, target );
             break;
       }
    } else if( dataType == vlsv::datatype::type::INT ) {
       switch (byteSize) {
          case sizeof(int32_t):
-            return _readCellParamsVariable<int32_t>( file, fileCells, localCellStartOffset, localCells, variableName, cellParamsIndex, expectedVectorSize, mpiGrid );
+            return _readCellParamsVariable<int32_t>( file, fileCells, runs, variableName, cellParamsIndex, expectedVectorSize, mpiGrid, target );
             break;
          case sizeof(int64_t):
-            return _readCellParamsVariable<int64_t>( file, fileCells, localCellStartOffset, localCells, variableName, cellParamsIndex, expectedVectorSize, mpiGrid );
+            return _readCellParamsVariable<int64_t>( file, fileCells, runs, variableName, cellParamsIndex, expectedVectorSize, mpiGrid, target );
             break;
       }
    } else {
@@ -795,9 +1160,9 @@ bool checkScalarParameter(vlsv::ParallelReader& file,const string& name,T correc
  \sa readGrid
  */
 bool exec_readGrid(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
-                   const std::string& name) {
+                   const std::string& name,
+                   bool& backgroundFieldRead) {
    vector<CellID> fileCells; /*< CellIds for all cells in file*/
-   vector<size_t> nBlocks;/*< Number of blocks for all cells in file*/
    bool success=true;
    int myRank,processes;
 
@@ -867,12 +1232,6 @@ bool exec_readGrid(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
    
    exitOnError(success,"(RESTART) Wrong number of cells in restart file",MPI_COMM_WORLD);
 
-   // Read the total number of velocity blocks in each spatial cell.
-   // Note that this is a sum over all existing particle species.
-   if (success == true) {
-      success = readNBlocks(file,meshName,nBlocks,MASTER_RANK,MPI_COMM_WORLD);
-   }
-
    //make sure all cells are empty, we will anyway overwrite everything and 
    // in that case moving cells is easier...
      {
@@ -883,59 +1242,126 @@ bool exec_readGrid(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
         }
      }
 
-   uint64_t totalNumberOfBlocks=0;
-   unsigned int numberOfBlocksPerProcess;
-   for(uint i=0; i<nBlocks.size(); ++i){
-      totalNumberOfBlocks += nBlocks[i];
+   unordered_map<CellID,uint64_t> fileIndex; // Position of each cell in fileCells
+   for (size_t i=0; i<fileCells.size(); ++i) fileIndex[fileCells[i]] = i;
+
+   // Load balance weights of the cells. The weights of the previous run are used if they
+   // exist, since the load balance done after the restart uses them as well, otherwise the
+   // number of velocity blocks is used. Each process reads a slice of the weights and
+   // fetches those of its cells.
+   const vector<CellID> cells = mpiGrid.get_cells();
+   vector<pair<uint64_t,CellID> > cellIndices; // Position in fileCells and ID of each cell, in file order
+   cellIndices.reserve(cells.size());
+   for (size_t i=0; i<cells.size(); ++i) {
+      unordered_map<CellID,uint64_t>::const_iterator it = fileIndex.find(cells[i]);
+      if (it == fileIndex.end()) {
+         success = false;
+         continue;
+      }
+      cellIndices.push_back(make_pair(it->second,cells[i]));
    }
-   numberOfBlocksPerProcess= 1 + totalNumberOfBlocks/processes;
-
-   uint64_t localCellStartOffset=0; // This is where local cells start in file-list after migration.
-   uint64_t localCells=0;
-   uint64_t numberOfBlocksCount=0;
-   
-   // Pin local cells to remote processes, we try to balance number of blocks so that 
-   // each process has the same amount of blocks, more or less.
-   for (size_t i=0; i<fileCells.size(); ++i) {
-      numberOfBlocksCount += nBlocks[i];
-      int newCellProcess = numberOfBlocksCount/numberOfBlocksPerProcess;
-      if (newCellProcess == myRank) {
-         if (localCells == 0)
-            localCellStartOffset=i; //here local cells start
-         ++localCells;
+   exitOnError(success,"(RESTART) Cells missing from restart file",MPI_COMM_WORLD);
+   sort(cellIndices.begin(),cellIndices.end());
+   {
+      const vector<uint64_t> sliceBegin = getSliceBegins(fileCells.size());
+      const uint64_t sliceSize = sliceBegin[myRank+1] - sliceBegin[myRank];
+      vector<Real> weightSlice(sliceSize+1);
+      list<pair<string,string> > attribs;
+      attribs.push_back(make_pair("name","LB_weight"));
+      attribs.push_back(make_pair("mesh",meshName));
+      uint64_t arraySize, vectorSize, byteSize;
+      vlsv::datatype::type dataType;
+      Real* weightPointer = weightSlice.data();
+      if (file.getArrayInfo("VARIABLE",attribs,arraySize,vectorSize,dataType,byteSize) == false
+          || file.read("VARIABLE",attribs,sliceBegin[myRank],sliceSize,weightPointer,false) == false) {
+         // Read the total number of velocity blocks in each spatial cell.
+         // Note that this is a sum over all existing particle species.
+         vector<size_t> nBlocks;
+         success = readNBlocks(file,meshName,sliceBegin[myRank],sliceSize,nBlocks);
+         for (size_t i=0; i<nBlocks.size(); ++i) weightSlice[i] = nBlocks[i];
       }
-      if (mpiGrid.is_local(fileCells[i])) {
-         mpiGrid.pin(fileCells[i],newCellProcess);
+      weightSlice.resize(sliceSize);
+
+      vector<uint64_t> indices(cellIndices.size());
+      for (size_t i=0; i<cellIndices.size(); ++i) indices[i] = cellIndices[i].first;
+      vector<Real> weights;
+      fetchSliceEntries(weightSlice,sliceBegin,indices,weights);
+      for (size_t i=0; i<cellIndices.size(); ++i) {
+         mpiGrid[cellIndices[i].second]->parameters[CellParams::LBWEIGHTCOUNTER] = weights[i];
       }
    }
-   
-   //Do initial load balance based on pins. Need to transfer at least sysboundaryflags
+   exitOnError(success,"(RESTART) Failed to read load balance weights",MPI_COMM_WORLD);
+
+   // With FsGrid colocation the cells are pinned to the FsGrid tasks like after the restart,
+   // see pinCellsToFsGrid. The FsGrids do not exist yet, a technical grid with the same
+   // dimensions has the same domain decomposition.
+   std::unordered_set<CellID> pinnedCells;
+   if (P::loadBalanceFsGridColocation) {
+      const std::array<int,3> dimensions = {convert<int>(P::xcells_ini), convert<int>(P::ycells_ini), convert<int>(P::zcells_ini)};
+      std::array<bool,3> periodicity{mpiGrid.topology.is_periodic(0),
+                                    mpiGrid.topology.is_periodic(1),
+                                    mpiGrid.topology.is_periodic(2)};
+      FsGridCouplingInformation gridCoupling;
+      FsGrid< fsgrids::technical, 2> technicalGrid(dimensions, MPI_COMM_WORLD, periodicity, gridCoupling);
+      pinCellsToFsGrid(mpiGrid, cells, technicalGrid, pinnedCells);
+      technicalGrid.finalize();
+   }
+
+   // Partition the still empty cells with the target weights before reading anything, so that
+   // each process reads its own cells directly from the file and the velocity space data
+   // does not have to be migrated afterwards. Need to transfer at least sysboundaryflags.
+   // Pinned cells are left out of the weights as in balanceLoad.
+   for (size_t i=0; i<cells.size(); ++i) {
+      if (pinnedCells.count(cells[i]) > 0) {
+         mpiGrid.set_cell_weight(cells[i],0.0);
+      } else {
+         mpiGrid.set_cell_weight(cells[i],mpiGrid[cells[i]]->parameters[CellParams::LBWEIGHTCOUNTER]);
+      }
+   }
+
    SpatialCell::set_mpi_transfer_type(Transfer::ALL_SPATIAL_DATA);
-   mpiGrid.balance_load(false);
+   int allPinned = (pinnedCells.size() == cells.size()) ? 1 : 0;
+   MPI_Allreduce(MPI_IN_PLACE,&allPinned,1,MPI_INT,MPI_LAND,MPI_COMM_WORLD);
+   mpiGrid.balance_load(allPinned == 0);
+   if (pinnedCells.size() > 0) mpiGrid.unpin_all_cells();
 
    //update list of local gridcells
    recalculateLocalCellsCache();
-   //getObjectWrapper().meshData.reallocate();
 
    //get new list of local gridcells
    const vector<CellID>& gridCells = getLocalCells();
 
-   // Unpin cells, otherwise we will never change this initial bad balance
-   for (size_t i=0; i<gridCells.size(); ++i) {
-      mpiGrid.unpin(gridCells[i]);
-   }
-
-   // Check for errors, has migration succeeded
-   if (localCells != gridCells.size() ) {
-      success=false;
-   }
-   if (success == true) {
-      for (uint64_t i=localCellStartOffset; i<localCellStartOffset+localCells; ++i) {
-         if(mpiGrid.is_local(fileCells[i]) == false) success = false;
+   // The local cells are scattered in the file, collect them into runs of nearby cells
+   FileCellRuns runs;
+   {
+      vector<uint64_t>& localFileCells = runs.cells;
+      localFileCells.resize(gridCells.size());
+      for (size_t i=0; i<gridCells.size(); ++i) {
+         unordered_map<CellID,uint64_t>::const_iterator it = fileIndex.find(gridCells[i]);
+         if (it == fileIndex.end()) {
+            success = false;
+            continue;
+         }
+         localFileCells[i] = it->second;
+      }
+      sort(localFileCells.begin(),localFileCells.end());
+      for (size_t i=0; i<localFileCells.size(); ++i) {
+         if (runs.begin.size() > 0
+             && localFileCells[i] <= runs.begin.back() + runs.size.back() + RESTART_READ_GAP_CELLS) {
+            runs.size.back() = localFileCells[i] + 1 - runs.begin.back();
+         } else {
+            runs.begin.push_back(localFileCells[i]);
+            runs.size.push_back(1);
+            runs.firstCell.push_back(i);
+         }
       }
+      runs.firstCell.push_back(localFileCells.size());
+      uint64_t localRuns = runs.begin.size();
+      MPI_Allreduce(&localRuns,&runs.N_runs,1,MPI_Type<uint64_t>(),MPI_MAX,MPI_COMM_WORLD);
    }
 
    exitOnError(success,"(RESTART) Cell migration failed",MPI_COMM_WORLD);
+   logFile << "(RESTART) Cells partitioned before reading, at most " << runs.N_runs << " contiguous reads per array and process" << endl << write;
 
    // Set cell coordinates based on cfg (mpigrid) information
    for (size_t i=0; i<gridCells.size(); ++i) {
@@ -950,35 +1376,47 @@ bool exec_readGrid(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
       mpiGrid[gridCells[i]]->parameters[CellParams::DZ  ] = cell_length[2];
    }
 
-   // Where local data start in the blocklists
-   //uint64_t localBlocks=0;
-   //for(uint64_t i=localCellStartOffset; i<localCellStartOffset+localCells; ++i) {
-   //  localBlocks += nBlocks[i];
-   //}
    phiprof::stop("readDatalayout");
 
    //todo, check file datatype, and do not just use double
    phiprof::start("readCellParameters");
-   if(success) { success=readCellParamsVariable(file,fileCells,localCellStartOffset,localCells,"perturbed_B",CellParams::PERBX,3,mpiGrid); }
-// Backround B has to be set, there are also the derivatives that should be written/read if we wanted to only read in background field
-   if(success) { success=readCellParamsVariable(file,fileCells,localCellStartOffset,localCells,"moments",CellParams::RHOM,5,mpiGrid); }
-   if(success) { success=readCellParamsVariable(file,fileCells,localCellStartOffset,localCells,"moments_dt2",CellParams::RHOM_DT2,5,mpiGrid); }
-   if(success) { success=readCellParamsVariable(file,fileCells,localCellStartOffset,localCells,"moments_r",CellParams::RHOM_R,5,mpiGrid); }
-   if(success) { success=readCellParamsVariable(file,fileCells,localCellStartOffset,localCells,"moments_v",CellParams::RHOM_V,5,mpiGrid); }
-   if(success) { success=readCellParamsVariable(file,fileCells,localCellStartOffset,localCells,"pressure",CellParams::P_11,3,mpiGrid); }
-   if(success) { success=readCellParamsVariable(file,fileCells,localCellStartOffset,localCells,"pressure_dt2",CellParams::P_11_DT2,3,mpiGrid); }
-   if(success) { success=readCellParamsVariable(file,fileCells,localCellStartOffset,localCells,"pressure_r",CellParams::P_11_R,3,mpiGrid); }
-   if(success) { success=readCellParamsVariable(file,fileCells,localCellStartOffset,localCells,"pressure_v",CellParams::P_11_V,3,mpiGrid); }
-   if(success) { success=readCellParamsVariable(file,fileCells,localCellStartOffset,localCells,"LB_weight",CellParams::LBWEIGHTCOUNTER,1,mpiGrid); }
-   if(success) { success=readCellParamsVariable(file,fileCells,localCellStartOffset,localCells,"max_v_dt",CellParams::MAXVDT,1,mpiGrid); }
-   if(success) { success=readCellParamsVariable(file,fileCells,localCellStartOffset,localCells,"max_r_dt",CellParams::MAXRDT,1,mpiGrid); }
-   if(success) { success=readCellParamsVariable(file,fileCells,localCellStartOffset,localCells,"max_fields_dt",CellParams::MAXFDT,1,mpiGrid); }
-// Backround B has to be set, there are also the derivatives that should be written/read if we wanted to only read in background field
+   if(success) { success=readCellParamsVariable(file,fileCells,runs,"perturbed_B",CellParams::PERBX,3,mpiGrid); }
+   if(success) { success=readCellParamsVariable(file,fileCells,runs,"moments",CellParams::RHOM,5,mpiGrid); }
+   if(success) { success=readCellParamsVariable(file,fileCells,runs,"moments_dt2",CellParams::RHOM_DT2,5,mpiGrid); }
+   if(success) { success=readCellParamsVariable(file,fileCells,runs,"moments_r",CellParams::RHOM_R,5,mpiGrid); }
+   if(success) { success=readCellParamsVariable(file,fileCells,runs,"moments_v",CellParams::RHOM_V,5,mpiGrid); }
+   if(success) { success=readCellParamsVariable(file,fileCells,runs,"pressure",CellParams::P_11,3,mpiGrid); }
+   if(success) { success=readCellParamsVariable(file,fileCells,runs,"pressure_dt2",CellParams::P_11_DT2,3,mpiGrid); }
+   if(success) { success=readCellParamsVariable(file,fileCells,runs,"pressure_r",CellParams::P_11_R,3,mpiGrid); }
+   if(success) { success=readCellParamsVariable(file,fileCells,runs,"pressure_v",CellParams::P_11_V,3,mpiGrid); }
+   if(success) { success=readCellParamsVariable(file,fileCells,runs,"LB_weight",CellParams::LBWEIGHTCOUNTER,1,mpiGrid); }
+   if(success) { success=readCellParamsVariable(file,fileCells,runs,"max_v_dt",CellParams::MAXVDT,1,mpiGrid); }
+   if(success) { success=readCellParamsVariable(file,fileCells,runs,"max_r_dt",CellParams::MAXRDT,1,mpiGrid); }
+   if(success) { success=readCellParamsVariable(file,fileCells,runs,"max_fields_dt",CellParams::MAXFDT,1,mpiGrid); }
    phiprof::stop("readCellParameters");
 
+   // The background field is read only if the file has it computed with the same parameters,
+   // the key and the configuration are the same on all processes so they all take the same branch
+   backgroundFieldRead = false;
+   if (success && P::restartReuseBackgroundField) {
+      phiprof::start("readBackgroundField");
+      uint64_t fileKey;
+      if (file.readParameter("background_B_key",fileKey) && fileKey == getBackgroundFieldKey()) {
+         success=readCellParamsVariable(file,fileCells,runs,"background_B",CellParams::BGBX,3,mpiGrid);
+         if(success) { success=readCellParamsVariable(file,fileCells,runs,"background_B_vol",CellParams::BGBXVOL,3,mpiGrid); }
+         if(success) { success=readCellParamsVariable(file,fileCells,runs,"background_B_derivatives",fieldsolver::dBGBxdy,6,mpiGrid,CELL_DERIVATIVES); }
+         if(success) { success=readCellParamsVariable(file,fileCells,runs,"background_B_vol_derivatives",bvolderivatives::dBGBXVOLdy,6,mpiGrid,CELL_BVOL_DERIVATIVES); }
+         backgroundFieldRead = success;
+         if (success) logFile << "(RESTART) Background field read from the restart file" << endl << write;
+      } else {
+         logFile << "(RESTART) Restart file has no background field for the current parameters, recomputing it" << endl << write;
+      }
+      phiprof::stop("readBackgroundField");
+   }
+
    phiprof::start("readBlockData");
    if (success == true) {
-      success = readBlockData(file,meshName,fileCells,localCellStartOffset,localCells,mpiGrid); 
+      success = readBlockData(file,meshName,fileCells,runs,mpiGrid); 
    }
    phiprof::stop("readBlockData");
 
@@ -994,9 +1432,11 @@ bool exec_readGrid(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
 \brief Read in state from a vlsv file in order to restart simulations
 \param mpiGrid Vlasiator's grid
 \param name Name of the restart file e.g. "restart.00052.vlsv"
+\param backgroundFieldRead Set to true if the background field was read from the file, otherwise it has to be computed
 */
 bool readGrid(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
-              const std::string& name){
+              const std::string& name,
+              bool& backgroundFieldRead){
    //Check the vlsv version from the file:
-   return exec_readGrid(mpiGrid,name);
+   return exec_readGrid(mpiGrid,name,backgroundFieldRead);
 }
@@ -35,9 +35,11 @@
 \brief Read in state from a vlsv file in order to restart simulations
 \param mpiGrid Vlasiator's grid
 \param name Name of the restart file e.g. "restart.00052.vlsv"
+\param backgroundFieldRead Set to true if the background field was read from the file, otherwise it has to be computed
 */
 bool readGrid(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
-              const std::string& name);
+              const std::string& name,
+              bool& backgroundFieldRead);
 
 
 /*!
@@ -34,6 +34,8 @@
 #include <algorithm>
 #include <limits>
 
+#include <omp.h>
+
 #include "iowrite.h"
 #include "grid.h"
 #include "phiprof.hpp"
@@ -41,6 +43,8 @@
 #include "logger.h"
 #include "vlasovmover.h"
 #include "object_wrapper.h"
+#include "velocity_block_compression.h"
+#include "backgroundfield/backgroundfield.h"
 
 using namespace std;
 using namespace phiprof;
@@ -52,7 +56,7 @@ typedef Parameters P;
 
 bool writeVelocityDistributionData(const uint popID,Writer& vlsvWriter,
                                    dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
-                                   const std::vector<CellID>& cells,MPI_Comm comm);
+                                   const std::vector<CellID>& cells,MPI_Comm comm,const bool allowLossy);
 
 /*! Updates local ids across MPI to let other processes know in which order this process saves the local cell ids
  \param mpiGrid Vlasiator's MPI grid
@@ -115,13 +119,14 @@ bool globalSuccess(bool success,string errorMessage,MPI_Comm comm){
  @param mpiGrid Vlasiator's grid.
  @param cells Vector of local cells within this process (no ghost cells).
  @param comm The MPI communicator.
+ @param allowLossy If false, quantized compression is replaced by lossless compression (restarts).
  @return Returns true if operation was successful.*/
 bool writeVelocityDistributionData(Writer& vlsvWriter,
                                    dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
-                                   const vector<CellID>& cells,MPI_Comm comm) {
+                                   const vector<CellID>& cells,MPI_Comm comm,const bool allowLossy) {
    bool success = true;
    for (size_t p=0; p<getObjectWrapper().particleSpecies.size(); ++p) {
-      if (writeVelocityDistributionData(p,vlsvWriter,mpiGrid,cells,comm) == false) success = false;
+      if (writeVelocityDistributionData(p,vlsvWriter,mpiGrid,cells,comm,allowLossy) == false) success = false;
    }
    return success;
 }
@@ -131,10 +136,11 @@ bool writeVelocityDistributionData(Writer& vlsvWriter,
  @param mpiGrid Vlasiator's grid.
  @param cells Vector of local cells within this process (no ghost cells).
  @param comm The MPI communicator.
+ @param allowLossy If false, quantized compression is replaced by lossless compression (restarts).
  @return Returns true if operation was successful.*/
 bool writeVelocityDistributionData(const uint popID,Writer& vlsvWriter,
                                    dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
-                                   const std::vector<CellID>& cells,MPI_Comm comm) {
+                                   const std::vector<CellID>& cells,MPI_Comm comm,const bool allowLossy) {
    // Write velocity blocks and related data. 
    // In restart we just write velocity grids for all cells.
    // First write global Ids of those cells which write velocity blocks (here: all cells):
@@ -252,6 +258,54 @@ bool writeVelocityDistributionData(const uint popID,Writer& vlsvWriter,
    attribs.clear();
    attribs["mesh"] = spatMeshName; // Name of the spatial mesh
    attribs["name"] = popName;      // Name of the velocity space distribution is written avgs
+
+   bool compress;
+   blockcompression::Mode mode;
+   blockcompression::parseMode(P::distributionCompression,compress,mode);
+   if (mode == blockcompression::QUANTIZED && allowLossy == false) mode = blockcompression::LOSSLESS;
+   if (compress == true) {
+      // Each cell is encoded into a self-contained chunk, the chunk sizes are written in
+      // BLOCKVARIABLEBYTES (same order as CELLSWITHBLOCKS) so that readers can find any cell.
+      phiprof::start("compress");
+      const double tolerance = P::distributionCompressionTolerance * getObjectWrapper().particleSpecies[popID].sparseMinValue;
+      vector<vector<char> > chunks(cells.size());
+      vector<uint64_t> bytesPerCell(cells.size());
+      #pragma omp parallel for schedule(dynamic,1)
+      for (size_t cell=0; cell<cells.size(); ++cell) {
+         SpatialCell* SC = mpiGrid[cells[cell]];
+         const uint64_t N_values = SC->get_number_of_velocity_blocks(popID)*WID3;
+         bytesPerCell[cell] = blockcompression::encode(SC->get_data(popID),N_values,mode,tolerance,chunks[cell]);
+      }
+      uint64_t compressedBytes = 0;
+      for (size_t cell=0; cell<cells.size(); ++cell) compressedBytes += bytesPerCell[cell];
+      vector<char> compressed;
+      compressed.reserve(compressedBytes);
+      for (size_t cell=0; cell<cells.size(); ++cell) {
+         compressed.insert(compressed.end(),chunks[cell].begin(),chunks[cell].end());
+         vector<char>().swap(chunks[cell]);
+      }
+      phiprof::stop("compress",cells.size(),"Spatial cells");
+
+      if (vlsvWriter.writeArray("BLOCKVARIABLEBYTES",attribs,cells.size(),vectorSize,bytesPerCell.data()) == false) success = false;
+      if (success == false) logFile << "(MAIN) writeGrid: ERROR failed to write BLOCKVARIABLEBYTES to file!" << endl << writeVerbose;
+      attribs["compression"] = blockcompression::modeName(mode);
+      if (vlsvWriter.writeArray("BLOCKVARIABLE_COMPRESSED",attribs,"uint",compressed.size(),1,1,compressed.data()) == false) success = false;
+
+      uint64_t localBytes[2] = {totalBlocks*WID3*sizeof(Realf), compressedBytes};
+      uint64_t globalBytes[2];
+      MPI_Reduce(localBytes,globalBytes,2,MPI_UINT64_T,MPI_SUM,MASTER_RANK,comm);
+      if (mpiGrid.get_rank() == MASTER_RANK && globalBytes[1] > 0) {
+         logFile << "(IO): BLOCKVARIABLE of " << popName << " compressed (" << blockcompression::modeName(mode) << ") from ";
+         logFile << globalBytes[0] << " to " << globalBytes[1] << " bytes, ratio " << (double)globalBytes[0]/globalBytes[1] << endl << writeVerbose;
+      }
+
+      if (globalSuccess(success,"(MAIN) writeGrid: ERROR: Failed to write compressed velocity block data",MPI_COMM_WORLD) == false) {
+         vlsvWriter.close();
+         return false;
+      }
+      return success;
+   }
+
    const string datatype_avgs = "float";
    const uint64_t arraySize_avgs = totalBlocks;
    const uint64_t vectorSize_avgs = WID3; // There are 64 elements in every velocity block
@@ -292,78 +346,121 @@ bool writeVelocityDistributionData(const uint popID,Writer& vlsvWriter,
    return success;
 }
 
-/*! Writes info received from data reducer. This function writes out the variable arrays into the file
- \param mpiGrid The Vlasiator's grid
+/*! Number of local cells handed out to a thread at a time when evaluating a data reducer.*/
+static const size_t DRO_CELL_CHUNK = 32;
+
+/*! A data reducer variable that has been (or is being) evaluated for all local cells and waits to be written.*/
+struct ReducedVariable {
+   int dataReducerIndex;
+   string name;
+   string dataType;
+   uint dataSize;
+   uint vectorSize;
+   char* buffer;
+   
+   ReducedVariable(): dataReducerIndex(-1),dataSize(0),vectorSize(0),buffer(NULL) { }
+};
+
+/*! Queries the vector info of a data reducer and allocates the output buffer for all local cells.
  \param cells List of local cells (no ghost cells included)
- \param writeAsFloat If true, the data reducer writes variable arrays as float instead of double
  \param dataReducer The data reducer which contains the necessary functions for calculating variables
- \param dataReducerIndex Index in the data reducer (determines which variable to read) Note: size of the data reducer can be retrieved with dataReducer.size()
- \param vlsvWriter Some vlsv writer with a file open
+ \param dataReducerIndex Index in the data reducer
+ \param variable Filled with the variable info, variable.buffer is left NULL if the reducer writes nothing
  \return Returns true if operation was successful
  */
-bool writeDataReducer(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
-                      const std::vector<CellID>& cells,
-                      const bool writeAsFloat,
-                      DataReducer& dataReducer,
-                      int dataReducerIndex,
-                      Writer& vlsvWriter){
-   map<string,string> attribs;
-   string variableName,dataType;
-   bool success=true;
-
-   const string meshName = "SpatialGrid";
-   variableName = dataReducer.getName(dataReducerIndex);
-   phiprof::start("DRO_"+variableName);
-
-   // If the DataReducer can write its data directly to the output file, do it here.
-   // Otherwise the output data is buffered and written below.
-   if (dataReducer.handlesWriting(dataReducerIndex) == true) {
-      success = dataReducer.writeData(dataReducerIndex,mpiGrid,cells,meshName,vlsvWriter);
-      phiprof::stop("DRO_"+variableName);
-      return success;
-   }
-
-   //Get basic data on a variable:
-   uint dataSize,vectorSize;
-   attribs["mesh"] = meshName;
-   attribs["name"] = variableName;
-   if (dataReducer.getDataVectorInfo(dataReducerIndex,dataType,dataSize,vectorSize) == false) {
+static bool allocateReducedVariable(const std::vector<CellID>& cells,
+                                    DataReducer& dataReducer,
+                                    int dataReducerIndex,
+                                    ReducedVariable& variable) {
+   variable.dataReducerIndex = dataReducerIndex;
+   variable.name = dataReducer.getName(dataReducerIndex);
+   variable.buffer = NULL;
+   if (dataReducer.getDataVectorInfo(dataReducerIndex,variable.dataType,variable.dataSize,variable.vectorSize) == false) {
       cerr << "ERROR when requesting info from DRO " << dataReducerIndex << endl;
-      phiprof::stop("DRO_"+variableName);
       return false;
    }
    
    // If DRO has a vector size of 0 it means this DRO should not write out anything. This is used e.g. for DROs we want only for certain populations.
-   if (vectorSize == 0) {
-      phiprof::stop("DRO_"+variableName);
-      return true;
-   }
-
-   const uint64_t varBufferArraySize = cells.size()*vectorSize*dataSize;
+   if (variable.vectorSize == 0) return true;
    
-   //Request DataReductionOperator to calculate the reduced data for all local cells:
-   char* varBuffer = NULL;
+   const uint64_t varBufferArraySize = cells.size()*variable.vectorSize*variable.dataSize;
    try {
-      varBuffer = new char[varBufferArraySize];
+      variable.buffer = new char[varBufferArraySize];
    } catch( bad_alloc& ) {
       cerr << "ERROR, FAILED TO ALLOCATE MEMORY AT: " << __FILE__ << " " << __LINE__ << endl;
       logFile << "(MAIN) writeGrid: ERROR FAILED TO ALLOCATE MEMORY AT: " << __FILE__ << " " << __LINE__ << endl << writeVerbose;
-      phiprof::stop("DRO_"+variableName);
       return false;
    }
+   return true;
+}
 
-   for (size_t cell=0; cell<cells.size(); ++cell) {
-      //Reduce data ( return false if the operation fails )
-      if (dataReducer.reduceData(mpiGrid[cells[cell]],dataReducerIndex,varBuffer + cell*vectorSize*dataSize) == false){
-         success = false;
-         logFile << "(MAIN) writeGrid: ERROR datareductionoperator '" << dataReducer.getName(dataReducerIndex) <<
-            "' returned false!" << endl << writeVerbose;
+/*! Evaluates a data reducer for chunks of local cells. Every thread of the enclosing parallel 
+ region calls this, chunks are claimed through the shared counter so that threads joining late 
+ (e.g. the master thread after writing the previous variable) just pick up the remaining work.
+ DataReductionOperators are reentrant, so different cells can be reduced concurrently.
+ \param mpiGrid The Vlasiator's grid
+ \param cells List of local cells (no ghost cells included)
+ \param dataReducer The data reducer which contains the necessary functions for calculating variables
+ \param variable The variable being evaluated, its buffer must be allocated
+ \param nextChunk Shared counter of the next unclaimed chunk
+ \return Returns false if the reducer failed for any cell handled by this thread
+ */
+static bool reduceCellChunks(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                             const std::vector<CellID>& cells,
+                             DataReducer& dataReducer,
+                             const ReducedVariable& variable,
+                             size_t& nextChunk) {
+   bool success = true;
+   const size_t cellBytes = variable.vectorSize*variable.dataSize;
+   while (true) {
+      size_t chunk;
+      #pragma omp atomic capture
+      chunk = nextChunk++;
+      
+      const size_t first = chunk*DRO_CELL_CHUNK;
+      if (first >= cells.size()) break;
+      const size_t last = min(first + DRO_CELL_CHUNK, cells.size());
+      for (size_t cell=first; cell<last; ++cell) {
+         //Reduce data ( return false if the operation fails )
+         if (dataReducer.reduceData(mpiGrid[cells[cell]],variable.dataReducerIndex,variable.buffer + cell*cellBytes) == false) {
+            success = false;
+         }
       }
    }
-   if( success ) {
+   return success;
+}
+
+/*! Writes an evaluated data reducer variable into the file and frees its buffer. Calls the vlsv writer, 
+ so this has to be called from the master thread.
+ \param cells List of local cells (no ghost cells included)
+ \param writeAsFloat If true, the data reducer writes variable arrays as float instead of double
+ \param dataReducer The data reducer which contains the necessary functions for calculating variables
+ \param variable The evaluated variable
+ \param reduced False if the reduction of the variable failed, in which case nothing is written
+ \param vlsvWriter Some vlsv writer with a file open
+ \return Returns true if operation was successful
+ */
+static bool writeReducedVariable(const std::vector<CellID>& cells,
+                                 const bool writeAsFloat,
+                                 DataReducer& dataReducer,
+                                 ReducedVariable& variable,
+                                 const bool reduced,
+                                 Writer& vlsvWriter) {
+   map<string,string> attribs;
+   bool success = reduced;
+   attribs["mesh"] = "SpatialGrid";
+   attribs["name"] = variable.name;
+   
+   if (reduced == false) {
+      logFile << "(MAIN) writeGrid: ERROR datareductionoperator '" << variable.name <<
+         "' returned false!" << endl << writeVerbose;
+   } else {
+      const string& dataType = variable.dataType;
+      const uint dataSize = variable.dataSize;
+      const uint vectorSize = variable.vectorSize;
 
       if( (writeAsFloat == true && dataType.compare("float") == 0) && dataSize == sizeof(double) ) {
-         double * varBuffer_double = reinterpret_cast<double*>(varBuffer);
+         double * varBuffer_double = reinterpret_cast<double*>(variable.buffer);
          //Declare smaller varbuffer:
          const uint64_t arraySize_smaller = cells.size();
          const uint32_t vectorSize_smaller = vectorSize;
@@ -375,9 +472,8 @@ bool writeDataReducer(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>&
          } catch( bad_alloc& ) {
             cerr << "ERROR, FAILED TO ALLOCATE MEMORY AT: " << __FILE__ << " " << __LINE__ << endl;
             logFile << "(MAIN) writeGrid: ERROR FAILED TO ALLOCATE MEMORY AT: " << __FILE__ << " " << __LINE__ << endl << writeVerbose;
-            delete[] varBuffer;
-            varBuffer = NULL;
-            phiprof::stop("DRO_"+variableName);
+            delete[] variable.buffer;
+            variable.buffer = NULL;
             return false;
          }
          //Input varBuffer_double into varBuffer_smaller:
@@ -399,26 +495,142 @@ bool writeDataReducer(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>&
       } else {
          // Write  reduced data to file if DROP was successful:
          phiprof::start("writeArray");
-         if (vlsvWriter.writeArray("VARIABLE",attribs, dataType, cells.size(), vectorSize, dataSize, varBuffer) == false) {
+         if (vlsvWriter.writeArray("VARIABLE",attribs, dataType, cells.size(), vectorSize, dataSize, variable.buffer) == false) {
             success = false;
             logFile << "(MAIN) writeGrid: ERROR failed to write datareductionoperator data to file!" << endl << writeVerbose;
          }
          phiprof::stop("writeArray");
       }
-
    }
    
    // Check if the DataReducer wants to write paramters to the output file
-   if (dataReducer.hasParameters(dataReducerIndex) == true) {
-      success = dataReducer.writeParameters(dataReducerIndex,vlsvWriter);
+   if (dataReducer.hasParameters(variable.dataReducerIndex) == true) {
+      success = dataReducer.writeParameters(variable.dataReducerIndex,vlsvWriter);
+   }
+
+   delete[] variable.buffer;
+   variable.buffer = NULL;
+   return success;
+}
+
+/*! Writes info received from data reducer. This function writes out the variable arrays into the file
+ \param mpiGrid The Vlasiator's grid
+ \param cells List of local cells (no ghost cells included)
+ \param writeAsFloat If true, the data reducer writes variable arrays as float instead of double
+ \param dataReducer The data reducer which contains the necessary functions for calculating variables
+ \param dataReducerIndex Index in the data reducer (determines which variable to read) Note: size of the data reducer can be retrieved with dataReducer.size()
+ \param vlsvWriter Some vlsv writer with a file open
+ \return Returns true if operation was successful
+ */
+bool writeDataReducer(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                      const std::vector<CellID>& cells,
+                      const bool writeAsFloat,
+                      DataReducer& dataReducer,
+                      int dataReducerIndex,
+                      Writer& vlsvWriter){
+   bool success=true;
+
+   const string meshName = "SpatialGrid";
+   const string variableName = dataReducer.getName(dataReducerIndex);
+   phiprof::start("DRO_"+variableName);
+
+   // If the DataReducer can write its data directly to the output file, do it here.
+   // Otherwise the output data is buffered and written below.
+   if (dataReducer.handlesWriting(dataReducerIndex) == true) {
+      success = dataReducer.writeData(dataReducerIndex,mpiGrid,cells,meshName,vlsvWriter);
+      phiprof::stop("DRO_"+variableName);
+      return success;
    }
 
-   delete[] varBuffer;
-   varBuffer = NULL;
+   ReducedVariable variable;
+   if (allocateReducedVariable(cells,dataReducer,dataReducerIndex,variable) == false) {
+      phiprof::stop("DRO_"+variableName);
+      return false;
+   }
+   if (variable.buffer == NULL) {
+      phiprof::stop("DRO_"+variableName);
+      return true;
+   }
+
+   //Request DataReductionOperator to calculate the reduced data for all local cells:
+   bool reduced = true;
+   size_t nextChunk = 0;
+   #pragma omp parallel reduction(&&:reduced)
+   {
+      reduced = reduceCellChunks(mpiGrid,cells,dataReducer,variable,nextChunk);
+   }
+   success = writeReducedVariable(cells,writeAsFloat,dataReducer,variable,reduced,vlsvWriter);
    phiprof::stop("DRO_"+variableName);
    return success;
 }
 
+/*! Writes out all variables of a data reducer. The evaluation of each variable is overlapped with 
+ writing the previous one: the master thread writes the previous variable (vlsv writes are MPI calls 
+ and have to stay on the master thread) while the other threads already reduce the next one, and the 
+ master joins the reduction once its write is done. Reducers that handle writing themselves are run 
+ serially in between.
+ \param mpiGrid The Vlasiator's grid
+ \param cells List of local cells (no ghost cells included)
+ \param writeAsFloat If true, the data reducer writes variable arrays as float instead of double
+ \param dataReducer The data reducer which contains the necessary functions for calculating variables
+ \param vlsvWriter Some vlsv writer with a file open
+ \return Returns true if operation was successful
+ */
+bool writeDataReducers(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                       const std::vector<CellID>& cells,
+                       const bool writeAsFloat,
+                       DataReducer& dataReducer,
+                       Writer& vlsvWriter) {
+   bool success = true;
+   ReducedVariable pending;
+   bool pendingReduced = true;
+   
+   // Reductions shared between several variables (e.g. the fused velocity moments) are done up front
+   if (dataReducer.prepareReductions(mpiGrid,cells) == false) success = false;
+   
+   for (uint i=0; i<dataReducer.size(); ++i) {
+      if (dataReducer.handlesWriting(i) == true) {
+         if (pending.buffer != NULL) {
+            success = writeReducedVariable(cells,writeAsFloat,dataReducer,pending,pendingReduced,vlsvWriter) && success;
+         }
+         success = writeDataReducer(mpiGrid,cells,writeAsFloat,dataReducer,i,vlsvWriter) && success;
+         continue;
+      }
+      
+      const string variableName = dataReducer.getName(i);
+      phiprof::start("DRO_"+variableName);
+      ReducedVariable variable;
+      if (allocateReducedVariable(cells,dataReducer,i,variable) == false) {
+         success = false;
+      }
+      if (variable.buffer == NULL) {
+         phiprof::stop("DRO_"+variableName);
+         continue;
+      }
+      
+      bool reduced = true;
+      bool written = true;
+      size_t nextChunk = 0;
+      #pragma omp parallel reduction(&&:reduced)
+      {
+         if (omp_get_thread_num() == 0 && pending.buffer != NULL) {
+            written = writeReducedVariable(cells,writeAsFloat,dataReducer,pending,pendingReduced,vlsvWriter);
+         }
+         reduced = reduceCellChunks(mpiGrid,cells,dataReducer,variable,nextChunk);
+      }
+      success = written && success;
+      phiprof::stop("DRO_"+variableName,cells.size(),"Spatial cells");
+      
+      pending = variable;
+      pendingReduced = reduced;
+   }
+   if (pending.buffer != NULL) {
+      success = writeReducedVariable(cells,writeAsFloat,dataReducer,pending,pendingReduced,vlsvWriter) && success;
+   }
+   dataReducer.finishReductions();
+   return success;
+}
+
 
 
 
@@ -846,7 +1058,7 @@ bool writeVelocitySpace(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpi
       localNumVelSpaceCells=velSpaceCells.size();
       MPI_Allreduce(&localNumVelSpaceCells,&numVelSpaceCells,1,MPI_UINT64_T,MPI_SUM,MPI_COMM_WORLD);
       //write out velocity space data NOTE: There is mpi communication in writeVelocityDistributionData
-      if (writeVelocityDistributionData(vlsvWriter, mpiGrid, velSpaceCells, MPI_COMM_WORLD ) == false ) {
+      if (writeVelocityDistributionData(vlsvWriter, mpiGrid, velSpaceCells, MPI_COMM_WORLD, true) == false ) {
          cerr << "ERROR, FAILED TO WRITE VELOCITY DISTRIBUTION DATA AT " << __FILE__ << " " << __LINE__ << endl;
          logFile << "(MAIN) writeGrid: ERROR FAILED TO WRITE VELOCITY DISTRIBUTION DATA AT: " << __FILE__ << " " << __LINE__ << endl << writeVerbose;
       }
@@ -994,8 +1206,8 @@ bool writeGrid(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
    //Write necessary variables:
    //Determines whether we write in floats or doubles
    phiprof::start("writeDataReducer");
-   if (dataReducer != NULL) for( uint i = 0; i < dataReducer->size(); ++i ) {
-      if( writeDataReducer( mpiGrid, local_cells, (P::writeAsFloat==1), *dataReducer, i, vlsvWriter ) == false ) return false;
+   if (dataReducer != NULL) {
+      if( writeDataReducers( mpiGrid, local_cells, (P::writeAsFloat==1), *dataReducer, vlsvWriter ) == false ) return false;
    }
    phiprof::stop("writeDataReducer");
    
@@ -1129,11 +1341,18 @@ bool writeRestart(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
    
    //Write zone global id numbers:
    if( writeZoneGlobalIdNumbers( mpiGrid, vlsvWriter, meshName, local_cells, ghost_cells ) == false ) return false;
+
+   //Parameters the background field was computed from, a matching restart can read it instead of recomputing
+   uint64_t backgroundFieldKey = getBackgroundFieldKey();
+   if( vlsvWriter.writeParameter("background_B_key", &backgroundFieldKey) == false ) return false;
    phiprof::stop("metadataIO");
    phiprof::start("reduceddataIO");   
    //write out DROs we need for restarts
    DataReducer restartReducer;
    restartReducer.addOperator(new DRO::DataReductionOperatorCellParams("background_B",CellParams::BGBX,3));
+   restartReducer.addOperator(new DRO::DataReductionOperatorCellParams("background_B_vol",CellParams::BGBXVOL,3));
+   restartReducer.addOperator(new DRO::DataReductionOperatorDerivatives("background_B_derivatives",fieldsolver::dBGBxdy,6));
+   restartReducer.addOperator(new DRO::DataReductionOperatorBVOLDerivatives("background_B_vol_derivatives",bvolderivatives::dBGBXVOLdy,6));
    restartReducer.addOperator(new DRO::DataReductionOperatorCellParams("perturbed_B",CellParams::PERBX,3));
    restartReducer.addOperator(new DRO::DataReductionOperatorCellParams("moments",CellParams::RHOM,5));
    restartReducer.addOperator(new DRO::DataReductionOperatorCellParams("moments_dt2",CellParams::RHOM_DT2,5));
@@ -1155,15 +1374,14 @@ bool writeRestart(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
    
    //Write necessary variables:
    const bool writeAsFloat = false;
-   for (uint i=0; i<restartReducer.size(); ++i) {
-      writeDataReducer(mpiGrid, local_cells, writeAsFloat, restartReducer, i, vlsvWriter);
-   }
+   writeDataReducers(mpiGrid, local_cells, writeAsFloat, restartReducer, vlsvWriter);
    phiprof::stop("reduceddataIO");   
    //write the velocity distribution data -- note: it's expecting a vector of pointers:
    // Note: restart should always write double values to ensure the accuracy of the restart runs. 
    // In case of distribution data it is not as important as they are mainly used for visualization purpose
+   // For the same reason a quantized distribution compression is replaced by lossless compression.
    phiprof::start("velocityspaceIO");
-   writeVelocityDistributionData(vlsvWriter, mpiGrid, local_cells, MPI_COMM_WORLD);
+   writeVelocityDistributionData(vlsvWriter, mpiGrid, local_cells, MPI_COMM_WORLD, false);
    phiprof::stop("velocityspaceIO");
 
    phiprof::start("close");
@@ -1224,7 +1442,6 @@ bool writeDiagnostic(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>&
    vector<Real> localMin(nOps), localMax(nOps), localSum(nOps+1), localAvg(nOps),
                globalMin(nOps),globalMax(nOps),globalSum(nOps+1),globalAvg(nOps);
    localSum[0] = 1.0 * nCells;
-   Real buffer;
    bool success = true;
    static bool printDiagnosticHeader = true;
    
@@ -1246,19 +1463,24 @@ bool writeDiagnostic(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>&
       if (dataReducer.getDataVectorInfo(i,dataType,dataSize,vectorSize) == false) {
          cerr << "ERROR when requesting info from diagnostic DRO " << dataReducer.getName(i) << endl;
       }
-      localMin[i] = std::numeric_limits<Real>::max();
-      localMax[i] = std::numeric_limits<Real>::min();
-      localSum[i+1] = 0.0;
-      buffer = 0.0;
+      Real opMin = std::numeric_limits<Real>::max();
+      Real opMax = std::numeric_limits<Real>::min();
+      Real opSum = 0.0;
+      success = true;
       
-      // Request DataReductionOperator to calculate the reduced data for all local cells:
+      // Request DataReductionOperator to calculate the reduced data for all local cells.
+      // The operators are reentrant, so the cells are reduced in parallel.
+      #pragma omp parallel for schedule(dynamic,DRO_CELL_CHUNK) reduction(min:opMin) reduction(max:opMax) reduction(+:opSum) reduction(&&:success)
       for (uint64_t cell=0; cell<nCells; ++cell) {
-         success = true;
+         Real buffer = 0.0;
          if (dataReducer.reduceDiagnostic(mpiGrid[cells[cell]], i, &buffer) == false) success = false;
-         localMin[i] = min(buffer, localMin[i]);
-         localMax[i] = max(buffer, localMax[i]);
-         localSum[i+1] += buffer;
+         opMin = min(buffer, opMin);
+         opMax = max(buffer, opMax);
+         opSum += buffer;
       }
+      localMin[i] = opMin;
+      localMax[i] = opMax;
+      localSum[i+1] = opSum;
       localAvg[i] = localSum[i+1];
       
       if (success == false) logFile << "(MAIN) writeDiagnostic: ERROR datareductionoperator '" << dataReducer.getName(i) <<
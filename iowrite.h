@@ -74,6 +74,6 @@ bool writeVelocitySpace(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpi
                         vlsv::Writer& vlsvWriter,int index,const std::vector<uint64_t>& cells);
 
 bool writeVelocityDistributionData(vlsv::Writer& vlsvWriter,dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
-                                   const std::vector<uint64_t>& cells,MPI_Comm comm);
+                                   const std::vector<uint64_t>& cells,MPI_Comm comm,const bool allowLossy=true);
 
 #endif
@@ -76,6 +76,7 @@ bool P::writeInitialState = true;
 bool P::meshRepartitioned = true;
 bool P::prepareForRebalance = false;
 std::vector<CellID> P::localCells;
+uint P::localCellsGeneration = 0;
 
 vector<string> P::systemWriteName;
 vector<string> P::systemWritePath;
@@ -106,6 +107,9 @@ bool P::dynamicTimestep = true;
 Real P::maxWaveVelocity = 0.0;
 uint P::maxFieldSolverSubcycles = 0.0;
 int P::maxSlAccelerationSubcycles = 0.0;
+bool P::sparseRemoteMapping = false;
+bool P::fusedBlockListExchange = false;
+bool P::stagedBlockDataExchange = false;
 Real P::resistivity = NAN;
 bool P::fieldSolverDiffusiveEterms = true;
 uint P::ohmHallTerm = 0;
@@ -114,10 +118,15 @@ Real P::electronTemperature = 0.0;
 
 string P::restartFileName = string("");
 bool P::isRestart=false;
+bool P::restartReuseBackgroundField = false;
 int P::writeAsFloat = false;
+bool P::fusedVelocityMoments = true;
+string P::distributionCompression = string("none");
+Real P::distributionCompressionTolerance = 0.01;
 string P::loadBalanceAlgorithm = string("");
 string P::loadBalanceTolerance = string("");
 uint P::rebalanceInterval = numeric_limits<uint>::max();
+bool P::loadBalanceFsGridColocation = false;
 
 vector<string> P::outputVariableList;
 vector<string> P::diagnosticVariableList;
@@ -158,6 +167,9 @@ bool Parameters::addParameters(){
    Readparameters::add("io.vlsv_buffer_size", "Buffer size passed to VLSV writer (bytes, up to uint64_t)", 1024*1024*1024);
    Readparameters::add("io.write_restart_stripe_factor","Stripe factor for restart writing.", -1);
    Readparameters::add("io.write_as_float","If true, write in floats instead of doubles", false);
+   Readparameters::add("io.fused_velocity_moments","If true, compute the requested backstream moments and energy densities of all populations in a single pass over each cell's velocity space before writing", true);
+   Readparameters::add("io.distribution_compression","Compression of written velocity distributions: none, lossless or quantized. Restarts use lossless if quantized is selected.", string("none"));
+   Readparameters::add("io.distribution_compression_tolerance","Maximum absolute error of quantized velocity distributions, in units of the sparsity threshold of the population", 0.01);
    Readparameters::add("io.restart_write_path", "Path to the location where restart files should be written. Defaults to the local directory, also if the specified destination is not writeable.", string("./"));
    
    Readparameters::add("propagate_potential","Propagate electrostatic potential during the simulation",false);
@@ -169,6 +181,7 @@ bool Parameters::addParameters(){
    Readparameters::add("project", "Specify the name of the project to use. Supported to date (20150610): Alfven Diffusion Dispersion Distributions Firehose Flowthrough Fluctuations Harris KHB Larmor Magnetosphere Multipeak PoissonTest Riemann1 Shock Shocktest Template test_fp testHall test_trans VelocityBox verificationLarmor", string(""));
 
    Readparameters::add("restart.filename","Restart from this vlsv file. No restart if empty file.",string(""));
+   Readparameters::add("restart.reuse_background_field","Read the background magnetic field and its derivatives from the restart file instead of recomputing them, if the file was written with the same project, grid and boundary parameters.",false);
    
    Readparameters::add("gridbuilder.geometry","Simulation geometry XY4D,XZ4D,XY5D,XZ5D,XYZ6D",string("XYZ6D"));
    Readparameters::add("gridbuilder.x_min","Minimum value of the x-coordinate.","");
@@ -202,11 +215,15 @@ bool Parameters::addParameters(){
    Readparameters::add("vlasovsolver.maxSlAccelerationSubcycles","Maximum number of subcycles for acceleration",1);
    Readparameters::add("vlasovsolver.maxCFL","The maximum CFL limit for vlasov propagation in ordinary space. Used to set timestep if dynamic_timestep is true.",0.99);
    Readparameters::add("vlasovsolver.minCFL","The minimum CFL limit for vlasov propagation in ordinary space. Used to set timestep if dynamic_timestep is true.",0.8);
+   Readparameters::add("vlasovsolver.sparseRemoteMapping","Send translation contributions to remote cells as runs of non-zero velocity blocks instead of the whole block array (costs one extra size exchange).",false);
+   Readparameters::add("vlasovsolver.fusedBlockListExchange","Exchange velocity block lists and lists of blocks with content with remote cells in a single round of size-prefixed messages instead of separate size and list transfers.",false);
+   Readparameters::add("vlasovsolver.stagedBlockDataExchange","Pack velocity block data sent to remote cells in translation into one contiguous buffer per process pair instead of sending a datatype per cell through dccrg.",false);
 
    // Load balancing parameters
    Readparameters::add("loadBalance.algorithm", "Load balancing algorithm to be used", string("RCB"));
    Readparameters::add("loadBalance.tolerance", "Load imbalance tolerance", string("1.05"));
    Readparameters::add("loadBalance.rebalanceInterval", "Load rebalance interval (steps)", 10);
+   Readparameters::add("loadBalance.fsgridColocation", "Keep spatial cells on the FsGrid task owning the same cell, so that field solver coupling stays rank-local, for the FsGrid task boxes where this keeps the load within loadBalance.tolerance. The other cells are partitioned with the load balancing algorithm.", false);
    
 // Output variable parameters
    // NOTE Do not remove the : before the list of variable names as this is parsed by tools/check_vlasiator_cfg.sh
@@ -246,6 +263,9 @@ bool Parameters::getParameters(){
    Readparameters::get("io.write_restart_stripe_factor", P::restartStripeFactor);
    Readparameters::get("io.restart_write_path", P::restartWritePath);
    Readparameters::get("io.write_as_float", P::writeAsFloat);
+   Readparameters::get("io.fused_velocity_moments", P::fusedVelocityMoments);
+   Readparameters::get("io.distribution_compression", P::distributionCompression);
+   Readparameters::get("io.distribution_compression_tolerance", P::distributionCompressionTolerance);
    
    // Checks for validity of io and restart parameters
    int myRank;
@@ -257,6 +277,12 @@ bool Parameters::getParameters(){
       }
       P::restartWritePath = prefix;
    }
+   if (P::distributionCompression != "none" && P::distributionCompression != "lossless" && P::distributionCompression != "quantized") {
+      if(myRank == MASTER_RANK) {
+         cerr << "ERROR io.distribution_compression should be one of none, lossless or quantized." << endl;
+      }
+      return false;
+   }
    size_t maxSize = 0;
    maxSize = max(maxSize, P::systemWriteTimeInterval.size());
    maxSize = max(maxSize, P::systemWriteName.size());
@@ -347,6 +373,7 @@ bool Parameters::getParameters(){
    P::hallMinimumRhoq = hallRho*physicalconstants::CHARGE;
    Readparameters::get("restart.filename",P::restartFileName);
    P::isRestart=(P::restartFileName!=string(""));
+   Readparameters::get("restart.reuse_background_field",P::restartReuseBackgroundField);
 
    Readparameters::get("project", P::projectName);
    if(Readparameters::helpRequested) {
@@ -428,12 +455,16 @@ bool Parameters::getParameters(){
    Readparameters::get("vlasovsolver.maxSlAccelerationSubcycles",P::maxSlAccelerationSubcycles);
    Readparameters::get("vlasovsolver.maxCFL",P::vlasovSolverMaxCFL);
    Readparameters::get("vlasovsolver.minCFL",P::vlasovSolverMinCFL);
+   Readparameters::get("vlasovsolver.sparseRemoteMapping",P::sparseRemoteMapping);
+   Readparameters::get("vlasovsolver.fusedBlockListExchange",P::fusedBlockListExchange);
+   Readparameters::get("vlasovsolver.stagedBlockDataExchange",P::stagedBlockDataExchange);
 
    
    // Get load balance parameters
    Readparameters::get("loadBalance.algorithm", P::loadBalanceAlgorithm);
    Readparameters::get("loadBalance.tolerance", P::loadBalanceTolerance);
    Readparameters::get("loadBalance.rebalanceInterval", P::rebalanceInterval);
+   Readparameters::get("loadBalance.fsgridColocation", P::loadBalanceFsGridColocation);
    
    // Get output variable parameters
    Readparameters::get("variables.output", P::outputVariableList);
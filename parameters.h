@@ -65,6 +65,7 @@ struct Parameters {
 
    static bool meshRepartitioned;         /*!< If true, mesh was repartitioned on this time step.*/
    static std::vector<CellID> localCells; /*!< Cached copy of spatial cell IDs on this process.*/
+   static uint localCellsGeneration; /*!< Incremented each time localCells is recalculated, i.e. after each repartitioning.*/
 
    static uint diagnosticInterval;
    static std::vector<std::string> systemWriteName; /*!< Names for the different classes of grid output*/
@@ -106,6 +107,9 @@ struct Parameters {
    
    static Real maxSlAccelerationRotation; /*!< Maximum rotation in acceleration for semilagrangian solver*/
    static int maxSlAccelerationSubcycles; /*!< Maximum number of subcycles in acceleration*/
+   static bool sparseRemoteMapping; /*!< If true, remote translation contributions are sent as runs of non-zero blocks only.*/
+   static bool fusedBlockListExchange; /*!< If true, block lists are exchanged with remote cells in one round of size-prefixed messages.*/
+   static bool stagedBlockDataExchange; /*!< If true, block data of translation is sent to remote cells in one packed message per process pair.*/
    
    static Real hallMinimumRhom;  /*!< Minimum mass density value used in the field solver.*/
    static Real hallMinimumRhoq;  /*!< Minimum charge density value used for the Hall and electron pressure gradient terms in the Lorentz force and in the field solver.*/
@@ -113,6 +117,7 @@ struct Parameters {
    static std::string loadBalanceAlgorithm; /*!< Algorithm to be used for load balance.*/
    static std::string loadBalanceTolerance; /*!< Load imbalance tolerance. */ 
    static uint rebalanceInterval; /*!< Load rebalance interval (steps). */
+   static bool loadBalanceFsGridColocation; /*!< If true, spatial cells are pinned to the FsGrid task owning the same cell where the load allows.*/
    static bool prepareForRebalance; /**< If true, propagators should measure their time consumption in preparation
                                      * for mesh repartitioning.*/
 
@@ -121,7 +126,11 @@ struct Parameters {
    
    static std::string restartFileName; /*!< If defined, restart from this file*/
    static bool isRestart; /*!< true if this is a restart, false otherwise */
+   static bool restartReuseBackgroundField; /*!< If true, read the background field from a matching restart file instead of recomputing it.*/
    static int writeAsFloat; /*!< true if writing into VLSV in floats instead of doubles, false otherwise */
+   static bool fusedVelocityMoments; /*!< If true, backstream moments and energy density of all populations are reduced in one pass over velocity space per output step */
+   static std::string distributionCompression; /*!< Compression of written velocity distributions (BLOCKVARIABLE): none, lossless or quantized */
+   static Real distributionCompressionTolerance; /*!< Maximum absolute error of quantized distributions in units of the population's sparsity threshold */
    static bool dynamicTimestep; /*!< If true, timestep is set based on  CFL limit */
    
    static std::string projectName; /*!< Project to be used in this run. */
@@ -34,6 +34,12 @@ struct Boundary
    // object cares about (for example: wrap in a periodic direction)
    virtual int cellCoordinate(int c) = 0;
 
+   // Number of cells by which coordinates outside the domain are wrapped
+   // around, 0 for boundaries that clamp them instead
+   virtual int periodicCells() {
+      return 0;
+   }
+
    Boundary(int _dimension) : dimension(_dimension) {};
    virtual void setExtent(double _min, double _max, int _cells) {
       min=_min;
@@ -159,6 +165,10 @@ struct PeriodicBoundary : public Boundary
       return c % cells;
    }
 
+   virtual int periodicCells() {
+      return cells;
+   }
+
    // Constructor
    PeriodicBoundary(int _dimension) : Boundary(_dimension) {
    }
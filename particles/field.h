@@ -20,11 +20,14 @@
  * with this program; if not, write to the Free Software Foundation, Inc.,
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
+#include <algorithm>
+#include <cstdint>
 #include <vector>
 #include "vectorclass.h"
 #include "vector3d.h"
 #include "boundaries.h"
 #include "particleparameters.h"
+#include "../memoryallocation.h"
 
 // A 3D cartesian vector field with suitable interpolation properties for
 // particle pushing
@@ -42,21 +45,70 @@ struct Field
    // The actual field data
    std::vector<double> data;
 
+   // When the pusher runs on several MPI ranks, the box is split into slabs along x
+   // and each rank only stores the x-cells slabStart ... slabStart+slabCells-1 (which
+   // include one ghost cell to the right, wrapped around in a periodic box). Cell
+   // coordinates are still global everywhere, getCellRef() maps them.
+   int slabStart;
+   int slabCells;
+   int slabRanks;
+
    // Constructor (primarily here to make sure boundaries are properly initialized as zero)
-   Field() {
+   Field() : slabStart(0), slabCells(0), slabRanks(1) {
       for(int i=0; i<3; i++) {
          dimension[i] = nullptr;
       }
    }
 
+   /* Set the slab of the given rank, out of ranks, for a box of globalCells x-cells */
+   void setSlab(int globalCells, int rank, int ranks) {
+      slabRanks = ranks;
+      slabStart = (int)((int64_t)rank*globalCells/ranks);
+      slabCells = (int)((int64_t)(rank+1)*globalCells/ranks) - slabStart;
+      if(ranks > 1) {
+         slabCells++;
+      }
+   }
+
+   // Position of global x-cell coordinate x in this rank's slab, beyond slabCells if
+   // the cell is not stored here
+   int slabCoordinate(int x) const {
+      x -= slabStart;
+      if(x < 0) {
+         x += dimension[0]->cells;
+      }
+      return x;
+   }
+
+   bool isLocal(int x) const {
+      return slabCoordinate(x) < slabCells;
+   }
+
+   // Rank whose slab the (boundary mapped) x-cell coordinate belongs to
+   int slabOwner(int x) const {
+      const int cells = dimension[0]->cells;
+      x = std::min(std::max(x, 0), cells-1);
+      return (int)(((int64_t)(x+1)*slabRanks - 1)/cells);
+   }
+
+   // Rank responsible for pushing a particle at this position
+   int owner(const Vec3d& v) const {
+      int x = dimension[0]->cellCoordinate((int)((v[0] - dimension[0]->min)/dx[0]));
+      if(x < 0) {
+         x += dimension[0]->cells;
+      }
+      return slabOwner(x);
+   }
+
    double* getCellRef(int x, int y, int z) {
 
+      x = slabCoordinate(x);
       if(dimension[2]->cells == 1) {
          // Equatorial plane
-         return &(data[4*(y*dimension[0]->cells+x)]);
+         return &(data[4*(y*slabCells+x)]);
       } else {
          // General 3d case
-         return &(data[4*(z*dimension[0]->cells*dimension[1]->cells + y*dimension[0]->cells + x)]);
+         return &(data[4*(z*slabCells*dimension[1]->cells + y*slabCells + x)]);
       }
    }
 
@@ -122,10 +174,10 @@ struct Field
          interp[6] = getCell(index[0],index[1]+1,index[2]+1);
          interp[7] = getCell(index[0]+1,index[1]+1,index[2]+1);
 
-         return fract[2] * (
+         return (1.-fract[2]) * (
                fract[0]*(fract[1]*interp[3]+(1.-fract[1])*interp[1])
                + (1.-fract[0])*(fract[1]*interp[2]+(1.-fract[1])*interp[0]))
-            + (1.-fract[2]) * (
+            + fract[2] * (
                   fract[0]*(fract[1]*interp[7]+(1.-fract[1])*interp[5])
                   + (1.-fract[0])*(fract[1]*interp[6]+(1.-fract[1])*interp[4]));
       }
@@ -158,3 +210,121 @@ struct Interpolated_Field : Field{
       return fract*bval + (1.-fract)*aval;
    }
 };
+
+/* E- and B-Field of the two input files bracketing the current time, interleaved per
+ * cell, for interpolating both fields at many particle positions in one go.
+ *
+ * Each cell holds one record of E and B of the earlier file followed by E and B of the
+ * later file, so the eight corners of a trilinear interpolation are eight contiguous
+ * loads that serve both fields and both times. The records are rebuilt with set()
+ * whenever a new input file has been read. Cell coordinates outside the domain are
+ * mapped without branching: periodic dimensions are wrapped first, then all
+ * coordinates are clamped (which is what open, reflecting and compact dimensions do),
+ * and finally shifted into the slab of this rank.
+ * The result is the same as that of Interpolated_Field on E and B. */
+struct ElectromagneticField
+{
+   // Values per cell: E0, B0, E1, B1
+   static const int RECORD = 12;
+
+   std::vector<double, aligned_allocator<double, 32>> data;
+
+   double time[2];
+   double min[3];
+   double dx[3];
+
+   // Stored cells, first stored cell and number of cells of the whole box
+   // (only x is split into slabs, see Field)
+   int cells[3];
+   int offset[3];
+   int globalCells[3];
+
+   // Number of cells in periodic dimensions, 0 in the others
+   int wrap[3];
+
+   ElectromagneticField() {
+      for(int i=0; i<3; i++) {
+         cells[i] = 0;
+      }
+   }
+
+   /* Interleave the fields of the earlier (E0, B0) and later (E1, B1) input file */
+   void set(Field& E0, Field& E1, Field& B0, Field& B1) {
+      time[0] = E0.time;
+      time[1] = E1.time;
+      for(int i=0; i<3; i++) {
+         min[i] = E0.dimension[i]->min;
+         dx[i] = E0.dx[i];
+         cells[i] = globalCells[i] = E0.dimension[i]->cells;
+         offset[i] = 0;
+         wrap[i] = E0.dimension[i]->periodicCells();
+      }
+      cells[0] = E0.slabCells;
+      offset[0] = E0.slabStart;
+
+      const size_t numCells = (size_t)cells[0]*cells[1]*cells[2];
+      data.resize(RECORD*numCells);
+      const double* src[4] = {E0.data.data(), B0.data.data(), E1.data.data(), B1.data.data()};
+#pragma omp parallel for
+      for(size_t c=0; c<numCells; c++) {
+         for(int f=0; f<4; f++) {
+            for(int i=0; i<3; i++) {
+               data[RECORD*c + 3*f + i] = src[f][4*c + i];
+            }
+         }
+      }
+   }
+
+   int cellCoordinate(int c, int dim) const {
+      c += wrap[dim] * ((c < 0) - (c >= globalCells[dim]));
+      c = std::min(std::max(c, 0), globalCells[dim]-1) - offset[dim];
+      c += globalCells[dim] * (c < 0);
+      return std::min(c, cells[dim]-1);
+   }
+
+   /* Interpolate E and B at time t to n positions given as separate coordinate arrays.
+    * E[i] and B[i] receive the i-component for each position. */
+   void interpolate(double t, size_t n, const double* const x[3], double* const E[3], double* const B[3]) const {
+
+      // Weights of the two input times, in the lanes of the three Vec4d of a record
+      const double ft = (t - time[0])/(time[1] - time[0]);
+      const Vec4d timeWeight[3] = {Vec4d(1.-ft), Vec4d(1.-ft, 1.-ft, ft, ft), Vec4d(ft)};
+
+      for(size_t p=0; p<n; p++) {
+         int index[3][2];
+         double weight[3][2];
+         for(int i=0; i<3; i++) {
+            const double v = (x[i][p] - min[i]) / dx[i];
+            const int lower = (int)v;
+            const double fract = v - lower;
+            index[i][0] = cellCoordinate(lower, i);
+            index[i][1] = cellCoordinate(lower+1, i);
+            weight[i][0] = 1.-fract;
+            weight[i][1] = fract;
+         }
+
+         Vec4d sum[3] = {Vec4d(0.), Vec4d(0.), Vec4d(0.)};
+         for(int k=0; k<2; k++) {
+            for(int j=0; j<2; j++) {
+               const size_t row = ((size_t)index[2][k]*cells[1] + index[1][j])*cells[0];
+               for(int i=0; i<2; i++) {
+                  const double* record = &(data[RECORD*(row + index[0][i])]);
+                  const double w = weight[0][i]*weight[1][j]*weight[2][k];
+                  for(int l=0; l<3; l++) {
+                     sum[l] += (w * timeWeight[l]) * Vec4d().load(record + 4*l);
+                  }
+               }
+            }
+         }
+
+         double result[RECORD];
+         for(int l=0; l<3; l++) {
+            sum[l].store(result + 4*l);
+         }
+         for(int i=0; i<3; i++) {
+            E[i][p] = result[i] + result[6+i];
+            B[i][p] = result[3+i] + result[9+i];
+         }
+      }
+   }
+};
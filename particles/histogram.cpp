@@ -34,6 +34,14 @@ void Histogram1D::save(const char* filename) const {
    // MPI Reduce the histograms
    MPI_Allreduce(bins, tempbuf, num_bins, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
 
+   // Only rank 0 writes the summed histogram
+   int rank;
+   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+   if(rank != 0) {
+      delete[] tempbuf;
+      return;
+   }
+
    int fd = open(filename, O_CREAT|O_TRUNC|O_WRONLY,0644);
    if(!fd || fd == -1) {
       ERROR("unable to write histogram file %s: %s\n", filename, strerror(errno));
@@ -111,6 +119,14 @@ void Histogram2D::save(const char* filename) const {
    // MPI Reduce the histograms
    MPI_Allreduce(bins, tempbuf, num_bins_tot, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
 
+   // Only rank 0 writes the summed histogram
+   int rank;
+   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+   if(rank != 0) {
+      delete[] tempbuf;
+      return;
+   }
+
    int fd = open(filename, O_CREAT|O_TRUNC|O_WRONLY,0644);
    if(!fd || fd == -1) {
       ERROR("unable to write histogram file %s: %s\n", filename, strerror(errno));
@@ -158,6 +174,14 @@ void Histogram3D::save(const char* filename) const {
    // MPI Reduce the histograms
    MPI_Allreduce(bins, tempbuf, num_bins_tot, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
 
+   // Only rank 0 writes the summed histogram
+   int rank;
+   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+   if(rank != 0) {
+      delete[] tempbuf;
+      return;
+   }
+
    int fd = open(filename, O_CREAT|O_TRUNC|O_WRONLY, 0644);
    if(!fd || fd == -1) {
       ERROR("unable to write histogram file %s: %s\n", filename, strerror(errno));
@@ -24,11 +24,84 @@
 #include <string.h>
 #include <stdio.h>
 #include <math.h>
+#include <vector>
+#ifdef _OPENMP
+   #include <omp.h>
+#endif
 #include "vectorclass.h"
 #include "vector3d.h"
 
 #define ERROR(format, ...) fprintf (stderr, "E: " format, ##__VA_ARGS__)
 
+/* Per-thread shadow copies of histogram bins.
+ * While active, values added by an OpenMP thread go into that thread's own copy, so
+ * a histogram can be filled from inside a parallel loop without atomics or critical
+ * sections. merge() adds the copies into the shared bins (in parallel over the bins)
+ * and deactivates them; the copies are kept for the next round. */
+template<typename T> class ThreadBins
+{
+   public:
+      ThreadBins() : size(0), active(false) {}
+      ~ThreadBins() {
+         for(size_t t = 0; t < copies.size(); t++) {
+            delete[] copies[t];
+         }
+      }
+
+      void activate(size_t n) {
+         if(copies.empty()) {
+            size = n;
+            #ifdef _OPENMP
+               copies.resize(omp_get_max_threads());
+            #else
+               copies.resize(1);
+            #endif
+            for(size_t t = 0; t < copies.size(); t++) {
+               copies[t] = new T[size];
+               memset(copies[t], 0, sizeof(T) * size);
+            }
+         }
+         active = true;
+      }
+
+      // Bins to add to from the calling thread
+      T* get(T* shared) {
+         if(!active) {
+            return shared;
+         }
+         #ifdef _OPENMP
+            return copies[omp_get_thread_num()];
+         #else
+            return copies[0];
+         #endif
+      }
+
+      void merge(T* shared) {
+         if(!active) {
+            return;
+         }
+         const int num_copies = copies.size();
+         #pragma omp parallel for
+         for(size_t i = 0; i < size; i++) {
+            T sum = 0;
+            for(int t = 0; t < num_copies; t++) {
+               sum += copies[t][i];
+               copies[t][i] = 0;
+            }
+            shared[i] += sum;
+         }
+         active = false;
+      }
+
+   private:
+      ThreadBins(const ThreadBins&);
+      ThreadBins& operator=(const ThreadBins&);
+
+      size_t size;
+      bool active;
+      std::vector<T*> copies;
+};
+
 // Histograms of 1D data
 class Histogram1D
 {
@@ -66,9 +139,19 @@ class Histogram1D
          return bins[x];
       }
 
+      // Fill the histogram from OpenMP threads: addValue() calls between these two go
+      // into per-thread bins, which are summed into the histogram at the end.
+      void privatizeBins() {
+         thread_bins.activate(num_bins);
+      }
+      void mergeBins() {
+         thread_bins.merge(bins);
+      }
+
    protected:
       size_t num_bins;
       double* bins;
+      ThreadBins<double> thread_bins;
 
 };
 
@@ -79,6 +162,7 @@ class LinearHistogram1D : public Histogram1D
          Histogram1D(n), low(_low), high(_high) {};
 
       virtual void addValue(double value) {
+         double* target = thread_bins.get(bins);
          value -= low;
          value /= high - low;
 
@@ -89,7 +173,7 @@ class LinearHistogram1D : public Histogram1D
          } else if (histogram_bin + 1 >= (ssize_t)num_bins) {
             histogram_bin = num_bins - 1;
          }
-         bins[histogram_bin]++;
+         target[histogram_bin]++;
       }
 
       virtual void saveAscii(const char* filename) const;
@@ -107,6 +191,7 @@ class LogHistogram1D : public Histogram1D
          Histogram1D(n), low(_low), high(_high) {};
 
       virtual void addValue(double value) {
+         double* target = thread_bins.get(bins);
          value /= low;
          value = log(value);
          value /= log(high / low);
@@ -118,7 +203,7 @@ class LogHistogram1D : public Histogram1D
          } else if (histogram_bin + 1 >= (ssize_t)num_bins) {
             histogram_bin = num_bins - 1;
          }
-         bins[histogram_bin]++;
+         target[histogram_bin]++;
       }
 
    private:
@@ -166,9 +251,19 @@ class Histogram2D
          return bins[x + num_bins[0] * y];
       }
 
+      // Fill the histogram from OpenMP threads: addValue() calls between these two go
+      // into per-thread bins, which are summed into the histogram at the end.
+      void privatizeBins() {
+         thread_bins.activate(num_bins[0] * num_bins[1]);
+      }
+      void mergeBins() {
+         thread_bins.merge(bins);
+      }
+
    protected:
       size_t num_bins[2];
       double* bins;
+      ThreadBins<double> thread_bins;
 };
 
 class LinearHistogram2D : public Histogram2D
@@ -183,6 +278,7 @@ class LinearHistogram2D : public Histogram2D
          low(_low), high(_high) {};
 
       virtual void addValue(Vec2d value, double weight=1.) {
+         double* target = thread_bins.get(bins);
          value -= low;
          value /= high - low;
 
@@ -197,10 +293,11 @@ class LinearHistogram2D : public Histogram2D
                histogram_bin[i] = num_bins[i] - 1;
             }
          }
-         bins[histogram_bin[0] + num_bins[0] * histogram_bin[1]] += weight;
+         target[histogram_bin[0] + num_bins[0] * histogram_bin[1]] += weight;
       }
 
       void addValueLinearInterpolate(Vec2d value, double weight=1.) {
+         double* target = thread_bins.get(bins);
 
          value -= low;
          value /= high - low;
@@ -238,10 +335,10 @@ class LinearHistogram2D : public Histogram2D
          histogram_bin[0] = floor(v[0]);
          histogram_bin[1] = floor(v[1]);
 
-         bins[histogram_bin[0] + num_bins[0] * histogram_bin[1]] += weight * (1. - a[0]) * (1. - a[1]);
-         bins[histogram_bin[0] + num_bins[0] * (histogram_bin[1] + 1)] += weight * (1. - a[0]) * a[1];
-         bins[histogram_bin[0] + 1 + num_bins[0] * histogram_bin[1]] += weight * a[0] * (1. - a[1]);
-         bins[histogram_bin[0] + 1 + num_bins[0] * (histogram_bin[1] + 1)] += weight * a[0] * a[1];
+         target[histogram_bin[0] + num_bins[0] * histogram_bin[1]] += weight * (1. - a[0]) * (1. - a[1]);
+         target[histogram_bin[0] + num_bins[0] * (histogram_bin[1] + 1)] += weight * (1. - a[0]) * a[1];
+         target[histogram_bin[0] + 1 + num_bins[0] * histogram_bin[1]] += weight * a[0] * (1. - a[1]);
+         target[histogram_bin[0] + 1 + num_bins[0] * (histogram_bin[1] + 1)] += weight * a[0] * a[1];
       }
 
       // Bin-wise arithmetic on histograms
@@ -266,6 +363,7 @@ class LinLogHistogram2D : public Histogram2D
          low(_low), high(_high) {};
 
       virtual void addValue(Vec2d value, double weight=1.) {
+         double* target = thread_bins.get(bins);
          double v[2];
          v[0] -= low[0];
          v[0] /= high[0] - low[0];
@@ -284,10 +382,11 @@ class LinLogHistogram2D : public Histogram2D
                histogram_bin[i] = num_bins[i] - 1;
             }
          }
-         bins[histogram_bin[0] + num_bins[0] * histogram_bin[1]] += weight;
+         target[histogram_bin[0] + num_bins[0] * histogram_bin[1]] += weight;
       }
 
       void addValueLinearInterpolate(Vec2d value, double weight=1.) {
+         double* target = thread_bins.get(bins);
 
          double v[2];
          v[0] = value[0] - low[0];
@@ -327,10 +426,10 @@ class LinLogHistogram2D : public Histogram2D
          histogram_bin[0] = floor(v[0]);
          histogram_bin[1] = floor(v[1]);
 
-         bins[histogram_bin[0] + num_bins[0] * histogram_bin[1]] += weight * (1. - a[0]) * (1. - a[1]);
-         bins[histogram_bin[0] + num_bins[0] * (histogram_bin[1] + 1)] += weight * (1. - a[0]) * a[1];
-         bins[histogram_bin[0] + 1 + num_bins[0] * histogram_bin[1]] += weight * a[0] * (1. - a[1]);
-         bins[histogram_bin[0] + 1 + num_bins[0] * (histogram_bin[1] + 1)] += weight * a[0] * a[1];
+         target[histogram_bin[0] + num_bins[0] * histogram_bin[1]] += weight * (1. - a[0]) * (1. - a[1]);
+         target[histogram_bin[0] + num_bins[0] * (histogram_bin[1] + 1)] += weight * (1. - a[0]) * a[1];
+         target[histogram_bin[0] + 1 + num_bins[0] * histogram_bin[1]] += weight * a[0] * (1. - a[1]);
+         target[histogram_bin[0] + 1 + num_bins[0] * (histogram_bin[1] + 1)] += weight * a[0] * a[1];
       }
 
    private:
@@ -349,6 +448,7 @@ class LogHistogram2D : public Histogram2D
          low(_low), high(_high) {};
 
       virtual void addValue(Vec2d value, double weight=1.) {
+         double* target = thread_bins.get(bins);
          value /= low;
 
          double v[2];
@@ -366,7 +466,7 @@ class LogHistogram2D : public Histogram2D
                histogram_bin[i] = num_bins[i] - 1;
             }
          }
-         bins[histogram_bin[0] + num_bins[0] * histogram_bin[1]] += weight;
+         target[histogram_bin[0] + num_bins[0] * histogram_bin[1]] += weight;
       }
 
       /* Bin-wise arithmetic on histograms */
@@ -414,9 +514,19 @@ class Histogram3D
          return bins[x + num_bins[0] * y + num_bins[0] * num_bins[1] * z];
       }
 
+      // Fill the histogram from OpenMP threads: addValue() calls between these two go
+      // into per-thread bins, which are summed into the histogram at the end.
+      void privatizeBins() {
+         thread_bins.activate(num_bins[0] * num_bins[1] * num_bins[2]);
+      }
+      void mergeBins() {
+         thread_bins.merge(bins);
+      }
+
    protected:
       size_t num_bins[3];
       float* bins;
+      ThreadBins<float> thread_bins;
 };
 
 class LinearHistogram3D : public Histogram3D
@@ -427,6 +537,7 @@ class LinearHistogram3D : public Histogram3D
          low(_low), high(_high) {};
 
       virtual void addValue(Vec3d value) {
+         float* target = thread_bins.get(bins);
          value -= low;
          value /= high - low;
 
@@ -442,7 +553,7 @@ class LinearHistogram3D : public Histogram3D
                histogram_bin[i] = num_bins[i] - 1;
             }
          }
-         bins[histogram_bin[0] + num_bins[0] * histogram_bin[1] + num_bins[0] * num_bins[1] * histogram_bin[2]]++;
+         target[histogram_bin[0] + num_bins[0] * histogram_bin[1] + num_bins[0] * num_bins[1] * histogram_bin[2]]++;
       }
 
       Vec3d coords_for_cell(Vec3d cell) {
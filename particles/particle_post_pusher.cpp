@@ -27,6 +27,7 @@
 #include <iostream>
 #include <random>
 #include <string.h>
+#include <algorithm>
 #include "particles.h"
 #include "field.h"
 #include "physconst.h"
@@ -41,6 +42,12 @@ int main(int argc, char** argv) {
 
    MPI::Init(argc, argv);
 
+   /* With several ranks, the box is split into slabs along x (see Field), each
+    * rank stores the fields of its own slab and pushes the particles in it. */
+   int rank,ranks;
+   MPI_Comm_rank(MPI_COMM_WORLD,&rank);
+   MPI_Comm_size(MPI_COMM_WORLD,&ranks);
+
    /* Parse commandline and config*/
    Readparameters parameters(argc, argv, MPI_COMM_WORLD);
    ParticleParameters::addParameters();
@@ -62,8 +69,13 @@ int main(int argc, char** argv) {
    E[0].dimension[0] = E[1].dimension[0] = B[0].dimension[0] = B[1].dimension[0] = V.dimension[0] = ParticleParameters::boundary_behaviour_x;
    E[0].dimension[1] = E[1].dimension[1] = B[0].dimension[1] = B[1].dimension[1] = V.dimension[1] = ParticleParameters::boundary_behaviour_y;
    E[0].dimension[2] = E[1].dimension[2] = B[0].dimension[2] = B[1].dimension[2] = V.dimension[2] = ParticleParameters::boundary_behaviour_z;
-   readfields(filename_buffer,E[1],B[1],V);
+   readfields(filename_buffer,E[1],B[1],V,true,rank,ranks);
    E[0]=E[1]; B[0]=B[1];
+   if(ranks > E[1].dimension[0]->cells) {
+      std::cerr << "Cannot split " << E[1].dimension[0]->cells << " cells in x between " << ranks
+         << " ranks, aborting." << std::endl;
+      MPI_Abort(MPI_COMM_WORLD,1);
+   }
 
    // Set boundary conditions based on sizes
    if(B[0].dimension[0]->cells <= 1) {
@@ -94,10 +106,27 @@ int main(int argc, char** argv) {
    int maxsteps = maxtime/dt;
 
    Scenario* scenario = createScenario(ParticleParameters::mode);
+
+   /* Every rank runs the scenario's particle creation and keeps the particles in its slab */
+   if(ranks > 1) {
+      ParticleContainer::owned = [&E,rank](const Vec3d& x) { return E[1].owner(x) == rank; };
+   }
+
+   /* Start reading the next input file while the particles are set up and pushed */
+   FieldPrefetcher<vlsvinterface::Reader> prefetcher(filename_pattern, scenario->needV);
+   prefetcher.prefetch(input_file_counter+1, E[1], B[1], V);
+
    ParticleContainer particles = scenario->initialParticles(E[0],B[0],V);
 
-   std::cerr << "Pushing " << particles.size() << " particles for " << maxsteps << " steps..." << std::endl;
-   std::cerr << "[                                                                        ]\x0d[";
+   uint64_t localParticles = particles.size(), totalParticles;
+   MPI_Allreduce(&localParticles,&totalParticles,1,MPI_UINT64_T,MPI_SUM,MPI_COMM_WORLD);
+   if(rank == 0) {
+      std::cerr << "Pushing " << totalParticles << " particles for " << maxsteps << " steps on " << ranks
+         << " ranks..." << std::endl;
+      std::cerr << "[                                                                        ]\x0d[";
+   }
+
+   ElectromagneticField fields;
 
    /* Push them around */
    for(int step=0; step<maxsteps; step++) {
@@ -105,15 +134,21 @@ int main(int argc, char** argv) {
       bool newfile;
       /* Load newer fields, if neccessary */
       if(step >= 0) {
-         newfile = readNextTimestep(filename_pattern, ParticleParameters::start_time + step*dt, 1,E[0], E[1],
-               B[0], B[1], V, scenario->needV, input_file_counter);
+         newfile = prefetcher.readNextTimestep(ParticleParameters::start_time + step*dt, 1,E[0], E[1],
+               B[0], B[1], V, input_file_counter);
       } else {
-         newfile = readNextTimestep(filename_pattern, ParticleParameters::start_time + step*dt, -1,E[1], E[0],
-               B[1], B[0], V, scenario->needV, input_file_counter);
+         newfile = prefetcher.readNextTimestep(ParticleParameters::start_time + step*dt, -1,E[1], E[0],
+               B[1], B[0], V, input_file_counter);
+      }
+
+      // Interleave E and B for the pusher whenever the input fields change
+      if(newfile || step == 0) {
+         fields.set(E[0],E[1],B[0],B[1]);
       }
+      double time = ParticleParameters::start_time + step*dt;
 
-      Interpolated_Field cur_E(E[0],E[1],ParticleParameters::start_time + step*dt);
-      Interpolated_Field cur_B(B[0],B[1],ParticleParameters::start_time + step*dt);
+      Interpolated_Field cur_E(E[0],E[1],time);
+      Interpolated_Field cur_B(B[0],B[1],time);
 
       // If a new timestep has been opened, add a new bunch of particles
       if(newfile) {
@@ -122,59 +157,70 @@ int main(int argc, char** argv) {
 
       scenario->beforePush(particles,cur_E,cur_B,V);
 
+      /* Push them around, four particles at a time */
 #pragma omp parallel for
-      for(unsigned int i=0; i< particles.size(); i++) {
-
-         if(isnan(vector_length(particles[i].x))) {
-            // Skip disabled particles.
-            continue;
+      for(unsigned int i=0; i< particles.size(); i+=4) {
+
+         /* Get E- and B-Field at their position, one particle per lane */
+         double Eval[3][4] = {{0.}}, Bval[3][4] = {{0.}};
+         const double* pos[3] = {&(particles.x[0][i]), &(particles.x[1][i]), &(particles.x[2][i])};
+         double* Eptr[3] = {Eval[0], Eval[1], Eval[2]};
+         double* Bptr[3] = {Bval[0], Bval[1], Bval[2]};
+         fields.interpolate(time, std::min<size_t>(4, particles.size()-i), pos, Eptr, Bptr);
+         Vec4d Elanes[3],Blanes[3];
+         for(int c=0; c<3; c++) {
+            Elanes[c].load(Eval[c]);
+            Blanes[c].load(Bval[c]);
          }
 
-         /* Get E- and B-Field at their position */
-         Vec3d Eval,Bval;
-
-         Eval = cur_E(particles[i].x);
-         Bval = cur_B(particles[i].x);
-
-         /* Push them around */
-         particles[i].push(Bval,Eval,dt);
-
+         particles.push(i,Elanes,Blanes,dt);
       }
 
-      // Remove all particles that have left the simulation box after this step
-      // (unfortunately, this can not be done in parallel, so it better be fast!)
-      for(auto i = particles.begin(); i != particles.end(); ) {
-
-         // Boundaries are allowed to mangle the particles here.
-         // If they return false, particles are deleted.
-         bool do_erase = false;
-         if(!ParticleParameters::boundary_behaviour_x->handleParticle(*i)) {
-            do_erase = true;
-         }
-         if(!ParticleParameters::boundary_behaviour_y->handleParticle(*i)) {
-            do_erase = true;
-         }
-         if(!ParticleParameters::boundary_behaviour_z->handleParticle(*i)) {
-            do_erase = true;
+      // Boundaries are allowed to mangle the particles here.
+      // If they return false, particles are disabled, and all disabled particles
+      // are removed from the container afterwards.
+#pragma omp parallel for
+      for(unsigned int i=0; i< particles.size(); i++) {
+         if(!particles.alive[i]) {
+            continue;
          }
-         if(do_erase) {
-            particles.erase(i);
+
+         Particle p = particles[i];
+         bool keep = ParticleParameters::boundary_behaviour_x->handleParticle(p);
+         keep = ParticleParameters::boundary_behaviour_y->handleParticle(p) && keep;
+         keep = ParticleParameters::boundary_behaviour_z->handleParticle(p) && keep;
+         if(keep) {
+            particles.setPosition(i,p.x);
+            particles.setVelocity(i,p.v);
          } else {
-            i++;
+            particles.disable(i);
          }
       }
+      if(ranks > 1) {
+         // Hand particles that have crossed a slab boundary to their new rank
+         std::vector<int> destination(particles.size());
+#pragma omp parallel for
+         for(unsigned int i=0; i< particles.size(); i++) {
+            destination[i] = E[0].owner(particles.position(i));
+         }
+         particles.migrate(destination);
+      } else {
+         particles.compact();
+      }
 
       scenario->afterPush(step, step*dt, particles, cur_E, cur_B, V);
 
       /* Draw progress bar */
-      if((step % (maxsteps/71))==0) {
+      if(rank == 0 && (step % (maxsteps/71))==0) {
          std::cerr << "=";
       }
    }
 
    scenario->finalize(particles,E[1],B[1],V);
 
-   std::cerr << std::endl;
+   if(rank == 0) {
+      std::cerr << std::endl;
+   }
 
    MPI::Finalize();
    return 0;
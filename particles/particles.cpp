@@ -19,7 +19,11 @@
  * with this program; if not, write to the Free Software Foundation, Inc.,
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
+#include <algorithm>
 #include <vector>
+#ifdef _OPENMP
+   #include <omp.h>
+#endif
 #include "particles.h"
 #include "physconst.h"
 #include "relativistic_math.h"
@@ -42,6 +46,238 @@ void Particle::push(Vec3d& B, Vec3d& E, double dt) {
    x += dt * v;
 }
 
+std::function<bool(const Vec3d&)> ParticleContainer::owned;
+
+void ParticleContainer::push_back(const Particle& p) {
+   const uint64_t particleId = nextId++;
+   if(!isOwned(p.x)) {
+      return;
+   }
+   append(p, particleId);
+}
+
+void ParticleContainer::append(const Particle& p, uint64_t particleId) {
+   for(int c=0; c<3; c++) {
+      x[c].push_back(p.x[c]);
+      v[c].push_back(p.v[c]);
+   }
+   m.push_back(p.m);
+   q.push_back(p.q);
+   id.push_back(particleId);
+   alive.push_back(1);
+}
+
+/* The same Boris step as Particle::push, for four particles at a time */
+void ParticleContainer::push(size_t first, const Vec4d E[3], const Vec4d B[3], double dt) {
+
+   const int n = std::min<size_t>(4, size()-first);
+   Vec4d px[3],pv[3],pm,pq;
+   for(int c=0; c<3; c++) {
+      px[c].load_partial(n, &(x[c][first]));
+      pv[c].load_partial(n, &(v[c][first]));
+   }
+   // Unused lanes get unit mass, so that they stay finite
+   pm.load_partial(n, &(m[first]));
+   pm = select(Vec4d(0.) == pm, Vec4d(1.), pm);
+   pq.load_partial(n, &(q[first]));
+
+   const Vec4d qdt2m = pq * dt / (2. * pm);
+   Vec4d uminus[3];
+   for(int c=0; c<3; c++) {
+      uminus[c] = pv[c] + qdt2m * E[c];
+   }
+   const Vec4d uq = uminus[0]*uminus[0] + uminus[1]*uminus[1] + uminus[2]*uminus[2];
+   const Vec4d g = sqrt(1. + uq / (PhysicalConstantsSI::c * PhysicalConstantsSI::c));
+
+   Vec4d h[3];
+   for(int c=0; c<3; c++) {
+      h[c] = qdt2m * B[c] / g;
+   }
+   Vec4d uprime[3];
+   uprime[0] = uminus[0] + uminus[1]*h[2] - uminus[2]*h[1];
+   uprime[1] = uminus[1] + uminus[2]*h[0] - uminus[0]*h[2];
+   uprime[2] = uminus[2] + uminus[0]*h[1] - uminus[1]*h[0];
+   const Vec4d s = 2. / (1. + h[0]*h[0] + h[1]*h[1] + h[2]*h[2]);
+   for(int c=0; c<3; c++) {
+      h[c] *= s;
+   }
+   Vec4d uplus[3];
+   uplus[0] = uminus[0] + uprime[1]*h[2] - uprime[2]*h[1];
+   uplus[1] = uminus[1] + uprime[2]*h[0] - uprime[0]*h[2];
+   uplus[2] = uminus[2] + uprime[0]*h[1] - uprime[1]*h[0];
+
+   // Disabled particles keep their state
+   double laneAlive[4] = {0.,0.,0.,0.};
+   for(int i=0; i<n; i++) {
+      laneAlive[i] = alive[first+i];
+   }
+   Vec4d aliveMask;
+   aliveMask.load(laneAlive);
+   const Vec4db doPush = aliveMask != 0.;
+
+   for(int c=0; c<3; c++) {
+      const Vec4d newv = uplus[c] + qdt2m * E[c];
+      select(doPush, newv, pv[c]).store_partial(n, &(v[c][first]));
+      select(doPush, px[c] + dt * newv, px[c]).store_partial(n, &(x[c][first]));
+   }
+}
+
+/* Parallel stream compaction: every thread counts the surviving particles of its
+ * contiguous chunk, a prefix sum over the counts gives each thread the place its
+ * survivors are copied to. */
+size_t ParticleContainer::compact() {
+
+   const size_t n = size();
+   #ifdef _OPENMP
+      const int maxThreads = omp_get_max_threads();
+   #else
+      const int maxThreads = 1;
+   #endif
+   std::vector<size_t> offset(maxThreads+1, 0);
+   size_t survivors = n;
+
+   Array newx[3],newv[3],newm,newq;
+   std::vector<uint64_t> newid;
+   std::vector<char> newalive;
+
+   #pragma omp parallel
+   {
+      #ifdef _OPENMP
+         const int thread = omp_get_thread_num();
+         const int numThreads = omp_get_num_threads();
+      #else
+         const int thread = 0;
+         const int numThreads = 1;
+      #endif
+      const size_t begin = n*thread/numThreads;
+      const size_t end = n*(thread+1)/numThreads;
+
+      size_t count = 0;
+      for(size_t i=begin; i<end; i++) {
+         count += (alive[i] != 0);
+      }
+      offset[thread+1] = count;
+
+      #pragma omp barrier
+      #pragma omp single
+      {
+         for(int t=0; t<numThreads; t++) {
+            offset[t+1] += offset[t];
+         }
+         survivors = offset[numThreads];
+         if(survivors < n) {
+            for(int c=0; c<3; c++) {
+               newx[c].resize(survivors);
+               newv[c].resize(survivors);
+            }
+            newm.resize(survivors);
+            newq.resize(survivors);
+            newid.resize(survivors);
+            newalive.assign(survivors, 1);
+         }
+      }
+
+      if(survivors < n) {
+         size_t j = offset[thread];
+         for(size_t i=begin; i<end; i++) {
+            if(alive[i] == 0) {
+               continue;
+            }
+            for(int c=0; c<3; c++) {
+               newx[c][j] = x[c][i];
+               newv[c][j] = v[c][i];
+            }
+            newm[j] = m[i];
+            newq[j] = q[i];
+            newid[j] = id[i];
+            j++;
+         }
+      }
+   }
+
+   if(survivors == n) {
+      return 0;
+   }
+
+   for(int c=0; c<3; c++) {
+      x[c].swap(newx[c]);
+      v[c].swap(newv[c]);
+   }
+   m.swap(newm);
+   q.swap(newq);
+   id.swap(newid);
+   alive.swap(newalive);
+   return n - alive.size();
+}
+
+size_t ParticleContainer::migrate(const std::vector<int>& destination) {
+
+   int rank,ranks;
+   MPI_Comm_rank(MPI_COMM_WORLD,&rank);
+   MPI_Comm_size(MPI_COMM_WORLD,&ranks);
+
+   // Values per particle: position, velocity, mass and charge
+   const int VALUES = 8;
+
+   std::vector<int> sendCounts(ranks,0);
+   for(size_t i=0; i<size(); i++) {
+      if(alive[i] && destination[i] != rank) {
+         sendCounts[destination[i]]++;
+      }
+   }
+   std::vector<int> recvCounts(ranks);
+   MPI_Alltoall(sendCounts.data(),1,MPI_INT,recvCounts.data(),1,MPI_INT,MPI_COMM_WORLD);
+
+   std::vector<int> sendOffsets(ranks+1,0), recvOffsets(ranks+1,0);
+   for(int r=0; r<ranks; r++) {
+      sendOffsets[r+1] = sendOffsets[r] + sendCounts[r];
+      recvOffsets[r+1] = recvOffsets[r] + recvCounts[r];
+   }
+   const size_t numSend = sendOffsets[ranks];
+   const size_t numRecv = recvOffsets[ranks];
+
+   /* Pack the leaving particles by destination and take them out */
+   std::vector<double> sendValues(VALUES*numSend), recvValues(VALUES*numRecv);
+   std::vector<uint64_t> sendIds(numSend), recvIds(numRecv);
+   std::vector<int> fill(sendOffsets.begin(), sendOffsets.end()-1);
+   for(size_t i=0; i<size(); i++) {
+      if(!alive[i] || destination[i] == rank) {
+         continue;
+      }
+      const int j = fill[destination[i]]++;
+      double* values = &(sendValues[VALUES*j]);
+      for(int c=0; c<3; c++) {
+         values[c] = x[c][i];
+         values[3+c] = v[c][i];
+      }
+      values[6] = m[i];
+      values[7] = q[i];
+      sendIds[j] = id[i];
+      disable(i);
+   }
+
+   MPI_Alltoallv(sendIds.data(),sendCounts.data(),sendOffsets.data(),MPI_UINT64_T,
+         recvIds.data(),recvCounts.data(),recvOffsets.data(),MPI_UINT64_T,MPI_COMM_WORLD);
+   for(int r=0; r<=ranks; r++) {
+      if(r < ranks) {
+         sendCounts[r] *= VALUES;
+         recvCounts[r] *= VALUES;
+      }
+      sendOffsets[r] *= VALUES;
+      recvOffsets[r] *= VALUES;
+   }
+   MPI_Alltoallv(sendValues.data(),sendCounts.data(),sendOffsets.data(),MPI_DOUBLE,
+         recvValues.data(),recvCounts.data(),recvOffsets.data(),MPI_DOUBLE,MPI_COMM_WORLD);
+
+   compact();
+   for(size_t j=0; j<numRecv; j++) {
+      const double* values = &(recvValues[VALUES*j]);
+      append(Particle(values[6], values[7], Vec3d(values[0],values[1],values[2]),
+               Vec3d(values[3],values[4],values[5])), recvIds[j]);
+   }
+   return numSend;
+}
+
 void writeParticles(ParticleContainer& p,const char* filename) {
 
    vlsv::Writer vlsvWriter;
@@ -52,11 +288,11 @@ void writeParticles(ParticleContainer& p,const char* filename) {
    /* First, store particle positions */
    uint writable_particles=0;
    for(unsigned int i=0; i < p.size(); i++) {
-      if(vector_length(p[i].x) == 0) {
+      if(!p.alive[i] || vector_length(p.position(i)) == 0) {
         continue;
       }
 
-      p[i].x.store(&(writebuf[3*writable_particles]));
+      p.position(i).store(&(writebuf[3*writable_particles]));
       writable_particles++;
    }
 
@@ -70,10 +306,10 @@ void writeParticles(ParticleContainer& p,const char* filename) {
    /* Then, velocities */
    writable_particles=0;
    for(unsigned int i=0; i < p.size(); i++) {
-      if(vector_length(p[i].x) == 0) {
+      if(!p.alive[i] || vector_length(p.position(i)) == 0) {
         continue;
       }
-      p[i].v.store(&(writebuf[3*writable_particles]));
+      p.velocity(i).store(&(writebuf[3*writable_particles]));
       writable_particles++;
    }
 
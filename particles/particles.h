@@ -20,18 +20,23 @@
  * with this program; if not, write to the Free Software Foundation, Inc.,
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
+#include <cstdint>
+#include <functional>
 #include <vector>
+#include <mpi.h>
 #include "vectorclass.h"
 #include "vector3d.h"
 #include "../definitions.h"
 #include "../memoryallocation.h"
 
+/* A single particle, used to create particles and to hand them to the boundaries.
+ * Particles are stored in a ParticleContainer, which keeps their components in
+ * separate arrays. */
 struct Particle {
       Vec3d x;
       Vec3d v;
       Real m;
       Real q;
-      char padding[128-sizeof(Vec3d)*2-sizeof(Real)*2];
 
       Particle(Real mass, Real charge, const Vec3d& _x, const Vec3d& _v) :
          x(_x),v(_v),m(mass),q(charge) {}
@@ -41,7 +46,85 @@ struct Particle {
       void push(Vec3d& B, Vec3d& E, double dt);
 };
 
-typedef std::vector<Particle, aligned_allocator<Particle, 32>> ParticleContainer;
+/* Structure-of-arrays particle storage.
+ *
+ * Each component of position and velocity, mass and charge live in their own arrays,
+ * so that the pusher can load them for four particles at a time into Vec4d lanes.
+ * Particles that have left the simulation or have been taken out by a scenario are
+ * only marked as not alive, compact() then removes them all in one (parallel) pass.
+ * Every particle gets a running id when it is added, it stays the same when particles
+ * before it are removed. */
+struct ParticleContainer {
+   typedef std::vector<double, aligned_allocator<double, 32>> Array;
 
-void writeParticles(ParticleContainer& p, const char* filename);
+   Array x[3];
+   Array v[3];
+   Array m;
+   Array q;
+   std::vector<uint64_t> id;
+   std::vector<char> alive;
+
+   // Id of the next particle to be added
+   uint64_t nextId;
+
+   ParticleContainer() : nextId(0) {}
+
+   // If set, particles for which this is false are not stored by push_back() (they
+   // still get an id). With several MPI ranks, every rank creates the same particles
+   // and keeps the ones in its own part of the box.
+   static std::function<bool(const Vec3d&)> owned;
+
+   // Whether a particle created at x is kept on this rank. The fields only cover the
+   // rank's own part of the box, so look them up only for positions where this is true.
+   static bool isOwned(const Vec3d& x) {
+      return !owned || owned(x);
+   }
+
+   size_t size() const {
+      return alive.size();
+   }
+
+   void push_back(const Particle& p);
+
+   // Add a particle that already has an id (one that moved in from another rank)
+   void append(const Particle& p, uint64_t particleId);
 
+   // Copy of a single particle
+   Particle operator[](size_t i) const {
+      return Particle(m[i], q[i], position(i), velocity(i));
+   }
+
+   Vec3d position(size_t i) const {
+      return Vec3d(x[0][i], x[1][i], x[2][i]);
+   }
+   Vec3d velocity(size_t i) const {
+      return Vec3d(v[0][i], v[1][i], v[2][i]);
+   }
+   void setPosition(size_t i, const Vec3d& pos) {
+      x[0][i] = pos[0]; x[1][i] = pos[1]; x[2][i] = pos[2];
+   }
+   void setVelocity(size_t i, const Vec3d& vel) {
+      v[0][i] = vel[0]; v[1][i] = vel[1]; v[2][i] = vel[2];
+   }
+
+   // Take a particle out of the simulation, it is removed by the next compact()
+   void disable(size_t i) {
+      alive[i] = 0;
+   }
+
+   /* Boris push of the particles first ... first+3 (or up to the end of the
+    * container) given the E- and B-Field at their locations, one particle per lane.
+    * Particles that are not alive are left untouched. */
+   void push(size_t first, const Vec4d E[3], const Vec4d B[3], double dt);
+
+   /* Remove all particles that are not alive, keeping the order of the others.
+    * Returns the number of removed particles. */
+   size_t compact();
+
+   /* Send every alive particle to the rank given in destination (one entry per
+    * particle), in one batched exchange over MPI_COMM_WORLD. Particles that leave are
+    * removed, arriving ones are appended. Returns the number of particles sent. */
+   size_t migrate(const std::vector<int>& destination);
+};
+
+void writeParticles(ParticleContainer& p, const char* filename);
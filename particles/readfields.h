@@ -28,6 +28,7 @@
 #include <vector>
 #include <string>
 #include <set>
+#include <future>
 
 #define DEBUG
 
@@ -97,6 +98,85 @@ std::vector<double> readFieldData(Reader& r, std::string& name, unsigned int num
    return buffer;
 }
 
+/* Read the fields of one input file into E1, B1 and (if doV) V.
+ * Cells that are not in the file keep their previous values.
+ * Return value: false if the file could not be opened or has no time. */
+template <class Reader>
+bool readTimestepFile(const char* filename, Field& E1, Field& B1, Field& V, bool doV) {
+
+   /* Open next file */
+   Reader r;
+   if(!r.open(filename)) {
+      return false;
+   }
+   double t;
+   if(!r.readParameter("time",t)) {
+      if(!r.readParameter("t",t)) {
+         std::cerr << "Time parameter in file " << filename << " is neither 't' nor 'time'. Bad file format?"
+            << std::endl;
+         return false;
+      }
+   }
+
+   E1.time = t;
+   B1.time = t;
+
+   uint64_t cells[3];
+   r.readParameter("xcells_ini",cells[0]);
+   r.readParameter("ycells_ini",cells[1]);
+   r.readParameter("zcells_ini",cells[2]);
+
+   /* Read CellIDs and Field data */
+   std::vector<uint64_t> cellIds = readCellIds(r);
+   std::string name(B_field_name);
+   std::vector<double> Bbuffer = readFieldData(r,name,3u);
+   name = E_field_name;
+   std::vector<double> Ebuffer = readFieldData(r,name,3u);
+   std::vector<double> Vbuffer;
+   if(doV) {
+     name = "rho_v";
+     std::vector<double> rho_v_buffer = readFieldData(r,name,3u);
+     name = "rho";
+     std::vector<double> rho_buffer = readFieldData(r,name,1u);
+     for(unsigned int i=0; i<rho_buffer.size(); i++) {
+       Vbuffer.push_back(rho_v_buffer[3*i] / rho_buffer[i]);
+       Vbuffer.push_back(rho_v_buffer[3*i+1] / rho_buffer[i]);
+       Vbuffer.push_back(rho_v_buffer[3*i+2] / rho_buffer[i]);
+     }
+   }
+
+   /* Assign them, without sanity checking */
+   /* TODO: Is this actually a good idea? */
+   for(uint i=0; i< cellIds.size(); i++) {
+      uint64_t c = cellIds[i];
+      int64_t x = c % cells[0];
+      int64_t y = (c /cells[0]) % cells[1];
+      int64_t z = c /(cells[0]*cells[1]);
+      if(!E1.isLocal(x)) {
+         continue;
+      }
+
+      double* Etgt = E1.getCellRef(x,y,z);
+      double* Btgt = B1.getCellRef(x,y,z);
+      Etgt[0] = Ebuffer[3*i];
+      Etgt[1] = Ebuffer[3*i+1];
+      Etgt[2] = Ebuffer[3*i+2];
+      Btgt[0] = Bbuffer[3*i];
+      Btgt[1] = Bbuffer[3*i+1];
+      Btgt[2] = Bbuffer[3*i+2];
+
+      if(doV) {
+        double* Vtgt = V.getCellRef(x,y,z);
+        Vtgt[0] = Vbuffer[3*i];
+        Vtgt[1] = Vbuffer[3*i+1];
+        Vtgt[2] = Vbuffer[3*i+2];
+      }
+   }
+
+   r.close();
+   return true;
+}
+
 /* Read the next logical input file. Depending on sign of dt,
  * this may be a numerically larger or smaller file.
  * Return value: true if a new file was read, otherwise false.
@@ -115,76 +195,97 @@ bool readNextTimestep(const std::string& filename_pattern, double t, int step, F
       B0=B1;
       snprintf(filename_buffer,256,filename_pattern.c_str(),input_file_counter);
 
-      /* Open next file */
-      Reader r;
-      r.open(filename_buffer);
-      double t;
-      if(!r.readParameter("time",t)) {
-         if(!r.readParameter("t",t)) {
-            std::cerr << "Time parameter in file " << filename_buffer << " is neither 't' nor 'time'. Bad file format?"
-               << std::endl;
-            exit(1);
+      if(!readTimestepFile<Reader>(filename_buffer,E1,B1,V,doV)) {
+         std::cerr << "Could not read input file " << filename_buffer << std::endl;
+         exit(1);
+      }
+      retval = true;
+   }
+
+   return retval;
+}
+
+/* Reads the input file after the current one in a background thread, while the
+ * particles are pushed with the current fields. readNextTimestep() then only has to
+ * swap the prefetched fields in, and starts reading the file after that.
+ * The background thread only reads the current fields (to start the next ones from
+ * their values), so they must not be modified between readNextTimestep() calls. */
+template <class Reader>
+class FieldPrefetcher {
+   public:
+      FieldPrefetcher(const std::string& _filename_pattern, bool _doV) :
+         filename_pattern(_filename_pattern), doV(_doV), counter(0) {}
+
+      ~FieldPrefetcher() {
+         if(pending.valid()) {
+            pending.wait();
          }
       }
 
-      E1.time = t;
-      B1.time = t;
-
-      uint64_t cells[3];
-      r.readParameter("xcells_ini",cells[0]);
-      r.readParameter("ycells_ini",cells[1]);
-      r.readParameter("zcells_ini",cells[2]);
-
-      /* Read CellIDs and Field data */
-      std::vector<uint64_t> cellIds = readCellIds(r);
-      std::string name(B_field_name);
-      std::vector<double> Bbuffer = readFieldData(r,name,3u);
-      name = E_field_name;
-      std::vector<double> Ebuffer = readFieldData(r,name,3u);
-      std::vector<double> Vbuffer;
-      if(doV) {
-        name = "rho_v";
-        std::vector<double> rho_v_buffer = readFieldData(r,name,3u);
-        name = "rho";
-        std::vector<double> rho_buffer = readFieldData(r,name,1u);
-        for(unsigned int i=0; i<rho_buffer.size(); i++) {
-          Vbuffer.push_back(rho_v_buffer[3*i] / rho_buffer[i]);
-          Vbuffer.push_back(rho_v_buffer[3*i+1] / rho_buffer[i]);
-          Vbuffer.push_back(rho_v_buffer[3*i+2] / rho_buffer[i]);
-        }
+      /* Same as the free readNextTimestep(), with the file read ahead of time */
+      bool readNextTimestep(double t, int step, Field& E0, Field& E1, Field& B0, Field& B1, Field& V,
+            int& input_file_counter) {
+
+         bool retval = false;
+
+         while(t < E0.time || t>= E1.time) {
+            input_file_counter += step;
+
+            // Nothing read ahead yet, or for the other direction
+            if(!pending.valid() || counter != input_file_counter) {
+               prefetch(input_file_counter, E1, B1, V);
+            }
+            if(!pending.get()) {
+               std::cerr << "Could not read input file " << filename << std::endl;
+               exit(1);
+            }
+
+            E0 = std::move(E1);
+            B0 = std::move(B1);
+            E1 = std::move(nextE);
+            B1 = std::move(nextB);
+            if(doV) {
+               V = std::move(nextV);
+            }
+            retval = true;
+
+            prefetch(input_file_counter + step, E1, B1, V);
+         }
+
+         return retval;
       }
 
-      /* Assign them, without sanity checking */
-      /* TODO: Is this actually a good idea? */
-      for(uint i=0; i< cellIds.size(); i++) {
-         uint64_t c = cellIds[i];
-         int64_t x = c % cells[0];
-         int64_t y = (c /cells[0]) % cells[1];
-         int64_t z = c /(cells[0]*cells[1]);
-
-         double* Etgt = E1.getCellRef(x,y,z);
-         double* Btgt = B1.getCellRef(x,y,z);
-         Etgt[0] = Ebuffer[3*i];
-         Etgt[1] = Ebuffer[3*i+1];
-         Etgt[2] = Ebuffer[3*i+2];
-         Btgt[0] = Bbuffer[3*i];
-         Btgt[1] = Bbuffer[3*i+1];
-         Btgt[2] = Bbuffer[3*i+2];
-
-         if(doV) {
-           double* Vtgt = V.getCellRef(x,y,z);
-           Vtgt[0] = Vbuffer[3*i];
-           Vtgt[1] = Vbuffer[3*i+1];
-           Vtgt[2] = Vbuffer[3*i+2];
+      /* Start reading the given input file in the background, on top of
+       * a copy of the given fields */
+      void prefetch(int input_file_counter, Field& E1, Field& B1, Field& V) {
+         if(pending.valid()) {
+            pending.wait();
          }
+         counter = input_file_counter;
+         char filename_buffer[256];
+         snprintf(filename_buffer,256,filename_pattern.c_str(),input_file_counter);
+         filename = filename_buffer;
+
+         pending = std::async(std::launch::async, [this, &E1, &B1, &V]() {
+            nextE = E1;
+            nextB = B1;
+            if(doV) {
+               nextV = V;
+            }
+            return readTimestepFile<Reader>(filename.c_str(), nextE, nextB, nextV, doV);
+         });
       }
 
-      r.close();
-      retval = true;
-   }
+   private:
+      std::string filename_pattern;
+      bool doV;
 
-   return retval;
-}
+      // Input file being read, and the fields it is read into
+      int counter;
+      std::string filename;
+      Field nextE, nextB, nextV;
+      std::future<bool> pending;
+};
 
 /* Non-template version, autodetecting the reader type */
 static bool readNextTimestep(const std::string& filename_pattern, double t, int step, Field& E0, Field& E1,
@@ -197,9 +298,10 @@ static bool readNextTimestep(const std::string& filename_pattern, double t, int
          step,E0,E1,B0,B1,V,doV,input_file_counter);
 }
 
-/* Read E- and B-Fields as well as velocity field from a vlsv file */
+/* Read E- and B-Fields as well as velocity field from a vlsv file.
+ * With ranks > 1, only the slab of the given rank is stored (see Field). */
 template <class Reader>
-void readfields(const char* filename, Field& E, Field& B, Field& V, bool doV=true) {
+void readfields(const char* filename, Field& E, Field& B, Field& V, bool doV=true, int rank=0, int ranks=1) {
    Reader r;
 
 #ifdef DEBUG
@@ -251,10 +353,13 @@ void readfields(const char* filename, Field& E, Field& B, Field& V, bool doV=tru
    //          << ", dz = " << ((max[2]-min[2])/cells[2]) << "." << std::endl;
 
    /* Allocate space for the actual field structures */
-   E.data.resize(4*cells[0]*cells[1]*cells[2]);
-   B.data.resize(4*cells[0]*cells[1]*cells[2]);
+   E.setSlab(cells[0],rank,ranks);
+   B.setSlab(cells[0],rank,ranks);
+   V.setSlab(cells[0],rank,ranks);
+   E.data.resize(4*E.slabCells*cells[1]*cells[2]);
+   B.data.resize(4*B.slabCells*cells[1]*cells[2]);
 	 if(doV) {
-		 V.data.resize(4*cells[0]*cells[1]*cells[2]);
+		 V.data.resize(4*V.slabCells*cells[1]*cells[2]);
 	 }
 
    /* Sanity-check stored data sizes */
@@ -306,6 +411,9 @@ void readfields(const char* filename, Field& E, Field& B, Field& V, bool doV=tru
       int64_t x = c % cells[0];
       int64_t y = (c /cells[0]) % cells[1];
       int64_t z = c /(cells[0]*cells[1]);
+      if(!E.isLocal(x)) {
+         continue;
+      }
 
       double* Etgt = E.getCellRef(x,y,z);
       double* Btgt = B.getCellRef(x,y,z);
@@ -328,8 +436,9 @@ void readfields(const char* filename, Field& E, Field& B, Field& V, bool doV=tru
 }
 
 /* Non-template version, autodetecting the reader type */
-static void readfields(const char* filename, Field& E, Field& B, Field& V, bool doV=true) {
-  readfields<vlsvinterface::Reader>(filename,E,B,V,doV);
+static void readfields(const char* filename, Field& E, Field& B, Field& V, bool doV=true, int rank=0,
+      int ranks=1) {
+  readfields<vlsvinterface::Reader>(filename,E,B,V,doV,rank,ranks);
 }
 
 /* For debugging purposes - dump a field into a png file */
@@ -21,15 +21,52 @@
  */
 #include <random>
 #include <iostream>
+#include <sstream>
+#include <cstdarg>
 #include "scenario.h"
 
+/* Collect text from all ranks and write it to f on rank 0, in rank order.
+ * Has to be called by all ranks, f is only used on rank 0. */
+static void writeOnRoot(FILE* f, const std::string& text) {
+   int rank,ranks;
+   MPI_Comm_rank(MPI_COMM_WORLD,&rank);
+   MPI_Comm_size(MPI_COMM_WORLD,&ranks);
+
+   int length = text.size();
+   std::vector<int> lengths(ranks), offsets(ranks+1,0);
+   MPI_Gather(&length,1,MPI_INT,lengths.data(),1,MPI_INT,0,MPI_COMM_WORLD);
+   for(int r=0; r<ranks; r++) {
+      offsets[r+1] = offsets[r] + lengths[r];
+   }
+   std::vector<char> all(rank == 0 ? offsets[ranks] : 0);
+   MPI_Gatherv(text.data(),length,MPI_CHAR,all.data(),lengths.data(),offsets.data(),MPI_CHAR,0,MPI_COMM_WORLD);
+   if(rank == 0 && all.size() > 0) {
+      fwrite(all.data(),1,all.size(),f);
+      fflush(f);
+   }
+}
+
+/* printf into a string */
+static void appendf(std::string& text, const char* format, ...) {
+   char buffer[512];
+   va_list args;
+   va_start(args, format);
+   vsnprintf(buffer, sizeof(buffer), format, args);
+   va_end(args);
+   text += buffer;
+}
+
 ParticleContainer singleParticleScenario::initialParticles(Field& E, Field& B, Field& V) {
 
    ParticleContainer particles;
 
    Vec3d vpos(ParticleParameters::init_x, ParticleParameters::init_y, ParticleParameters::init_z);
-   /* Look up builk velocity in the V-field */
-   Vec3d bulk_vel = V(vpos);
+   /* Look up builk velocity in the V-field (only where this rank has it, the
+    * particle is not kept elsewhere) */
+   Vec3d bulk_vel(0.,0.,0.);
+   if(ParticleContainer::isOwned(vpos)) {
+      bulk_vel = V(vpos);
+   }
 
    particles.push_back(Particle(PhysicalConstantsSI::mp, PhysicalConstantsSI::e, vpos, bulk_vel));
 
@@ -39,8 +76,12 @@ ParticleContainer singleParticleScenario::initialParticles(Field& E, Field& B, F
 void singleParticleScenario::afterPush(int step, double time, ParticleContainer& particles, 
       Field& E, Field& B, Field& V) {
 
-   Vec3d& x = particles[0].x;
-   Vec3d& v = particles[0].v;
+   if(particles.size() == 0) {
+      // The particle has left the simulation box
+      return;
+   }
+   Vec3d x = particles.position(0);
+   Vec3d v = particles.velocity(0);
 
    std::cout << 0 << " " << time << "\t" <<  x[0] << " " << x[1] << " " << x[2] << "\t"
       << v[0] << " " << v[1] << " " << v[2] << std::endl;
@@ -57,9 +98,14 @@ ParticleContainer distributionScenario::initialParticles(Field& E, Field& B, Fie
 
    Vec3d vpos(ParticleParameters::init_x, ParticleParameters::init_y, ParticleParameters::init_z);
 
-   /* Look up builk velocity in the V-field */
-   Vec3d bulk_vel = V(vpos);
+   /* Look up builk velocity in the V-field (only where this rank has it, the
+    * particles are not kept elsewhere) */
+   Vec3d bulk_vel(0.,0.,0.);
+   if(ParticleContainer::isOwned(vpos)) {
+      bulk_vel = V(vpos);
+   }
 
+   /* The velocities are drawn on every rank, so that all ranks stay in step */
    for(unsigned int i=0; i< ParticleParameters::num_particles; i++) {
       /* Create a particle with velocity drawn from the given distribution ... */
       Particle p = velocity_distribution->next_particle();
@@ -91,38 +137,40 @@ void distributionScenario::finalize(ParticleContainer& particles, Field& E, Fiel
 void precipitationScenario::afterPush(int step, double time, ParticleContainer& particles,
       Field& E, Field& B, Field& V) {
 
+   std::string output;
+
    for(unsigned int i=0; i<particles.size(); i++) {
 
-      if(isnan(vector_length(particles[i].x))) {
+      if(!particles.alive[i]) {
          // skip disabled particles
          continue;
       }
 
       // Check if the particle hit a boundary. If yes, mark it as disabled.
       // Original starting x of this particle
+      const uint64_t id = particles.id[i];
       double start_pos = ParticleParameters::precip_start_x +
-         ((double)(i%ParticleParameters::num_particles))/ParticleParameters::num_particles *
+         ((double)(id%ParticleParameters::num_particles))/ParticleParameters::num_particles *
           (ParticleParameters::precip_stop_x - ParticleParameters::precip_start_x);
-      int start_timestep = i / ParticleParameters::num_particles;
-      if(vector_length(particles[i].x) <= ParticleParameters::precip_inner_boundary) {
+      int start_timestep = id / ParticleParameters::num_particles;
+      Vec3d x = particles.position(i);
+      if(vector_length(x) <= ParticleParameters::precip_inner_boundary) {
 
          // Record latitude and energy
-         double latitude = atan2(particles[i].x[2],particles[i].x[0]);
-         printf("%u %i %lf %lf %lf\n",i, start_timestep, start_pos, latitude, .5*particles[i].m *
-               dot_product(particles[i].v,particles[i].v)/PhysicalConstantsSI::e);
+         Vec3d v = particles.velocity(i);
+         double latitude = atan2(x[2],x[0]);
+         appendf(output,"%u %i %lf %lf %lf\n",(unsigned int)id, start_timestep, start_pos, latitude, .5*particles.m[i] *
+               dot_product(v,v)/PhysicalConstantsSI::e);
 
-         // Disable by setting position to NaN and velocity to 0
-         particles[i].x = Vec3d(std::numeric_limits<double>::quiet_NaN(),0.,0.);
-         particles[i].v = Vec3d(0,0,0);
-      } else if (particles[i].x[0] <= ParticleParameters::precip_start_x) {
+         particles.disable(i);
+      } else if (x[0] <= ParticleParameters::precip_start_x) {
 
          // Record marker value for lost particle
-         printf("%u %i %lf -5. -1.\n", i, start_timestep, start_pos);
-         // Disable by setting position to NaN and velocity to 0
-         particles[i].x = Vec3d(std::numeric_limits<double>::quiet_NaN(),0.,0.);
-         particles[i].v = Vec3d(0,0,0);
+         appendf(output,"%u %i %lf -5. -1.\n", (unsigned int)id, start_timestep, start_pos);
+         particles.disable(i);
       }
    }
+   writeOnRoot(stdout, output);
 }
 
 void precipitationScenario::newTimestep(int input_file_counter, int step, double time, ParticleContainer& particles,
@@ -137,20 +185,27 @@ void precipitationScenario::newTimestep(int input_file_counter, int step, double
          ((double)i)/ParticleParameters::num_particles *
           (ParticleParameters::precip_stop_x - ParticleParameters::precip_start_x);
       Vec3d pos(start_x,0,0);
-
-      // Find cell with minimum B value in this plane
-      double min_B = 99999999999.;
-      for(double z=-1e7; z<1e7; z+=1e5) {
-         Vec3d candidate_pos(start_x,0,z);
-         double B_here = vector_length(B(candidate_pos));
-         if(B_here < min_B) {
-            pos = candidate_pos;
-            min_B = B_here;
+      Vec3d bulk_vel(0.,0.,0.);
+
+      // The fields are only there on the rank that keeps this particle (all
+      // candidates have the same x). The others only count its id in push_back.
+      if(ParticleContainer::isOwned(pos)) {
+
+         // Find cell with minimum B value in this plane
+         double min_B = 99999999999.;
+         for(double z=-1e7; z<1e7; z+=1e5) {
+            Vec3d candidate_pos(start_x,0,z);
+            double B_here = vector_length(B(candidate_pos));
+            if(B_here < min_B) {
+               pos = candidate_pos;
+               min_B = B_here;
+            }
          }
+         bulk_vel = V(pos);
       }
 
       // Add a particle at this location, with bulk velocity at its starting point
-      particles.push_back(Particle(PhysicalConstantsSI::mp, PhysicalConstantsSI::e, pos, V(pos)));
+      particles.push_back(Particle(PhysicalConstantsSI::mp, PhysicalConstantsSI::e, pos, bulk_vel));
    }
 
    // Write out the state
@@ -165,17 +220,31 @@ ParticleContainer analysatorScenario::initialParticles(Field& E, Field& B, Field
 
    ParticleContainer particles;
 
-   std::cerr << "Reading initial particle data from stdin" << std::endl
-      << "(format: x y z vx vy vz)" << std::endl;
-
-   while(std::cin) {
-      double x0,x1,x2,v0,v1,v2;
-      std::cin >> x0 >> x1 >> x2 >> v0 >> v1 >> v2;
-      if(std::cin) {
-         particles.push_back(Particle(PhysicalConstantsSI::mp, PhysicalConstantsSI::e,
-                  Vec3d(x0,x1,x2), Vec3d(v0,v1,v2)));
+   // Only rank 0 reads, all ranks get the same particles
+   int rank;
+   MPI_Comm_rank(MPI_COMM_WORLD,&rank);
+   std::vector<double> values;
+   if(rank == 0) {
+      std::cerr << "Reading initial particle data from stdin" << std::endl
+         << "(format: x y z vx vy vz)" << std::endl;
+
+      while(std::cin) {
+         double x0,x1,x2,v0,v1,v2;
+         std::cin >> x0 >> x1 >> x2 >> v0 >> v1 >> v2;
+         if(std::cin) {
+            values.insert(values.end(), {x0,x1,x2,v0,v1,v2});
+         }
       }
    }
+   uint64_t numValues = values.size();
+   MPI_Bcast(&numValues,1,MPI_UINT64_T,0,MPI_COMM_WORLD);
+   values.resize(numValues);
+   MPI_Bcast(values.data(),numValues,MPI_DOUBLE,0,MPI_COMM_WORLD);
+
+   for(size_t i=0; i<values.size(); i+=6) {
+      particles.push_back(Particle(PhysicalConstantsSI::mp, PhysicalConstantsSI::e,
+               Vec3d(values[i],values[i+1],values[i+2]), Vec3d(values[i+3],values[i+4],values[i+5])));
+   }
 
    return particles;
 }
@@ -183,12 +252,15 @@ ParticleContainer analysatorScenario::initialParticles(Field& E, Field& B, Field
 void analysatorScenario::newTimestep(int input_file_counter, int step, double time, ParticleContainer& particles,
       Field& E, Field& B, Field& V) {
 
+   std::ostringstream output;
    for(unsigned int i=0; i< particles.size(); i++) {
-      Vec3d& x = particles[i].x;
-      Vec3d& v = particles[i].v;
-      std::cout << i << " " << time << "\t" <<  x[0] << " " << x[1] << " " << x[2] << "\t"
+      Vec3d x = particles.position(i);
+      Vec3d v = particles.velocity(i);
+      output << particles.id[i] << " " << time << "\t" <<  x[0] << " " << x[1] << " " << x[2] << "\t"
          << v[0] << " " << v[1] << " " << v[2] << std::endl;
    }
+   std::cout << std::flush;
+   writeOnRoot(stdout, output.str());
 }
 
 void shockReflectivityScenario::newTimestep(int input_file_counter, int step, double time,
@@ -218,8 +290,13 @@ void shockReflectivityScenario::newTimestep(int input_file_counter, int step, do
       // TODO: Multiple
       //particles.push_back(Particle(PhysicalConstantsSI::mp, PhysicalConstantsSI::e, pos, V(pos)));
 
-      /* Look up builk velocity in the V-field */
-      Vec3d bulk_vel = V(pos);
+      /* Look up builk velocity in the V-field (only where this rank has it, the
+       * particles are not kept elsewhere). The velocities are drawn on every rank,
+       * so that all ranks stay in step. */
+      Vec3d bulk_vel(0.,0.,0.);
+      if(ParticleContainer::isOwned(pos)) {
+         bulk_vel = V(pos);
+      }
 
       for(unsigned int i=0; i< ParticleParameters::num_particles; i++) {
          /* Create a particle with velocity drawn from the given distribution ... */
@@ -245,15 +322,21 @@ void shockReflectivityScenario::newTimestep(int input_file_counter, int step, do
 void shockReflectivityScenario::afterPush(int step, double time, ParticleContainer& particles,
       Field& E, Field& B, Field& V) {
 
+   // Threads fill private copies of the histograms, summed after the loop
+   transmitted.privatizeBins();
+   reflected.privatizeBins();
+
+   #pragma omp parallel for
    for(unsigned int i=0; i<particles.size(); i++) {
 
-      if(isnan(vector_length(particles[i].x))) {
+      if(!particles.alive[i]) {
          // skip disabled particles
          continue;
       }
 
       //Get particle's y-coordinate
-      double y = particles[i].x[1];
+      Vec3d pos = particles.position(i);
+      double y = pos[1];
 
       // Get x for it's shock boundary (approx)
       double x = y / ParticleParameters::reflect_start_y;
@@ -267,32 +350,36 @@ void shockReflectivityScenario::afterPush(int step, double time, ParticleContain
 
       // Check if the particle hit a boundary. If yes, mark it as disabled.
       // Original starting x of this particle
-      int start_timestep = i / 200 / ParticleParameters::num_particles;
+      int start_timestep = particles.id[i] / 200 / ParticleParameters::num_particles;
       double start_time = ParticleParameters::start_time + start_timestep * ParticleParameters::input_dt;
-      if(particles[i].x[0] < boundary_left) {
+      if(pos[0] < boundary_left) {
          // Record it is transmitted.
          transmitted.addValue(Vec2d(y,start_time));
 
-         // Disable by setting position to NaN and velocity to 0
-         particles[i].x = Vec3d(std::numeric_limits<double>::quiet_NaN(),0.,0.);
-         particles[i].v = Vec3d(0,0,0);
-      } else if (particles[i].x[0] > boundary_right) {
+         particles.disable(i);
+      } else if (pos[0] > boundary_right) {
 
          //Record it as reflected
          reflected.addValue(Vec2d(y,start_time));
 
-         // Disable by setting position to NaN and velocity to 0
-         particles[i].x = Vec3d(std::numeric_limits<double>::quiet_NaN(),0.,0.);
-         particles[i].v = Vec3d(0.,0.,0.);
+         particles.disable(i);
       }
    }
+
+   transmitted.mergeBins();
+   reflected.mergeBins();
 }
 
 void shockReflectivityScenario::finalize(ParticleContainer& particles, Field& E, Field& B, Field& V) {
+   // save() sums the histograms of all ranks
    transmitted.save("transmitted.dat");
-   transmitted.writeBovAscii("transmitted.dat.bov",0,"transmitted.dat");
    reflected.save("reflected.dat");
-   reflected.writeBovAscii("reflected.dat.bov",0,"reflected.dat");
+   int rank;
+   MPI_Comm_rank(MPI_COMM_WORLD,&rank);
+   if(rank == 0) {
+      transmitted.writeBovAscii("transmitted.dat.bov",0,"transmitted.dat");
+      reflected.writeBovAscii("reflected.dat.bov",0,"reflected.dat");
+   }
 }
 
 
@@ -300,9 +387,14 @@ void shockReflectivityScenario::finalize(ParticleContainer& particles, Field& E,
 
 ParticleContainer ipShockScenario::initialParticles(Field& E, Field& B, Field& V) {
 
-  // Open output files for transmission and reflection
-  traFile = fopen("transmitted.dat","w"); 
-  refFile = fopen("reflected.dat","w"); 
+  // Open output files for transmission and reflection, written by rank 0
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD,&rank);
+  traFile = refFile = nullptr;
+  if(rank == 0) {
+    traFile = fopen("transmitted.dat","w"); 
+    refFile = fopen("reflected.dat","w"); 
+  }
   
    ParticleContainer particles;
 
@@ -310,8 +402,8 @@ ParticleContainer ipShockScenario::initialParticles(Field& E, Field& B, Field& V
    std::default_random_engine generator(ParticleParameters::random_seed);
    Distribution* velocity_distribution=ParticleParameters::distribution(generator);
 
-   std::random_device rd;
-   std::mt19937 gen(rd());
+   // Fixed seed, so that every rank draws the same positions
+   std::mt19937 gen(ParticleParameters::random_seed);
    std::uniform_real_distribution<> disx(ParticleParameters::ipshock_inject_x0, ParticleParameters::ipshock_inject_x1);
    std::uniform_real_distribution<> disy(ParticleParameters::ipshock_inject_y0, ParticleParameters::ipshock_inject_y1);
    std::uniform_real_distribution<> disz(ParticleParameters::ipshock_inject_z0, ParticleParameters::ipshock_inject_z1);
@@ -324,8 +416,12 @@ ParticleContainer ipShockScenario::initialParticles(Field& E, Field& B, Field& V
      Real posz = disz(gen);
      Vec3d vpos(posx, posy, posz);
 
-     /* Look up bulk velocity in the V-field */
-     Vec3d bulk_vel = V(vpos); 
+     /* Look up bulk velocity in the V-field (only where this rank has it, the
+      * particle is not kept elsewhere) */
+     Vec3d bulk_vel(0.,0.,0.);
+     if(ParticleContainer::isOwned(vpos)) {
+       bulk_vel = V(vpos);
+     }
      
      /* Create a particle with velocity drawn from the given distribution ... */
      Particle p = velocity_distribution->next_particle();
@@ -353,51 +449,50 @@ void ipShockScenario::afterPush(int step, double time, ParticleContainer& partic
       Field& E, Field& B, Field& V) {
   
   /* Perform transmission / reflection check for each particle */
+   std::string transmittedOutput, reflectedOutput;
    for(unsigned int i=0; i<particles.size(); i++) {
 
-      if(isnan(vector_length(particles[i].x))) {
+      if(!particles.alive[i]) {
          // skip disabled particles
          continue;
       }
 
       //Get particle's x-coordinate
-      double x = particles[i].x[0];
+      Vec3d pos = particles.position(i);
+      Vec3d v = particles.velocity(i);
+      double x = pos[0];
 
       // Check if the particle hit a boundary. 
       // If yes, print it and mark it as disabled.
-      if(particles[i].x[0] < ParticleParameters::ipshock_transmit) {
+      if(x < ParticleParameters::ipshock_transmit) {
 	// Record it as transmitted.
 	//transmitted.addValue(Vec2d(y,start_time));
 	
 	// Write particle information to a file
-	fprintf(traFile,"%lf %lf %lf %lf %lf %lf %lf %lf %lf\n", time, 
-		particles[i].x[0], particles[i].x[1], particles[i].x[2],
-		particles[i].v[0], particles[i].v[1], particles[i].v[2],
-		.5 * particles[i].m * dot_product(particles[i].v, particles[i].v) / PhysicalConstantsSI::e,
-		dot_product(normalize_vector(particles[i].v), normalize_vector(B(particles[i].x))) );
-
-	// Disable by setting position to NaN and velocity to 0
-	particles[i].x = Vec3d(std::numeric_limits<double>::quiet_NaN(),0.,0.);
-	particles[i].v = Vec3d(0,0,0);
-      } else if (particles[i].x[0] > ParticleParameters::ipshock_reflect) {
+	appendf(transmittedOutput,"%lf %lf %lf %lf %lf %lf %lf %lf %lf\n", time, 
+		pos[0], pos[1], pos[2],
+		v[0], v[1], v[2],
+		.5 * particles.m[i] * dot_product(v, v) / PhysicalConstantsSI::e,
+		dot_product(normalize_vector(v), normalize_vector(B(pos))) );
+
+	particles.disable(i);
+      } else if (x > ParticleParameters::ipshock_reflect) {
 	// Record it as reflected
 	//reflected.addValue(Vec2d(y,start_time));
 	
 	// Write particle information to a file
 	// Write particle information to a file
-	fprintf(refFile,"%lf %lf %lf %lf %lf %lf %lf %lf %lf\n", time, 
-		particles[i].x[0], particles[i].x[1], particles[i].x[2],
-		particles[i].v[0], particles[i].v[1], particles[i].v[2],
-		.5 * particles[i].m * dot_product(particles[i].v, particles[i].v) / PhysicalConstantsSI::e,
-		dot_product(normalize_vector(particles[i].v), normalize_vector(B(particles[i].x))) );
-
-	// Disable by setting position to NaN and velocity to 0
-	particles[i].x = Vec3d(std::numeric_limits<double>::quiet_NaN(),0.,0.);
-	particles[i].v = Vec3d(0.,0.,0.);
+	appendf(reflectedOutput,"%lf %lf %lf %lf %lf %lf %lf %lf %lf\n", time, 
+		pos[0], pos[1], pos[2],
+		v[0], v[1], v[2],
+		.5 * particles.m[i] * dot_product(v, v) / PhysicalConstantsSI::e,
+		dot_product(normalize_vector(v), normalize_vector(B(pos))) );
+
+	particles.disable(i);
       }
    }
-   fflush(traFile);
-   fflush(refFile);
+   writeOnRoot(traFile, transmittedOutput);
+   writeOnRoot(refFile, reflectedOutput);
 }
 
 void ipShockScenario::finalize(ParticleContainer& particles, Field& E, Field& B, Field& V) {
@@ -408,8 +503,10 @@ void ipShockScenario::finalize(ParticleContainer& particles, Field& E, Field& B,
    //reflected.save("reflected.dat");
    //reflected.writeBovAscii("reflected.dat.bov",0,"reflected.dat");
 
-   fclose(traFile);
-   fclose(refFile);
+   if(traFile) {
+      fclose(traFile);
+      fclose(refFile);
+   }
 }
 
 
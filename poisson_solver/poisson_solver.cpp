@@ -41,6 +41,7 @@
 #include "poisson_solver_jacobi.h"
 #include "poisson_solver_sor.h"
 #include "poisson_solver_cg.h"
+#include "poisson_solver_mg.h"
 //#include "poisson_solver_cg2.h"
 
 #ifndef NDEBUG
@@ -408,6 +409,8 @@ namespace poisson {
       Poisson::solvers.add("Jacobi",makeJacobi);
       Poisson::solvers.add("SOR",makeSOR);
       Poisson::solvers.add("CG",makeCG);
+      Poisson::solvers.add("PipelinedCG",makePipelinedCG);
+      Poisson::solvers.add("MG",makeMG);
       //Poisson::solvers.add("CG2",makeCG2);
 
       // Create and initialize the Poisson solver
@@ -52,7 +52,23 @@ namespace poisson {
       return new PoissonSolverCG();
    }
 
-   PoissonSolverCG::PoissonSolverCG(): PoissonSolver() { 
+   PoissonSolver* makePipelinedCG() {
+      return new PoissonSolverCG(true);
+   }
+
+   /** Reduction operator of the pipelined CG, sums (r,r) and (w,r) and 
+    * takes the maximum of max|r| in one reduction.*/
+   static void reduceSumSumMax(void* in,void* inout,int* len,MPI_Datatype* /*datatype*/) {
+      const Real* a = reinterpret_cast<const Real*>(in);
+      Real* b = reinterpret_cast<Real*>(inout);
+      for (int i=0; i<*len; ++i) {
+         b[3*i  ] += a[3*i  ];
+         b[3*i+1] += a[3*i+1];
+         b[3*i+2] = max(b[3*i+2],a[3*i+2]);
+      }
+   }
+
+   PoissonSolverCG::PoissonSolverCG(const bool& pipelined): PoissonSolver(),pipelined(pipelined) { 
 
    }
 
@@ -62,11 +78,21 @@ namespace poisson {
       bool success = true;
       bndryCellParams[CellParams::PHI] = 0;
       bndryCellParams[CellParams::PHI_TMP] = 0;
+
+      if (pipelined == true) {
+         if (MPI_Type_contiguous(3,MPI_Type<Real>(),&reductionType) != MPI_SUCCESS) success = false;
+         if (MPI_Type_commit(&reductionType) != MPI_SUCCESS) success = false;
+         if (MPI_Op_create(reduceSumSumMax,1,&reductionOp) != MPI_SUCCESS) success = false;
+      }
       return success;
    }
 
    bool PoissonSolverCG::finalize() {
       bool success = true;
+      if (pipelined == true) {
+         MPI_Op_free(&reductionOp);
+         MPI_Type_free(&reductionType);
+      }
       return success;
    }
    
@@ -437,6 +463,11 @@ namespace poisson {
       mpiGrid.wait_remote_neighbor_copy_updates(POISSON_NEIGHBORHOOD_ID);
       phiprof::stop("MPI (RHOQ)");
 
+      if (pipelined == true) {
+         if (solvePipelined(mpiGrid) == false) success = false;
+         return success;
+      }
+
       // Initialize
       if (startIteration(mpiGrid) == false) {
          cerr << "(POISSON CG) ERROR has occurred in startIteration in " << __FILE__ << ":" << __LINE__ << endl;
@@ -699,4 +730,210 @@ namespace poisson {
       return true;
    }
 
+   /** Calculate Q = A*W on the given cells, W is stored in CellParams::PHI_TMP.
+    * @param cells Cells to evaluate.*/
+   void PoissonSolverCG::applyOperator(std::vector<CellCache3D<cgvar::SIZE> >& cells) {
+      #pragma omp parallel for
+      for (size_t c=0; c<cells.size(); ++c) {
+         cells[c].variables[cgvar::Q] = -4*cells[c].parameters[0][CellParams::PHI_TMP]
+           + cells[c].parameters[1][CellParams::PHI_TMP]
+           + cells[c].parameters[2][CellParams::PHI_TMP]
+           + cells[c].parameters[3][CellParams::PHI_TMP]
+           + cells[c].parameters[4][CellParams::PHI_TMP];
+      }
+   }
+
+   /** Calculate B and R0 = B - A*X0 and copy R0 to CellParams::PHI_TMP, 
+    * the remaining vectors of the pipelined CG are cleared.
+    * @param cells Cells to initialize.*/
+   void PoissonSolverCG::startPipelined(std::vector<CellCache3D<cgvar::SIZE> >& cells) {
+      #pragma omp parallel for
+      for (size_t c=0; c<cells.size(); ++c) {
+         const Real DX2 = cells[c].parameters[0][CellParams::DX]*cells[c].parameters[0][CellParams::DX];
+         cells[c].variables[cgvar::B] = -cells[c].parameters[0][CellParams::RHOQ_TOT]*DX2;
+
+         Real RHS = -4*cells[c].parameters[0][CellParams::PHI]
+                  + cells[c].parameters[1][CellParams::PHI] + cells[c].parameters[2][CellParams::PHI]
+                  + cells[c].parameters[3][CellParams::PHI] + cells[c].parameters[4][CellParams::PHI];
+         cells[c].variables[cgvar::R] = cells[c].variables[cgvar::B] - RHS;
+         cells[c].parameters[0][CellParams::PHI_TMP] = cells[c].variables[cgvar::R];
+
+         cells[c].variables[cgvar::Z] = 0;
+         cells[c].variables[cgvar::S] = 0;
+         cells[c].variables[cgvar::P] = 0;
+      }
+   }
+
+   /** Copy W0 = A*R0 to CellParams::PHI_TMP and add the contributions of the 
+    * given cells to (r,r), (w,r) and max|r| of the first iteration.
+    * @param cells Cells to initialize.
+    * @param sums Local (r,r), (w,r) and max|r|.*/
+   void PoissonSolverCG::startPipelined(std::vector<CellCache3D<cgvar::SIZE> >& cells,Real* sums) {
+      Real R_T_R = 0;
+      Real W_T_R = 0;
+      Real R_max = 0;
+
+      #pragma omp parallel for reduction(+:R_T_R,W_T_R) reduction(max:R_max)
+      for (size_t c=0; c<cells.size(); ++c) {
+         const Real R = cells[c].variables[cgvar::R];
+         const Real W = cells[c].variables[cgvar::Q];
+         cells[c].parameters[0][CellParams::PHI_TMP] = W;
+
+         R_T_R += R*R;
+         W_T_R += W*R;
+         R_max = max(R_max,fabs(R));
+      }
+
+      sums[0] += R_T_R;
+      sums[1] += W_T_R;
+      sums[2] = max(sums[2],R_max);
+   }
+
+   /** Update the vectors of the pipelined CG on the given cells and add the 
+    * contributions of the cells to (r,r), (w,r) and max|r| of the next iteration.
+    * @param cells Cells to update.
+    * @param alpha Step length.
+    * @param beta Search direction update coefficient.
+    * @param sums Local (r,r), (w,r) and max|r|.*/
+   void PoissonSolverCG::updatePipelined(std::vector<CellCache3D<cgvar::SIZE> >& cells,
+                                         const Real& alpha,const Real& beta,Real* sums) {
+      Real R_T_R = 0;
+      Real W_T_R = 0;
+      Real R_max = 0;
+
+      #pragma omp parallel for reduction(+:R_T_R,W_T_R) reduction(max:R_max)
+      for (size_t c=0; c<cells.size(); ++c) {
+         Real* variables = cells[c].variables;
+         Real& W = cells[c].parameters[0][CellParams::PHI_TMP];
+
+         variables[cgvar::Z] = variables[cgvar::Q] + beta*variables[cgvar::Z];
+         variables[cgvar::S] = W + beta*variables[cgvar::S];
+         variables[cgvar::P] = variables[cgvar::R] + beta*variables[cgvar::P];
+         cells[c].parameters[0][CellParams::PHI] += alpha*variables[cgvar::P];
+         variables[cgvar::R] -= alpha*variables[cgvar::S];
+         W -= alpha*variables[cgvar::Z];
+
+         R_T_R += variables[cgvar::R]*variables[cgvar::R];
+         W_T_R += W*variables[cgvar::R];
+         R_max = max(R_max,fabs(variables[cgvar::R]));
+      }
+
+      sums[0] += R_T_R;
+      sums[1] += W_T_R;
+      sums[2] = max(sums[2],R_max);
+   }
+
+   /** Solve the potential with the pipelined CG. Each iteration starts the reduction of 
+    * (r,r), (w,r) and max|r| and then calculates Q = A*W on inner cells while both the 
+    * reduction and the exchange of W started at the end of the previous iteration are 
+    * in flight. Process boundary cells are updated first so that the next exchange of W 
+    * overlaps with the update of inner cells.
+    * @param mpiGrid Parallel grid library.
+    * @return If true, the potential was solved successfully.*/
+   bool PoissonSolverCG::solvePipelined(dccrg::Dccrg<spatial_cell::SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid) {
+      bool success = true;
+      const size_t N_cells = bndryCellPointers.size() + innerCellPointers.size();
+      SpatialCell::set_mpi_transfer_type(Transfer::CELL_PHI,false);
+
+      Real t_start = 0;
+      if (Parameters::prepareForRebalance == true) t_start = MPI_Wtime();
+
+      // Calculate R0 and W0 = A*R0, PHI_TMP holds R0 while W0 is calculated
+      phiprof::start("start iteration");
+      startPipelined(bndryCellPointers);
+      startPipelined(innerCellPointers);
+      mpiGrid.update_copies_of_remote_neighbors(POISSON_NEIGHBORHOOD_ID);
+      applyOperator(bndryCellPointers);
+      applyOperator(innerCellPointers);
+
+      Real sums[3] = {0,0,0};
+      startPipelined(bndryCellPointers,sums);
+      mpiGrid.start_remote_neighbor_copy_updates(POISSON_NEIGHBORHOOD_ID);
+      startPipelined(innerCellPointers,sums);
+      phiprof::stop("start iteration",N_cells,"Spatial Cells");
+
+      Real alpha = 0;
+      Real R_T_R_old = 0;
+      iterations = 0;
+      do {
+         Real globalSums[3];
+         MPI_Request request;
+         phiprof::start("MPI (start reduction)");
+         MPI_Iallreduce(sums,globalSums,1,reductionType,reductionOp,MPI_COMM_WORLD,&request);
+         phiprof::stop("MPI (start reduction)");
+
+         // Calculate A*W while the reduction and the exchange of W are in flight
+         phiprof::start("A times W");
+         applyOperator(innerCellPointers);
+         phiprof::stop("A times W",innerCellPointers.size(),"Spatial Cells");
+
+         phiprof::start("MPI (update W)");
+         mpiGrid.wait_remote_neighbor_copy_updates(POISSON_NEIGHBORHOOD_ID);
+         phiprof::stop("MPI (update W)");
+
+         phiprof::start("A times W");
+         applyOperator(bndryCellPointers);
+         phiprof::stop("A times W",bndryCellPointers.size(),"Spatial Cells");
+
+         phiprof::start("MPI (wait reduction)");
+         MPI_Wait(&request,MPI_STATUS_IGNORE);
+         phiprof::stop("MPI (wait reduction)");
+
+         const Real R_T_R = globalSums[0];
+         const Real W_T_R = globalSums[1];
+         globalVariables[cgglobal::R_MAX] = globalSums[2];
+         if (globalVariables[cgglobal::R_MAX] < Poisson::maxAbsoluteError) break;
+         if (iterations >= Poisson::maxIterations) break;
+
+         Real beta = 0;
+         if (iterations == 0) {
+            alpha = R_T_R / (W_T_R + 100*numeric_limits<Real>::min());
+         } else {
+            beta = R_T_R / (R_T_R_old + 100*numeric_limits<Real>::min());
+            alpha = R_T_R / (W_T_R - beta*R_T_R/alpha + 100*numeric_limits<Real>::min());
+         }
+         R_T_R_old = R_T_R;
+         globalVariables[cgglobal::ALPHA] = alpha;
+         globalVariables[cgglobal::BETA] = beta;
+         globalVariables[cgglobal::R_T_R] = R_T_R;
+
+         phiprof::start("update vectors");
+         sums[0] = 0; sums[1] = 0; sums[2] = 0;
+         updatePipelined(bndryCellPointers,alpha,beta,sums);
+         mpiGrid.start_remote_neighbor_copy_updates(POISSON_NEIGHBORHOOD_ID);
+         updatePipelined(innerCellPointers,alpha,beta,sums);
+         phiprof::stop("update vectors",N_cells,"Spatial Cells");
+
+         ++iterations;
+      } while (true);
+
+      // Measure computation time if needed
+      if (Parameters::prepareForRebalance == true) {
+         const Real t_average = (MPI_Wtime() - t_start) / max((size_t)1,N_cells);
+
+         #pragma omp parallel
+         {
+            #pragma omp for nowait
+            for (size_t c=0; c<bndryCellPointers.size(); ++c) {
+               bndryCellPointers[c].parameters[0][CellParams::LBWEIGHTCOUNTER] += t_average;
+            }
+            #pragma omp for nowait
+            for (size_t c=0; c<innerCellPointers.size(); ++c) {
+               innerCellPointers[c].parameters[0][CellParams::LBWEIGHTCOUNTER] += t_average;
+            }
+         }
+      }
+
+      if (calculateElectrostaticField(mpiGrid) == false) {
+         logFile << "(POISSON SOLVER CG) ERROR: Failed to calculate electrostatic field in ";
+         logFile << __FILE__ << ":" << __LINE__ << endl << write;
+         success = false;
+      }
+
+      error<cgvar::SIZE>(innerCellPointers);
+      error<cgvar::SIZE>(bndryCellPointers);
+
+      return success;
+   }
+
 } // namespace poisson
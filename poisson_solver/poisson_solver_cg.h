@@ -40,6 +40,10 @@ namespace poisson {
          B,          /**< Charge density multiplied by dx2/epsilon0.*/
          R,
          A_TIMES_P,  /**< Matrix A times P.*/
+         Z,          /**< Pipelined CG: matrix A times S.*/
+         S,          /**< Pipelined CG: matrix A times P.*/
+         P,          /**< Pipelined CG: search direction.*/
+         Q,          /**< Pipelined CG: matrix A times W, W is stored in CellParams::PHI_TMP.*/
          SIZE
       };
    }
@@ -55,9 +59,12 @@ namespace poisson {
       };
    }
 
+   /** Conjugate gradient solver. The pipelined variant (Ghysels and Vanroose 2014) 
+    * needs one non-blocking global reduction per iteration, which is overlapped 
+    * with the exchange of W and with the matrix-vector product on inner cells.*/
    class PoissonSolverCG: public PoissonSolver {
    public:
-        PoissonSolverCG();
+        PoissonSolverCG(const bool& pipelined=false);
         ~PoissonSolverCG();
         
         bool calculateElectrostaticField(dccrg::Dccrg<spatial_cell::SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid);
@@ -86,11 +93,21 @@ namespace poisson {
         bool update_p(dccrg::Dccrg<spatial_cell::SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid);
         bool update_x_r();
 
+        void applyOperator(std::vector<CellCache3D<cgvar::SIZE> >& cells);
+        bool solvePipelined(dccrg::Dccrg<spatial_cell::SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid);
+        void startPipelined(std::vector<CellCache3D<cgvar::SIZE> >& cells);
+        void startPipelined(std::vector<CellCache3D<cgvar::SIZE> >& cells,Real* sums);
+        void updatePipelined(std::vector<CellCache3D<cgvar::SIZE> >& cells,const Real& alpha,const Real& beta,Real* sums);
+
         Real globalVariables[cgglobal::SIZE];
         uint iterations;
+        bool pipelined;                 /**< If true, the pipelined variant is used.*/
+        MPI_Datatype reductionType;     /**< Three Reals reduced by reductionOp.*/
+        MPI_Op reductionOp;             /**< Sums the first two Reals and takes the maximum of the third one.*/
    };
 
    PoissonSolver* makeCG();
+   PoissonSolver* makePipelinedCG();
 
 } // namespace poisson
 
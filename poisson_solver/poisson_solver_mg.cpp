@@ -0,0 +1,1318 @@
+/*
+ * This file is part of Vlasiator.
+ * Copyright 2010-2016 Finnish Meteorological Institute
+ *
+ * For details of usage, see the COPYING file and read the "Rules of the Road"
+ * at http://www.physics.helsinki.fi/vlasiator/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * 
+ * File:   poisson_solver_mg.cpp
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <omp.h>
+
+#include "../logger.h"
+#include "../grid.h"
+#include "../mpiconversion.h"
+
+#include "poisson_solver_mg.h"
+
+using namespace std;
+
+extern Logger logFile;
+
+namespace poisson {
+
+   static const int RED   = 0;
+   static const int BLACK = 1;
+
+   static const int PRE_SWEEPS  = 2; /**< Red-black sweeps before coarse grid correction.*/
+   static const int POST_SWEEPS = 2; /**< Black-red sweeps after coarse grid correction.*/
+   static const int MIN_NODES   = 3; /**< Coarsening stops before a level would have fewer nodes per dimension.*/
+   static const size_t MAX_REPLICATED_NODES = 32768; /**< Coarse levels with more nodes are distributed over processes.*/
+
+   static const int GHOST_UPDATE_TAG = 1100; /**< MPI tag of the owned node values sent to ghost nodes.*/
+   static const int GHOST_SUM_TAG    = 1101; /**< MPI tag of the ghost node values summed to owned nodes.*/
+
+   /** Coarse nodes that a cell or node of the next finer level restricts to with full 
+    * weighting: the coinciding node with weight 1/2, or the two nodes on both sides with 
+    * weight 1/4, per dimension.
+    * @param f Indices of the finer cell or node.
+    * @param nodes Output, indices of the coarse nodes.
+    * @param weights Output, weights of the coarse nodes.
+    * @return Number of coarse nodes.*/
+   static int coarseNodes(const std::array<int,3>& f,std::array<int,3> nodes[8],Real weights[8]) {
+      const int dimensions = (Poisson::is2D == true) ? 2 : 3;
+      int count = 1;
+      nodes[0] = {{0,0,0}};
+      weights[0] = 1;
+      for (int d=0; d<3; ++d) {
+         if (d >= dimensions) {
+            for (int n=0; n<count; ++n) nodes[n][d] = f[d];
+         } else if (f[d] % 2 == 0) {
+            for (int n=0; n<count; ++n) {
+               nodes[n][d] = f[d]/2;
+               weights[n] *= 0.5;
+            }
+         } else {
+            for (int n=0; n<count; ++n) {
+               nodes[count+n] = nodes[n];
+               nodes[n][d] = f[d]/2;
+               nodes[count+n][d] = f[d]/2+1;
+               weights[n] *= 0.25;
+               weights[count+n] = weights[n];
+            }
+            count *= 2;
+         }
+      }
+      return count;
+   }
+
+   /** Distance from the coarse node coinciding with a fine cell to its neighbor in the 
+    * given direction: twice the cell size if the fine neighbor is an unknown and the 
+    * cell size if it is a system boundary cell.
+    * @param mpiGrid Parallel grid library.
+    * @param indices Indices of the fine cell.
+    * @param cellSize Size of the fine cell in the given dimension.
+    * @param d Dimension.
+    * @param side 0 for the negative and 1 for the positive direction.*/
+   static Real fineDistance(dccrg::Dccrg<spatial_cell::SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                            dccrg::Types<3>::indices_t indices,const Real& cellSize,const int& d,const int& side) {
+      indices[d] += (side == 0) ? -1 : +1;
+      const spatial_cell::SpatialCell* nbr = mpiGrid[ mpiGrid.mapping.get_cell_from_indices(indices,0) ];
+      if (nbr != NULL && nbr->sysBoundaryFlag == sysboundarytype::NOT_SYSBOUNDARY) return 2*cellSize;
+      return cellSize;
+   }
+
+   /** Distance from the coarse node coinciding with a node of a distributed level to its 
+    * neighbor or the boundary in the given direction, see PoissonSolverMG::coarsen.
+    * @param fine Distributed level with up-to-date ghost node distances.
+    * @param n Local index of the fine node.
+    * @param d Dimension.
+    * @param side 0 for the negative and 1 for the positive direction.
+    * @param coarseH Node spacing of the coarse level.*/
+   static Real coarseDistance(const DistributedLevel& fine,const size_t& n,const int& d,const int& side,const Real& coarseH) {
+      std::array<int,3> f = fine.nodes[n];
+      f[d] += (side == 0) ? -1 : +1;
+      if (f[d] >= 0 && f[d] < fine.size[d]) {
+         unordered_map<uint64_t,size_t>::const_iterator it = fine.localIndex.find(fine.key(f));
+         if (it != fine.localIndex.end()) return min(coarseH,fine.h[d] + fine.distance[6*it->second+2*d+side]);
+      }
+      return fine.distance[6*n+2*d+side];
+   }
+
+   /** Process owning a node of a distributed level, the owner of the fine cell the node coincides with.
+    * @param mpiGrid Parallel grid library.
+    * @param l Index of the distributed level.
+    * @param node Indices of the node.
+    * @return Process, or -1 if the node does not coincide with a fine cell.*/
+   static int nodeOwner(dccrg::Dccrg<spatial_cell::SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                        const size_t& l,const std::array<int,3>& node) {
+      const int dimensions = (Poisson::is2D == true) ? 2 : 3;
+      const int fineSize[3] = {(int)Parameters::xcells_ini,(int)Parameters::ycells_ini,(int)Parameters::zcells_ini};
+      dccrg::Types<3>::indices_t indices;
+      for (int d=0; d<3; ++d) {
+         const long int index = (d < dimensions) ? ((long int)node[d] << (l+1)) : node[d];
+         if (index < 0 || index >= fineSize[d]) return -1;
+         indices[d] = index;
+      }
+      return mpiGrid.get_process(mpiGrid.mapping.get_cell_from_indices(indices,0));
+   }
+
+   PoissonSolver* makeMG() {
+      return new PoissonSolverMG();
+   }
+
+   PoissonSolverMG::PoissonSolverMG(): PoissonSolver() { }
+
+   PoissonSolverMG::~PoissonSolverMG() { }
+
+   bool PoissonSolverMG::initialize() {
+      bool success = true;
+      return success;
+   }
+
+   bool PoissonSolverMG::finalize() {
+      bool success = true;
+      levels.clear();
+      distributedLevels.clear();
+      return success;
+   }
+
+   bool PoissonSolverMG::calculateElectrostaticField(dccrg::Dccrg<spatial_cell::SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid) {
+      bool success = true;
+      SpatialCell::set_mpi_transfer_type(Transfer::CELL_PHI,false);
+
+      mpiGrid.start_remote_neighbor_copy_updates(POISSON_NEIGHBORHOOD_ID);
+
+      // Calculate electric field on inner cells
+      for (int color=RED; color<=BLACK; ++color) {
+         if (Poisson::is2D == true) {
+            if (calculateElectrostaticField2D(innerCells[color].cells) == false) success = false;
+         } else {
+            if (calculateElectrostaticField3D(innerCells[color].cells) == false) success = false;
+         }
+      }
+
+      mpiGrid.wait_remote_neighbor_copy_updates(POISSON_NEIGHBORHOOD_ID);
+
+      // Calculate electric field on boundary cells
+      for (int color=RED; color<=BLACK; ++color) {
+         if (Poisson::is2D == true) {
+            if (calculateElectrostaticField2D(bndryCells[color].cells) == false) success = false;
+         } else {
+            if (calculateElectrostaticField3D(bndryCells[color].cells) == false) success = false;
+         }
+      }
+
+      return success;
+   }
+
+   /** Cache pointers to the parameters of the given cells and their face neighbors.
+    * Only cells that are not system boundary cells are unknowns, system boundary 
+    * cells keep their potential and act as Dirichlet boundaries.
+    * @param mpiGrid Parallel grid library.
+    * @param cells List of local cells.
+    * @param cache Output, cells sorted to red and black cells.*/
+   void PoissonSolverMG::cachePointers(dccrg::Dccrg<spatial_cell::SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                                       const std::vector<CellID>& cells,FineCells* cache) {
+      cache[RED].clear();
+      cache[BLACK].clear();
+
+      for (size_t c=0; c<cells.size(); ++c) {
+         if (mpiGrid[cells[c]]->sysBoundaryFlag != sysboundarytype::NOT_SYSBOUNDARY) continue;
+
+         // Calculate cell i/j/k indices
+         dccrg::Types<3>::indices_t indices = mpiGrid.mapping.get_indices(cells[c]);
+
+         CellCache3D<mgvar::SIZE> cellCache;
+         cellCache.cellID = cells[c];
+         cellCache.cell = mpiGrid[cells[c]];
+         cellCache[0] = mpiGrid[cells[c]]->parameters.data();
+
+         // Fetch pointers to +/- xyz face neighbors' parameters arrays, 
+         // z-neighbors are not used by the 2D solver
+         const int dimensions = (Poisson::is2D == true) ? 2 : 3;
+         for (int d=0; d<dimensions; ++d) {
+            indices[d] -= 1; cellCache[1+2*d] = mpiGrid[ mpiGrid.mapping.get_cell_from_indices(indices,0) ]->parameters.data();
+            indices[d] += 2; cellCache[2+2*d] = mpiGrid[ mpiGrid.mapping.get_cell_from_indices(indices,0) ]->parameters.data();
+            indices[d] -= 1;
+         }
+         if (Poisson::is2D == true) {
+            cellCache[5] = cellCache[0];
+            cellCache[6] = cellCache[0];
+         }
+         cellCache.variables[mgvar::RESIDUAL] = 0;
+
+         const int color = (indices[0] + indices[1] + indices[2]) % 2;
+         cache[color].cells.push_back(cellCache);
+         cache[color].indices.push_back(indices);
+      }
+   }
+
+   /** Allocate a coarse level, all nodes are initially inactive.
+    * @param level Level to initialize.
+    * @param size Number of nodes per dimension.
+    * @param h Node spacing.*/
+   void PoissonSolverMG::initializeLevel(MultigridLevel& level,const int size[3],const Real h[3]) {
+      for (int d=0; d<3; ++d) {
+         level.size[d] = size[d];
+         level.h[d] = h[d];
+      }
+      level.stride[0] = 1;
+      level.stride[1] = size[0]+2;
+      level.stride[2] = (size_t)(size[0]+2)*(size[1]+2);
+
+      const size_t N_nodes = (size_t)(size[0]+2)*(size[1]+2)*(size[2]+2);
+      level.phi.assign(N_nodes,0);
+      level.rhs.assign(N_nodes,0);
+      level.residual.assign(N_nodes,0);
+      level.coeff.assign(7*N_nodes,0);
+      level.distance.assign(6*N_nodes,0);
+      level.active.assign(N_nodes,0);
+   }
+
+   /** Calculate the stencil of each active node from the distances to its neighbors.
+    * If the distance in some direction is less than the node spacing, there is a system 
+    * boundary cell in between and the stencil is the standard non-uniform three-point 
+    * stencil with zero correction at the boundary.
+    * @param level Level whose stencils are calculated.*/
+   void PoissonSolverMG::coefficients(MultigridLevel& level) {
+      const int dimensions = (Poisson::is2D == true) ? 2 : 3;
+
+      #pragma omp parallel for
+      for (size_t n=0; n<level.active.size(); ++n) {
+         if (level.active[n] == 0) continue;
+         Real* coeff = &(level.coeff[7*n]);
+         coeff[0] = 0;
+         for (int d=0; d<dimensions; ++d) {
+            const Real a = level.distance[6*n+2*d  ];
+            const Real b = level.distance[6*n+2*d+1];
+            coeff[1+2*d] = (a < level.h[d]) ? 0 : 2/(a*(a+b));
+            coeff[2+2*d] = (b < level.h[d]) ? 0 : 2/(b*(a+b));
+            coeff[0] += 2/(a*b);
+         }
+      }
+   }
+
+   /** Calculate the stencil of each owned node of a distributed level, see coefficients(MultigridLevel&).
+    * @param level Level whose stencils are calculated.*/
+   void PoissonSolverMG::coefficients(DistributedLevel& level) {
+      const int dimensions = (Poisson::is2D == true) ? 2 : 3;
+      level.coeff.assign(7*level.N_owned,0);
+
+      #pragma omp parallel for
+      for (size_t n=0; n<level.N_owned; ++n) {
+         Real* coeff = &(level.coeff[7*n]);
+         for (int d=0; d<dimensions; ++d) {
+            const Real a = level.distance[6*n+2*d  ];
+            const Real b = level.distance[6*n+2*d+1];
+            coeff[1+2*d] = (a < level.h[d]) ? 0 : 2/(a*(a+b));
+            coeff[2+2*d] = (b < level.h[d]) ? 0 : 2/(b*(a+b));
+            coeff[0] += 2/(a*b);
+         }
+      }
+   }
+
+   /** Find the ghost nodes of a distributed level and set up their exchange. The owner of 
+    * each candidate node is asked whether the node is active, only active nodes become ghosts.
+    * @param mpiGrid Parallel grid library.
+    * @param l Index of the level.
+    * @param level Level with its owned nodes set.
+    * @param candidates Nodes that may be needed on this process.*/
+   void PoissonSolverMG::findGhosts(dccrg::Dccrg<spatial_cell::SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                                    const size_t& l,DistributedLevel& level,const std::vector<std::array<int,3> >& candidates) {
+      int myRank,processes;
+      MPI_Comm_rank(MPI_COMM_WORLD,&myRank);
+      MPI_Comm_size(MPI_COMM_WORLD,&processes);
+
+      vector<vector<uint64_t> > requests(processes);
+      for (size_t c=0; c<candidates.size(); ++c) {
+         bool inside = true;
+         for (int d=0; d<3; ++d) if (candidates[c][d] < 0 || candidates[c][d] >= level.size[d]) inside = false;
+         if (inside == false) continue;
+         const uint64_t key = level.key(candidates[c]);
+         if (level.localIndex.find(key) != level.localIndex.end()) continue;
+         const int owner = nodeOwner(mpiGrid,l,candidates[c]);
+         if (owner < 0 || owner == myRank) continue;
+         requests[owner].push_back(key);
+      }
+
+      vector<int> sendCounts(processes),recvCounts(processes);
+      vector<int> sendDispls(processes,0),recvDispls(processes,0);
+      vector<uint64_t> sendKeys;
+      for (int p=0; p<processes; ++p) {
+         sort(requests[p].begin(),requests[p].end());
+         requests[p].erase(unique(requests[p].begin(),requests[p].end()),requests[p].end());
+         sendCounts[p] = requests[p].size();
+         if (p > 0) sendDispls[p] = sendDispls[p-1] + sendCounts[p-1];
+         sendKeys.insert(sendKeys.end(),requests[p].begin(),requests[p].end());
+      }
+      MPI_Alltoall(sendCounts.data(),1,MPI_INT,recvCounts.data(),1,MPI_INT,MPI_COMM_WORLD);
+      for (int p=1; p<processes; ++p) recvDispls[p] = recvDispls[p-1] + recvCounts[p-1];
+      vector<uint64_t> recvKeys(recvDispls.back() + recvCounts.back() + 1);
+      sendKeys.push_back(0);
+      MPI_Alltoallv(sendKeys.data(),sendCounts.data(),sendDispls.data(),MPI_Type<uint64_t>(),
+                    recvKeys.data(),recvCounts.data(),recvDispls.data(),MPI_Type<uint64_t>(),MPI_COMM_WORLD);
+
+      // Reply which of the requested nodes are active, and remember them as the owned nodes sent to each process
+      vector<char> replies(recvKeys.size(),0);
+      vector<char> active(sendKeys.size(),0);
+      level.sendRanks.clear();
+      level.sendNodes.clear();
+      for (int p=0; p<processes; ++p) {
+         vector<size_t> nodes;
+         for (int r=recvDispls[p]; r<recvDispls[p]+recvCounts[p]; ++r) {
+            unordered_map<uint64_t,size_t>::const_iterator it = level.localIndex.find(recvKeys[r]);
+            if (it == level.localIndex.end()) continue;
+            replies[r] = 1;
+            nodes.push_back(it->second);
+         }
+         if (nodes.size() == 0) continue;
+         level.sendRanks.push_back(p);
+         level.sendNodes.push_back(nodes);
+      }
+      MPI_Alltoallv(replies.data(),recvCounts.data(),recvDispls.data(),MPI_CHAR,
+                    active.data(),sendCounts.data(),sendDispls.data(),MPI_CHAR,MPI_COMM_WORLD);
+
+      // Active requested nodes become ghosts, in the order in which their owner sends them
+      level.recvRanks.clear();
+      level.recvNodes.clear();
+      for (int p=0; p<processes; ++p) {
+         vector<size_t> nodes;
+         for (int r=0; r<sendCounts[p]; ++r) {
+            if (active[sendDispls[p]+r] == 0) continue;
+            const uint64_t key = requests[p][r];
+            std::array<int,3> node;
+            node[0] = key % level.size[0];
+            node[1] = (key / level.size[0]) % level.size[1];
+            node[2] = key / ((uint64_t)level.size[0]*level.size[1]);
+            level.localIndex[key] = level.nodes.size();
+            nodes.push_back(level.nodes.size());
+            level.nodes.push_back(node);
+         }
+         if (nodes.size() == 0) continue;
+         level.recvRanks.push_back(p);
+         level.recvNodes.push_back(nodes);
+      }
+      level.sendBuffers.resize(level.sendRanks.size());
+      level.recvBuffers.resize(level.recvRanks.size());
+   }
+
+   /** Copy the values of the owned nodes of a distributed level to their ghost copies on other processes.
+    * @param level Distributed level.
+    * @param values Values of the owned and ghost nodes.
+    * @param stride Number of values per node.*/
+   void PoissonSolverMG::updateGhosts(DistributedLevel& level,std::vector<Real>& values,const int& stride) {
+      vector<MPI_Request> requests(level.recvRanks.size() + level.sendRanks.size());
+      for (size_t r=0; r<level.recvRanks.size(); ++r) {
+         level.recvBuffers[r].resize(stride*level.recvNodes[r].size());
+         MPI_Irecv(level.recvBuffers[r].data(),level.recvBuffers[r].size(),MPI_Type<Real>(),
+                   level.recvRanks[r],GHOST_UPDATE_TAG,MPI_COMM_WORLD,&(requests[r]));
+      }
+      for (size_t r=0; r<level.sendRanks.size(); ++r) {
+         vector<Real>& buffer = level.sendBuffers[r];
+         buffer.resize(stride*level.sendNodes[r].size());
+         for (size_t n=0; n<level.sendNodes[r].size(); ++n) {
+            for (int s=0; s<stride; ++s) buffer[stride*n+s] = values[stride*level.sendNodes[r][n]+s];
+         }
+         MPI_Isend(buffer.data(),buffer.size(),MPI_Type<Real>(),
+                   level.sendRanks[r],GHOST_UPDATE_TAG,MPI_COMM_WORLD,&(requests[level.recvRanks.size()+r]));
+      }
+      MPI_Waitall(requests.size(),requests.data(),MPI_STATUSES_IGNORE);
+      for (size_t r=0; r<level.recvRanks.size(); ++r) {
+         for (size_t n=0; n<level.recvNodes[r].size(); ++n) {
+            for (int s=0; s<stride; ++s) values[stride*level.recvNodes[r][n]+s] = level.recvBuffers[r][stride*n+s];
+         }
+      }
+   }
+
+   /** Add the values of the ghost nodes of a distributed level to the owned nodes on other 
+    * processes, the ghost values are cleared.
+    * @param level Distributed level.
+    * @param values Values of the owned and ghost nodes.*/
+   void PoissonSolverMG::sumGhosts(DistributedLevel& level,std::vector<Real>& values) {
+      vector<MPI_Request> requests(level.recvRanks.size() + level.sendRanks.size());
+      for (size_t r=0; r<level.sendRanks.size(); ++r) {
+         level.sendBuffers[r].resize(level.sendNodes[r].size());
+         MPI_Irecv(level.sendBuffers[r].data(),level.sendBuffers[r].size(),MPI_Type<Real>(),
+                   level.sendRanks[r],GHOST_SUM_TAG,MPI_COMM_WORLD,&(requests[r]));
+      }
+      for (size_t r=0; r<level.recvRanks.size(); ++r) {
+         vector<Real>& buffer = level.recvBuffers[r];
+         buffer.resize(level.recvNodes[r].size());
+         for (size_t n=0; n<level.recvNodes[r].size(); ++n) {
+            buffer[n] = values[level.recvNodes[r][n]];
+            values[level.recvNodes[r][n]] = 0;
+         }
+         MPI_Isend(buffer.data(),buffer.size(),MPI_Type<Real>(),
+                   level.recvRanks[r],GHOST_SUM_TAG,MPI_COMM_WORLD,&(requests[level.sendRanks.size()+r]));
+      }
+      MPI_Waitall(requests.size(),requests.data(),MPI_STATUSES_IGNORE);
+      for (size_t r=0; r<level.sendRanks.size(); ++r) {
+         for (size_t n=0; n<level.sendNodes[r].size(); ++n) values[level.sendNodes[r][n]] += level.sendBuffers[r][n];
+      }
+   }
+
+   /** Build the next coarser level. A coarse node is active if the coinciding fine node is, 
+    * its distance to the boundary follows from the fine level distances.
+    * @param fine Fine level.
+    * @param coarse Coarse level, allocated by initializeLevel.*/
+   void PoissonSolverMG::coarsen(const MultigridLevel& fine,MultigridLevel& coarse) {
+      const int dimensions = (Poisson::is2D == true) ? 2 : 3;
+      const int rows = coarse.size[1]*coarse.size[2];
+
+      #pragma omp parallel for
+      for (int row=0; row<rows; ++row) {
+         const int j = row % coarse.size[1];
+         const int k = row / coarse.size[1];
+         for (int i=0; i<coarse.size[0]; ++i) {
+            int f[3] = {2*i,2*j,(dimensions == 2) ? k : 2*k};
+            if (f[0] >= fine.size[0] || f[1] >= fine.size[1] || f[2] >= fine.size[2]) continue;
+            const size_t fineNode = fine.index(f[0],f[1],f[2]);
+            if (fine.active[fineNode] == 0) continue;
+
+            const size_t node = coarse.index(i,j,k);
+            coarse.active[node] = 1;
+            for (int d=0; d<3; ++d) for (int side=0; side<2; ++side) {
+               Real& distance = coarse.distance[6*node+2*d+side];
+               if (d >= dimensions) {
+                  distance = coarse.h[d];
+                  continue;
+               }
+
+               // Distance is that of the fine node if the boundary is next to it, 
+               // otherwise the boundary is beyond the next fine node
+               f[d] += (side == 0) ? -1 : +1;
+               if (f[d] < 0 || f[d] >= fine.size[d] || fine.active[fine.index(f[0],f[1],f[2])] == 0) {
+                  distance = fine.distance[6*fineNode+2*d+side];
+               } else {
+                  distance = min(coarse.h[d],fine.h[d] + fine.distance[6*fine.index(f[0],f[1],f[2])+2*d+side]);
+               }
+               f[d] -= (side == 0) ? -1 : +1;
+            }
+         }
+      }
+
+      coefficients(coarse);
+   }
+
+   /** Build a distributed coarse level from the fine cells or from the next finer 
+    * distributed level. Each process creates the active nodes that coincide with its 
+    * cells or nodes, then fetches the ghost nodes needed by their stencils and by the 
+    * restriction from the finer level.
+    * @param mpiGrid Parallel grid library.
+    * @param l Index of the level in distributedLevels.
+    * @param size Number of nodes per dimension.
+    * @param h Node spacing.*/
+   void PoissonSolverMG::buildDistributedLevel(dccrg::Dccrg<spatial_cell::SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                                               const size_t& l,const int size[3],const Real h[3]) {
+      const int dimensions = (Poisson::is2D == true) ? 2 : 3;
+      DistributedLevel& level = distributedLevels[l];
+      for (int d=0; d<3; ++d) {
+         level.size[d] = size[d];
+         level.h[d] = h[d];
+      }
+
+      std::array<int,3> nodes[8];
+      Real weights[8];
+      vector<std::array<int,3> > candidates;
+      if (l == 0) {
+         for (int color=RED; color<=BLACK; ++color) {
+            FineCells* lists[2] = {&(innerCells[color]),&(bndryCells[color])};
+            for (int list=0; list<2; ++list) {
+               for (size_t c=0; c<lists[list]->cells.size(); ++c) {
+                  const dccrg::Types<3>::indices_t& indices = lists[list]->indices[c];
+                  const std::array<int,3> f = {{(int)indices[0],(int)indices[1],(int)indices[2]}};
+                  const int count = coarseNodes(f,nodes,weights);
+                  candidates.insert(candidates.end(),nodes,nodes+count);
+
+                  bool coincides = true;
+                  for (int d=0; d<dimensions; ++d) if (indices[d] % 2 != 0) coincides = false;
+                  if (coincides == false) continue;
+                  level.localIndex[level.key(nodes[0])] = level.nodes.size();
+                  level.nodes.push_back(nodes[0]);
+                  for (int d=0; d<3; ++d) for (int side=0; side<2; ++side) {
+                     level.distance.push_back((d < dimensions) ? fineDistance(mpiGrid,indices,lists[list]->cells[c][0][CellParams::DX+d],d,side) : h[d]);
+                  }
+               }
+            }
+         }
+      } else {
+         const DistributedLevel& finer = distributedLevels[l-1];
+         for (size_t n=0; n<finer.N_owned; ++n) {
+            const int count = coarseNodes(finer.nodes[n],nodes,weights);
+            candidates.insert(candidates.end(),nodes,nodes+count);
+
+            bool coincides = true;
+            for (int d=0; d<dimensions; ++d) if (finer.nodes[n][d] % 2 != 0) coincides = false;
+            if (coincides == false) continue;
+            level.localIndex[level.key(nodes[0])] = level.nodes.size();
+            level.nodes.push_back(nodes[0]);
+            for (int d=0; d<3; ++d) for (int side=0; side<2; ++side) {
+               level.distance.push_back((d < dimensions) ? coarseDistance(finer,n,d,side,h[d]) : h[d]);
+            }
+         }
+      }
+      level.N_owned = level.nodes.size();
+
+      // Stencil neighbors of the owned nodes
+      for (size_t n=0; n<level.N_owned; ++n) {
+         for (int d=0; d<dimensions; ++d) for (int side=-1; side<=1; side+=2) {
+            std::array<int,3> node = level.nodes[n];
+            node[d] += side;
+            candidates.push_back(node);
+         }
+      }
+      findGhosts(mpiGrid,l,level,candidates);
+
+      const size_t N_nodes = level.nodes.size();
+      level.phi.assign(N_nodes,0);
+      level.rhs.assign(N_nodes,0);
+      level.residual.assign(N_nodes,0);
+      level.neighbors.assign(6*level.N_owned,-1);
+      for (size_t n=0; n<level.N_owned; ++n) {
+         for (int d=0; d<dimensions; ++d) for (int side=0; side<2; ++side) {
+            std::array<int,3> node = level.nodes[n];
+            node[d] += (side == 0) ? -1 : +1;
+            if (node[d] < 0 || node[d] >= level.size[d]) continue;
+            unordered_map<uint64_t,size_t>::const_iterator it = level.localIndex.find(level.key(node));
+            if (it != level.localIndex.end()) level.neighbors[6*n+2*d+side] = it->second;
+         }
+      }
+      coefficients(level);
+
+      // Ghost node distances are needed for the next coarser level
+      level.distance.resize(6*N_nodes);
+      updateGhosts(level,level.distance,6);
+
+      // Link the finer level to the nodes it restricts to
+      auto link = [&](const std::array<int,3>& f,CoarseLinks& links) {
+         const int count = coarseNodes(f,nodes,weights);
+         links.count = 0;
+         for (int i=0; i<count; ++i) {
+            bool inside = true;
+            for (int d=0; d<3; ++d) if (nodes[i][d] >= level.size[d]) inside = false;
+            if (inside == false) continue;
+            unordered_map<uint64_t,size_t>::const_iterator it = level.localIndex.find(level.key(nodes[i]));
+            if (it == level.localIndex.end()) continue;
+            links.node[links.count] = it->second;
+            links.weight[links.count] = weights[i];
+            ++links.count;
+         }
+      };
+      if (l == 0) {
+         for (int color=RED; color<=BLACK; ++color) {
+            FineCells* lists[2] = {&(innerCells[color]),&(bndryCells[color])};
+            for (int list=0; list<2; ++list) {
+               lists[list]->links.resize(lists[list]->cells.size());
+               for (size_t c=0; c<lists[list]->cells.size(); ++c) {
+                  const dccrg::Types<3>::indices_t& indices = lists[list]->indices[c];
+                  link({{(int)indices[0],(int)indices[1],(int)indices[2]}},lists[list]->links[c]);
+               }
+            }
+         }
+      } else {
+         DistributedLevel& finer = distributedLevels[l-1];
+         finer.links.resize(finer.N_owned);
+         for (size_t n=0; n<finer.N_owned; ++n) link(finer.nodes[n],finer.links[n]);
+      }
+   }
+
+   /** Build the coarse levels. Coarse levels with more than MAX_REPLICATED_NODES nodes 
+    * are distributed over processes like the fine level. The first smaller level is built 
+    * from the local cells or the last distributed level of all processes and summed, the 
+    * rest are coarsened from it on each process.
+    * @param mpiGrid Parallel grid library.*/
+   void PoissonSolverMG::buildLevels(dccrg::Dccrg<spatial_cell::SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid) {
+      levels.clear();
+      distributedLevels.clear();
+
+      const int dimensions = (Poisson::is2D == true) ? 2 : 3;
+      const int fineSize[3] = {(int)Parameters::xcells_ini,(int)Parameters::ycells_ini,(int)Parameters::zcells_ini};
+      const Real fineH[3] = {Parameters::dx_ini,Parameters::dy_ini,Parameters::dz_ini};
+      int size[3];
+      Real h[3];
+      for (int d=0; d<3; ++d) {
+         size[d] = (d < dimensions) ? fineSize[d]/2+1 : fineSize[d];
+         h[d]    = (d < dimensions) ? 2*fineH[d] : fineH[d];
+         if (d < dimensions && size[d] < MIN_NODES) return;
+      }
+
+      // Distribute the large levels, unless the grid cannot be coarsened further
+      bool coarsenable = true;
+      while ((size_t)size[0]*size[1]*size[2] > MAX_REPLICATED_NODES) {
+         distributedLevels.push_back(DistributedLevel());
+         buildDistributedLevel(mpiGrid,distributedLevels.size()-1,size,h);
+         for (int d=0; d<dimensions; ++d) {
+            size[d] = size[d]/2+1;
+            h[d] = 2*h[d];
+            if (size[d] < MIN_NODES) coarsenable = false;
+         }
+         if (coarsenable == false) break;
+      }
+
+      if (coarsenable == true) {
+         levels.push_back(MultigridLevel());
+         MultigridLevel& first = levels[0];
+         initializeLevel(first,size,h);
+
+         // Each process sets the distances of the coarse nodes that coincide with its 
+         // local cells or nodes of the last distributed level
+         if (distributedLevels.size() == 0) {
+            for (int color=RED; color<=BLACK; ++color) {
+               FineCells* lists[2] = {&(innerCells[color]),&(bndryCells[color])};
+               for (int l=0; l<2; ++l) {
+                  for (size_t c=0; c<lists[l]->cells.size(); ++c) {
+                     const dccrg::Types<3>::indices_t& indices = lists[l]->indices[c];
+                     bool coincides = true;
+                     for (int d=0; d<dimensions; ++d) if (indices[d] % 2 != 0) coincides = false;
+                     if (coincides == false) continue;
+
+                     const size_t node = first.index(indices[0]/2,indices[1]/2,(dimensions == 2) ? indices[2] : indices[2]/2);
+                     for (int d=0; d<3; ++d) for (int side=0; side<2; ++side) {
+                        first.distance[6*node+2*d+side] = (d < dimensions) ? fineDistance(mpiGrid,indices,lists[l]->cells[c][0][CellParams::DX+d],d,side) : first.h[d];
+                     }
+                  }
+               }
+            }
+         } else {
+            const DistributedLevel& finer = distributedLevels.back();
+            for (size_t n=0; n<finer.N_owned; ++n) {
+               const std::array<int,3>& f = finer.nodes[n];
+               bool coincides = true;
+               for (int d=0; d<dimensions; ++d) if (f[d] % 2 != 0) coincides = false;
+               if (coincides == false) continue;
+
+               const size_t node = first.index(f[0]/2,f[1]/2,(dimensions == 2) ? f[2] : f[2]/2);
+               for (int d=0; d<3; ++d) for (int side=0; side<2; ++side) {
+                  first.distance[6*node+2*d+side] = (d < dimensions) ? coarseDistance(finer,n,d,side,first.h[d]) : first.h[d];
+               }
+            }
+         }
+
+         MPI_Allreduce(MPI_IN_PLACE,&(first.distance[0]),first.distance.size(),MPI_Type<Real>(),MPI_SUM,MPI_COMM_WORLD);
+         for (size_t n=0; n<first.active.size(); ++n) {
+            if (first.distance[6*n] > 0) first.active[n] = 1;
+         }
+         coefficients(first);
+
+         // Coarsen until the coarsest level is small enough to be solved with plain sweeps
+         do {
+            for (int d=0; d<dimensions; ++d) {
+               size[d] = levels.back().size[d]/2+1;
+               h[d] = 2*levels.back().h[d];
+            }
+            for (int d=0; d<dimensions; ++d) if (size[d] < MIN_NODES) coarsenable = false;
+            if (coarsenable == false) break;
+
+            levels.push_back(MultigridLevel());
+            initializeLevel(levels.back(),size,h);
+            coarsen(levels[levels.size()-2],levels.back());
+         } while (true);
+      }
+
+      // Distances and node lookups are not needed after the stencils have been calculated
+      for (size_t l=0; l<levels.size(); ++l) vector<Real>().swap(levels[l].distance);
+      for (size_t l=0; l<distributedLevels.size(); ++l) {
+         vector<Real>().swap(distributedLevels[l].distance);
+         unordered_map<uint64_t,size_t>().swap(distributedLevels[l].localIndex);
+      }
+   }
+
+   /** Perform one Gauss-Seidel update on the given fine level cells.
+    * @param cells Cells of one color.*/
+   void PoissonSolverMG::smooth(FineCells& cells) {
+      vector<CellCache3D<mgvar::SIZE> >& cellPointers = cells.cells;
+      const bool is2D = Poisson::is2D;
+
+      #pragma omp parallel for
+      for (size_t c=0; c<cellPointers.size(); ++c) {
+         const Real DX2 = cellPointers[c][0][CellParams::DX]*cellPointers[c][0][CellParams::DX];
+         const Real DY2 = cellPointers[c][0][CellParams::DY]*cellPointers[c][0][CellParams::DY];
+         const Real rho_q = cellPointers[c][0][CellParams::RHOQ_TOT];
+
+         Real factor = 2*(1/DX2 + 1/DY2);
+         Real rhs = (cellPointers[c][1][CellParams::PHI] + cellPointers[c][2][CellParams::PHI])/DX2
+                  + (cellPointers[c][3][CellParams::PHI] + cellPointers[c][4][CellParams::PHI])/DY2
+                  + rho_q;
+         if (is2D == false) {
+            const Real DZ2 = cellPointers[c][0][CellParams::DZ]*cellPointers[c][0][CellParams::DZ];
+            factor += 2/DZ2;
+            rhs += (cellPointers[c][5][CellParams::PHI] + cellPointers[c][6][CellParams::PHI])/DZ2;
+         }
+         cellPointers[c][0][CellParams::PHI] = rhs/factor;
+      }
+   }
+
+   /** Smooth the fine level with red-black Gauss-Seidel. Process boundary cells of 
+    * each color are updated first so that the exchange overlaps with the inner cells.
+    * @param mpiGrid Parallel grid library.
+    * @param sweeps Number of sweeps.
+    * @param reverse If true, black cells are updated before red cells.*/
+   void PoissonSolverMG::smoothFine(dccrg::Dccrg<spatial_cell::SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                                    const int& sweeps,const bool& reverse) {
+      phiprof::start("Smooth");
+      SpatialCell::set_mpi_transfer_type(Transfer::CELL_PHI,false);
+      for (int s=0; s<sweeps; ++s) {
+         for (int c=0; c<2; ++c) {
+            const int color = (reverse == true) ? 1-c : c;
+            smooth(bndryCells[color]);
+            mpiGrid.start_remote_neighbor_copy_updates(POISSON_NEIGHBORHOOD_ID);
+            smooth(innerCells[color]);
+            mpiGrid.wait_remote_neighbor_copy_updates(POISSON_NEIGHBORHOOD_ID);
+         }
+      }
+      size_t N_cells = 0;
+      for (int color=RED; color<=BLACK; ++color) N_cells += innerCells[color].cells.size() + bndryCells[color].cells.size();
+      phiprof::stop("Smooth",N_cells*sweeps,"Spatial Cells");
+   }
+
+   /** Calculate the residual rho_q + nabla^2 phi on the given fine level cells. 
+    * The error measure of the cell, the residual times cell size squared as in 
+    * PoissonSolver::error, is written to CellParams::PHI_TMP.
+    * @param cells Fine level cells.
+    * @return Maximum error measure of the cells.*/
+   Real PoissonSolverMG::residual(FineCells& cells) {
+      vector<CellCache3D<mgvar::SIZE> >& cellPointers = cells.cells;
+      const bool is2D = Poisson::is2D;
+      Real maxError = 0;
+
+      #pragma omp parallel
+      {
+         Real myMaxError = 0;
+         #pragma omp for nowait
+         for (size_t c=0; c<cellPointers.size(); ++c) {
+            const Real DX2 = cellPointers[c][0][CellParams::DX]*cellPointers[c][0][CellParams::DX];
+            const Real DY2 = cellPointers[c][0][CellParams::DY]*cellPointers[c][0][CellParams::DY];
+            const Real phi_111 = cellPointers[c][0][CellParams::PHI];
+
+            Real laplacian = (cellPointers[c][1][CellParams::PHI] + cellPointers[c][2][CellParams::PHI] - 2*phi_111)/DX2
+                           + (cellPointers[c][3][CellParams::PHI] + cellPointers[c][4][CellParams::PHI] - 2*phi_111)/DY2;
+            if (is2D == false) {
+               const Real DZ2 = cellPointers[c][0][CellParams::DZ]*cellPointers[c][0][CellParams::DZ];
+               laplacian += (cellPointers[c][5][CellParams::PHI] + cellPointers[c][6][CellParams::PHI] - 2*phi_111)/DZ2;
+            }
+
+            const Real cellResidual = cellPointers[c][0][CellParams::RHOQ_TOT] + laplacian;
+            const Real cellError = fabs(cellResidual)*DX2;
+            cellPointers[c].variables[mgvar::RESIDUAL] = cellResidual;
+            cellPointers[c][0][CellParams::PHI_TMP] = cellError;
+            if (cellError > myMaxError) myMaxError = cellError;
+         }
+         #pragma omp critical
+         {
+            if (myMaxError > maxError) maxError = myMaxError;
+         }
+      }
+      return maxError;
+   }
+
+   /** Calculate the residual of a coarse level.
+    * @param level Coarse level.*/
+   void PoissonSolverMG::residual(MultigridLevel& level) {
+      const int rows = level.size[1]*level.size[2];
+      const long int sx = level.stride[0];
+      const long int sy = level.stride[1];
+      const long int sz = level.stride[2];
+
+      #pragma omp parallel for
+      for (int row=0; row<rows; ++row) {
+         const int j = row % level.size[1];
+         const int k = row / level.size[1];
+         for (int i=0; i<level.size[0]; ++i) {
+            const size_t n = level.index(i,j,k);
+            if (level.active[n] == 0) {
+               level.residual[n] = 0;
+               continue;
+            }
+            const Real* coeff = &(level.coeff[7*n]);
+            const Real* phi = &(level.phi[n]);
+            level.residual[n] = level.rhs[n] - coeff[0]*phi[0]
+                              + coeff[1]*phi[-sx] + coeff[2]*phi[sx]
+                              + coeff[3]*phi[-sy] + coeff[4]*phi[sy]
+                              + coeff[5]*phi[-sz] + coeff[6]*phi[sz];
+         }
+      }
+   }
+
+   /** Perform one Gauss-Seidel update on the nodes of one color on a coarse level.
+    * @param level Coarse level.
+    * @param color Color of the updated nodes.*/
+   void PoissonSolverMG::smooth(MultigridLevel& level,const int& color) {
+      const int rows = level.size[1]*level.size[2];
+      const long int sx = level.stride[0];
+      const long int sy = level.stride[1];
+      const long int sz = level.stride[2];
+
+      #pragma omp parallel for
+      for (int row=0; row<rows; ++row) {
+         const int j = row % level.size[1];
+         const int k = row / level.size[1];
+         for (int i=(j+k+color)%2; i<level.size[0]; i+=2) {
+            const size_t n = level.index(i,j,k);
+            if (level.active[n] == 0) continue;
+            const Real* coeff = &(level.coeff[7*n]);
+            Real* phi = &(level.phi[n]);
+            phi[0] = (level.rhs[n]
+                      + coeff[1]*phi[-sx] + coeff[2]*phi[sx]
+                      + coeff[3]*phi[-sy] + coeff[4]*phi[sy]
+                      + coeff[5]*phi[-sz] + coeff[6]*phi[sz]) / coeff[0];
+         }
+      }
+   }
+
+   /** Calculate the residual of the owned nodes of a distributed level.
+    * @param level Distributed level.*/
+   void PoissonSolverMG::residual(DistributedLevel& level) {
+      updateGhosts(level,level.phi,1);
+
+      #pragma omp parallel for
+      for (size_t n=0; n<level.N_owned; ++n) {
+         const Real* coeff = &(level.coeff[7*n]);
+         const long int* nbrs = &(level.neighbors[6*n]);
+         Real value = level.rhs[n] - coeff[0]*level.phi[n];
+         for (int i=0; i<6; ++i) if (nbrs[i] >= 0) value += coeff[1+i]*level.phi[nbrs[i]];
+         level.residual[n] = value;
+      }
+   }
+
+   /** Perform one Gauss-Seidel update on the owned nodes of one color on a distributed level.
+    * The ghost nodes are updated first.
+    * @param level Distributed level.
+    * @param color Color of the updated nodes.*/
+   void PoissonSolverMG::smooth(DistributedLevel& level,const int& color) {
+      updateGhosts(level,level.phi,1);
+
+      #pragma omp parallel for
+      for (size_t n=0; n<level.N_owned; ++n) {
+         const std::array<int,3>& node = level.nodes[n];
+         if ((node[0]+node[1]+node[2]) % 2 != color) continue;
+         const Real* coeff = &(level.coeff[7*n]);
+         const long int* nbrs = &(level.neighbors[6*n]);
+         Real value = level.rhs[n];
+         for (int i=0; i<6; ++i) if (nbrs[i] >= 0) value += coeff[1+i]*level.phi[nbrs[i]];
+         level.phi[n] = value / coeff[0];
+      }
+   }
+
+   /** Restrict the residual of a distributed level to the next coarser distributed level 
+    * with full weighting, the correction on the coarser level is cleared.
+    * @param fine Distributed level with up-to-date residual.
+    * @param coarse Next coarser distributed level.*/
+   void PoissonSolverMG::restrictResidual(const DistributedLevel& fine,DistributedLevel& coarse) {
+      std::fill(coarse.phi.begin(),coarse.phi.end(),0);
+      std::fill(coarse.rhs.begin(),coarse.rhs.end(),0);
+
+      #pragma omp parallel for
+      for (size_t n=0; n<fine.N_owned; ++n) {
+         const CoarseLinks& links = fine.links[n];
+         for (int i=0; i<links.count; ++i) {
+            const Real value = links.weight[i]*fine.residual[n];
+            #pragma omp atomic
+            coarse.rhs[links.node[i]] += value;
+         }
+      }
+      sumGhosts(coarse,coarse.rhs);
+   }
+
+   /** Restrict the residual of the last distributed level to the first replicated level 
+    * with full weighting and sum it over processes, the correction on the replicated 
+    * level is cleared.
+    * @param fine Distributed level with up-to-date residual.
+    * @param coarse First replicated level.*/
+   void PoissonSolverMG::restrictResidual(const DistributedLevel& fine,MultigridLevel& coarse) {
+      std::fill(coarse.phi.begin(),coarse.phi.end(),0);
+      std::fill(coarse.rhs.begin(),coarse.rhs.end(),0);
+
+      #pragma omp parallel for
+      for (size_t n=0; n<fine.N_owned; ++n) {
+         std::array<int,3> nodes[8];
+         Real weights[8];
+         const int count = coarseNodes(fine.nodes[n],nodes,weights);
+         for (int i=0; i<count; ++i) {
+            if (nodes[i][0] >= coarse.size[0] || nodes[i][1] >= coarse.size[1] || nodes[i][2] >= coarse.size[2]) continue;
+            const Real value = weights[i]*fine.residual[n];
+            #pragma omp atomic
+            coarse.rhs[coarse.index(nodes[i][0],nodes[i][1],nodes[i][2])] += value;
+         }
+      }
+      MPI_Allreduce(MPI_IN_PLACE,&(coarse.rhs[0]),coarse.rhs.size(),MPI_Type<Real>(),MPI_SUM,MPI_COMM_WORLD);
+   }
+
+   /** Restrict the residual of a coarse level to the next coarser level with full 
+    * weighting, the correction on the coarser level is cleared.
+    * @param fine Fine level with up-to-date residual.
+    * @param coarse Next coarser level.*/
+   void PoissonSolverMG::restrictResidual(const MultigridLevel& fine,MultigridLevel& coarse) {
+      const int dimensions = (Poisson::is2D == true) ? 2 : 3;
+      const int rows = coarse.size[1]*coarse.size[2];
+      const int zRange = (dimensions == 2) ? 0 : 1;
+      const Real weights[3] = {0.25,0.5,0.25};
+
+      #pragma omp parallel for
+      for (int row=0; row<rows; ++row) {
+         const int j = row % coarse.size[1];
+         const int k = row / coarse.size[1];
+         for (int i=0; i<coarse.size[0]; ++i) {
+            const size_t n = coarse.index(i,j,k);
+            coarse.phi[n] = 0;
+            coarse.rhs[n] = 0;
+            if (coarse.active[n] == 0) continue;
+
+            const int fk = (dimensions == 2) ? k : 2*k;
+            Real sum = 0;
+            for (int c=-zRange; c<=zRange; ++c) for (int b=-1; b<=1; ++b) for (int a=-1; a<=1; ++a) {
+               const int f[3] = {2*i+a,2*j+b,fk+c};
+               if (f[0] < 0 || f[1] < 0 || f[2] < 0) continue;
+               if (f[0] >= fine.size[0] || f[1] >= fine.size[1] || f[2] >= fine.size[2]) continue;
+               const Real weight = weights[a+1]*weights[b+1]*((dimensions == 2) ? 1 : weights[c+1]);
+               sum += weight*fine.residual[fine.index(f[0],f[1],f[2])];
+            }
+            coarse.rhs[n] = sum;
+         }
+      }
+   }
+
+   /** Add the full weighting contributions of the residuals of the given fine level 
+    * cells to the right-hand side of the first coarse level.
+    * @param cells Fine level cells with up-to-date residual.
+    * @param coarse First coarse level.*/
+   void PoissonSolverMG::restrictResidual(const FineCells& cells,MultigridLevel& coarse) {
+      const int dimensions = (Poisson::is2D == true) ? 2 : 3;
+
+      #pragma omp parallel for
+      for (size_t c=0; c<cells.cells.size(); ++c) {
+         // Each fine cell contributes to the coinciding coarse node with weight 1/2, 
+         // or to the two coarse nodes on both sides with weight 1/4, per dimension
+         int nodes[3][2];
+         Real weights[3][2];
+         int count[3];
+         for (int d=0; d<3; ++d) {
+            const int index = cells.indices[c][d];
+            if (d >= dimensions) {
+               nodes[d][0] = index; weights[d][0] = 1; count[d] = 1;
+            } else if (index % 2 == 0) {
+               nodes[d][0] = index/2; weights[d][0] = 0.5; count[d] = 1;
+            } else {
+               nodes[d][0] = index/2;   weights[d][0] = 0.25;
+               nodes[d][1] = index/2+1; weights[d][1] = 0.25;
+               count[d] = 2;
+            }
+         }
+
+         const Real cellResidual = cells.cells[c].variables[mgvar::RESIDUAL];
+         for (int k=0; k<count[2]; ++k) for (int j=0; j<count[1]; ++j) for (int i=0; i<count[0]; ++i) {
+            if (nodes[0][i] >= coarse.size[0] || nodes[1][j] >= coarse.size[1] || nodes[2][k] >= coarse.size[2]) continue;
+            const size_t n = coarse.index(nodes[0][i],nodes[1][j],nodes[2][k]);
+            const Real value = weights[0][i]*weights[1][j]*weights[2][k]*cellResidual;
+            #pragma omp atomic
+            coarse.rhs[n] += value;
+         }
+      }
+   }
+
+   /** Add the full weighting contributions of the residuals of the given fine level 
+    * cells to the right-hand side of the first coarse level, when it is distributed.
+    * @param cells Fine level cells with up-to-date residual.
+    * @param coarse First distributed level.*/
+   void PoissonSolverMG::restrictResidual(const FineCells& cells,DistributedLevel& coarse) {
+      #pragma omp parallel for
+      for (size_t c=0; c<cells.cells.size(); ++c) {
+         const CoarseLinks& links = cells.links[c];
+         const Real cellResidual = cells.cells[c].variables[mgvar::RESIDUAL];
+         for (int i=0; i<links.count; ++i) {
+            const Real value = links.weight[i]*cellResidual;
+            #pragma omp atomic
+            coarse.rhs[links.node[i]] += value;
+         }
+      }
+   }
+
+   /** Restrict the fine level residual to the first coarse level. A distributed level is 
+    * summed from ghost nodes to their owners, a replicated one over all processes.*/
+   void PoissonSolverMG::restrictFine() {
+      if (distributedLevels.size() > 0) {
+         phiprof::start("Restrict");
+         DistributedLevel& coarse = distributedLevels[0];
+         std::fill(coarse.phi.begin(),coarse.phi.end(),0);
+         std::fill(coarse.rhs.begin(),coarse.rhs.end(),0);
+         for (int color=RED; color<=BLACK; ++color) {
+            restrictResidual(innerCells[color],coarse);
+            restrictResidual(bndryCells[color],coarse);
+         }
+         phiprof::stop("Restrict");
+
+         phiprof::start("MPI (Restrict)");
+         sumGhosts(coarse,coarse.rhs);
+         phiprof::stop("MPI (Restrict)");
+         return;
+      }
+
+      phiprof::start("Restrict");
+      MultigridLevel& coarse = levels[0];
+      #pragma omp parallel for
+      for (size_t n=0; n<coarse.rhs.size(); ++n) {
+         coarse.rhs[n] = 0;
+         coarse.phi[n] = 0;
+      }
+
+      for (int color=RED; color<=BLACK; ++color) {
+         restrictResidual(innerCells[color],coarse);
+         restrictResidual(bndryCells[color],coarse);
+      }
+      phiprof::stop("Restrict");
+
+      phiprof::start("MPI (Restrict)");
+      MPI_Allreduce(MPI_IN_PLACE,&(coarse.rhs[0]),coarse.rhs.size(),MPI_Type<Real>(),MPI_SUM,MPI_COMM_WORLD);
+      phiprof::stop("MPI (Restrict)");
+   }
+
+   /** Interpolate the correction of a coarse level (multi)linearly and add it to the next finer level.
+    * @param coarse Coarse level.
+    * @param fine Next finer level.*/
+   void PoissonSolverMG::prolongate(const MultigridLevel& coarse,MultigridLevel& fine) {
+      const int dimensions = (Poisson::is2D == true) ? 2 : 3;
+      const int rows = fine.size[1]*fine.size[2];
+
+      #pragma omp parallel for
+      for (int row=0; row<rows; ++row) {
+         const int j = row % fine.size[1];
+         const int k = row / fine.size[1];
+         for (int i=0; i<fine.size[0]; ++i) {
+            const size_t n = fine.index(i,j,k);
+            if (fine.active[n] == 0) continue;
+
+            const int K = (dimensions == 2) ? k : k/2;
+            const int ni = i % 2;
+            const int nj = j % 2;
+            const int nk = (dimensions == 2) ? 0 : k % 2;
+            Real correction = 0;
+            for (int c=0; c<=nk; ++c) for (int b=0; b<=nj; ++b) for (int a=0; a<=ni; ++a) {
+               correction += coarse.phi[coarse.index(i/2+a,j/2+b,K+c)];
+            }
+            fine.phi[n] += correction / ((1 << ni)*(1 << nj)*(1 << nk));
+         }
+      }
+   }
+
+   /** Interpolate the correction of the first replicated level (multi)linearly and add it 
+    * to the owned nodes of the last distributed level.
+    * @param coarse First replicated level.
+    * @param fine Last distributed level.*/
+   void PoissonSolverMG::prolongate(const MultigridLevel& coarse,DistributedLevel& fine) {
+      const int dimensions = (Poisson::is2D == true) ? 2 : 3;
+
+      #pragma omp parallel for
+      for (size_t n=0; n<fine.N_owned; ++n) {
+         std::array<int,3> nodes[8];
+         Real weights[8];
+         const int count = coarseNodes(fine.nodes[n],nodes,weights);
+         Real correction = 0;
+         for (int i=0; i<count; ++i) {
+            correction += weights[i]*coarse.phi[coarse.index(nodes[i][0],nodes[i][1],nodes[i][2])];
+         }
+         fine.phi[n] += (1 << dimensions)*correction;
+      }
+   }
+
+   /** Interpolate the correction of a distributed level (multi)linearly and add it to the 
+    * owned nodes of the next finer distributed level.
+    * @param coarse Distributed level, its ghost nodes are updated first.
+    * @param fine Next finer distributed level.*/
+   void PoissonSolverMG::prolongate(DistributedLevel& coarse,DistributedLevel& fine) {
+      const int dimensions = (Poisson::is2D == true) ? 2 : 3;
+      updateGhosts(coarse,coarse.phi,1);
+
+      #pragma omp parallel for
+      for (size_t n=0; n<fine.N_owned; ++n) {
+         const CoarseLinks& links = fine.links[n];
+         Real correction = 0;
+         for (int i=0; i<links.count; ++i) correction += links.weight[i]*coarse.phi[links.node[i]];
+         fine.phi[n] += (1 << dimensions)*correction;
+      }
+   }
+
+   /** Interpolate the correction of the first coarse level and add it to the potential of the given fine level cells.
+    * If the first coarse level is distributed, its ghost nodes must be up to date.
+    * @param cells Fine level cells.*/
+   void PoissonSolverMG::prolongate(FineCells& cells) {
+      const int dimensions = (Poisson::is2D == true) ? 2 : 3;
+      if (distributedLevels.size() > 0) {
+         const DistributedLevel& coarse = distributedLevels[0];
+
+         #pragma omp parallel for
+         for (size_t c=0; c<cells.cells.size(); ++c) {
+            const CoarseLinks& links = cells.links[c];
+            Real correction = 0;
+            for (int i=0; i<links.count; ++i) correction += links.weight[i]*coarse.phi[links.node[i]];
+            cells.cells[c][0][CellParams::PHI] += (1 << dimensions)*correction;
+         }
+         return;
+      }
+
+      const MultigridLevel& coarse = levels[0];
+
+      #pragma omp parallel for
+      for (size_t c=0; c<cells.cells.size(); ++c) {
+         const dccrg::Types<3>::indices_t& indices = cells.indices[c];
+         const int K = (dimensions == 2) ? indices[2] : indices[2]/2;
+         const int ni = indices[0] % 2;
+         const int nj = indices[1] % 2;
+         const int nk = (dimensions == 2) ? 0 : indices[2] % 2;
+         Real correction = 0;
+         for (int k=0; k<=nk; ++k) for (int j=0; j<=nj; ++j) for (int i=0; i<=ni; ++i) {
+            correction += coarse.phi[coarse.index(indices[0]/2+i,indices[1]/2+j,K+k)];
+         }
+         cells.cells[c][0][CellParams::PHI] += correction / ((1 << ni)*(1 << nj)*(1 << nk));
+      }
+   }
+
+   /** Add the coarse grid correction to the fine level and update remote copies of the potential.
+    * @param mpiGrid Parallel grid library.*/
+   void PoissonSolverMG::prolongateFine(dccrg::Dccrg<spatial_cell::SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid) {
+      phiprof::start("Prolongate");
+      if (distributedLevels.size() > 0) updateGhosts(distributedLevels[0],distributedLevels[0].phi,1);
+      SpatialCell::set_mpi_transfer_type(Transfer::CELL_PHI,false);
+      for (int color=RED; color<=BLACK; ++color) prolongate(bndryCells[color]);
+      mpiGrid.start_remote_neighbor_copy_updates(POISSON_NEIGHBORHOOD_ID);
+      for (int color=RED; color<=BLACK; ++color) prolongate(innerCells[color]);
+      mpiGrid.wait_remote_neighbor_copy_updates(POISSON_NEIGHBORHOOD_ID);
+      phiprof::stop("Prolongate");
+   }
+
+   /** Solve the residual equation on the given coarse level and all coarser levels 
+    * with a V-cycle. The coarsest level is solved with plain red-black sweeps.
+    * @param level Index of the coarse level.*/
+   void PoissonSolverMG::vcycle(const size_t& level) {
+      MultigridLevel& current = levels[level];
+
+      if (level+1 == levels.size()) {
+         const int sweeps = 2*(current.size[0] + current.size[1] + current.size[2]);
+         for (int s=0; s<sweeps; ++s) {
+            smooth(current,RED);
+            smooth(current,BLACK);
+         }
+         return;
+      }
+
+      for (int s=0; s<PRE_SWEEPS; ++s) {
+         smooth(current,RED);
+         smooth(current,BLACK);
+      }
+      residual(current);
+      restrictResidual(current,levels[level+1]);
+      vcycle(level+1);
+      prolongate(levels[level+1],current);
+      for (int s=0; s<POST_SWEEPS; ++s) {
+         smooth(current,BLACK);
+         smooth(current,RED);
+      }
+   }
+
+   /** Solve the residual equation on the given distributed level and all coarser levels 
+    * with a V-cycle, continuing on the replicated levels after the last distributed one. 
+    * If there are no replicated levels, the last distributed level is solved with plain 
+    * red-black sweeps.
+    * @param level Index of the distributed level.*/
+   void PoissonSolverMG::vcycleDistributed(const size_t& level) {
+      DistributedLevel& current = distributedLevels[level];
+      const bool last = (level+1 == distributedLevels.size());
+
+      if (last == true && levels.size() == 0) {
+         const int sweeps = 2*(current.size[0] + current.size[1] + current.size[2]);
+         for (int s=0; s<sweeps; ++s) {
+            smooth(current,RED);
+            smooth(current,BLACK);
+         }
+         return;
+      }
+
+      for (int s=0; s<PRE_SWEEPS; ++s) {
+         smooth(current,RED);
+         smooth(current,BLACK);
+      }
+      residual(current);
+      if (last == true) {
+         restrictResidual(current,levels[0]);
+         vcycle(0);
+         prolongate(levels[0],current);
+      } else {
+         restrictResidual(current,distributedLevels[level+1]);
+         vcycleDistributed(level+1);
+         prolongate(distributedLevels[level+1],current);
+      }
+      for (int s=0; s<POST_SWEEPS; ++s) {
+         smooth(current,BLACK);
+         smooth(current,RED);
+      }
+   }
+
+   bool PoissonSolverMG::solve(dccrg::Dccrg<spatial_cell::SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid) {
+      bool success = true;
+
+      // If mesh partitioning has changed, recalculate pointer caches and the coarse levels
+      if (Parameters::meshRepartitioned == true) {
+         phiprof::start("Pointer Caching");
+         cachePointers(mpiGrid,mpiGrid.get_local_cells_on_process_boundary(POISSON_NEIGHBORHOOD_ID),bndryCells);
+         cachePointers(mpiGrid,mpiGrid.get_local_cells_not_on_process_boundary(POISSON_NEIGHBORHOOD_ID),innerCells);
+         phiprof::stop("Pointer Caching");
+
+         phiprof::start("Build Levels");
+         buildLevels(mpiGrid);
+         phiprof::stop("Build Levels");
+      }
+
+      // Calculate charge density, only local values are needed
+      phiprof::start("Charge Density");
+      const vector<CellID>& cells = getLocalCells();
+      #pragma omp parallel for
+      for (size_t c=0; c<cells.size(); ++c) {
+         calculateChargeDensitySingle(mpiGrid[cells[c]]);
+      }
+      phiprof::stop("Charge Density");
+
+      Real t_start = 0;
+      if (Parameters::prepareForRebalance == true) t_start = MPI_Wtime();
+
+      // Iterate V-cycles until the error is less than the required value. 
+      // The error is evaluated after pre-smoothing, so that the residual 
+      // is also used for the coarse grid correction.
+      phiprof::start("V-cycles");
+      uint cycles = 0;
+      do {
+         smoothFine(mpiGrid,PRE_SWEEPS,false);
+
+         phiprof::start("Residual");
+         Real maxError = 0;
+         for (int color=RED; color<=BLACK; ++color) {
+            maxError = max(maxError,residual(innerCells[color]));
+            maxError = max(maxError,residual(bndryCells[color]));
+         }
+         phiprof::stop("Residual");
+
+         phiprof::start("MPI (Residual)");
+         Real globalMaxError;
+         MPI_Allreduce(&maxError,&globalMaxError,1,MPI_Type<Real>(),MPI_MAX,MPI_COMM_WORLD);
+         phiprof::stop("MPI (Residual)");
+
+         if (globalMaxError < Poisson::maxAbsoluteError) break;
+         if (cycles >= Poisson::maxIterations) break;
+
+         if (distributedLevels.size() > 0 || levels.size() > 0) {
+            restrictFine();
+            phiprof::start("Coarse Levels");
+            if (distributedLevels.size() > 0) vcycleDistributed(0);
+            else vcycle(0);
+            phiprof::stop("Coarse Levels");
+            prolongateFine(mpiGrid);
+         }
+
+         smoothFine(mpiGrid,POST_SWEEPS,true);
+         ++cycles;
+      } while (true);
+      phiprof::stop("V-cycles",cycles,"V-cycles");
+
+      // Measure computation time (if needed)
+      if (Parameters::prepareForRebalance == true) {
+         size_t N_cells = 0;
+         for (int color=RED; color<=BLACK; ++color) N_cells += innerCells[color].cells.size() + bndryCells[color].cells.size();
+         const Real t_average = (MPI_Wtime() - t_start) / max((size_t)1,N_cells);
+
+         for (int color=RED; color<=BLACK; ++color) {
+            FineCells* lists[2] = {&(innerCells[color]),&(bndryCells[color])};
+            for (int l=0; l<2; ++l) {
+               #pragma omp parallel for
+               for (size_t c=0; c<lists[l]->cells.size(); ++c) {
+                  lists[l]->cells[c][0][CellParams::LBWEIGHTCOUNTER] += t_average;
+               }
+            }
+         }
+      }
+
+      if (calculateElectrostaticField(mpiGrid) == false) {
+         logFile << "(POISSON SOLVER MG) ERROR: Failed to calculate electrostatic field in ";
+         logFile << __FILE__ << ":" << __LINE__ << endl << write;
+         success = false;
+      }
+
+      return success;
+   }
+
+} // namespace poisson
@@ -0,0 +1,179 @@
+/*
+ * This file is part of Vlasiator.
+ * Copyright 2010-2016 Finnish Meteorological Institute
+ *
+ * For details of usage, see the COPYING file and read the "Rules of the Road"
+ * at http://www.physics.helsinki.fi/vlasiator/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * 
+ * File:   poisson_solver_mg.h
+ */
+
+#ifndef POISSON_SOLVER_MG_H
+#define	POISSON_SOLVER_MG_H
+
+#include <array>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+#include "poisson_solver.h"
+
+namespace poisson {
+
+   namespace mgvar {
+      enum Variable {
+         RESIDUAL,   /**< Residual rho_q + nabla^2 phi of the fine level.*/
+         SIZE
+      };
+   }
+
+   /** One of the small coarse levels of the multigrid hierarchy. The level is a structured 
+    * array of nodes covering the whole simulation box, with one layer of padding nodes 
+    * on each side, and it is replicated on all processes. Coarse node (i,j,k) 
+    * coincides with node (2i,2j,2k) of the next finer level (in 2D runs z is not coarsened).*/
+   struct MultigridLevel {
+      int size[3];                      /**< Number of nodes per dimension, without padding.*/
+      size_t stride[3];                 /**< Index strides of the padded array.*/
+      Real h[3];                        /**< Node spacing.*/
+      std::vector<Real> phi;            /**< Potential correction.*/
+      std::vector<Real> rhs;            /**< Restricted residual of the finer level.*/
+      std::vector<Real> residual;       /**< Residual of this level.*/
+      std::vector<Real> coeff;          /**< Stencil per node: diagonal, -x,+x,-y,+y,-z,+z.*/
+      std::vector<Real> distance;       /**< Distance to the neighbor or the boundary per node and 
+                                         * direction, only needed while the hierarchy is built.*/
+      std::vector<char> active;         /**< If 1, the node is an unknown.*/
+
+      size_t index(const int& i,const int& j,const int& k) const {
+         return (i+1)*stride[0] + (j+1)*stride[1] + (k+1)*stride[2];
+      }
+   };
+
+   /** Nodes of a distributed coarse level that a cell or node of the next finer level 
+    * restricts to and interpolates from, as local node indices, with their full weighting 
+    * weights. The interpolation weights are the same times 2^dimensions.*/
+   struct CoarseLinks {
+      int count;
+      size_t node[8];
+      Real weight[8];
+   };
+
+   /** One of the large coarse levels of the multigrid hierarchy, distributed over processes 
+    * like the dccrg grid: a node belongs to the process of the fine cell it coincides with. 
+    * Only active nodes are stored, the owned nodes first and then ghost copies of the nodes 
+    * of other processes needed by the stencils of the owned nodes or by the next finer level.*/
+   struct DistributedLevel {
+      int size[3];                      /**< Number of nodes per dimension in the whole box.*/
+      Real h[3];                        /**< Node spacing.*/
+      size_t N_owned;                   /**< Number of owned nodes.*/
+      std::vector<std::array<int,3> > nodes; /**< Indices of the owned and ghost nodes.*/
+      std::vector<Real> phi;            /**< Potential correction per owned and ghost node.*/
+      std::vector<Real> rhs;            /**< Restricted residual of the finer level per owned and ghost node.*/
+      std::vector<Real> residual;       /**< Residual per owned node.*/
+      std::vector<Real> coeff;          /**< Stencil per owned node as in MultigridLevel.*/
+      std::vector<long int> neighbors;  /**< Local index of the -x,+x,-y,+y,-z,+z neighbor per owned node, -1 if inactive.*/
+      std::vector<CoarseLinks> links;   /**< Nodes of the next coarser distributed level per owned node.*/
+      std::vector<Real> distance;       /**< As in MultigridLevel per owned and ghost node, only 
+                                         * needed while the hierarchy is built.*/
+      std::unordered_map<uint64_t,size_t> localIndex; /**< Local index of each node, only needed 
+                                                       * while the hierarchy is built.*/
+      std::vector<int> sendRanks;       /**< Processes that have ghost copies of owned nodes.*/
+      std::vector<std::vector<size_t> > sendNodes; /**< Owned nodes copied to each of sendRanks.*/
+      std::vector<int> recvRanks;       /**< Processes that own the ghost nodes.*/
+      std::vector<std::vector<size_t> > recvNodes; /**< Ghost nodes owned by each of recvRanks.*/
+      std::vector<std::vector<Real> > sendBuffers;
+      std::vector<std::vector<Real> > recvBuffers;
+
+      uint64_t key(const std::array<int,3>& node) const {
+         return node[0] + (uint64_t)size[0]*(node[1] + (uint64_t)size[1]*node[2]);
+      }
+   };
+
+   /** Geometric multigrid solver. The fine level is the dccrg grid, smoothed with red-black 
+    * Gauss-Seidel through CellCache3D neighbor pointers. The residual is restricted with 
+    * full weighting to the first coarse level. Coarse levels with many nodes are distributed 
+    * with the dccrg partition and exchange ghost nodes with their neighbor processes, the 
+    * first small one is summed over processes and every process then runs the same V-cycle 
+    * on it and the coarser levels. Coarse stencils use the actual distance to the 
+    * nearest system boundary cell, so the number of V-cycles stays nearly independent of 
+    * the grid size also when the box is not a power of two in size.*/
+   class PoissonSolverMG: public PoissonSolver {
+   public:
+      PoissonSolverMG();
+      ~PoissonSolverMG();
+
+      bool calculateElectrostaticField(dccrg::Dccrg<spatial_cell::SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid);
+      bool initialize();
+      bool finalize();
+      bool solve(dccrg::Dccrg<spatial_cell::SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid);
+
+   private:
+
+      /** Local cells of the fine level and their dccrg indices.*/
+      struct FineCells {
+         std::vector<poisson::CellCache3D<mgvar::SIZE> > cells;
+         std::vector<dccrg::Types<3>::indices_t> indices;
+         std::vector<CoarseLinks> links; /**< Nodes of the first coarse level, if it is distributed.*/
+         void clear() {cells.clear(); indices.clear(); links.clear();}
+      };
+
+      FineCells innerCells[2];          /**< Cells not on process boundary, red and black.*/
+      FineCells bndryCells[2];          /**< Cells on process boundary, red and black.*/
+      std::vector<DistributedLevel> distributedLevels; /**< Large coarse levels, finest first.*/
+      std::vector<MultigridLevel> levels;              /**< Small coarse levels, finest first.*/
+
+      void buildDistributedLevel(dccrg::Dccrg<spatial_cell::SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                                 const size_t& l,const int size[3],const Real h[3]);
+      void buildLevels(dccrg::Dccrg<spatial_cell::SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid);
+      void cachePointers(dccrg::Dccrg<spatial_cell::SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                         const std::vector<CellID>& cells,FineCells* cache);
+      void coarsen(const MultigridLevel& fine,MultigridLevel& coarse);
+      void coefficients(MultigridLevel& level);
+      void coefficients(DistributedLevel& level);
+      void findGhosts(dccrg::Dccrg<spatial_cell::SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                      const size_t& l,DistributedLevel& level,const std::vector<std::array<int,3> >& candidates);
+      void initializeLevel(MultigridLevel& level,const int size[3],const Real h[3]);
+
+      void prolongate(const MultigridLevel& coarse,MultigridLevel& fine);
+      void prolongate(const MultigridLevel& coarse,DistributedLevel& fine);
+      void prolongate(DistributedLevel& coarse,DistributedLevel& fine);
+      void prolongate(FineCells& cells);
+      void prolongateFine(dccrg::Dccrg<spatial_cell::SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid);
+      Real residual(FineCells& cells);
+      void residual(MultigridLevel& level);
+      void residual(DistributedLevel& level);
+      void restrictResidual(const MultigridLevel& fine,MultigridLevel& coarse);
+      void restrictResidual(const DistributedLevel& fine,MultigridLevel& coarse);
+      void restrictResidual(const DistributedLevel& fine,DistributedLevel& coarse);
+      void restrictResidual(const FineCells& cells,MultigridLevel& coarse);
+      void restrictResidual(const FineCells& cells,DistributedLevel& coarse);
+      void restrictFine();
+      void smooth(FineCells& cells);
+      void smooth(MultigridLevel& level,const int& color);
+      void smooth(DistributedLevel& level,const int& color);
+      void smoothFine(dccrg::Dccrg<spatial_cell::SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                      const int& sweeps,const bool& reverse);
+      void sumGhosts(DistributedLevel& level,std::vector<Real>& values);
+      void updateGhosts(DistributedLevel& level,std::vector<Real>& values,const int& stride);
+      void vcycle(const size_t& level);
+      void vcycleDistributed(const size_t& level);
+   };
+
+   PoissonSolver* makeMG();
+
+} // namespace poisson
+
+#endif	// POISSON_SOLVER_MG_H
@@ -582,6 +582,30 @@ bool Readparameters::get(const std::string& name,double& value) {
 
 
 
+/** Get the values of all parameters of a section, i.e. the parameters whose name starts
+ * with the section name and a dot. Composing parameters are returned with their values
+ * joined by commas. This may be called after having called Parse, and it may be called by
+ * any process, in any order.
+ * @param section The name of the section, e.g. "ionosphere".
+ * @param values Map where the values are written, keyed (and so sorted) by parameter name.
+ */
+void Readparameters::getSection(const std::string& section,std::map<std::string,std::string>& values) {
+   const string prefix = section + ".";
+   for (map<string,string>::const_iterator it=options.lower_bound(prefix); it!=options.end(); ++it) {
+      if (it->first.compare(0,prefix.size(),prefix) != 0) break;
+      values[it->first] = it->second;
+   }
+   for (map<string,vector<string> >::const_iterator it=vectorOptions.lower_bound(prefix); it!=vectorOptions.end(); ++it) {
+      if (it->first.compare(0,prefix.size(),prefix) != 0) break;
+      string joined;
+      for (size_t i=0; i<it->second.size(); ++i) {
+         if (i > 0) joined += ",";
+         joined += it->second[i];
+      }
+      values[it->first] = joined;
+   }
+}
+
 /** Write the descriptions of known input options to standard output if 
  * an option called "help" has been read, and exit in that case.
  */
@@ -23,6 +23,7 @@
 #ifndef READPARAMETERS_H
 #define READPARAMETERS_H
 #include <limits>
+#include <map>
 #include <mpi.h>
 #include <stdint.h>
 #include <string>
@@ -55,6 +56,8 @@ struct Readparameters {
     static bool get(const std::string& name,std::vector<float>& value);
     static bool get(const std::string& name,std::vector<double>& value);
 
+    static void getSection(const std::string& section,std::map<std::string,std::string>& values);
+
     
     static bool finalize();
     static void helpMessage();
@@ -37,6 +37,87 @@ namespace spatial_cell {
    int SpatialCell::activePopID = -1;
    uint64_t SpatialCell::mpi_transfer_type = 0;
    bool SpatialCell::mpiTransferAtSysBoundaries = false;
+   std::atomic<uint64_t> MpiDatatypeCache::hits(0);
+   std::atomic<uint64_t> MpiDatatypeCache::misses(0);
+
+   bool MpiDatatypeCache::Key::operator==(const Key& other) const {
+      return cell == other.cell && transferType == other.transferType && popID == other.popID
+          && nBlocks == other.nBlocks && data == other.data && blockParameters == other.blockParameters
+          && neighborData == other.neighborData && neighborBlocks == other.neighborBlocks
+          && populations == other.populations;
+   }
+
+   MpiDatatypeCache::MpiDatatypeCache() {
+      datatypes.fill(MPI_DATATYPE_NULL);
+      nextEntry = 0;
+   }
+
+   MpiDatatypeCache::MpiDatatypeCache(const MpiDatatypeCache& other) {
+      datatypes.fill(MPI_DATATYPE_NULL);
+      nextEntry = 0;
+   }
+
+   MpiDatatypeCache& MpiDatatypeCache::operator=(const MpiDatatypeCache& other) {
+      clear();
+      return *this;
+   }
+
+   MpiDatatypeCache::~MpiDatatypeCache() {
+      clear();
+   }
+
+   /*! Look up a datatype.
+    * \param key Transfer type and layout of the wanted datatype
+    * \param datatype Duplicate of the cached datatype, if found
+    * \return True if the datatype was found in the cache
+    */
+   bool MpiDatatypeCache::find(const Key& key,MPI_Datatype& datatype) {
+      for (int i=0; i<N_ENTRIES; ++i) {
+         if (datatypes[i] != MPI_DATATYPE_NULL && keys[i] == key) {
+            MPI_Type_dup(datatypes[i],&datatype);
+            ++hits;
+            return true;
+         }
+      }
+      ++misses;
+      return false;
+   }
+
+   /*! Commit a datatype and store it in the cache, replacing the oldest entry.
+    * \param key Transfer type and layout of the datatype
+    * \param datatype Uncommitted datatype, owned by the cache afterwards
+    * \return Duplicate of the committed datatype to be handed to the caller
+    */
+   MPI_Datatype MpiDatatypeCache::insert(const Key& key,MPI_Datatype datatype) {
+      MPI_Type_commit(&datatype);
+      if (datatypes[nextEntry] != MPI_DATATYPE_NULL) MPI_Type_free(&(datatypes[nextEntry]));
+      keys[nextEntry] = key;
+      datatypes[nextEntry] = datatype;
+      nextEntry = (nextEntry+1) % N_ENTRIES;
+
+      MPI_Datatype duplicate;
+      MPI_Type_dup(datatype,&duplicate);
+      return duplicate;
+   }
+
+   /*! Free all cached datatypes. Safe to call after MPI_Finalize, the cells of a
+    * static grid are destroyed only then.
+    */
+   void MpiDatatypeCache::clear() {
+      int finalized;
+      MPI_Finalized(&finalized);
+      for (int i=0; i<N_ENTRIES; ++i) {
+         if (datatypes[i] != MPI_DATATYPE_NULL && !finalized) MPI_Type_free(&(datatypes[i]));
+         datatypes[i] = MPI_DATATYPE_NULL;
+      }
+      nextEntry = 0;
+   }
+
+   /*! Get the number of cache hits and misses on this process so far.*/
+   void MpiDatatypeCache::getStatistics(uint64_t& hits,uint64_t& misses) {
+      hits = MpiDatatypeCache::hits;
+      misses = MpiDatatypeCache::misses;
+   }
 
    SpatialCell::SpatialCell() {
       // Block list and cache always have room for all blocks
@@ -607,7 +688,34 @@ namespace spatial_cell {
 
       // create datatype for actual data if we are in the first two 
       // layers around a boundary, or if we send for the whole system
-      if (this->mpiTransferEnabled && (SpatialCell::mpiTransferAtSysBoundaries==false || this->sysBoundaryLayer ==1 || this->sysBoundaryLayer ==2 )) {
+      const bool transferEnabled = this->mpiTransferEnabled
+         && (SpatialCell::mpiTransferAtSysBoundaries==false || this->sysBoundaryLayer ==1 || this->sysBoundaryLayer ==2 );
+
+      // Reuse an earlier datatype if nothing it points to has moved or been resized.
+      // Transfers that resize containers on the receiving side are always rebuilt.
+      const bool cacheable = transferEnabled && (SpatialCell::mpi_transfer_type & Transfer::SIZE_EXCHANGE_STAGES) == 0;
+      MpiDatatypeCache::Key key = {this, SpatialCell::mpi_transfer_type, activePopID, 0, NULL, NULL, NULL, 0, NULL};
+      if (cacheable) {
+         const uint64_t blockTransfers = Transfer::VEL_BLOCK_DATA | Transfer::VEL_BLOCK_PARAMETERS;
+         if ((SpatialCell::mpi_transfer_type & blockTransfers) != 0) {
+            key.nBlocks = populations[activePopID].blockContainer.size();
+            key.data = get_data(activePopID);
+            key.blockParameters = get_block_parameters(activePopID);
+         }
+         if ((SpatialCell::mpi_transfer_type & Transfer::NEIGHBOR_VEL_BLOCK_DATA) != 0) {
+            key.neighborData = this->neighbor_block_data;
+            key.neighborBlocks = this->neighbor_number_of_blocks;
+         }
+         if ((SpatialCell::mpi_transfer_type & Transfer::POP_METADATA) != 0) {
+            key.populations = populations.data();
+         }
+         MPI_Datatype datatype;
+         if (mpiDatatypeCache.find(key,datatype)) {
+            return std::make_tuple((void*)this,1,datatype);
+         }
+      }
+
+      if (transferEnabled) {
          //add data to send/recv to displacement and block length lists
          if ((SpatialCell::mpi_transfer_type & Transfer::VEL_BLOCK_LIST_STAGE1) != 0) {
             //first copy values in case this is the send operation
@@ -663,6 +771,23 @@ namespace spatial_cell {
             block_lengths.push_back(sizeof(Realf) * VELOCITY_BLOCK_LENGTH* this->neighbor_number_of_blocks);
          }
 
+         if ((SpatialCell::mpi_transfer_type & Transfer::NEIGHBOR_VEL_BLOCK_RUNS_STAGE1) != 0) {
+            // Sizes of a sparse neighbor transfer, so that buffers can be allocated on receiving side
+            displacements.push_back((uint8_t*) &(this->neighbor_number_of_runs) - (uint8_t*) this);
+            block_lengths.push_back(sizeof(vmesh::LocalID));
+            displacements.push_back((uint8_t*) &(this->neighbor_number_of_blocks) - (uint8_t*) this);
+            block_lengths.push_back(sizeof(vmesh::LocalID));
+         }
+
+         if ((SpatialCell::mpi_transfer_type & Transfer::NEIGHBOR_VEL_BLOCK_RUNS_STAGE2) != 0) {
+            // Block runs of a sparse neighbor transfer, the data itself goes with NEIGHBOR_VEL_BLOCK_DATA
+            if (receiving) this->neighbor_block_runs.resize(2*this->neighbor_number_of_runs);
+            if (this->neighbor_number_of_runs > 0) {
+               displacements.push_back((uint8_t*) &(this->neighbor_block_runs[0]) - (uint8_t*) this);
+               block_lengths.push_back(sizeof(vmesh::LocalID) * 2 * this->neighbor_number_of_runs);
+            }
+         }
+
          // send  spatial cell parameters
          if ((SpatialCell::mpi_transfer_type & Transfer::CELL_PARAMETERS)!=0){
             displacements.push_back((uint8_t*) &(this->parameters[0]) - (uint8_t*) this);
@@ -828,6 +953,7 @@ namespace spatial_cell {
             MPI_BYTE,
             &datatype
          );
+         if (cacheable) datatype = mpiDatatypeCache.insert(key,datatype);
       } else {
          count = 0;
          datatype = MPI_BYTE;
@@ -40,6 +40,7 @@ Spatial cell class for Vlasiator that supports a variable number of velocity blo
 #include <map>
 #include <phiprof.hpp>
 #include <tuple>
+#include <atomic>
 
 #include "memoryallocation.h"
 #include "common.h"
@@ -94,6 +95,7 @@ namespace spatial_cell {
       const uint64_t VEL_BLOCK_LIST_STAGE1    = (1ull<<2);
       const uint64_t VEL_BLOCK_LIST_STAGE2    = (1ull<<3);
       const uint64_t VEL_BLOCK_DATA           = (1ull<<4);
+      const uint64_t NEIGHBOR_VEL_BLOCK_RUNS_STAGE1 = (1ull<<5);
       const uint64_t VEL_BLOCK_PARAMETERS     = (1ull<<6);
       const uint64_t VEL_BLOCK_WITH_CONTENT_STAGE1  = (1ull<<7); 
       const uint64_t VEL_BLOCK_WITH_CONTENT_STAGE2  = (1ull<<8); 
@@ -120,6 +122,7 @@ namespace spatial_cell {
       const uint64_t POP_METADATA             = (1ull<<29);
       const uint64_t RANDOMGEN                = (1ull<<30);
       const uint64_t CELL_GRADPE_TERM         = (1ull<<31);
+      const uint64_t NEIGHBOR_VEL_BLOCK_RUNS_STAGE2 = (1ull<<32);
       //all data
       const uint64_t ALL_DATA =
       CELL_PARAMETERS
@@ -134,8 +137,54 @@ namespace spatial_cell {
       | CELL_DERIVATIVES | CELL_BVOL_DERIVATIVES
       | CELL_SYSBOUNDARYFLAG
       | POP_METADATA | RANDOMGEN;
+
+      //transfers whose datatype depends on sizes received in the same exchange, never cached
+      const uint64_t SIZE_EXCHANGE_STAGES =
+      VEL_BLOCK_LIST_STAGE1 | VEL_BLOCK_LIST_STAGE2
+      | VEL_BLOCK_WITH_CONTENT_STAGE1 | VEL_BLOCK_WITH_CONTENT_STAGE2
+      | NEIGHBOR_VEL_BLOCK_RUNS_STAGE1 | NEIGHBOR_VEL_BLOCK_RUNS_STAGE2;
    }
 
+   /*! Small per-cell cache of committed MPI datatypes built by SpatialCell::get_mpi_datatype.
+    * Entries are keyed on the transfer type, population, block count and the addresses the
+    * datatype points to, so a reallocated block container never hits a stale entry. dccrg
+    * frees the datatypes it is given, hence a hit returns a duplicate of the cached type.
+    * A copy starts with an empty cache as MPI datatypes cannot be shared between cells.
+    */
+   class MpiDatatypeCache {
+   public:
+      struct Key {
+         const void* cell;
+         uint64_t transferType;
+         int popID;
+         vmesh::LocalID nBlocks;
+         const void* data;
+         const void* blockParameters;
+         const void* neighborData;
+         vmesh::LocalID neighborBlocks;
+         const void* populations;
+         bool operator==(const Key& other) const;
+      };
+
+      MpiDatatypeCache();
+      MpiDatatypeCache(const MpiDatatypeCache& other);
+      MpiDatatypeCache& operator=(const MpiDatatypeCache& other);
+      ~MpiDatatypeCache();
+
+      bool find(const Key& key,MPI_Datatype& datatype);
+      MPI_Datatype insert(const Key& key,MPI_Datatype datatype);
+      void clear();
+      static void getStatistics(uint64_t& hits,uint64_t& misses);
+
+   private:
+      static const int N_ENTRIES = 4;
+      std::array<Key,N_ENTRIES> keys;
+      std::array<MPI_Datatype,N_ENTRIES> datatypes;
+      int nextEntry;                               /**< Entry replaced by the next insert.*/
+      static std::atomic<uint64_t> hits;
+      static std::atomic<uint64_t> misses;
+   };
+
    typedef std::array<unsigned int, 3> velocity_cell_indices_t;             /**< Defines the indices of a velocity cell in a velocity block.
                                                                                * Indices start from 0 and the first value is the index in x direction.
                                                                                * Note: these are the (i,j,k) indices of the cell within the block.
@@ -308,6 +357,7 @@ namespace spatial_cell {
       static uint64_t get_mpi_transfer_type(void);
       static void set_mpi_transfer_type(const uint64_t type,bool atSysBoundaries=false);
       void set_mpi_transfer_enabled(bool transferEnabled);
+      bool get_mpi_transfer_enabled() const;
       void updateSparseMinValue(const uint popID);
       Real getVelocityBlockMinValue(const uint popID) const;
 
@@ -333,6 +383,9 @@ namespace spatial_cell {
       Realf* neighbor_block_data;                                             /**< Pointers for translation operator. We can point to neighbor
                                                                                * cell block data. We do not allocate memory for the pointer.*/
       vmesh::LocalID neighbor_number_of_blocks;
+      std::vector<vmesh::LocalID> neighbor_block_runs;                        /**< Runs of non-zero blocks in neighbor_block_data for sparse
+                                                                               * translation transfers, as (first block, number of blocks) pairs.*/
+      vmesh::LocalID neighbor_number_of_runs;                                 /**< Number of runs in neighbor_block_runs. Needed for MPI communication of size before actual list transfer.*/
       uint sysBoundaryFlag;                                                   /**< What type of system boundary does the cell belong to. 
                                                                                * Enumerated in the sysboundarytype namespace's enum.*/
       uint sysBoundaryLayer;                                                  /**< Layers counted from closest systemBoundary. If 0 then it has not 
@@ -357,6 +410,7 @@ namespace spatial_cell {
       static int activePopID;
       bool initialized;
       bool mpiTransferEnabled;
+      MpiDatatypeCache mpiDatatypeCache;                                        /**< Datatypes of earlier get_mpi_datatype calls.*/
 
       // Random number generator state variables, used for running reproducible 
       // simulations that do not depend on the number of threads of MPI processes used.
@@ -1869,6 +1923,13 @@ namespace spatial_cell {
       this->mpiTransferEnabled=transferEnabled;
    }
    
+   /*!
+    Whether this cell is transferred/received using MPI in the next communication phase.
+    */
+   inline bool SpatialCell::get_mpi_transfer_enabled() const {
+      return this->mpiTransferEnabled;
+   }
+   
    inline bool SpatialCell::velocity_block_has_children(const vmesh::GlobalID& blockGID,const uint popID) const {
       #ifdef DEBUG_SPATIAL_CELL
       if (popID >= populations.size()) {
@@ -490,6 +490,27 @@ namespace SBC {
       return normalDirection;
    }
    
+   /*! In addition to the closest non-sysboundary cells, precompute the normal direction of each
+    * local ionosphere FsGrid cell so that fieldSolverBoundaryCondMagneticField need not redo the geometry.
+    */
+   void Ionosphere::updateFsGridBoundaryTable(
+      FsGrid< fsgrids::technical, 2> & technicalGrid
+   ) {
+      SysBoundaryCondition::updateFsGridBoundaryTable(technicalGrid);
+      
+      const std::array<int, 3>& gridDims = technicalGrid.getLocalSize();
+      const std::array<Real, 3> zero = {{ 0.0 }};
+      fsGridNormalDirections.assign((size_t)gridDims[0] * gridDims[1] * gridDims[2], zero);
+      for (int k=0; k<gridDims[2]; k++) {
+         for (int j=0; j<gridDims[1]; j++) {
+            for (int i=0; i<gridDims[0]; i++) {
+               if (technicalGrid.get(i,j,k)->sysBoundaryFlag != this->getIndex()) continue;
+               fsGridNormalDirections[fsGridLocalIndex(technicalGrid, i, j, k)] = fieldSolverGetNormalDirection(technicalGrid, i, j, k);
+            }
+         }
+      }
+   }
+   
    /*! We want here to
     * 
     * -- Average perturbed face B from the nearest neighbours
@@ -509,8 +530,8 @@ namespace SBC {
       cuint& RKCase,
       cuint& component
    ) {
-      std::vector< std::array<int, 3> > closestCells = getAllClosestNonsysboundaryCells(technicalGrid, i,j,k);
-      if (closestCells.size() == 1 && closestCells[0][0] == std::numeric_limits<int>::min() ) {
+      const FsGridCellList closestCells = getAllClosestNonsysboundaryCells(technicalGrid, i,j,k);
+      if (closestCells.empty() || (closestCells.size() == 1 && closestCells[0][0] == std::numeric_limits<int>::min()) ) {
          std::cerr << __FILE__ << ":" << __LINE__ << ":" << "No closest cells found!" << std::endl;
          abort();
       }
@@ -540,7 +561,7 @@ namespace SBC {
       }
 
       // Average and project to normal direction
-      std::array<Real, 3> normalDirection = fieldSolverGetNormalDirection(technicalGrid, i, j, k);
+      const std::array<Real, 3> & normalDirection = fsGridNormalDirections[fsGridLocalIndex(technicalGrid, i, j, k)];
       for(uint i=0; i<3; i++) {
          averageB[i] *= normalDirection[i] / closestCells.size();
       }
@@ -655,60 +676,21 @@ namespace SBC {
       for (uint popID=0; popID<getObjectWrapper().particleSpecies.size(); ++popID) {
          const IonosphereSpeciesParameters& sP = this->speciesParams[popID];
          const vector<vmesh::GlobalID> blocksToInitialize = findBlocksToInitialize(templateCell,popID);
-         Realf* data = templateCell.get_data(popID);
+         const Real MASS = getObjectWrapper().particleSpecies[popID].mass;
          
+         // Blocks have all been added above, so their data can be filled independently.
+         #pragma omp parallel for schedule(static)
          for (size_t i = 0; i < blocksToInitialize.size(); i++) {
-            const vmesh::GlobalID blockGID = blocksToInitialize.at(i);
-            const vmesh::LocalID blockLID = templateCell.get_velocity_block_local_id(blockGID,popID);
-            const Real* block_parameters = templateCell.get_block_parameters(blockLID,popID);
-            creal vxBlock = block_parameters[BlockParams::VXCRD];
-            creal vyBlock = block_parameters[BlockParams::VYCRD];
-            creal vzBlock = block_parameters[BlockParams::VZCRD];
-            creal dvxCell = block_parameters[BlockParams::DVX];
-            creal dvyCell = block_parameters[BlockParams::DVY];
-            creal dvzCell = block_parameters[BlockParams::DVZ];
-
-            creal x = templateCell.parameters[CellParams::XCRD];
-            creal y = templateCell.parameters[CellParams::YCRD];
-            creal z = templateCell.parameters[CellParams::ZCRD];
-            creal dx = templateCell.parameters[CellParams::DX];
-            creal dy = templateCell.parameters[CellParams::DY];
-            creal dz = templateCell.parameters[CellParams::DZ];
-         
-            // Calculate volume average of distrib. function for each cell in the block.
-            for (uint kc=0; kc<WID; ++kc) for (uint jc=0; jc<WID; ++jc) for (uint ic=0; ic<WID; ++ic) {
-               creal vxCell = vxBlock + ic*dvxCell;
-               creal vyCell = vyBlock + jc*dvyCell;
-               creal vzCell = vzBlock + kc*dvzCell;
-               Real average = 0.0;
-               if(sP.nVelocitySamples > 1) {
-                  creal d_vx = dvxCell / (sP.nVelocitySamples-1);
-                  creal d_vy = dvyCell / (sP.nVelocitySamples-1);
-                  creal d_vz = dvzCell / (sP.nVelocitySamples-1);
-                  for (uint vi=0; vi<sP.nVelocitySamples; ++vi)
-                     for (uint vj=0; vj<sP.nVelocitySamples; ++vj)
-                        for (uint vk=0; vk<sP.nVelocitySamples; ++vk) {
-                           average +=  shiftedMaxwellianDistribution(
-                                                                     popID,
-                                                                     vxCell + vi*d_vx,
-                                                                     vyCell + vj*d_vy,
-                                                                     vzCell + vk*d_vz
-                                                                    );
-                        }
-                  average /= sP.nVelocitySamples * sP.nVelocitySamples * sP.nVelocitySamples;
-               } else {
-                  average = shiftedMaxwellianDistribution(
-                                                          popID,
-                                                          vxCell + 0.5*dvxCell,
-                                                          vyCell + 0.5*dvyCell,
-                                                          vzCell + 0.5*dvzCell
-                                                         );
-               }
-
-               if (average !=0.0 ) {
-                  data[blockLID*WID3+cellIndex(ic,jc,kc)] = average;
-               }
-            } // for-loop over cells in velocity block
+            const vmesh::LocalID blockLID = templateCell.get_velocity_block_local_id(blocksToInitialize[i],popID);
+            setMaxwellianBlock(
+               templateCell.get_data(blockLID,popID),
+               templateCell.get_block_parameters(blockLID,popID),
+               sP.rho,
+               sP.T,
+               MASS,
+               sP.V0,
+               sP.nVelocitySamples
+            );
          } // for-loop over velocity blocks
 
          // let's get rid of blocks not fulfilling the criteria here to save memory.
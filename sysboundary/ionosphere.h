@@ -68,6 +68,9 @@ namespace SBC {
          const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
          Project &project
       );
+      virtual void updateFsGridBoundaryTable(
+         FsGrid< fsgrids::technical, 2> & technicalGrid
+      );
       virtual Real fieldSolverBoundaryCondMagneticField(
          FsGrid< std::array<Real, fsgrids::bfield::N_BFIELD>, 2> & perBGrid,
          FsGrid< std::array<Real, fsgrids::bfield::N_BFIELD>, 2> & perBDt2Grid,
@@ -159,6 +162,9 @@ namespace SBC {
       uint nVelocitySamples;
       
       spatial_cell::SpatialCell templateCell;
+      
+      /*! Normal directions of the local FsGrid cells, indexed by fsGridLocalIndex. Only set for ionosphere cells. Built in updateFsGridBoundaryTable. */
+      std::vector< std::array<Real, 3> > fsGridNormalDirections;
    };
 }
 
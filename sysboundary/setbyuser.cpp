@@ -377,18 +377,20 @@ namespace SBC {
    
    /*! Loops through the array of template cells and generates the ones needed. The function
     * generateTemplateCell is defined in the inheriting class such as to have the specific
-    * condition needed.
+    * condition needed. Calling this again for a new time only regenerates templates whose input changed.
     * \param t Simulation time.
     * \sa generateTemplateCell
     */
    bool SetByUser::generateTemplateCells(creal& t) {
-      #pragma omp parallel for
+      phiprof::start("SetByUser::generateTemplateCells");
+      // Faces are done in order so that generateTemplateCell can reuse an earlier face's template;
+      // the threads are used across the velocity blocks of each template instead.
       for(uint i=0; i<6; i++) {
-         int index;
          if(facesToProcess[i]) {
             generateTemplateCell(templateCells[i], i, t);
          }
       }
+      phiprof::stop("SetByUser::generateTemplateCells");
       return true;
    }
    
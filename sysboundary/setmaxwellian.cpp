@@ -227,6 +227,8 @@ namespace SBC {
       templateCell.parameters[CellParams::DZ] = 1;
       
       // Init all particle species
+      bool changed = false;
+      templateInputs[inputDataIndex].resize(getObjectWrapper().particleSpecies.size());
       for (uint popID=0; popID<getObjectWrapper().particleSpecies.size(); ++popID) {
          interpolate(inputDataIndex, popID, t, &buffer[0]);
          rho = buffer[0];
@@ -237,66 +239,48 @@ namespace SBC {
          Bx = buffer[5];
          By = buffer[6];
          Bz = buffer[7];
-
-         vector<vmesh::GlobalID> blocksToInitialize = this->findBlocksToInitialize(popID,templateCell, rho, T, Vx, Vy, Vz);
-         Realf* data = templateCell.get_data(popID);
-
-         for(vmesh::GlobalID i=0; i<blocksToInitialize.size(); ++i) {
-            const vmesh::GlobalID blockGID = blocksToInitialize[i];
-            const vmesh::LocalID blockLID = templateCell.get_velocity_block_local_id(blockGID,popID);
-            const Real* block_parameters = templateCell.get_block_parameters(blockLID,popID);
-            creal vxBlock = block_parameters[BlockParams::VXCRD];
-            creal vyBlock = block_parameters[BlockParams::VYCRD];
-            creal vzBlock = block_parameters[BlockParams::VZCRD];
-            creal dvxCell = block_parameters[BlockParams::DVX];
-            creal dvyCell = block_parameters[BlockParams::DVY];
-            creal dvzCell = block_parameters[BlockParams::DVZ];
+         const std::array<Real, 5> inputs = {{rho, T, Vx, Vy, Vz}};
          
-            creal x = templateCell.parameters[CellParams::XCRD];
-            creal y = templateCell.parameters[CellParams::YCRD];
-            creal z = templateCell.parameters[CellParams::ZCRD];
-            creal dx = templateCell.parameters[CellParams::DX];
-            creal dy = templateCell.parameters[CellParams::DY];
-            creal dz = templateCell.parameters[CellParams::DZ];
+         // Nothing to do if this template was already generated from the same (rho, T, V)
+         if (templateCell.get_number_of_velocity_blocks(popID) > 0 && templateInputs[inputDataIndex][popID] == inputs) {
+            continue;
+         }
+         changed = true;
+         templateInputs[inputDataIndex][popID] = inputs;
          
-            // Calculate volume average of distrib. function for each cell in the block.
-            for (uint kc=0; kc<WID; ++kc) for (uint jc=0; jc<WID; ++jc) for (uint ic=0; ic<WID; ++ic) {
-               creal vxCell = vxBlock + ic*dvxCell;
-               creal vyCell = vyBlock + jc*dvyCell;
-               creal vzCell = vzBlock + kc*dvzCell;
-               Real average = 0.0;
-               if(speciesParams[popID].nVelocitySamples > 1) {
-                  creal d_vx = dvxCell / (speciesParams[popID].nVelocitySamples-1);
-                  creal d_vy = dvyCell / (speciesParams[popID].nVelocitySamples-1);
-                  creal d_vz = dvzCell / (speciesParams[popID].nVelocitySamples-1);
-                  for (uint vi=0; vi<speciesParams[popID].nVelocitySamples; ++vi)
-                    for (uint vj=0; vj<speciesParams[popID].nVelocitySamples; ++vj)
-                      for (uint vk=0; vk<speciesParams[popID].nVelocitySamples; ++vk) {
-                         average +=  maxwellianDistribution(
-                                                            popID,
-                                                            rho,
-                                                            T,
-                                                            vxCell + vi*d_vx - Vx,
-                                                            vyCell + vj*d_vy - Vy,
-                                                            vzCell + vk*d_vz - Vz
-                                                           );
-                      }
-                  average /= speciesParams[popID].nVelocitySamples * speciesParams[popID].nVelocitySamples * speciesParams[popID].nVelocitySamples;
-               } else {
-                  average =   maxwellianDistribution(
-                                                     popID,
-                                                     rho,
-                                                     T,
-                                                     vxCell + 0.5*dvxCell,
-                                                     vyCell + 0.5*dvyCell,
-                                                     vzCell + 0.5*dvzCell
-                                                    );
-               }
-               
-               if (average != 0.0) {
-                  data[blockLID*WID3+cellIndex(ic,jc,kc)] = average;
-               } 
-            } // for-loop over cells in velocity block
+         // Reuse the distribution of another face already generated from the same (rho, T, V)
+         bool copied = false;
+         for (int face=0; face<inputDataIndex; face++) {
+            if (facesToProcess[face] && templateInputs[face].size() > popID && templateInputs[face][popID] == inputs) {
+               templateCell.set_population(templateCells[face].get_population(popID), popID);
+               copied = true;
+               break;
+            }
+         }
+         if (copied) continue;
+         
+         templateCell.clear(popID);
+         vector<vmesh::GlobalID> blocksToInitialize = this->findBlocksToInitialize(popID,templateCell, rho, T, Vx, Vy, Vz);
+         const Real MASS = getObjectWrapper().particleSpecies[popID].mass;
+         // The single sample (cell centre) template has always been the unshifted Maxwellian,
+         // only the averaged one is shifted by V. Keep it that way.
+         const Real V0[3] = {Vx, Vy, Vz};
+         const Real noShift[3] = {0.0, 0.0, 0.0};
+         const Real* shift = (speciesParams[popID].nVelocitySamples > 1) ? V0 : noShift;
+         
+         // Blocks have all been added above, so their data can be filled independently.
+         #pragma omp parallel for schedule(static)
+         for (size_t i=0; i<blocksToInitialize.size(); ++i) {
+            const vmesh::LocalID blockLID = templateCell.get_velocity_block_local_id(blocksToInitialize[i],popID);
+            setMaxwellianBlock(
+               templateCell.get_data(blockLID,popID),
+               templateCell.get_block_parameters(blockLID,popID),
+               rho,
+               T,
+               MASS,
+               shift,
+               speciesParams[popID].nVelocitySamples
+            );
          } // for-loop over velocity blocks
          
          //let's get rid of blocks not fulfilling the criteria here to save
@@ -308,7 +292,9 @@ namespace SBC {
       templateCell.parameters[CellParams::PERBY] = By;
       templateCell.parameters[CellParams::PERBZ] = Bz;
       
-      calculateCellMoments(&templateCell,true,true);
+      if (changed) {
+         calculateCellMoments(&templateCell,true,true);
+      }
       
       if(!this->isThisDynamic) {
          // WARNING Time-independence assumed here.
@@ -75,6 +75,8 @@ namespace SBC {
          creal& VZ
       );
       
+      /*! Per face and population, the (rho, T, Vx, Vy, Vz) the template cell was last generated from. */
+      std::vector< std::array<Real, 5> > templateInputs[6];
    };
 }
 
@@ -668,3 +668,16 @@ bool SysBoundary::updateSysBoundariesAfterLoadBalance(dccrg::Dccrg<SpatialCell,d
    return true;
 }
 
+
+/*! Builds the per-rank tables of closest non-sysboundary neighbours (and other precomputed geometry)
+ * of the FsGrid boundary cells. The FsGrid decomposition is static, so this is called once after the
+ * technical grid has been set up; the field solver boundary conditions then only do table lookups.
+ * \param technicalGrid The technical FsGrid holding the sysboundary flags, with up-to-date ghost cells
+ */
+void SysBoundary::updateFsGridBoundaryTables(FsGrid< fsgrids::technical, 2> & technicalGrid) {
+   phiprof::start("updateFsGridBoundaryTables");
+   for( std::list<SBC::SysBoundaryCondition*>::iterator it = sysBoundaries.begin(); it != sysBoundaries.end(); ++it ) {
+      (*it)->updateFsGridBoundaryTable(technicalGrid);
+   }
+   phiprof::stop("updateFsGridBoundaryTables");
+}
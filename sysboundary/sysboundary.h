@@ -78,6 +78,7 @@ class SysBoundary {
    bool isDynamic() const;
    bool isBoundaryPeriodic(uint direction) const;
    bool updateSysBoundariesAfterLoadBalance(dccrg::Dccrg<spatial_cell::SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid);
+   void updateFsGridBoundaryTables(FsGrid< fsgrids::technical, 2> & technicalGrid);
 
    private:
       /*! Private copy-constructor to prevent copying the class. */
@@ -33,6 +33,7 @@
 #include "../parameters.h"
 #include "../vlasovmover.h"
 #include "sysboundarycondition.h"
+#include "vlasov_boundary_kernels.h"
 #include "../projects/projects_common.h"
 
 using namespace std;
@@ -477,7 +478,115 @@ namespace SBC {
       }
    }
 
+   /*! Get the data of the given velocity block in cell, adding the block if it does not exist yet.
+    * \param cell Cell in which to look up the block
+    * \param blockGID Global ID of the block
+    * \param popID Particle population
+    * \return Pointer to the block data. Invalidated by any subsequent block addition to cell.
+    */
+   Realf* SysBoundaryCondition::getOrAddBlockData(
+      SpatialCell* cell,
+      const vmesh::GlobalID& blockGID,
+      const uint popID
+   ) {
+      vmesh::LocalID blockLID = cell->get_velocity_block_local_id(blockGID,popID);
+      if (blockLID == SpatialCell::invalid_local_id()) {
+         if (!cell->add_velocity_block(blockGID,popID)) {
+            std::cerr << __FILE__ << ":" << __LINE__ << ": Couldn't add velocity block " << blockGID << std::endl;
+            abort();
+         }
+         blockLID = cell->get_velocity_block_local_id(blockGID,popID);
+      }
+      return cell->get_data(blockLID,popID);
+   }
+   
+   /*! Set the velocity block to the volume average of a shifted Maxwellian over each velocity cell.
+    * The average is sampled on a nVelocitySamples^3 lattice per cell as before, but as the Maxwellian
+    * factorises over vx, vy and vz, so does its lattice average: only 3*WID one-dimensional averages
+    * are needed per block instead of WID3*nVelocitySamples^3 evaluations of the full distribution.
+    * \param data Data of the velocity block
+    * \param blockParameters Parameters of the velocity block
+    * \param rho Number density
+    * \param T Temperature
+    * \param mass Particle mass
+    * \param V0 Bulk velocity
+    * \param nVelocitySamples Number of samples per velocity cell and dimension, 1 samples the cell centre.
+    */
+   void SysBoundaryCondition::setMaxwellianBlock(
+      Realf* data,
+      const Real* blockParameters,
+      creal& rho,
+      creal& T,
+      creal& mass,
+      const Real* V0,
+      cuint& nVelocitySamples
+   ) {
+      creal norm = rho * pow(mass / (2.0 * M_PI * physicalconstants::K_B * T), 1.5);
+      creal expCoefficient = mass / (2.0 * physicalconstants::K_B * T);
+      
+      Real average[3][WID];
+      for (uint d=0; d<3; ++d) {
+         creal dvCell = blockParameters[BlockParams::DVX+d];
+         for (uint c=0; c<WID; ++c) {
+            creal vCell = blockParameters[BlockParams::VXCRD+d] + c*dvCell - V0[d];
+            if (nVelocitySamples > 1) {
+               creal dv = dvCell / (nVelocitySamples-1);
+               Real sum = 0.0;
+               for (uint s=0; s<nVelocitySamples; ++s) {
+                  creal v = vCell + s*dv;
+                  sum += exp(-expCoefficient*v*v);
+               }
+               average[d][c] = sum / nVelocitySamples;
+            } else {
+               creal v = vCell + 0.5*dvCell;
+               average[d][c] = exp(-expCoefficient*v*v);
+            }
+         }
+      }
+      
+      for (uint kc=0; kc<WID; ++kc) for (uint jc=0; jc<WID; ++jc) {
+         creal yz = norm*average[1][jc]*average[2][kc];
+         #pragma omp simd
+         for (uint ic=0; ic<WID; ++ic) {
+            data[cellIndex(ic,jc,kc)] = yz*average[0][ic];
+         }
+      }
+   }
+   
+   /*! Determine whether reflection about the plane with normal (nx,ny,nz) maps velocity blocks onto velocity blocks.
+    * This is the case when the normal is along a coordinate axis and the velocity mesh is symmetric about zero
+    * along that axis: then velocity cell i of block b along the axis maps to cell WID-1-i of block N-1-b.
+    * \param cell Cell whose velocity mesh is queried
+    * \param nx,ny,nz Unit normal of the reflection plane
+    * \param popID Particle population
+    * \return The axis (0, 1 or 2) of the normal, or -1 if the block-level mapping does not apply.
+    */
+   int SysBoundaryCondition::getBlockReflectionAxis(
+      const SpatialCell* cell,
+      creal& nx,
+      creal& ny,
+      creal& nz,
+      const uint popID
+   ) {
+      const Real n[3] = {nx, ny, nz};
+      int axis = -1;
+      for (int d=0; d<3; d++) {
+         if (n[d] == 0.0) continue;
+         if (axis >= 0) return -1;
+         axis = d;
+      }
+      if (axis < 0) return -1;
+      
+      const Real* meshMin = cell->get_population(popID).vmesh.getMeshMinLimits();
+      const Real* meshMax = cell->get_population(popID).vmesh.getMeshMaxLimits();
+      if (fabs(meshMin[axis] + meshMax[axis]) > 1e-6*(meshMax[axis] - meshMin[axis])) return -1;
+      return axis;
+   }
+   
    /*! Take neighboring distribution and reflect all parts going in the direction opposite to the normal vector given in.
+    * Whole velocity blocks are mapped to their mirrored blocks so that there is one block lookup per source block
+    * instead of two per velocity cell. If the normal is not along a coordinate axis or the velocity mesh is not
+    * symmetric, falls back to vlasovBoundaryReflectPerValue.
     * \param mpiGrid Grid
     * \param cellID Cell in which to set the distribution where incoming velocity cells have been reflected/bounced.
     * \param nx Unit vector x component normal to the bounce/reflection plane.
@@ -493,58 +602,52 @@ namespace SBC {
          const uint popID
    ) {
       SpatialCell * cell = mpiGrid[cellID];
-      const std::vector<CellID> cellList = this->getAllClosestNonsysboundaryCells(cellID);
+      const int axis = getBlockReflectionAxis(cell, nx, ny, nz, popID);
+      if (axis < 0) {
+         vlasovBoundaryReflectPerValue(mpiGrid, cellID, nx, ny, nz, popID);
+         return;
+      }
+      
+      const std::vector<CellID> & cellList = this->getAllClosestNonsysboundaryCells(cellID);
       const size_t numberOfCells = cellList.size();
-
       creal factor = 1.0 / convert<Real>(numberOfCells);
+      creal nAxis = (axis == 0) ? nx : ((axis == 1) ? ny : nz);
       
       cell->clear(popID);
       
       for (size_t i=0; i<numberOfCells; i++) {
          SpatialCell* incomingCell = mpiGrid[cellList[i]];
          const Real* blockParameters = incomingCell->get_block_parameters(popID);
-
-         // add blocks
+         
          for (vmesh::LocalID blockLID=0; blockLID<incomingCell->get_number_of_velocity_blocks(popID); ++blockLID) {
-            // check where cells are
-            creal vxBlock = blockParameters[BlockParams::VXCRD];
-            creal vyBlock = blockParameters[BlockParams::VYCRD];
-            creal vzBlock = blockParameters[BlockParams::VZCRD];
-            creal dvxCell = blockParameters[BlockParams::DVX];
-            creal dvyCell = blockParameters[BlockParams::DVY];
-            creal dvzCell = blockParameters[BlockParams::DVZ];
-            for (uint kc=0; kc<WID; ++kc) for (uint jc=0; jc<WID; ++jc) for (uint ic=0; ic<WID; ++ic) {
-               creal vxCellCenter = vxBlock + (ic+convert<Real>(0.5))*dvxCell;
-               creal vyCellCenter = vyBlock + (jc+convert<Real>(0.5))*dvyCell;
-               creal vzCellCenter = vzBlock + (kc+convert<Real>(0.5))*dvzCell;
-               // scalar product v.n
-               creal vNormal = vxCellCenter*nx + vyCellCenter*ny + vzCellCenter*nz;
-               if (vNormal >= 0.0) {
-                  // Not flowing in, leave as is.
-                  cell->increment_value(
-                     vxCellCenter,
-                     vyCellCenter,
-                     vzCellCenter,
-                     factor*incomingCell->get_value(vxCellCenter, vyCellCenter, vzCellCenter,popID),
-                     popID
-                  );
-               } else {
-                  // Flowing in, bounce off.
-                  cell->increment_value(
-                     vxCellCenter - 2.0*vNormal*nx,
-                     vyCellCenter - 2.0*vNormal*ny,
-                     vzCellCenter - 2.0*vNormal*nz,
-                     factor*incomingCell->get_value(vxCellCenter, vyCellCenter, vzCellCenter,popID),
-                     popID
-                  );
-               }
-            } // for-loop over cells in velocity block
+            // Weights of the velocity cell layers along the normal: kept where v.n >= 0, mirrored where v.n < 0
+            Realf keepWeight[WID];
+            Realf mirrorWeight[WID];
+            bool keep, mirror;
+            reflectionWeights(blockParameters, axis, nAxis, factor, keepWeight, mirrorWeight, keep, mirror);
+            
+            const vmesh::GlobalID blockGID = incomingCell->get_velocity_block_global_id(blockLID,popID);
+            const Realf* fromData = incomingCell->get_data(blockLID,popID);
+            
+            if (keep) {
+               addBlockLayers(axis, keepWeight, fromData, getOrAddBlockData(cell, blockGID, popID));
+            }
+            
+            if (mirror) {
+               uint8_t refLevel;
+               velocity_block_indices_t indices = incomingCell->get_velocity_block_indices(popID,blockGID,refLevel);
+               indices[axis] = cell->get_velocity_grid_length(popID,refLevel)[axis] - 1 - indices[axis];
+               const vmesh::GlobalID mirroredGID = cell->get_velocity_block(popID,indices,refLevel);
+               addMirroredBlockLayers(axis, mirrorWeight, fromData, getOrAddBlockData(cell, mirroredGID, popID));
+            }
+            blockParameters += BlockParams::N_VELOCITY_BLOCK_PARAMS;
          } // for-loop over velocity blocks
-         blockParameters += BlockParams::N_VELOCITY_BLOCK_PARAMS;
       } // for-loop over spatial cells
    }
    
    /*! Take neighboring distribution and absorb all parts going in the direction opposite to the normal vector given in.
+    * Works on whole velocity blocks: the target block is looked up once per source block and the per-cell
+    * weights are applied in a vectorisable loop.
     * \param mpiGrid Grid
     * \param cellID Cell in which to set the distribution where incoming velocity cells have been kept or swallowed.
     * \param nx Unit vector x component normal to the absorption plane.
@@ -562,10 +665,11 @@ namespace SBC {
       const uint popID
    ) {
       SpatialCell* cell = mpiGrid[cellID];
-      const std::vector<CellID> cellList = this->getAllClosestNonsysboundaryCells(cellID);
+      const std::vector<CellID> & cellList = this->getAllClosestNonsysboundaryCells(cellID);
       const size_t numberOfCells = cellList.size();
-
+      
       creal factor = 1.0 / convert<Real>(numberOfCells);
+      creal quenchedFactor = factor*quenchingFactor;
       
       cell->clear(popID);
       
@@ -573,47 +677,42 @@ namespace SBC {
          SpatialCell* incomingCell = mpiGrid[cellList[i]];
          const Real* blockParameters = incomingCell->get_block_parameters(popID);
          
-         // add blocks
          for (vmesh::LocalID blockLID=0; blockLID<incomingCell->get_number_of_velocity_blocks(popID); ++blockLID) {
-            // check where cells are
-            creal vxBlock = blockParameters[BlockParams::VXCRD];
-            creal vyBlock = blockParameters[BlockParams::VYCRD];
-            creal vzBlock = blockParameters[BlockParams::VZCRD];
-            creal dvxCell = blockParameters[BlockParams::DVX];
-            creal dvyCell = blockParameters[BlockParams::DVY];
-            creal dvzCell = blockParameters[BlockParams::DVZ];
-            for (uint kc=0; kc<WID; ++kc) 
-               for (uint jc=0; jc<WID; ++jc) 
-                  for (uint ic=0; ic<WID; ++ic) {
-                     creal vxCellCenter = vxBlock + (ic+convert<Real>(0.5))*dvxCell;
-                     creal vyCellCenter = vyBlock + (jc+convert<Real>(0.5))*dvyCell;
-                     creal vzCellCenter = vzBlock + (kc+convert<Real>(0.5))*dvzCell;
-                     // scalar product v.n
-                     creal vNormal = vxCellCenter*nx + vyCellCenter*ny + vzCellCenter*nz;
-                     if(vNormal >= 0.0) {
-                        // Not flowing in, leave as is.
-                        cell->increment_value(
-                           vxCellCenter,
-                           vyCellCenter,
-                           vzCellCenter,
-                           factor*incomingCell->get_value(vxCellCenter, vyCellCenter, vzCellCenter),
-                           popID
-                        );
-                     } else {
-                        // Flowing in, bounce off.
-                        cell->increment_value(
-                           vxCellCenter,
-                           vyCellCenter,
-                           vzCellCenter,
-                           factor*quenchingFactor*incomingCell->get_value(vxCellCenter, vyCellCenter, vzCellCenter),
-                           popID
-                        );
-                     }
-            }
+            const vmesh::GlobalID blockGID = incomingCell->get_velocity_block_global_id(blockLID,popID);
+            absorbBlock(blockParameters, incomingCell->get_data(blockLID,popID), getOrAddBlockData(cell, blockGID, popID), nx, ny, nz, factor, quenchedFactor);
+            blockParameters += BlockParams::N_VELOCITY_BLOCK_PARAMS;
          } // for-loop over velocity blocks
-         blockParameters += BlockParams::N_VELOCITY_BLOCK_PARAMS;
       } // for-loop over spatial cells
    }
+   
+   /*! Reference implementation of vlasovBoundaryReflect working one velocity cell at a time through
+    * get_value/increment_value, see reflectPerValue. Handles arbitrary normals and velocity meshes.
+    * \param mpiGrid Grid
+    * \param cellID Cell in which to set the distribution where incoming velocity cells have been reflected/bounced.
+    * \param nx Unit vector x component normal to the bounce/reflection plane.
+    * \param ny Unit vector y component normal to the bounce/reflection plane.
+    * \param nz Unit vector z component normal to the bounce/reflection plane.
+    */
+   void SysBoundaryCondition::vlasovBoundaryReflectPerValue(
+         const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+         const CellID& cellID,
+         creal& nx,
+         creal& ny,
+         creal& nz,
+         const uint popID
+   ) {
+      SpatialCell * cell = mpiGrid[cellID];
+      const std::vector<CellID> cellList = this->getAllClosestNonsysboundaryCells(cellID);
+      const size_t numberOfCells = cellList.size();
+
+      creal factor = 1.0 / convert<Real>(numberOfCells);
+      
+      cell->clear(popID);
+      
+      for (size_t i=0; i<numberOfCells; i++) {
+         reflectPerValue(*mpiGrid[cellList[i]], *cell, nx, ny, nz, factor, popID);
+      }
+   }
 
 
    /*! Updates the system boundary conditions after load balancing. This is called from e.g. the class SysBoundary.
@@ -672,6 +771,34 @@ namespace SBC {
       return true;
    }
    
+   /*! Builds the table of closest NOT_SYSBOUNDARY cells for the local FsGrid cells of this system boundary type.
+    * The FsGrid decomposition does not change during the run, so this only needs to be called once
+    * after the technical grid has been set up and its ghost cells updated. Derived classes can extend
+    * this to precompute further per-cell geometric quantities.
+    * \param technicalGrid The technical FsGrid holding the sysboundary flags
+    */
+   void SysBoundaryCondition::updateFsGridBoundaryTable(
+      FsGrid< fsgrids::technical, 2> & technicalGrid
+   ) {
+      const std::array<int, 3>& gridDims = technicalGrid.getLocalSize();
+      const size_t nLocalCells = (size_t)gridDims[0] * gridDims[1] * gridDims[2];
+      fsGridClosestNonsysboundaryOffsets.assign(nLocalCells + 1, 0);
+      fsGridClosestNonsysboundaryCells.clear();
+      for (int k=0; k<gridDims[2]; k++) {
+         for (int j=0; j<gridDims[1]; j++) {
+            for (int i=0; i<gridDims[0]; i++) {
+               const int64_t n = fsGridLocalIndex(technicalGrid, i, j, k);
+               if (technicalGrid.get(i,j,k)->sysBoundaryFlag == this->getIndex()) {
+                  const std::vector< std::array<int, 3> > closestCells = findAllClosestNonsysboundaryCells(technicalGrid, i, j, k);
+                  fsGridClosestNonsysboundaryCells.insert(fsGridClosestNonsysboundaryCells.end(), closestCells.begin(), closestCells.end());
+               }
+               fsGridClosestNonsysboundaryOffsets[n+1] = fsGridClosestNonsysboundaryCells.size();
+            }
+         }
+      }
+      fsGridClosestNonsysboundaryCells.shrink_to_fit();
+   }
+   
    /*! Get the cellID of the first closest cell of type NOT_SYSBOUNDARY found.
     * \param i,j,k Coordinates of the cell to start looking from
     * \return The cell index of that cell
@@ -683,16 +810,40 @@ namespace SBC {
       cint j,
       cint k
    ) {
-      const std::vector< std::array<int, 3> > closestCells = getAllClosestNonsysboundaryCells(technicalGrid, i, j, k);
-      return closestCells.at(0);
+      const FsGridCellList closestCells = getAllClosestNonsysboundaryCells(technicalGrid, i, j, k);
+      if (closestCells.empty()) {
+         const std::array<int32_t, 3> gid = technicalGrid.getGlobalIndices(i, j, k);
+         std::cerr << __FILE__ << ":" << __LINE__ << ": No closest cells of cell (" << gid[0] << "," << gid[1] << "," << gid[2] << ") in the boundary table of " << getName() << "!" << std::endl;
+         abort();
+      }
+      return closestCells[0];
    }
    
    /*! Get the cellIDs of all the closest cells of type NOT_SYSBOUNDARY.
+    * The result is read from the table built in updateFsGridBoundaryTable, so this is only valid
+    * for local FsGrid cells of this system boundary type; for other local cells the list is empty.
+    * \param i,j,k Coordinates of the cell to start looking from
+    * \return The list of cell indices of those cells
+    * \sa getTheClosestNonsysboundaryCell findAllClosestNonsysboundaryCells
+    */
+   FsGridCellList SysBoundaryCondition::getAllClosestNonsysboundaryCells(
+      FsGrid< fsgrids::technical, 2> & technicalGrid,
+      cint i,
+      cint j,
+      cint k
+   ) {
+      const int64_t n = fsGridLocalIndex(technicalGrid, i, j, k);
+      const std::array<int, 3>* cells = fsGridClosestNonsysboundaryCells.data();
+      FsGridCellList closestCells = {cells + fsGridClosestNonsysboundaryOffsets[n], cells + fsGridClosestNonsysboundaryOffsets[n+1]};
+      return closestCells;
+   }
+   
+   /*! Search the 5x5x5 neighbourhood for the cellIDs of all the closest cells of type NOT_SYSBOUNDARY.
     * \param i,j,k Coordinates of the cell to start looking from
     * \return The vector of cell indices of those cells
-    * \sa getTheClosestNonsysboundaryCell
+    * \sa updateFsGridBoundaryTable
     */
-   std::vector< std::array<int, 3> > SysBoundaryCondition::getAllClosestNonsysboundaryCells(
+   std::vector< std::array<int, 3> > SysBoundaryCondition::findAllClosestNonsysboundaryCells(
       FsGrid< fsgrids::technical, 2> & technicalGrid,
       cint i,
       cint j,
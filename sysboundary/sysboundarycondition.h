@@ -26,6 +26,7 @@
 #include <dccrg.hpp>
 #include <dccrg_cartesian_geometry.hpp>
 #include <fsgrid.hpp>
+#include <cassert>
 
 #include <vector>
 #include "../common.h"
@@ -37,6 +38,19 @@ using namespace spatial_cell;
 using namespace projects;
 
 namespace SBC {
+   /*! Read-only view of the closest NOT_SYSBOUNDARY cells of one FsGrid cell, stored contiguously
+    * in the flat neighbour list of SysBoundaryCondition.
+    */
+   struct FsGridCellList {
+      const std::array<int, 3>* first;
+      const std::array<int, 3>* last;
+      size_t size() const {return last - first;}
+      bool empty() const {return first == last;}
+      const std::array<int, 3>& operator[](const size_t n) const {return first[n];}
+      const std::array<int, 3>* begin() const {return first;}
+      const std::array<int, 3>* end() const {return last;}
+   };
+   
    /*!\brief SBC::SysBoundaryCondition is the base class for system boundary conditions.
     * 
     * SBC::SysBoundaryCondition defines a base class for applying boundary conditions.
@@ -158,6 +172,9 @@ namespace SBC {
             dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
             const std::vector<CellID> & local_cells_on_boundary
          );
+         virtual void updateFsGridBoundaryTable(
+            FsGrid< fsgrids::technical, 2> & technicalGrid
+         );
       bool doApplyUponRestart() const;
       void setPeriodicity(
          bool isFacePeriodic[3]
@@ -236,18 +253,68 @@ namespace SBC {
             creal& quenchingFactor,
             const uint popID
          );
+         void vlasovBoundaryReflectPerValue(
+            const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+            const CellID& cellID,
+            creal& nx,
+            creal& ny,
+            creal& nz,
+            const uint popID
+         );
+         int getBlockReflectionAxis(
+            const SpatialCell* cell,
+            creal& nx,
+            creal& ny,
+            creal& nz,
+            const uint popID
+         );
+         Realf* getOrAddBlockData(
+            SpatialCell* cell,
+            const vmesh::GlobalID& blockGID,
+            const uint popID
+         );
+         static void setMaxwellianBlock(
+            Realf* data,
+            const Real* blockParameters,
+            creal& rho,
+            creal& T,
+            creal& mass,
+            const Real* V0,
+            cuint& nVelocitySamples
+         );
          std::array<int, 3> getTheClosestNonsysboundaryCell(
             FsGrid< fsgrids::technical, 2> & technicalGrid,
             cint i,
             cint j,
             cint k
          );
-         std::vector< std::array<int, 3> > getAllClosestNonsysboundaryCells(
+         FsGridCellList getAllClosestNonsysboundaryCells(
+            FsGrid< fsgrids::technical, 2> & technicalGrid,
+            cint i,
+            cint j,
+            cint k
+         );
+         std::vector< std::array<int, 3> > findAllClosestNonsysboundaryCells(
             FsGrid< fsgrids::technical, 2> & technicalGrid,
             cint i,
             cint j,
             cint k
          );
+         /*! Flat index of local FsGrid cell (i,j,k), used as index of the FsGrid boundary tables.
+          * Ghost cells are not in the tables, so (i,j,k) has to be within the local domain.
+          */
+         inline int64_t fsGridLocalIndex(
+            FsGrid< fsgrids::technical, 2> & technicalGrid,
+            cint i,
+            cint j,
+            cint k
+         ) {
+            const std::array<int, 3>& localSize = technicalGrid.getLocalSize();
+            assert(i >= 0 && i < localSize[0] && j >= 0 && j < localSize[1] && k >= 0 && k < localSize[2]);
+            const int64_t n = i + (int64_t)localSize[0] * (j + (int64_t)localSize[1] * k);
+            assert(n >= 0);
+            return n;
+         }
          CellID & getTheClosestNonsysboundaryCell(
             const CellID& cellID
          );
@@ -271,6 +338,10 @@ namespace SBC {
          bool isPeriodic[3];
          /*! Map of closest nonsysboundarycells. Used in getAllClosestNonsysboundaryCells. */
          std::unordered_map<CellID, std::vector<CellID>> allClosestNonsysboundaryCells;
+         /*! Offsets into fsGridClosestNonsysboundaryCells, indexed by fsGridLocalIndex, with one extra entry at the end. The closest nonsysboundarycells of local FsGrid cell n are entries offsets[n] to offsets[n+1]-1; the range is empty for cells not of this boundary type. Built in updateFsGridBoundaryTable. */
+         std::vector<uint32_t> fsGridClosestNonsysboundaryOffsets;
+         /*! Flat list of closest nonsysboundarycells of the local FsGrid cells of this boundary. Used in getAllClosestNonsysboundaryCells. */
+         std::vector< std::array<int, 3> > fsGridClosestNonsysboundaryCells;
       
          /*! Array of cells into which the distribution function can flow. Used in getAllFlowtoCells. Cells into which one cannot flow are set to INVALID_CELLID. */
          std::unordered_map<CellID, std::array<SpatialCell*, 27>> allFlowtoCells;
@@ -0,0 +1,240 @@
+/*
+Test of the per velocity block kernels of the reflecting and absorbing Vlasov system boundaries.
+
+Fills a few neighbouring spatial cells with random sparse distributions on a velocity mesh
+symmetric about zero, applies the block kernels of SysBoundaryCondition::vlasovBoundaryReflect
+and SysBoundaryCondition::vlasovBoundaryAbsorb to them, and compares the resulting boundary cell
+distribution to the per value reference implementations reflectPerValue and absorbPerValue, which
+work one velocity cell at a time through get_value and increment_value. Reflection is compared for
+normals along the coordinate axes, the only ones for which the block kernels are used, absorption
+also for oblique normals. For oblique normals, where vlasovBoundaryReflect falls back to
+reflectPerValue, single velocity cells are checked to be reflected to their mirror image. Exits with
+failure if a relative difference exceeds the tolerance.
+
+Usage: test_vlasov_boundary [blocks per dimension] [tolerance]
+*/
+
+#include "cmath"
+#include "cstdlib"
+#include "iostream"
+#include "vector"
+
+#include "../vlasov_boundary_kernels.h"
+
+using namespace std;
+using namespace SBC;
+
+// Dense velocity mesh of N^3 blocks spanning [-vMax, vMax] in each dimension
+struct VelocityMesh {
+   int N;
+   Real vMax;
+   Real dv;
+
+   int blocks() const {return N*N*N;}
+   int blockIndex(const int i, const int j, const int k) const {return i + N*(j + N*k);}
+   void blockParameters(const int block, Real* parameters) const {
+      const int indices[3] = {block % N, (block / N) % N, block / (N*N)};
+      for (int d = 0; d < 3; d++) {
+         parameters[BlockParams::VXCRD+d] = -vMax + indices[d]*WID*dv;
+         parameters[BlockParams::DVX+d] = dv;
+      }
+   }
+   // Block and cell index of the velocity cell containing v, false if v is outside the mesh
+   bool locate(const Real v[3], int& block, int& cell) const {
+      int indices[3];
+      for (int d = 0; d < 3; d++) {
+         indices[d] = (int)floor((v[d] + vMax) / dv);
+         if (indices[d] < 0 || indices[d] >= N*WID) return false;
+      }
+      block = blockIndex(indices[0] / WID, indices[1] / WID, indices[2] / WID);
+      cell = cellIndex(indices[0] % WID, indices[1] % WID, indices[2] % WID);
+      return true;
+   }
+};
+
+// Sparse distribution of one spatial cell with the velocity block interface of SpatialCell used by the kernels
+struct TestCell {
+   const VelocityMesh* mesh;
+   vector<int> localIDs;      // Local ID of each block of the mesh, -1 if not present
+   vector<int> globalIDs;     // Mesh block of each local ID
+   vector<Real> parameters;
+   vector<Realf> data;
+
+   TestCell(const VelocityMesh& mesh) : mesh(&mesh), localIDs(mesh.blocks(), -1) {}
+   Realf* block(const int b) {
+      if (localIDs[b] < 0) {
+         localIDs[b] = globalIDs.size();
+         globalIDs.push_back(b);
+         parameters.resize(parameters.size() + BlockParams::N_VELOCITY_BLOCK_PARAMS);
+         mesh->blockParameters(b, &parameters[localIDs[b]*BlockParams::N_VELOCITY_BLOCK_PARAMS]);
+         data.resize(data.size() + WID3, 0.0);
+      }
+      return &data[localIDs[b]*WID3];
+   }
+   Realf value(const int b, const int c) const {return (localIDs[b] < 0) ? 0.0 : data[localIDs[b]*WID3 + c];}
+
+   vmesh::LocalID get_number_of_velocity_blocks(const uint) const {return globalIDs.size();}
+   const Real* get_block_parameters(const uint) const {return parameters.data();}
+   Realf get_value(const Real vx, const Real vy, const Real vz, const uint) const {
+      const Real v[3] = {vx, vy, vz};
+      int b, c;
+      if (!mesh->locate(v, b, c)) return 0.0;
+      return value(b, c);
+   }
+   void increment_value(const Real vx, const Real vy, const Real vz, const Realf value, const uint) {
+      const Real v[3] = {vx, vy, vz};
+      int b, c;
+      if (!mesh->locate(v, b, c)) return;
+      block(b)[c] += value;
+   }
+};
+
+// Reference: reflect, or absorb with quenchingFactor, one velocity cell at a time as vlasovBoundaryReflectPerValue does
+void perValue(
+   const vector<TestCell>& incoming,
+   const Real n[3],
+   const bool reflect,
+   const Real quenchingFactor,
+   TestCell& result
+) {
+   const Real factor = 1.0 / incoming.size();
+   for (size_t s = 0; s < incoming.size(); s++) {
+      if (reflect) {
+         reflectPerValue(incoming[s], result, n[0], n[1], n[2], factor, 0);
+      } else {
+         absorbPerValue(incoming[s], result, n[0], n[1], n[2], factor, quenchingFactor, 0);
+      }
+   }
+}
+
+// The block kernels, as vlasovBoundaryReflect and vlasovBoundaryAbsorb use them
+void perBlock(
+   const VelocityMesh& mesh,
+   const vector<TestCell>& incoming,
+   const Real n[3],
+   const bool reflect,
+   const Real quenchingFactor,
+   TestCell& result
+) {
+   const Real factor = 1.0 / incoming.size();
+   const int axis = (n[0] != 0.0) ? 0 : ((n[1] != 0.0) ? 1 : 2);
+   for (size_t s = 0; s < incoming.size(); s++) {
+      const Real* parameters = incoming[s].get_block_parameters(0);
+      for (size_t blockLID = 0; blockLID < incoming[s].globalIDs.size(); blockLID++) {
+         const int b = incoming[s].globalIDs[blockLID];
+         const Realf* fromData = &incoming[s].data[blockLID*WID3];
+         if (!reflect) {
+            absorbBlock(parameters, fromData, result.block(b), n[0], n[1], n[2], factor, factor*quenchingFactor);
+         } else {
+            Realf keepWeight[WID];
+            Realf mirrorWeight[WID];
+            bool keep, mirror;
+            reflectionWeights(parameters, axis, n[axis], factor, keepWeight, mirrorWeight, keep, mirror);
+            if (keep) addBlockLayers(axis, keepWeight, fromData, result.block(b));
+            if (mirror) {
+               int indices[3] = {b % mesh.N, (b / mesh.N) % mesh.N, b / (mesh.N*mesh.N)};
+               indices[axis] = mesh.N - 1 - indices[axis];
+               addMirroredBlockLayers(axis, mirrorWeight, fromData, result.block(mesh.blockIndex(indices[0], indices[1], indices[2])));
+            }
+         }
+         parameters += BlockParams::N_VELOCITY_BLOCK_PARAMS;
+      }
+   }
+}
+
+int main(int argc, char* argv[]) {
+   const int N = (argc > 1) ? atoi(argv[1]) : 6;
+   const double tolerance = (argc > 2) ? atof(argv[2]) : 1e-6;
+   const int nIncoming = 3;
+   const int nBoundaryCells = 4;
+
+   VelocityMesh mesh;
+   mesh.N = N;
+   mesh.vMax = 2.0e6;
+   mesh.dv = 2.0*mesh.vMax / (N*WID);
+
+   const Real s = 1.0 / sqrt(3.0);
+   const Real normals[][3] = {
+      {1.0, 0.0, 0.0}, {-1.0, 0.0, 0.0}, {0.0, 1.0, 0.0}, {0.0, -1.0, 0.0}, {0.0, 0.0, 1.0}, {0.0, 0.0, -1.0},
+      {s, s, s}, {-s, s, -s}, {0.6, -0.8, 0.0}
+   };
+   const int nAxisNormals = 6;
+   const int nNormals = sizeof(normals) / sizeof(normals[0]);
+   const Real quenchingFactors[] = {0.0, 0.3};
+
+   srand(1);
+   double maxDifference = 0.0;
+   int nCases = 0;
+   for (int cell = 0; cell < nBoundaryCells; cell++) {
+      // Random sparse distributions of the closest non-sysboundary cells
+      vector<TestCell> incoming(nIncoming, TestCell(mesh));
+      for (int i = 0; i < nIncoming; i++) {
+         for (int b = 0; b < mesh.blocks(); b++) {
+            if (rand() % 2) continue;
+            Realf* data = incoming[i].block(b);
+            for (int c = 0; c < WID3; c++) data[c] = (Realf)rand() / RAND_MAX;
+         }
+      }
+
+      for (int nn = 0; nn < nNormals; nn++) {
+         for (int mode = 0; mode < 3; mode++) {
+            const bool reflect = (mode == 2);
+            if (reflect && nn >= nAxisNormals) continue;
+            const Real quenchingFactor = reflect ? 0.0 : quenchingFactors[mode];
+
+            TestCell reference(mesh), result(mesh);
+            perValue(incoming, normals[nn], reflect, quenchingFactor, reference);
+            perBlock(mesh, incoming, normals[nn], reflect, quenchingFactor, result);
+
+            double maxValue = 0.0, difference = 0.0;
+            for (int b = 0; b < mesh.blocks(); b++) for (int c = 0; c < WID3; c++) {
+               maxValue = max(maxValue, fabs((double)reference.value(b, c)));
+               difference = max(difference, fabs((double)result.value(b, c) - reference.value(b, c)));
+            }
+            difference /= maxValue;
+            maxDifference = max(maxDifference, difference);
+            nCases++;
+            if (difference > tolerance) {
+               cerr << "Boundary cell " << cell << ", normal (" << normals[nn][0] << "," << normals[nn][1] << "," << normals[nn][2] << "), "
+                    << (reflect ? "reflect" : "absorb") << ": relative difference " << difference << " exceeds tolerance " << tolerance << endl;
+               return EXIT_FAILURE;
+            }
+         }
+      }
+   }
+
+   // Oblique normals only go through reflectPerValue: a single incoming velocity cell has to end up in
+   // the cell containing its mirror image v - 2 (v.n) n
+   for (int nn = nAxisNormals; nn < nNormals; nn++) {
+      const Real* n = normals[nn];
+      int nChecked = 0;
+      for (int trial = 0; trial < 1000 && nChecked < 20; trial++) {
+         const int b = rand() % mesh.blocks();
+         const int c = rand() % WID3;
+         TestCell incoming(mesh), result(mesh);
+         incoming.block(b)[c] = 1.0;
+         Real v[3];
+         const Real* parameters = incoming.get_block_parameters(0);
+         const int ic[3] = {c % WID, (c / WID) % WID, c / WID2};
+         for (int d = 0; d < 3; d++) v[d] = parameters[BlockParams::VXCRD+d] + (ic[d] + 0.5)*parameters[BlockParams::DVX+d];
+         const Real vNormal = v[0]*n[0] + v[1]*n[1] + v[2]*n[2];
+         const Real mirrored[3] = {v[0] - 2.0*vNormal*n[0], v[1] - 2.0*vNormal*n[1], v[2] - 2.0*vNormal*n[2]};
+         int mb, mc;
+         if (vNormal >= 0.0 || !mesh.locate(mirrored, mb, mc)) continue;
+
+         reflectPerValue(incoming, result, n[0], n[1], n[2], 1.0, 0);
+         double total = 0.0;
+         for (size_t i = 0; i < result.data.size(); i++) total += result.data[i];
+         if (result.value(mb, mc) != 1.0 || total != 1.0) {
+            cerr << "Normal (" << n[0] << "," << n[1] << "," << n[2] << "), reflect: velocity (" << v[0] << "," << v[1] << "," << v[2]
+                 << ") not mirrored to (" << mirrored[0] << "," << mirrored[1] << "," << mirrored[2] << ")" << endl;
+            return EXIT_FAILURE;
+         }
+         nChecked++;
+         nCases++;
+      }
+   }
+
+   cout << nCases << " cases, largest relative difference " << maxDifference << endl;
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,242 @@
+/*
+ * This file is part of Vlasiator.
+ * Copyright 2010-2016 Finnish Meteorological Institute
+ *
+ * For details of usage, see the COPYING file and read the "Rules of the Road"
+ * at http://www.physics.helsinki.fi/vlasiator/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef VLASOV_BOUNDARY_KERNELS_H
+#define VLASOV_BOUNDARY_KERNELS_H
+
+#include "../common.h"
+
+/*! Kernels of SysBoundaryCondition::vlasovBoundaryReflect and SysBoundaryCondition::vlasovBoundaryAbsorb.
+ * The per velocity block kernels only depend on the block parameters and data, the per value reference
+ * implementations on the get_value/increment_value interface of SpatialCell, so that both can be
+ * tested without a spatial cell, see sysboundary/tests.
+ */
+namespace SBC {
+   /*! Add the source block to the target block with the same global ID, scaled by factor where
+    * v.n >= 0 and by quenchedFactor where v.n < 0.
+    * \param blockParameters Parameters of the source block
+    * \param fromData Source block data
+    * \param toData Target block data
+    * \param nx,ny,nz Unit vector normal to the absorption plane
+    */
+   inline void absorbBlock(
+      const Real* blockParameters,
+      const Realf* fromData,
+      Realf* toData,
+      creal nx,
+      creal ny,
+      creal nz,
+      creal factor,
+      creal quenchedFactor
+   ) {
+      creal vxBlock = blockParameters[BlockParams::VXCRD];
+      creal vyBlock = blockParameters[BlockParams::VYCRD];
+      creal vzBlock = blockParameters[BlockParams::VZCRD];
+      creal dvxCell = blockParameters[BlockParams::DVX];
+      creal dvyCell = blockParameters[BlockParams::DVY];
+      creal dvzCell = blockParameters[BlockParams::DVZ];
+
+      for (uint kc=0; kc<WID; ++kc) for (uint jc=0; jc<WID; ++jc) {
+         creal vyCellCenter = vyBlock + (jc+convert<Real>(0.5))*dvyCell;
+         creal vzCellCenter = vzBlock + (kc+convert<Real>(0.5))*dvzCell;
+         #pragma omp simd
+         for (uint ic=0; ic<WID; ++ic) {
+            creal vxCellCenter = vxBlock + (ic+convert<Real>(0.5))*dvxCell;
+            // scalar product v.n, incoming parts are quenched
+            creal vNormal = vxCellCenter*nx + vyCellCenter*ny + vzCellCenter*nz;
+            toData[cellIndex(ic,jc,kc)] += ((vNormal >= 0.0) ? factor : quenchedFactor)*fromData[cellIndex(ic,jc,kc)];
+         }
+      }
+   }
+
+   /*! Weights of the velocity cell layers of a block along the reflection axis: the layers with
+    * v.n >= 0 are kept, the others are mirrored.
+    * \param blockParameters Parameters of the source block
+    * \param axis Coordinate axis of the normal
+    * \param nAxis Component of the normal along axis
+    * \param keep Set if any layer is kept
+    * \param mirror Set if any layer is mirrored
+    */
+   inline void reflectionWeights(
+      const Real* blockParameters,
+      const int axis,
+      creal nAxis,
+      creal factor,
+      Realf keepWeight[WID],
+      Realf mirrorWeight[WID],
+      bool& keep,
+      bool& mirror
+   ) {
+      keep = false;
+      mirror = false;
+      for (uint c=0; c<WID; ++c) {
+         creal vNormal = (blockParameters[BlockParams::VXCRD+axis] + (c+convert<Real>(0.5))*blockParameters[BlockParams::DVX+axis])*nAxis;
+         keepWeight[c] = (vNormal >= 0.0) ? factor : 0.0;
+         mirrorWeight[c] = (vNormal >= 0.0) ? 0.0 : factor;
+         keep = keep || (vNormal >= 0.0);
+         mirror = mirror || (vNormal < 0.0);
+      }
+   }
+
+   /*! Add the source block to the target block, the velocity cell layers along axis scaled by weight. */
+   inline void addBlockLayers(
+      const int axis,
+      const Realf weight[WID],
+      const Realf* fromData,
+      Realf* toData
+   ) {
+      for (uint kc=0; kc<WID; ++kc) for (uint jc=0; jc<WID; ++jc) {
+         #pragma omp simd
+         for (uint ic=0; ic<WID; ++ic) {
+            const uint layer = (axis == 0) ? ic : ((axis == 1) ? jc : kc);
+            toData[cellIndex(ic,jc,kc)] += weight[layer]*fromData[cellIndex(ic,jc,kc)];
+         }
+      }
+   }
+
+   /*! Add the source block mirrored along axis to the target block, the velocity cell layers
+    * along axis scaled by weight. Layer c of the source goes to layer WID-1-c of the target.
+    */
+   inline void addMirroredBlockLayers(
+      const int axis,
+      const Realf weight[WID],
+      const Realf* fromData,
+      Realf* toData
+   ) {
+      // Offset between a velocity cell and the next one along the normal within a block
+      const int stride = (axis == 0) ? 1 : ((axis == 1) ? WID : WID2);
+      for (uint kc=0; kc<WID; ++kc) for (uint jc=0; jc<WID; ++jc) {
+         #pragma omp simd
+         for (uint ic=0; ic<WID; ++ic) {
+            const int layer = (axis == 0) ? ic : ((axis == 1) ? jc : kc);
+            toData[cellIndex(ic,jc,kc) + (WID-1-2*layer)*stride] += weight[layer]*fromData[cellIndex(ic,jc,kc)];
+         }
+      }
+   }
+
+   /*! Reference implementation of the reflection working one velocity cell at a time: adds factor times
+    * the distribution of incomingCell to cell, with the parts going in the direction opposite to the normal
+    * reflected. Handles arbitrary normals and velocity meshes, used by vlasovBoundaryReflect when the block
+    * kernels do not apply.
+    * \param incomingCell Cell to take the distribution from
+    * \param cell Cell to add the reflected distribution to
+    * \param nx,ny,nz Unit vector normal to the bounce/reflection plane
+    */
+   template<typename SOURCE_CELL, typename TARGET_CELL>
+   void reflectPerValue(
+      const SOURCE_CELL& incomingCell,
+      TARGET_CELL& cell,
+      creal nx,
+      creal ny,
+      creal nz,
+      creal factor,
+      const uint popID
+   ) {
+      const Real* blockParameters = incomingCell.get_block_parameters(popID);
+      for (vmesh::LocalID blockLID=0; blockLID<incomingCell.get_number_of_velocity_blocks(popID); ++blockLID) {
+         // check where cells are
+         creal vxBlock = blockParameters[BlockParams::VXCRD];
+         creal vyBlock = blockParameters[BlockParams::VYCRD];
+         creal vzBlock = blockParameters[BlockParams::VZCRD];
+         creal dvxCell = blockParameters[BlockParams::DVX];
+         creal dvyCell = blockParameters[BlockParams::DVY];
+         creal dvzCell = blockParameters[BlockParams::DVZ];
+         for (uint kc=0; kc<WID; ++kc) for (uint jc=0; jc<WID; ++jc) for (uint ic=0; ic<WID; ++ic) {
+            creal vxCellCenter = vxBlock + (ic+convert<Real>(0.5))*dvxCell;
+            creal vyCellCenter = vyBlock + (jc+convert<Real>(0.5))*dvyCell;
+            creal vzCellCenter = vzBlock + (kc+convert<Real>(0.5))*dvzCell;
+            // scalar product v.n
+            creal vNormal = vxCellCenter*nx + vyCellCenter*ny + vzCellCenter*nz;
+            if (vNormal >= 0.0) {
+               // Not flowing in, leave as is.
+               cell.increment_value(
+                  vxCellCenter,
+                  vyCellCenter,
+                  vzCellCenter,
+                  factor*incomingCell.get_value(vxCellCenter, vyCellCenter, vzCellCenter, popID),
+                  popID
+               );
+            } else {
+               // Flowing in, bounce off.
+               cell.increment_value(
+                  vxCellCenter - 2.0*vNormal*nx,
+                  vyCellCenter - 2.0*vNormal*ny,
+                  vzCellCenter - 2.0*vNormal*nz,
+                  factor*incomingCell.get_value(vxCellCenter, vyCellCenter, vzCellCenter, popID),
+                  popID
+               );
+            }
+         } // for-loop over cells in velocity block
+         blockParameters += BlockParams::N_VELOCITY_BLOCK_PARAMS;
+      } // for-loop over velocity blocks
+   }
+
+   /*! Reference implementation of the absorption working one velocity cell at a time: adds factor times
+    * the distribution of incomingCell to cell, with the parts going in the direction opposite to the normal
+    * scaled by quenchingFactor.
+    * \param incomingCell Cell to take the distribution from
+    * \param cell Cell to add the absorbed distribution to
+    * \param nx,ny,nz Unit vector normal to the absorption plane
+    * \param quenchingFactor Multiplicative factor of the incoming parts. 0: absorb. ]0;1[: quench.
+    */
+   template<typename SOURCE_CELL, typename TARGET_CELL>
+   void absorbPerValue(
+      const SOURCE_CELL& incomingCell,
+      TARGET_CELL& cell,
+      creal nx,
+      creal ny,
+      creal nz,
+      creal factor,
+      creal quenchingFactor,
+      const uint popID
+   ) {
+      const Real* blockParameters = incomingCell.get_block_parameters(popID);
+      for (vmesh::LocalID blockLID=0; blockLID<incomingCell.get_number_of_velocity_blocks(popID); ++blockLID) {
+         // check where cells are
+         creal vxBlock = blockParameters[BlockParams::VXCRD];
+         creal vyBlock = blockParameters[BlockParams::VYCRD];
+         creal vzBlock = blockParameters[BlockParams::VZCRD];
+         creal dvxCell = blockParameters[BlockParams::DVX];
+         creal dvyCell = blockParameters[BlockParams::DVY];
+         creal dvzCell = blockParameters[BlockParams::DVZ];
+         for (uint kc=0; kc<WID; ++kc) for (uint jc=0; jc<WID; ++jc) for (uint ic=0; ic<WID; ++ic) {
+            creal vxCellCenter = vxBlock + (ic+convert<Real>(0.5))*dvxCell;
+            creal vyCellCenter = vyBlock + (jc+convert<Real>(0.5))*dvyCell;
+            creal vzCellCenter = vzBlock + (kc+convert<Real>(0.5))*dvzCell;
+            // scalar product v.n
+            creal vNormal = vxCellCenter*nx + vyCellCenter*ny + vzCellCenter*nz;
+            // Parts flowing in are quenched, the rest is left as is.
+            creal weight = (vNormal >= 0.0) ? factor : factor*quenchingFactor;
+            cell.increment_value(
+               vxCellCenter,
+               vyCellCenter,
+               vzCellCenter,
+               weight*incomingCell.get_value(vxCellCenter, vyCellCenter, vzCellCenter, popID),
+               popID
+            );
+         } // for-loop over cells in velocity block
+         blockParameters += BlockParams::N_VELOCITY_BLOCK_PARAMS;
+      } // for-loop over velocity blocks
+   }
+}
+
+#endif
@@ -0,0 +1,162 @@
+/*
+Round trip test of the velocity block compression of Vlasiator output files.
+
+Encodes the distribution functions of a number of cells with velocity_block_compression.h
+in all modes and for float and double values, concatenates the chunks as iowrite.cpp does
+and decodes every cell again through the chunk byte sizes, as ioread.cpp and the tools do.
+Checks that
+- lossless and raw chunks decode bit for bit, including zeros, denormals, infinities and NaNs,
+- quantized chunks decode within the tolerance plus the rounding to the stored type,
+- chunks that would not get smaller are stored raw,
+- truncated chunks and a wrong value type are reported as malformed instead of decoded.
+Reports the compression ratio of each mode. Exits with failure if a check fails.
+
+Usage: test_block_compression [cells] [seed]
+*/
+
+#include "cmath"
+#include "cstdlib"
+#include "cstring"
+#include "iostream"
+#include "limits"
+#include "vector"
+
+#include "../../velocity_block_compression.h"
+
+using namespace std;
+
+const uint64_t WID3 = 64;
+
+/*
+Distribution of one cell: a drifting Maxwellian sampled in blocks of WID3 values, with
+values below the sparsity threshold dropped as the sparse velocity mesh would. A few cells
+get special values to test the bitwise round trip of the lossless mode.
+*/
+template<typename T> vector<T> cellDistribution(const int cell,const double threshold) {
+   const uint64_t N_blocks = 1 + rand() % 200;
+   vector<T> values(N_blocks*WID3);
+   const double drift = 2.0*rand()/RAND_MAX;
+   for (uint64_t i=0; i<values.size(); ++i) {
+      const double v = 4.0*i/values.size() - 2.0 - drift;
+      const double f = 1.0e-9*exp(-v*v) * (1.0 + 0.01*rand()/RAND_MAX);
+      values[i] = (f < threshold) ? 0.0 : f;
+   }
+   if (cell % 7 == 3) {
+      values[0] = numeric_limits<T>::denorm_min();
+      values[1] = -numeric_limits<T>::infinity();
+      values[2] = numeric_limits<T>::quiet_NaN();
+      values[3] = -0.0;
+   }
+   return values;
+}
+
+template<typename T> bool test(const int N_cells,const blockcompression::Mode mode,const double threshold,const double tolerance) {
+   const string name = blockcompression::modeName(mode) + (sizeof(T) == sizeof(float) ? " float" : " double");
+   const bool lossy = (mode == blockcompression::QUANTIZED);
+
+   // Encode all cells into one buffer, as the BLOCKVARIABLE_COMPRESSED array
+   vector<vector<T> > cells(N_cells);
+   vector<uint64_t> bytesPerCell(N_cells);
+   vector<char> compressed;
+   uint64_t rawBytes = 0;
+   for (int c=0; c<N_cells; ++c) {
+      cells[c] = cellDistribution<T>(c,threshold);
+      // Quantization of infinities and NaNs is undefined, the writer never sees them
+      if (lossy) for (uint64_t i=0; i<cells[c].size(); ++i) if (!isfinite(cells[c][i])) cells[c][i] = 0.0;
+      bytesPerCell[c] = blockcompression::encode(cells[c].data(),cells[c].size(),mode,tolerance,compressed);
+      rawBytes += cells[c].size()*sizeof(T);
+   }
+   // An empty cell and a cell of random bits that cannot be compressed
+   cells.push_back(vector<T>());
+   bytesPerCell.push_back(blockcompression::encode(cells.back().data(),0,mode,tolerance,compressed));
+   vector<T> noise(WID3);
+   if (lossy) {
+      // Random values of about 2^59 quantization steps need more bytes as varints than as values
+      for (uint64_t i=0; i<WID3; ++i) noise[i] = 1.0e3*rand()/RAND_MAX;
+   } else {
+      vector<unsigned char> bytes(WID3*sizeof(T));
+      for (size_t i=0; i<bytes.size(); ++i) bytes[i] = rand() % 256;
+      memcpy(noise.data(),bytes.data(),bytes.size());
+   }
+   const size_t noiseStart = compressed.size();
+   cells.push_back(noise);
+   bytesPerCell.push_back(blockcompression::encode(noise.data(),WID3,mode,lossy ? 1.0e-15 : tolerance,compressed));
+   if (compressed[noiseStart] != blockcompression::RAW || bytesPerCell.back() != blockcompression::HEADER_SIZE + WID3*sizeof(T)) {
+      cerr << name << ": incompressible cell not stored raw" << endl;
+      return false;
+   }
+
+   // Decode each cell from its offset, as the readers do with BLOCKVARIABLEBYTES
+   uint64_t offset = 0;
+   double maxError = 0.0;
+   for (size_t c=0; c<cells.size(); ++c) {
+      const char* chunk = compressed.data() + offset;
+      const uint64_t N_values = cells[c].size();
+      vector<T> decoded(N_values + 1);
+      if (blockcompression::valueSize(chunk,bytesPerCell[c]) != sizeof(T)
+          || blockcompression::decode(chunk,bytesPerCell[c],N_values,decoded.data()) == false) {
+         cerr << name << ": failed to decode cell " << c << endl;
+         return false;
+      }
+      const bool raw = (chunk[0] == blockcompression::RAW);
+      for (uint64_t i=0; i<N_values; ++i) {
+         if (lossy && !raw) {
+            const double error = fabs((double)decoded[i] - (double)cells[c][i]);
+            maxError = max(maxError,error);
+            if (error > tolerance + fabs((double)cells[c][i])*numeric_limits<T>::epsilon()) {
+               cerr << name << ": cell " << c << " value " << i << " error " << error << " exceeds tolerance " << tolerance << endl;
+               return false;
+            }
+         } else if (memcmp(&decoded[i],&cells[c][i],sizeof(T)) != 0) {
+            cerr << name << ": cell " << c << " value " << i << " differs after round trip" << endl;
+            return false;
+         }
+      }
+
+      // Truncated chunks and chunks read as the wrong type are malformed
+      if (bytesPerCell[c] > blockcompression::HEADER_SIZE) {
+         if (blockcompression::decode(chunk,bytesPerCell[c]-1,N_values,decoded.data()) == true) {
+            cerr << name << ": truncated chunk of cell " << c << " decoded" << endl;
+            return false;
+         }
+      }
+      if (sizeof(T) == sizeof(float)) {
+         vector<double> wrongType(N_values + 1);
+         if (blockcompression::decode(chunk,bytesPerCell[c],N_values,wrongType.data()) == true) {
+            cerr << name << ": float chunk of cell " << c << " decoded as double" << endl;
+            return false;
+         }
+      }
+      offset += bytesPerCell[c];
+   }
+   if (offset != compressed.size()) {
+      cerr << name << ": chunk sizes do not add up to the compressed size" << endl;
+      return false;
+   }
+
+   cout << name << ": " << N_cells << " cells, ratio " << (double)rawBytes/(offset - bytesPerCell.back() - bytesPerCell[N_cells]);
+   if (lossy) cout << ", largest error " << maxError << " for tolerance " << tolerance;
+   cout << endl;
+   return true;
+}
+
+int main(int argc,char* argv[]) {
+   const int N_cells = (argc > 1) ? atoi(argv[1]) : 100;
+   const int seed = (argc > 2) ? atoi(argv[2]) : 1;
+   srand(seed);
+
+   // Sparsity threshold and the default quantization tolerance relative to it
+   const double threshold = 1.0e-15;
+   const double tolerance = 0.01*threshold;
+
+   bool success = true;
+   success = test<float>(N_cells,blockcompression::RAW,threshold,tolerance) && success;
+   success = test<float>(N_cells,blockcompression::LOSSLESS,threshold,tolerance) && success;
+   success = test<float>(N_cells,blockcompression::QUANTIZED,threshold,tolerance) && success;
+   success = test<double>(N_cells,blockcompression::RAW,threshold,tolerance) && success;
+   success = test<double>(N_cells,blockcompression::LOSSLESS,threshold,tolerance) && success;
+   success = test<double>(N_cells,blockcompression::QUANTIZED,threshold,tolerance) && success;
+   // A zero tolerance falls back to lossless
+   success = test<float>(N_cells,blockcompression::QUANTIZED,threshold,0.0) && success;
+   return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
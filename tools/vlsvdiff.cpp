@@ -759,8 +759,8 @@ bool readAvgs( T & vlsvReader,
    attribs.push_back(make_pair("mesh", attributes["--meshname"]));
 
    datatype::type dataType;
-   uint64_t arraySize, vectorSize, dataSize;
-   if (vlsvReader.getArrayInfo("BLOCKVARIABLE", attribs, arraySize, vectorSize, dataType, dataSize) == false) {
+   uint64_t vectorSize, dataSize;
+   if (vlsvReader.getBlockVariableInfo(attribs, vectorSize, dataType, dataSize) == false) {
       //no 
 //      cerr << "ERROR READING BLOCKVARIABLE AT " << __FILE__ << " " << __LINE__ << endl;
       return false;
@@ -789,7 +789,7 @@ bool readAvgs( T & vlsvReader,
    }
 
    char* buffer = new char[N_blocks * vectorSize * dataSize];
-   if (vlsvReader.readArray("BLOCKVARIABLE", attribs, blockOffset, N_blocks, buffer) == false) {
+   if (vlsvReader.readBlockVariable(attribs, blockOffset, N_blocks, buffer) == false) {
       cerr << "ERROR could not read block variable at " << __FILE__ << " " << __LINE__ << endl;
       delete[] buffer;
       return false;
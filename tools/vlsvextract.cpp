@@ -154,8 +154,7 @@ bool convertSlicedVelocityMesh(vlsvinterface::Reader& vlsvReader,const string& f
 
    // Get the names of velocity mesh variables
    set<string> blockVarNames;
-   const string attributeName = "name";
-   if (vlsvReader.getUniqueAttributeValues("BLOCKVARIABLE",attributeName,blockVarNames) == false) {
+   if (vlsvReader.getBlockVariableNames(blockVarNames) == false) {
       cerr << "ERROR, FAILED TO GET UNIQUE ATTRIBUTE VALUES AT " << __FILE__ << " " << __LINE__ << endl;
    }
 
@@ -204,10 +203,9 @@ bool convertSlicedVelocityMesh(vlsvinterface::Reader& vlsvReader,const string& f
          list<pair<string,string> > attribs;
          attribs.push_back(make_pair("name",*var));
          attribs.push_back(make_pair("mesh",meshName));
-         uint64_t arraySize;
          BlockVarInfo vinfo;
          vinfo.name = *var;
-         if (vlsvReader.getArrayInfo("BLOCKVARIABLE",attribs,arraySize,vinfo.vectorSize,vinfo.dataType,vinfo.dataSize) == false) {
+         if (vlsvReader.getBlockVariableInfo(attribs,vinfo.vectorSize,vinfo.dataType,vinfo.dataSize) == false) {
             cerr << "Could not read BLOCKVARIABLE array info" << endl;
          }
          varInfo.push_back(vinfo);
@@ -868,8 +866,7 @@ bool convertVelocityBlocks2(
    // Get the names of velocity mesh variables. NOTE: This will find _all_ particle populations
    // which are stored in their separate meshes.
    set<string> blockVarNames;
-   const string attributeName = "name";
-   if (vlsvReader.getUniqueAttributeValues( "BLOCKVARIABLE", attributeName, blockVarNames) == false) {
+   if (vlsvReader.getBlockVariableNames(blockVarNames) == false) {
       cerr << "ERROR, FAILED TO GET UNIQUE ATTRIBUTE VALUES AT " << __FILE__ << " " << __LINE__ << endl;
    }
 
@@ -883,14 +880,14 @@ bool convertVelocityBlocks2(
          attribs.push_back(make_pair("name", *it));
          attribs.push_back(make_pair("mesh", meshName));
          datatype::type dataType;
-         uint64_t arraySize, vectorSize, dataSize;
-         if (vlsvReader.getArrayInfo("BLOCKVARIABLE", attribs, arraySize, vectorSize, dataType, dataSize) == false) {
+         uint64_t vectorSize, dataSize;
+         if (vlsvReader.getBlockVariableInfo(attribs, vectorSize, dataType, dataSize) == false) {
             cerr << "Could not read BLOCKVARIABLE array info in " << __FILE__ << ":" << __LINE__ << endl;
             return false;
          }
 	 
          char* buffer = new char[N_blocks * vectorSize * dataSize];
-         if (vlsvReader.readArray("BLOCKVARIABLE", attribs, vlsvReader.getBlockOffset(cellID), N_blocks, buffer) == false) {
+         if (vlsvReader.readBlockVariable(attribs, vlsvReader.getBlockOffset(cellID), N_blocks, buffer) == false) {
             cerr << "ERROR could not read block variable in " << __FILE__ << ":" << __LINE__ << endl;
             delete[] buffer;
             return success;
@@ -21,6 +21,7 @@
  */
 #include <iostream>
 #include "vlsvreaderinterface.h"
+#include "velocity_block_compression.h"
 
 using namespace std;
 
@@ -355,8 +356,8 @@ namespace vlsvinterface {
       attribs.push_back(make_pair("mesh", "SpatialGrid"));
 
       vlsv::datatype::type dataType;
-      uint64_t arraySize, vectorSize, dataSize;
-      if (getArrayInfo("BLOCKVARIABLE", attribs, arraySize, vectorSize, dataType, dataSize) == false) {
+      uint64_t vectorSize, dataSize;
+      if (getBlockVariableInfo(attribs, vectorSize, dataType, dataSize) == false) {
          cerr << "Could not read BLOCKVARIABLE array info" << endl;
          return false;
       }
@@ -370,7 +371,7 @@ namespace vlsvinterface {
       }
    
       //Read the variables (Note: usually vectorSize = 64)
-      if (readArray("BLOCKVARIABLE", attribs, offset, amountToReadIn, buffer) == false) {
+      if (readBlockVariable(attribs, offset, amountToReadIn, buffer) == false) {
          cerr << "ERROR could not read block variable" << endl;
          if( allocateMemory == true ) {
             delete[] buffer; buffer = NULL;
@@ -380,4 +381,107 @@ namespace vlsvinterface {
       return true;
    }
 
+   bool Reader::getBlockVariableNames(set<string> & names) {
+      const string attributeName = "name";
+      set<string> compressedNames;
+      const bool found = getUniqueAttributeValues("BLOCKVARIABLE", attributeName, names);
+      const bool foundCompressed = getUniqueAttributeValues("BLOCKVARIABLE_COMPRESSED", attributeName, compressedNames);
+      names.insert(compressedNames.begin(), compressedNames.end());
+      return found || foundCompressed;
+   }
+
+   bool Reader::getBlockVariableInfo(const list<pair<string, string> > & attribs,uint64_t & vectorSize,vlsv::datatype::type & dataType,uint64_t & dataSize) {
+      uint64_t arraySize;
+      if (getArrayInfo("BLOCKVARIABLE", attribs, arraySize, vectorSize, dataType, dataSize) == true) return true;
+
+      uint64_t chunkVectorSize, chunkDataSize;
+      vlsv::datatype::type chunkDataType;
+      if (getArrayInfo("BLOCKVARIABLE_COMPRESSED", attribs, arraySize, chunkVectorSize, chunkDataType, chunkDataSize) == false) return false;
+      // All chunks have the value size of the distribution function in their header, read it from the first one
+      char header[blockcompression::HEADER_SIZE];
+      if (arraySize < blockcompression::HEADER_SIZE) return false;
+      if (readArray("BLOCKVARIABLE_COMPRESSED", attribs, 0, blockcompression::HEADER_SIZE, header) == false) return false;
+      vectorSize = 64;
+      dataType = vlsv::datatype::type::FLOAT;
+      dataSize = blockcompression::valueSize(header, blockcompression::HEADER_SIZE);
+      return dataSize == sizeof(float) || dataSize == sizeof(double);
+   }
+
+   const unordered_map<uint64_t, pair<uint64_t, uint64_t> >* Reader::getCompressedLocations(const list<pair<string, string> > & attribs) {
+      string key;
+      for (list<pair<string, string> >::const_iterator it = attribs.begin(); it != attribs.end(); ++it) {
+         key += it->first + "=" + it->second + ";";
+      }
+      map<string, unordered_map<uint64_t, pair<uint64_t, uint64_t> > >::const_iterator found = compressedLocations.find(key);
+      if (found != compressedLocations.end()) return &(found->second);
+
+      // Blocks and chunk bytes per cell, both in CELLSWITHBLOCKS order
+      vlsv::datatype::type nb_dataType, bytes_dataType;
+      uint64_t nb_arraySize, nb_vectorSize, nb_dataSize;
+      uint64_t bytes_arraySize, bytes_vectorSize, bytes_dataSize;
+      if (getArrayInfo("BLOCKSPERCELL", attribs, nb_arraySize, nb_vectorSize, nb_dataType, nb_dataSize) == false
+          || getArrayInfo("BLOCKVARIABLEBYTES", attribs, bytes_arraySize, bytes_vectorSize, bytes_dataType, bytes_dataSize) == false) {
+         cerr << "ERROR, COULD NOT FIND ARRAY BLOCKSPERCELL OR BLOCKVARIABLEBYTES AT " << __FILE__ << " " << __LINE__ << endl;
+         return NULL;
+      }
+      if (nb_arraySize != bytes_arraySize) {
+         cerr << "ERROR, BLOCKSPERCELL AND BLOCKVARIABLEBYTES SIZES DIFFER AT " << __FILE__ << " " << __LINE__ << endl;
+         return NULL;
+      }
+      vector<char> nb_buffer(nb_arraySize * nb_vectorSize * nb_dataSize + 1);
+      vector<char> bytes_buffer(bytes_arraySize * bytes_vectorSize * bytes_dataSize + 1);
+      if (readArray("BLOCKSPERCELL", attribs, 0, nb_arraySize, nb_buffer.data()) == false
+          || readArray("BLOCKVARIABLEBYTES", attribs, 0, bytes_arraySize, bytes_buffer.data()) == false) {
+         cerr << "ERROR, FAILED TO READ BLOCKSPERCELL OR BLOCKVARIABLEBYTES AT " << __FILE__ << " " << __LINE__ << endl;
+         return NULL;
+      }
+
+      unordered_map<uint64_t, pair<uint64_t, uint64_t> > & locations = compressedLocations[key];
+      uint64_t blockOffset = 0;
+      uint64_t byteOffset = 0;
+      for (uint64_t cell = 0; cell < nb_arraySize; ++cell) {
+         const uint64_t N_blocks = convUInt(nb_buffer.data() + cell*nb_dataSize, nb_dataType, nb_dataSize);
+         const uint64_t N_bytes = convUInt(bytes_buffer.data() + cell*bytes_dataSize, bytes_dataType, bytes_dataSize);
+         // A cell without blocks shares its block offset with the next cell but is never read
+         if (N_blocks > 0) locations[blockOffset] = make_pair(byteOffset, N_bytes);
+         blockOffset += N_blocks;
+         byteOffset += N_bytes;
+      }
+      return &locations;
+   }
+
+   bool Reader::readBlockVariable(const list<pair<string, string> > & attribs,const uint64_t & blockOffset,const uint64_t & N_blocks,char* buffer) {
+      vlsv::datatype::type dataType;
+      uint64_t arraySize, vectorSize, dataSize;
+      if (getArrayInfo("BLOCKVARIABLE", attribs, arraySize, vectorSize, dataType, dataSize) == true) {
+         return readArray("BLOCKVARIABLE", attribs, blockOffset, N_blocks, buffer);
+      }
+      if (N_blocks == 0) return true;
+
+      const unordered_map<uint64_t, pair<uint64_t, uint64_t> >* locations = getCompressedLocations(attribs);
+      if (locations == NULL) return false;
+      unordered_map<uint64_t, pair<uint64_t, uint64_t> >::const_iterator it = locations->find(blockOffset);
+      if (it == locations->end()) {
+         cerr << "ERROR, NO COMPRESSED BLOCK DATA AT BLOCK OFFSET " << blockOffset << " AT " << __FILE__ << " " << __LINE__ << endl;
+         return false;
+      }
+      vector<char> chunk(it->second.second);
+      if (readArray("BLOCKVARIABLE_COMPRESSED", attribs, it->second.first, chunk.size(), chunk.data()) == false) {
+         cerr << "ERROR, FAILED TO READ BLOCKVARIABLE_COMPRESSED AT " << __FILE__ << " " << __LINE__ << endl;
+         return false;
+      }
+
+      const uint64_t N_values = N_blocks * 64;
+      bool success = false;
+      if (blockcompression::valueSize(chunk.data(), chunk.size()) == sizeof(float)) {
+         success = blockcompression::decode(chunk.data(), chunk.size(), N_values, reinterpret_cast<float*>(buffer));
+      } else {
+         success = blockcompression::decode(chunk.data(), chunk.size(), N_values, reinterpret_cast<double*>(buffer));
+      }
+      if (success == false) {
+         cerr << "ERROR, MALFORMED BLOCKVARIABLE_COMPRESSED CHUNK AT " << __FILE__ << " " << __LINE__ << endl;
+      }
+      return success;
+   }
+
 } // namespace vlsvinterface
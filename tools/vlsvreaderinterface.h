@@ -26,6 +26,9 @@
 #define TOOL_NOT_PARALLEL
 
 #include <map>
+#include <set>
+#include <list>
+#include <string>
 #include <vector>
 #include <unordered_map>
 #include <array>
@@ -42,6 +45,10 @@ namespace vlsvinterface {
       std::unordered_map<uint64_t, std::pair<uint64_t, uint32_t> > cellsWithBlocksLocations;
       bool cellIdsSet;
       bool cellsWithBlocksSet;
+      // Byte offset and size of the chunk of each cell in BLOCKVARIABLE_COMPRESSED, keyed by the
+      // block offset of the cell, for each set of BLOCKVARIABLE attributes read so far
+      std::map<std::string, std::unordered_map<uint64_t, std::pair<uint64_t, uint64_t> > > compressedLocations;
+      const std::unordered_map<uint64_t, std::pair<uint64_t, uint64_t> >* getCompressedLocations( const std::list<std::pair<std::string, std::string> > & attribs );
    public:
       Reader();
       virtual ~Reader();
@@ -65,6 +72,11 @@ namespace vlsvinterface {
          cellsWithBlocksSet = false;
       }
       bool getVelocityBlockVariables( const std::string & variableName, const uint64_t & cellId, char*& buffer, bool allocateMemory = true );
+      // Velocity block data is written either as BLOCKVARIABLE or, with io.distribution_compression,
+      // as BLOCKVARIABLE_COMPRESSED. These read both, the latter is decoded to what BLOCKVARIABLE would hold.
+      bool getBlockVariableNames( std::set<std::string> & names );
+      bool getBlockVariableInfo( const std::list<std::pair<std::string, std::string> > & attribs, uint64_t & vectorSize, vlsv::datatype::type & dataType, uint64_t & dataSize );
+      bool readBlockVariable( const std::list<std::pair<std::string, std::string> > & attribs, const uint64_t & blockOffset, const uint64_t & N_blocks, char* buffer );
 
       inline uint64_t getBlockOffset( const uint64_t & cellId ) {
          //Check if the cell id can be found:
@@ -0,0 +1,229 @@
+/*
+ * This file is part of Vlasiator.
+ * Copyright 2010-2016 Finnish Meteorological Institute
+ *
+ * For details of usage, see the COPYING file and read the "Rules of the Road"
+ * at http://www.physics.helsinki.fi/vlasiator/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef VELOCITY_BLOCK_COMPRESSION_H
+#define VELOCITY_BLOCK_COMPRESSION_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/** Compression of velocity block data (BLOCKVARIABLE) for output files.
+ *
+ * The distribution function of one spatial cell is encoded into one self-contained
+ * chunk, so that a reader can decode any single cell once it knows the byte size of
+ * the chunks before it (stored in BLOCKVARIABLEBYTES in CELLSWITHBLOCKS order).
+ *
+ * A chunk starts with two bytes, the mode and the byte size of one value, followed by
+ * the payload:
+ * - RAW:       the values as they are.
+ * - LOSSLESS:  each value is XORed with the bits of the previous one, the result is
+ *              split into byte planes and zero bytes are run-length coded. Most values
+ *              are close to the sparsity threshold and to their neighbours, so the sign,
+ *              exponent and high mantissa bytes are mostly zero after the XOR.
+ * - QUANTIZED: the values are rounded to the nearest multiple of step = 2*tolerance
+ *              (so the absolute error is at most tolerance, plus the rounding to the stored
+ *              type on decoding), and the differences of
+ *              consecutive integers are stored as zigzag varints. The step is stored
+ *              as a double in front of the varints.
+ * The encoder falls back to RAW for a cell if the encoded chunk would be larger.
+ */
+namespace blockcompression {
+
+   enum Mode : uint8_t {
+      RAW = 0,
+      LOSSLESS = 1,
+      QUANTIZED = 2
+   };
+
+   const size_t HEADER_SIZE = 2;
+
+   /** Parse the name of a compression mode.
+    * @return False if the name is not known.*/
+   inline bool parseMode(const std::string& name,bool& compress,Mode& mode) {
+      if (name == "none")      { compress = false; mode = RAW;       return true; }
+      if (name == "lossless")  { compress = true;  mode = LOSSLESS;  return true; }
+      if (name == "quantized") { compress = true;  mode = QUANTIZED; return true; }
+      return false;
+   }
+
+   inline std::string modeName(const Mode mode) {
+      switch (mode) {
+         case LOSSLESS:  return "lossless";
+         case QUANTIZED: return "quantized";
+         default:        return "raw";
+      }
+   }
+
+   inline void putVarint(uint64_t value,std::vector<char>& out) {
+      while (value >= 0x80) {
+         out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+         value >>= 7;
+      }
+      out.push_back(static_cast<char>(value));
+   }
+
+   inline bool getVarint(const char*& in,const char* end,uint64_t& value) {
+      value = 0;
+      for (int shift=0; shift<64; shift+=7) {
+         if (in >= end) return false;
+         const uint8_t byte = static_cast<uint8_t>(*in++);
+         value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+         if ((byte & 0x80) == 0) return true;
+      }
+      return false;
+   }
+
+   /** Encode the values of one cell, the chunk is appended to out.
+    * @param data Values to encode.
+    * @param n Number of values.
+    * @param mode Requested encoding.
+    * @param tolerance Maximum absolute error, only used by QUANTIZED.
+    * @param out Buffer the chunk is appended to.
+    * @return Size of the chunk in bytes.*/
+   template<typename T>
+   size_t encode(const T* data,const uint64_t n,Mode mode,const double tolerance,std::vector<char>& out) {
+      typedef typename std::conditional<sizeof(T) == sizeof(uint32_t),uint32_t,uint64_t>::type Bits;
+      static_assert(sizeof(T) == sizeof(Bits),"Velocity block compression supports 4 and 8 byte values");
+
+      const size_t start = out.size();
+      const size_t rawSize = n*sizeof(T);
+      if (mode == QUANTIZED && !(tolerance > 0.0)) mode = LOSSLESS;
+      out.push_back(static_cast<char>(mode));
+      out.push_back(static_cast<char>(sizeof(T)));
+
+      if (mode == LOSSLESS) {
+         Bits previous = 0;
+         std::vector<uint8_t> planes(rawSize);
+         for (uint64_t i=0; i<n; ++i) {
+            Bits bits;
+            std::memcpy(&bits,&data[i],sizeof(T));
+            const Bits x = bits ^ previous;
+            previous = bits;
+            for (size_t b=0; b<sizeof(T); ++b) planes[b*n + i] = static_cast<uint8_t>(x >> (8*b));
+         }
+         for (size_t i=0; i<rawSize; ) {
+            if (planes[i] != 0) {
+               out.push_back(static_cast<char>(planes[i]));
+               ++i;
+               continue;
+            }
+            size_t run = 0;
+            while (i < rawSize && planes[i] == 0) { ++run; ++i; }
+            out.push_back(0);
+            putVarint(run,out);
+         }
+      } else if (mode == QUANTIZED) {
+         const double step = 2.0*tolerance;
+         const char* stepBytes = reinterpret_cast<const char*>(&step);
+         out.insert(out.end(),stepBytes,stepBytes + sizeof(double));
+         int64_t previous = 0;
+         for (uint64_t i=0; i<n; ++i) {
+            const int64_t q = std::llround(static_cast<double>(data[i])/step);
+            const int64_t delta = q - previous;
+            previous = q;
+            putVarint((static_cast<uint64_t>(delta) << 1) ^ static_cast<uint64_t>(delta >> 63),out);
+         }
+      }
+
+      if (mode == RAW || out.size() - start >= HEADER_SIZE + rawSize) {
+         out.resize(start);
+         out.push_back(static_cast<char>(RAW));
+         out.push_back(static_cast<char>(sizeof(T)));
+         const char* raw = reinterpret_cast<const char*>(data);
+         out.insert(out.end(),raw,raw + rawSize);
+      }
+      return out.size() - start;
+   }
+
+   /** @return Byte size of one value in the given chunk, 0 if the chunk is too short.*/
+   inline size_t valueSize(const char* in,const uint64_t nBytes) {
+      if (nBytes < HEADER_SIZE) return 0;
+      return static_cast<uint8_t>(in[1]);
+   }
+
+   /** Decode one cell.
+    * @param in Start of the chunk.
+    * @param nBytes Size of the chunk.
+    * @param n Number of values in the chunk.
+    * @param data Output array of n values, T has to match valueSize() of the chunk.
+    * @return False if the chunk is malformed.*/
+   template<typename T>
+   bool decode(const char* in,const uint64_t nBytes,const uint64_t n,T* data) {
+      typedef typename std::conditional<sizeof(T) == sizeof(uint32_t),uint32_t,uint64_t>::type Bits;
+      if (valueSize(in,nBytes) != sizeof(T)) return false;
+      const Mode mode = static_cast<Mode>(static_cast<uint8_t>(in[0]));
+      const char* end = in + nBytes;
+      in += HEADER_SIZE;
+
+      if (mode == RAW) {
+         if (static_cast<uint64_t>(end - in) != n*sizeof(T)) return false;
+         std::memcpy(data,in,n*sizeof(T));
+         return true;
+      }
+      if (mode == LOSSLESS) {
+         const size_t rawSize = n*sizeof(T);
+         std::vector<uint8_t> planes(rawSize);
+         for (size_t i=0; i<rawSize; ) {
+            if (in >= end) return false;
+            const uint8_t byte = static_cast<uint8_t>(*in++);
+            if (byte != 0) {
+               planes[i++] = byte;
+               continue;
+            }
+            uint64_t run;
+            if (getVarint(in,end,run) == false || run > rawSize - i) return false;
+            std::memset(&planes[i],0,run);
+            i += run;
+         }
+         Bits previous = 0;
+         for (uint64_t i=0; i<n; ++i) {
+            Bits x = 0;
+            for (size_t b=0; b<sizeof(T); ++b) x |= static_cast<Bits>(planes[b*n + i]) << (8*b);
+            previous ^= x;
+            std::memcpy(&data[i],&previous,sizeof(T));
+         }
+         return in == end;
+      }
+      if (mode == QUANTIZED) {
+         if (static_cast<uint64_t>(end - in) < sizeof(double)) return false;
+         double step;
+         std::memcpy(&step,in,sizeof(double));
+         in += sizeof(double);
+         int64_t q = 0;
+         for (uint64_t i=0; i<n; ++i) {
+            uint64_t zigzag;
+            if (getVarint(in,end,zigzag) == false) return false;
+            q += static_cast<int64_t>(zigzag >> 1) ^ -static_cast<int64_t>(zigzag & 1);
+            data[i] = static_cast<T>(q*step);
+         }
+         return in == end;
+      }
+      return false;
+   }
+
+} // namespace blockcompression
+
+#endif
@@ -242,6 +242,7 @@ void recalculateLocalCellsCache() {
         dummy.swap(Parameters::localCells);
      }
    Parameters::localCells = mpiGrid.get_cells();
+   Parameters::localCellsGeneration++;
 }
 
 int main(int argn,char* args[]) {
@@ -406,6 +407,20 @@ int main(int argn,char* args[]) {
    phiprof::stop("Init fieldsolver grids");
    phiprof::start("Initial fsgrid coupling");
    const std::vector<CellID>& cells = getLocalCells();
+   FsGridCoupling fsGridCoupling;
+   fsGridCoupling.setup(technicalGrid, cells);
+
+   if (P::loadBalanceFsGridColocation) {
+      // Repartition the Vlasov grid along the FsGrid task boxes where it is cheap
+      const double localFractionBefore = fsGridCoupling.computeLocalFraction();
+      std::unordered_set<CellID> pinnedCells;
+      pinCellsToFsGrid(mpiGrid, cells, technicalGrid, pinnedCells);
+      balanceLoad(mpiGrid, sysBoundaries, pinnedCells);
+      fsGridCoupling.setup(technicalGrid, cells);
+      const double localFractionAfter = fsGridCoupling.computeLocalFraction();
+      logFile << "(LB): FsGrid colocation, rank-local fraction of coupled cells " << localFractionBefore;
+      logFile << " before and " << localFractionAfter << " after" << endl << writeVerbose;
+   }
 
    // Couple FSGrids to mpiGrid. Note that the coupling information is shared
    // between them.
@@ -420,15 +435,15 @@ int main(int argn,char* args[]) {
 
    // Transfer initial field configuration into the FsGrids
    feedFieldDataIntoFsGrid<fsgrids::N_BFIELD>(mpiGrid,cells,CellParams::PERBX,perBGrid);
-   feedBgFieldsIntoFsGrid(mpiGrid,cells,BgBGrid);
+   feedBgFieldsIntoFsGrid(mpiGrid,cells,BgBGrid,fsGridCoupling);
    BgBGrid.updateGhostCells();
    
    setupTechnicalFsGrid(mpiGrid, cells, technicalGrid);
    technicalGrid.updateGhostCells();
+   sysBoundaries.updateFsGridBoundaryTables(technicalGrid);
    
    // WARNING this means moments and dt2 moments are the same here.
-   feedMomentsIntoFsGrid(mpiGrid, cells, momentsGrid,false);
-   feedMomentsIntoFsGrid(mpiGrid, cells, momentsDt2Grid,false);
+   feedMomentsIntoFsGrid(mpiGrid, cells, momentsGrid, momentsDt2Grid, fsGridCoupling, false);
    
    phiprof::start("Init field propagator");
    if (
@@ -499,7 +514,7 @@ int main(int argn,char* args[]) {
    
    phiprof::start("getVolumeFieldsFromFsGrid");
    // These should be done by initializeFieldPropagator() if the propagation is turned off.
-   getVolumeFieldsFromFsGrid(volGrid, mpiGrid, cells);
+   getVolumeFieldsFromFsGrid(volGrid, mpiGrid, cells, fsGridCoupling);
    phiprof::stop("getVolumeFieldsFromFsGrid");
    
    // Save restart data
@@ -510,7 +525,7 @@ int main(int argn,char* args[]) {
       getFieldDataFromFsGrid<fsgrids::N_EFIELD>(EGrid,mpiGrid,cells,CellParams::EX);
       getFieldDataFromFsGrid<fsgrids::N_EHALL>(EHallGrid,mpiGrid,cells,CellParams::EXHALL_000_100);
       getFieldDataFromFsGrid<fsgrids::N_EGRADPE>(EGradPeGrid,mpiGrid,cells,CellParams::EXGRADPE);
-      getDerivativesFromFsGrid(dPerBGrid, dMomentsGrid, BgBGrid, mpiGrid, cells);
+      getDerivativesFromFsGrid(dPerBGrid, dMomentsGrid, BgBGrid, mpiGrid, cells, fsGridCoupling);
       phiprof::stop("fsgrid-coupling-out");
       
       if (myRank == MASTER_RANK)
@@ -651,6 +666,14 @@ int main(int argn,char* args[]) {
          beforeStep=P::tstep;
          //report_grid_memory_consumption(mpiGrid);
          report_process_memory_consumption();
+
+         uint64_t datatypeCacheCounts[2], globalDatatypeCacheCounts[2];
+         spatial_cell::MpiDatatypeCache::getStatistics(datatypeCacheCounts[0],datatypeCacheCounts[1]);
+         MPI_Reduce(datatypeCacheCounts,globalDatatypeCacheCounts,2,MPI_UINT64_T,MPI_SUM,MASTER_RANK,MPI_COMM_WORLD);
+         const uint64_t datatypeLookups = globalDatatypeCacheCounts[0] + globalDatatypeCacheCounts[1];
+         logFile << "(MPI) Datatype cache hits " << globalDatatypeCacheCounts[0] << " of " << datatypeLookups << " lookups";
+         if (datatypeLookups > 0) logFile << " (" << 100.0*globalDatatypeCacheCounts[0]/datatypeLookups << " %)";
+         logFile << endl;
       }
       logFile << writeVerbose;
       phiprof::stop("logfile-io");
@@ -714,7 +737,7 @@ int main(int argn,char* args[]) {
                   }
                   if (*it == "derivs") {
                      phiprof::start("fsgrid-coupling-out");
-                     getDerivativesFromFsGrid(dPerBGrid, dMomentsGrid, BgBGrid, mpiGrid, cells);
+                     getDerivativesFromFsGrid(dPerBGrid, dMomentsGrid, BgBGrid, mpiGrid, cells, fsGridCoupling);
                      phiprof::stop("fsgrid-coupling-out");
                   }
                }
@@ -805,7 +828,12 @@ int main(int argn,char* args[]) {
       //TODO - add LB measure and do LB if it exceeds threshold
       if((P::tstep % P::rebalanceInterval == 0 && P::tstep > P::tstep_min) || overrideRebalanceNow == true) {
          logFile << "(LB): Start load balance, tstep = " << P::tstep << " t = " << P::t << endl << writeVerbose;
-         balanceLoad(mpiGrid, sysBoundaries);
+         const double localFractionBefore = fsGridCoupling.computeLocalFraction();
+         std::unordered_set<CellID> pinnedCells;
+         if (P::loadBalanceFsGridColocation) {
+            pinCellsToFsGrid(mpiGrid, getLocalCells(), technicalGrid, pinnedCells);
+         }
+         balanceLoad(mpiGrid, sysBoundaries, pinnedCells);
          addTimedBarrier("barrier-end-load-balance");
          phiprof::start("Shrink_to_fit");
          // * shrink to fit after LB * //
@@ -824,7 +852,11 @@ int main(int argn,char* args[]) {
             technicalGrid.setGridCoupling(i-1, myRank);
          }
          technicalGrid.finishGridCoupling();
+         fsGridCoupling.setup(technicalGrid, cells);
+         const double localFractionAfter = fsGridCoupling.computeLocalFraction();
          phiprof::stop("fsgrid-recouple-after-lb");
+         logFile << "(LB): Rank-local fraction of coupled cells " << localFractionBefore;
+         logFile << " before and " << localFractionAfter << " after load balance" << endl << writeVerbose;
 
          overrideRebalanceNow = false;
       }
@@ -930,8 +962,7 @@ int main(int argn,char* args[]) {
          phiprof::start("fsgrid-coupling-in");
          // Copy moments over into the fsgrid.
          //setupTechnicalFsGrid(mpiGrid, cells, technicalGrid);
-         feedMomentsIntoFsGrid(mpiGrid, cells, momentsGrid,false);
-         feedMomentsIntoFsGrid(mpiGrid, cells, momentsDt2Grid,true);
+         feedMomentsIntoFsGrid(mpiGrid, cells, momentsGrid, momentsDt2Grid, fsGridCoupling, true);
          phiprof::stop("fsgrid-coupling-in");
 
          propagateFields(
@@ -955,7 +986,7 @@ int main(int argn,char* args[]) {
 
          phiprof::start("fsgrid-coupling-out");
          // Copy results back from fsgrid.
-         getVolumeFieldsFromFsGrid(volGrid, mpiGrid, cells);
+         getVolumeFieldsFromFsGrid(volGrid, mpiGrid, cells, fsGridCoupling);
          phiprof::stop("fsgrid-coupling-out");
          phiprof::stop("Propagate Fields",cells.size(),"SpatialCells");
          addTimedBarrier("barrier-after-field-solver");
@@ -1051,6 +1082,7 @@ int main(int argn,char* args[]) {
    logFile.close();
    if (P::diagnosticInterval != 0) diagnostic.close();
    
+   fsGridCoupling.finalize();
    perBGrid.finalize();
    perBDt2Grid.finalize();
    EGrid.finalize();
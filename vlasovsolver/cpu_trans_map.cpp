@@ -645,41 +645,92 @@ bool trans_map_1d(const dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpi
 }
 
 /*!
+  Pack the velocity blocks of data that contain any non-zero value into packed, and record
+  them as runs of consecutive block indices into the neighbor transfer fields of cell.
 
-  This function communicates the mapping on process boundaries, and then updates the data to their correct values.
-  TODO, this could be inside an openmp region, in which case some m ore barriers and masters should be added
+  \par data Block data to be packed
+  \par nBlocks Number of blocks in data
+  \par packed Buffer with room for nBlocks blocks
+  \par cell Cell whose neighbor_block_data, neighbor_number_of_blocks, neighbor_block_runs and neighbor_number_of_runs are set
+*/
+void pack_nonzero_block_runs(const Realf* data,const vmesh::LocalID nBlocks,Realf* packed,SpatialCell* cell) {
+   std::vector<vmesh::LocalID>& runs = cell->neighbor_block_runs;
+   runs.clear();
+   vmesh::LocalID nPacked = 0;
+   for (vmesh::LocalID block=0; block<nBlocks; ++block) {
+      bool nonzero = false;
+      for (uint i=0; i<WID3; ++i) {
+         nonzero = nonzero || (data[block*WID3+i] != 0.0);
+      }
+      if (!nonzero) continue;
+      memcpy(packed + nPacked*WID3, data + block*WID3, WID3 * sizeof(Realf));
+      if (runs.size() > 0 && runs[runs.size()-2] + runs[runs.size()-1] == block) {
+         runs[runs.size()-1]++;
+      } else {
+         runs.push_back(block);
+         runs.push_back(1);
+      }
+      nPacked++;
+   }
+   cell->neighbor_block_data = packed;
+   cell->neighbor_number_of_blocks = nPacked;
+   cell->neighbor_number_of_runs = runs.size()/2;
+}
 
-  \par dimension: 0,1,2 for x,y,z
-  \par direction: 1 for + dir, -1 for - dir
+/*! Send and receive lists of update_remote_mapping_contribution for one dimension and direction.
+  They only depend on the partitioning and on the sysboundary classification, so they are
+  computed once per repartitioning (see Parameters::localCellsGeneration).
 */
-void update_remote_mapping_contribution(
-   dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
-   const uint dimension,
-   int direction,
-   const uint popID) {
-   
-   const vector<CellID> local_cells = mpiGrid.get_cells();
+struct RemoteMappingLists {
+   bool initialized;
+   uint generation;
+   std::vector<SpatialCell*> sendCells;      /*!< Remote target cells p_ngbr whose data is sent.*/
+   std::vector<SpatialCell*> sendCarriers;   /*!< Local cells ccell carrying the data of sendCells in their neighbor fields.*/
+   std::vector<SpatialCell*> receiveCells;   /*!< Local cells to which received contributions are added.*/
+   std::vector<SpatialCell*> receiveCarriers;/*!< Remote cells m_ngbr carrying the contributions to receiveCells.*/
+   std::vector<size_t> sendOffsets;          /*!< Offsets of the send cells in sendBuffer (sparse mode), in Realfs.*/
+   std::vector<Realf*> receiveTargets;       /*!< Target block of each received block, in receive buffer order.*/
+   Realf* sendBuffer;
+   size_t sendBufferSize;
+   Realf* receiveBuffer;
+   size_t receiveBufferSize;
+   RemoteMappingLists(): initialized(false), generation(0), sendBuffer(NULL), sendBufferSize(0), receiveBuffer(NULL), receiveBufferSize(0) { }
+};
+
+/*! Grow an aligned buffer to hold at least size Realfs. Contents are not preserved.*/
+void reserve_aligned_buffer(Realf*& buffer,size_t& capacity,const size_t size) {
+   if (size <= capacity) return;
+   if (buffer != NULL) aligned_free(buffer);
+   capacity = std::max(size, capacity + capacity/4);
+   buffer = (Realf*) aligned_malloc(capacity * sizeof(Realf), 64);
+}
+
+/*! Recompute the send and receive lists of update_remote_mapping_contribution after repartitioning.*/
+void build_remote_mapping_lists(dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+                                const uint dimension,
+                                const int direction,
+                                RemoteMappingLists& lists) {
+   const vector<CellID>& local_cells = getLocalCells();
    const vector<CellID> remote_cells = mpiGrid.get_remote_cells_on_process_boundary(VLASOV_SOLVER_NEIGHBORHOOD_ID);
-   vector<CellID> receive_cells;
-   vector<CellID> send_cells;
-   vector<Realf*> receiveBuffers;
+   lists.sendCells.clear();
+   lists.sendCarriers.clear();
+   lists.receiveCells.clear();
+   lists.receiveCarriers.clear();
    
-   //normalize
-   if(direction > 0) direction = 1;
-   if(direction < 0) direction = -1;
+   // Default values, to avoid any extra sends and receives. The neighbor fields are reset
+   // to these after every update, new remote cells only appear when repartitioning.
    for (size_t c=0; c<remote_cells.size(); ++c) {
       SpatialCell *ccell = mpiGrid[remote_cells[c]];
-      //default values, to avoid any extra sends and receives
-      ccell->neighbor_block_data = ccell->get_data(popID);
+      ccell->neighbor_block_data = ccell->null_block_data.data();
       ccell->neighbor_number_of_blocks = 0;
+      ccell->neighbor_number_of_runs = 0;
    }
 
-   //TODO: prepare arrays, make parallel by avoidin push_back and by checking also for other stuff
    for (size_t c=0; c<local_cells.size(); ++c) {
       SpatialCell *ccell = mpiGrid[local_cells[c]];
-      //default values, to avoid any extra sends and receives
-      ccell->neighbor_block_data = ccell->get_data(popID);
+      ccell->neighbor_block_data = ccell->null_block_data.data();
       ccell->neighbor_number_of_blocks = 0;
+      ccell->neighbor_number_of_runs = 0;
       CellID p_ngbr,m_ngbr;
       switch (dimension) {
       case 0:
@@ -708,78 +759,193 @@ void update_remote_mapping_contribution(
       if (m_ngbr != INVALID_CELLID) mcell = mpiGrid[m_ngbr];
       if (p_ngbr != INVALID_CELLID && pcell->sysBoundaryFlag == sysboundarytype::NOT_SYSBOUNDARY) 
          if (!mpiGrid.is_local(p_ngbr) && do_translate_cell(ccell)) {
-            //if (p_ngbr != INVALID_CELLID && !mpiGrid.is_local(p_ngbr) && do_translate_cell(ccell)) {
             //Send data in p_ngbr target array that we just
             //mapped to if 1) it is a valid target,
             //2) is remote cell, 3) if the source cell in center was
             //translated
-            ccell->neighbor_block_data = pcell->get_data(popID);
-            ccell->neighbor_number_of_blocks = pcell->get_number_of_velocity_blocks(popID);
-            send_cells.push_back(p_ngbr);
+            lists.sendCells.push_back(pcell);
+            lists.sendCarriers.push_back(ccell);
          }
       if (m_ngbr != INVALID_CELLID &&
           !mpiGrid.is_local(m_ngbr) &&
           ccell->sysBoundaryFlag == sysboundarytype::NOT_SYSBOUNDARY) {
          //Receive data that mcell mapped to ccell to this local cell
          //data array, if 1) m is a valid source cell, 2) center cell is to be updated (normal cell) 3) m is remote
-         //we will here allocate a receive buffer, since we need to aggregate values
-         mcell->neighbor_number_of_blocks = ccell->get_number_of_velocity_blocks(popID);
-         mcell->neighbor_block_data = (Realf*) aligned_malloc(mcell->neighbor_number_of_blocks * WID3 * sizeof(Realf), 64);
-         
-         receive_cells.push_back(local_cells[c]);
-         receiveBuffers.push_back(mcell->neighbor_block_data);
+         lists.receiveCells.push_back(ccell);
+         lists.receiveCarriers.push_back(mcell);
+      }
+   }
+   lists.sendOffsets.resize(lists.sendCells.size());
+   lists.generation = P::localCellsGeneration;
+   lists.initialized = true;
+}
+
+/*!
+
+  This function communicates the mapping on process boundaries, and then updates the data to their correct values.
+  TODO, this could be inside an openmp region, in which case some m ore barriers and masters should be added
+
+  The send and receive lists are built once per repartitioning, and the receive buffer is a
+  single persistent buffer holding the contributions to all receiving cells one after the
+  other, so that they can be accumulated in one flat parallel loop over received blocks.
+
+  With P::sparseRemoteMapping only the blocks with non-zero contributions are sent, as runs of
+  consecutive blocks. Their sizes are exchanged first so that the receiving side can place
+  them in its buffer. The bytes of distribution function data sent are recorded as work units
+  of the "update_remote_mapping_contribution-MPI" timer.
+
+  \par dimension: 0,1,2 for x,y,z
+  \par direction: 1 for + dir, -1 for - dir
+*/
+void update_remote_mapping_contribution(
+   dccrg::Dccrg<SpatialCell,dccrg::Cartesian_Geometry>& mpiGrid,
+   const uint dimension,
+   int direction,
+   const uint popID) {
+   
+   static RemoteMappingLists allLists[3][2];
+   
+   //normalize
+   if(direction > 0) direction = 1;
+   if(direction < 0) direction = -1;
+   
+   RemoteMappingLists& lists = allLists[dimension][(direction > 0) ? 1 : 0];
+   if (!lists.initialized || lists.generation != P::localCellsGeneration) {
+      build_remote_mapping_lists(mpiGrid, dimension, direction, lists);
+   }
+   const bool sparse = P::sparseRemoteMapping;
+   double bytesSent = 0.0;
+   
+   // Point the carrier cells at the data to send
+   if (sparse) {
+      size_t sendSize = 0;
+      for (size_t c=0; c<lists.sendCells.size(); ++c) {
+         lists.sendOffsets[c] = sendSize;
+         sendSize += lists.sendCells[c]->get_number_of_velocity_blocks(popID) * WID3;
+      }
+      reserve_aligned_buffer(lists.sendBuffer, lists.sendBufferSize, sendSize);
+#pragma omp parallel for schedule(dynamic)
+      for (size_t c=0; c<lists.sendCells.size(); ++c) {
+         pack_nonzero_block_runs(lists.sendCells[c]->get_data(popID), lists.sendCells[c]->get_number_of_velocity_blocks(popID),
+                                 lists.sendBuffer + lists.sendOffsets[c], lists.sendCarriers[c]);
+      }
+      for (size_t c=0; c<lists.sendCarriers.size(); ++c) {
+         bytesSent += 2 * sizeof(vmesh::LocalID) * (1 + lists.sendCarriers[c]->neighbor_number_of_runs);
+      }
+   } else {
+      for (size_t c=0; c<lists.sendCells.size(); ++c) {
+         lists.sendCarriers[c]->neighbor_block_data = lists.sendCells[c]->get_data(popID);
+         lists.sendCarriers[c]->neighbor_number_of_blocks = lists.sendCells[c]->get_number_of_velocity_blocks(popID);
       }
    }
+   for (size_t c=0; c<lists.sendCarriers.size(); ++c) {
+      bytesSent += sizeof(Realf) * WID3 * lists.sendCarriers[c]->neighbor_number_of_blocks;
+   }
     
    // Do communication
-   SpatialCell::setCommunicatedSpecies(popID);
-   SpatialCell::set_mpi_transfer_type(Transfer::NEIGHBOR_VEL_BLOCK_DATA);
+   int neighborhood = 0;
    switch(dimension) {
    case 0:
-      if(direction > 0) mpiGrid.update_copies_of_remote_neighbors(SHIFT_P_X_NEIGHBORHOOD_ID);
-      if(direction < 0) mpiGrid.update_copies_of_remote_neighbors(SHIFT_M_X_NEIGHBORHOOD_ID);
+      neighborhood = (direction > 0) ? SHIFT_P_X_NEIGHBORHOOD_ID : SHIFT_M_X_NEIGHBORHOOD_ID;
       break;
    case 1:
-      if(direction > 0) mpiGrid.update_copies_of_remote_neighbors(SHIFT_P_Y_NEIGHBORHOOD_ID);
-      if(direction < 0) mpiGrid.update_copies_of_remote_neighbors(SHIFT_M_Y_NEIGHBORHOOD_ID);
+      neighborhood = (direction > 0) ? SHIFT_P_Y_NEIGHBORHOOD_ID : SHIFT_M_Y_NEIGHBORHOOD_ID;
       break;
    case 2:
-      if(direction > 0) mpiGrid.update_copies_of_remote_neighbors(SHIFT_P_Z_NEIGHBORHOOD_ID);
-      if(direction < 0) mpiGrid.update_copies_of_remote_neighbors(SHIFT_M_Z_NEIGHBORHOOD_ID);
+      neighborhood = (direction > 0) ? SHIFT_P_Z_NEIGHBORHOOD_ID : SHIFT_M_Z_NEIGHBORHOOD_ID;
       break;
    }
    
+   phiprof::start("update_remote_mapping_contribution-MPI");
+   SpatialCell::setCommunicatedSpecies(popID);
+   if (sparse) {
+      SpatialCell::set_mpi_transfer_type(Transfer::NEIGHBOR_VEL_BLOCK_RUNS_STAGE1);
+      mpiGrid.update_copies_of_remote_neighbors(neighborhood);
+   } else {
+      for (size_t c=0; c<lists.receiveCells.size(); ++c) {
+         lists.receiveCarriers[c]->neighbor_number_of_blocks = lists.receiveCells[c]->get_number_of_velocity_blocks(popID);
+      }
+   }
+   
+   // Place the incoming data of all receiving cells one after the other in the receive buffer,
+   // and record for each received block the block it is to be added to.
+   size_t receiveSize = 0;
+   for (size_t c=0; c<lists.receiveCarriers.size(); ++c) {
+      receiveSize += lists.receiveCarriers[c]->neighbor_number_of_blocks * WID3;
+   }
+   reserve_aligned_buffer(lists.receiveBuffer, lists.receiveBufferSize, receiveSize);
+   lists.receiveTargets.resize(receiveSize / WID3);
+   size_t receivedBlocks = 0;
+   for (size_t c=0; c<lists.receiveCarriers.size(); ++c) {
+      SpatialCell* mcell = lists.receiveCarriers[c];
+      Realf* blockData = lists.receiveCells[c]->get_data(popID);
+      mcell->neighbor_block_data = lists.receiveBuffer + receivedBlocks * WID3;
+      if (sparse) {
+         // Runs have not been received yet, the targets are filled in below
+         receivedBlocks += mcell->neighbor_number_of_blocks;
+      } else {
+         for (vmesh::LocalID block=0; block<mcell->neighbor_number_of_blocks; ++block) {
+            lists.receiveTargets[receivedBlocks++] = blockData + block * WID3;
+         }
+      }
+   }
+   
+   if (sparse) {
+      SpatialCell::set_mpi_transfer_type(Transfer::NEIGHBOR_VEL_BLOCK_RUNS_STAGE2 | Transfer::NEIGHBOR_VEL_BLOCK_DATA);
+      mpiGrid.update_copies_of_remote_neighbors(neighborhood);
+   } else if (P::stagedBlockDataExchange) {
+      updateRemoteNeighborBlockData(mpiGrid, neighborhood);
+   } else {
+      SpatialCell::set_mpi_transfer_type(Transfer::NEIGHBOR_VEL_BLOCK_DATA);
+      mpiGrid.update_copies_of_remote_neighbors(neighborhood);
+   }
+   phiprof::stop("update_remote_mapping_contribution-MPI",bytesSent,"bytes");
+   
+   if (sparse) {
+      receivedBlocks = 0;
+      for (size_t c=0; c<lists.receiveCarriers.size(); ++c) {
+         const std::vector<vmesh::LocalID>& runs = lists.receiveCarriers[c]->neighbor_block_runs;
+         Realf* blockData = lists.receiveCells[c]->get_data(popID);
+         for (size_t r=0; r<runs.size(); r+=2) {
+            for (vmesh::LocalID block=runs[r]; block<runs[r]+runs[r+1]; ++block) {
+               lists.receiveTargets[receivedBlocks++] = blockData + block * WID3;
+            }
+         }
+      }
+   }
+   
 #pragma omp parallel
    {
       //reduce data: sum received data in the data array to 
       // the target grid in the temporary block container
-      for (size_t c=0; c < receive_cells.size(); ++c) {
-         SpatialCell* spatial_cell = mpiGrid[receive_cells[c]];
-         Realf *blockData = spatial_cell->get_data(popID);
-          
-#pragma omp for 
-         for(unsigned int cell = 0; cell<VELOCITY_BLOCK_LENGTH * spatial_cell->get_number_of_velocity_blocks(popID); ++cell) {
-            blockData[cell] += receiveBuffers[c][cell];
+#pragma omp for nowait
+      for (size_t block=0; block<lists.receiveTargets.size(); ++block) {
+         Realf* target = lists.receiveTargets[block];
+         const Realf* source = lists.receiveBuffer + block * WID3;
+         for (uint cell=0; cell<WID3; ++cell) {
+            target[cell] += source[cell];
          }
       }
        
       // send cell data is set to zero. This is to avoid double copy if
       // one cell is the neighbor on bot + and - side to the same
       // process
-      for (size_t c=0; c<send_cells.size(); ++c) {
-         SpatialCell* spatial_cell = mpiGrid[send_cells[c]];
-         Realf * blockData = spatial_cell->get_data(popID);
-           
-#pragma omp for nowait
-         for(unsigned int cell = 0; cell< VELOCITY_BLOCK_LENGTH * spatial_cell->get_number_of_velocity_blocks(popID); ++cell) {
-            // copy received target data to temporary array where target data is stored.
-            blockData[cell] = 0;
-         }
+#pragma omp for schedule(dynamic)
+      for (size_t c=0; c<lists.sendCells.size(); ++c) {
+         SpatialCell* spatial_cell = lists.sendCells[c];
+         memset(spatial_cell->get_data(popID), 0, VELOCITY_BLOCK_LENGTH * spatial_cell->get_number_of_velocity_blocks(popID) * sizeof(Realf));
       }
    }
-    
-   //and finally free temporary receive buffer
-   for (size_t c=0; c < receiveBuffers.size(); ++c) {
-      aligned_free(receiveBuffers[c]);
+   
+   // Reset the neighbor fields to their default values for the next exchange
+   for (size_t c=0; c<lists.sendCarriers.size(); ++c) {
+      lists.sendCarriers[c]->neighbor_block_data = lists.sendCarriers[c]->null_block_data.data();
+      lists.sendCarriers[c]->neighbor_number_of_blocks = 0;
+      lists.sendCarriers[c]->neighbor_number_of_runs = 0;
+   }
+   for (size_t c=0; c<lists.receiveCarriers.size(); ++c) {
+      lists.receiveCarriers[c]->neighbor_block_data = lists.receiveCarriers[c]->null_block_data.data();
+      lists.receiveCarriers[c]->neighbor_number_of_blocks = 0;
+      lists.receiveCarriers[c]->neighbor_number_of_runs = 0;
    }
 }
@@ -80,8 +80,12 @@ void calculateSpatialTranslation(
    if(P::zcells_ini > 1 ){
       trans_timer=phiprof::initializeTimer("transfer-stencil-data-z","MPI");
       phiprof::start(trans_timer);
-      SpatialCell::set_mpi_transfer_type(Transfer::VEL_BLOCK_DATA);
-      mpiGrid.update_copies_of_remote_neighbors(VLASOV_SOLVER_Z_NEIGHBORHOOD_ID);
+      if (P::stagedBlockDataExchange) {
+         updateRemoteVelocityBlockData(mpiGrid, VLASOV_SOLVER_Z_NEIGHBORHOOD_ID, popID);
+      } else {
+         SpatialCell::set_mpi_transfer_type(Transfer::VEL_BLOCK_DATA);
+         mpiGrid.update_copies_of_remote_neighbors(VLASOV_SOLVER_Z_NEIGHBORHOOD_ID);
+      }
       phiprof::stop(trans_timer);
       
       phiprof::start("compute-mapping-z");
@@ -101,8 +105,12 @@ void calculateSpatialTranslation(
    if(P::xcells_ini > 1 ){
       trans_timer=phiprof::initializeTimer("transfer-stencil-data-x","MPI");
       phiprof::start(trans_timer);
-      SpatialCell::set_mpi_transfer_type(Transfer::VEL_BLOCK_DATA);
-      mpiGrid.update_copies_of_remote_neighbors(VLASOV_SOLVER_X_NEIGHBORHOOD_ID);
+      if (P::stagedBlockDataExchange) {
+         updateRemoteVelocityBlockData(mpiGrid, VLASOV_SOLVER_X_NEIGHBORHOOD_ID, popID);
+      } else {
+         SpatialCell::set_mpi_transfer_type(Transfer::VEL_BLOCK_DATA);
+         mpiGrid.update_copies_of_remote_neighbors(VLASOV_SOLVER_X_NEIGHBORHOOD_ID);
+      }
       phiprof::stop(trans_timer);
 
       phiprof::start("compute-mapping-x");
@@ -120,8 +128,12 @@ void calculateSpatialTranslation(
    if(P::ycells_ini > 1 ){
       trans_timer=phiprof::initializeTimer("transfer-stencil-data-y","MPI");
       phiprof::start(trans_timer);
-      SpatialCell::set_mpi_transfer_type(Transfer::VEL_BLOCK_DATA);
-      mpiGrid.update_copies_of_remote_neighbors(VLASOV_SOLVER_Y_NEIGHBORHOOD_ID);
+      if (P::stagedBlockDataExchange) {
+         updateRemoteVelocityBlockData(mpiGrid, VLASOV_SOLVER_Y_NEIGHBORHOOD_ID, popID);
+      } else {
+         SpatialCell::set_mpi_transfer_type(Transfer::VEL_BLOCK_DATA);
+         mpiGrid.update_copies_of_remote_neighbors(VLASOV_SOLVER_Y_NEIGHBORHOOD_ID);
+      }
       phiprof::stop(trans_timer);
 
       phiprof::start("compute-mapping-y");      